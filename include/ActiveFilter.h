@@ -0,0 +1,193 @@
+///
+/// @file
+/// @brief アクティブな辞書・固有名クラスの判定器 ActiveFilter と、その指定を保持する ActiveSettings の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _ACTIVE_FILTER_H
+#define _ACTIVE_FILTER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/regex.hpp>
+#include <boost/thread/mutex.hpp>
+#include "Dictionary.h"
+#include "WordlistAttributes.h"
+#include "GeowordStore.h"
+
+namespace geonlp
+{
+  class Geoword;
+  class MA;
+
+  /// @brief アクティブな辞書 ID と固有名クラス正規表現から構築する判定器。
+  ///
+  /// ActiveSettings で辞書・クラスの指定が変わるたびに
+  /// 一度だけ構築し、以降は変更しない。辞書はビットセットで判定する。
+  /// 固有名クラスは、辞書に含まれる全てのクラス（updateWordlists 時点）の判定結果を
+  /// 構築時に表にしておき、判定時は表だけを引く。表に無いクラスは非アクティブとする。
+  /// 所属情報が無い（古い形式の wordlist）場合に限り、コンパイル済み正規表現で判定する。
+  /// 構築後は状態を変更しないので、複数のスレッドからロック無しで利用できる。
+  class ActiveFilter {
+  private:
+    /// 利用する辞書 ID のビットセット（添字が辞書 ID）
+    std::vector<bool> _dictionary_bits;
+
+    /// 辞書による絞り込みを行うかどうか（アクティブ辞書が空の場合は全辞書を利用）
+    bool _check_dictionary;
+
+    /// 利用するクラスの正規表現
+    std::vector<boost::regex> _includes;
+
+    /// 除外するクラスの正規表現（'-' から始まる指定）
+    std::vector<boost::regex> _excludes;
+
+    /// クラスによる絞り込みを行うかどうか（アクティブクラスが空の場合は全クラスを利用）
+    bool _check_class;
+
+    /// 固有名クラスから判定結果への表（構築時に作成し、以降は変更しない）
+    boost::unordered_map<std::string, bool> _class_table;
+
+    /// 表が辞書の全ての固有名クラスを含むかどうか（false の場合は正規表現で判定する）
+    bool _class_table_complete;
+
+    /// 見出し語ごとの辞書・クラス所属情報（読み込めなかった場合は NULL）
+    WordlistAttributesPtr _wordlist_attributes;
+
+    /// シグネチャごとにアクティブな地名語を含みうるかどうかのビットマップ
+    std::vector<bool> _signature_bits;
+
+    // 固有名クラスを正規表現で判定する（表を使わない）
+    bool matchClass(const std::string& ne_class) const;
+
+    // 辞書に含まれる固有名クラスの判定結果の表を作成する
+    void buildClassTable(void);
+
+    // シグネチャごとのビットマップを作成する
+    void buildSignatureBits(void);
+
+  public:
+    // コンストラクタ
+    ActiveFilter(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes, WordlistAttributesPtr wordlist_attributes = WordlistAttributesPtr());
+
+    /// @brief 辞書 ID がアクティブかどうか判定する
+    inline bool acceptDictionary(int dictionary_id) const {
+      if (!this->_check_dictionary) return true;
+      if (dictionary_id < 0 || (size_t)dictionary_id >= this->_dictionary_bits.size()) return false;
+      return this->_dictionary_bits[dictionary_id];
+    }
+
+    // 固有名クラスがアクティブかどうか判定する
+    bool acceptClass(const std::string& ne_class) const;
+
+    /// @brief 辞書 ID と固有名クラスの両方がアクティブかどうか判定する
+    inline bool accept(int dictionary_id, const std::string& ne_class) const {
+      return this->acceptDictionary(dictionary_id) && this->acceptClass(ne_class);
+    }
+
+    // 地名語がアクティブな辞書・クラスに含まれるかどうか判定する
+    bool accept(const Geoword& geo) const;
+
+    /// @brief バイナリ格納ファイルの地名語がアクティブな辞書・クラスに含まれるかどうか判定する
+    inline bool accept(const GeowordView& geo) const {
+      return this->accept(geo.get_dictionary_id(), geo.get_ne_class());
+    }
+
+    /// @brief 見出し語がアクティブな地名語を含みうるかどうか判定する
+    ///
+    /// false の場合、その見出し語の地名語はすべて非アクティブなので
+    /// wordlist や geoword を検索する必要はない。
+    /// true の場合でも、地名語ごとの判定 accept(const Geoword&) は必要。
+    inline bool acceptWordlist(unsigned int wordlist_id) const {
+      if (!this->_check_dictionary && !this->_check_class) return true;
+      if (!this->_wordlist_attributes) return true;
+      unsigned int signature_id = this->_wordlist_attributes->getSignatureId(wordlist_id);
+      if (signature_id >= this->_signature_bits.size()) return true; // 属性不明
+      return this->_signature_bits[signature_id];
+    }
+  };
+
+  typedef boost::shared_ptr<const ActiveFilter> ActiveFilterPtr;
+
+  /// @brief 利用する辞書と固有名クラスの指定を保持し、指定から判定器を構築するクラス。
+  ///
+  /// MAImpl と MASession は setActiveDictionaries, setActiveClasses 等の処理を
+  /// このクラスに委譲する。指定を変更するたびに ActiveFilter を再構築する。
+  class ActiveSettings {
+  private:
+    /// 利用する辞書
+    std::map<int, Dictionary> _dictionaries;
+
+    /// 利用するクラスの正規表現リスト
+    std::vector<std::string> _classes;
+
+    /// 見出し語ごとの辞書・クラス所属情報（NULL の場合は見出し語単位の判定を行わない）
+    WordlistAttributesPtr _wordlist_attributes;
+
+    /// 利用する辞書とクラスから構築した判定器
+    ActiveFilterPtr _filter;
+
+    /// _filter の差し替えと取得を保護する
+    mutable boost::mutex _filter_mutex;
+
+    // 判定器を再構築する
+    void update(void);
+
+  public:
+    // コンストラクタ
+    ActiveSettings(void);
+    ActiveSettings(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes, WordlistAttributesPtr wordlist_attributes = WordlistAttributesPtr());
+
+    // コピーコンストラクタ（判定器は共有する）
+    ActiveSettings(const ActiveSettings& other);
+
+    // 代入演算子（判定器は共有する）
+    ActiveSettings& operator=(const ActiveSettings& other);
+
+    // 利用する辞書を辞書IDのリストで指定する、空の場合は ma の全辞書を利用する
+    void setDictionaries(const std::vector<int>& dics, const MA& ma);
+
+    // 利用する辞書を追加する
+    void addDictionaries(const std::vector<int>& dics, const MA& ma);
+
+    // 利用する辞書から除外する
+    void removeDictionaries(const std::vector<int>& dics);
+
+    // 利用する固有名クラスの正規表現を追加する
+    void addClasses(const std::vector<std::string>& ne_classes);
+
+    // 利用する固有名クラスの正規表現を除外する
+    void removeClasses(const std::vector<std::string>& ne_classes);
+
+    // 利用する辞書と固有名クラスを与えられた値のまま設定する
+    void assign(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes);
+
+    /// @brief 利用する辞書を与えられた値のまま設定する
+    inline void assignDictionaries(const std::map<int, Dictionary>& dictionaries) { this->assign(dictionaries, this->_classes); }
+
+    /// @brief 利用する固有名クラスを与えられた値のまま設定する
+    inline void assignClasses(const std::vector<std::string>& ne_classes) { this->assign(this->_dictionaries, ne_classes); }
+
+    /// @brief 利用する辞書
+    inline const std::map<int, Dictionary>& dictionaries(void) const { return this->_dictionaries; }
+
+    /// @brief 利用する固有名クラスの正規表現リスト
+    inline const std::vector<std::string>& classes(void) const { return this->_classes; }
+
+    /// @brief 現在の指定から構築した判定器
+    ///
+    /// 指定を変更すると判定器は作り直されるので、呼び出し側は返された
+    /// スナップショットを処理の間保持して利用すること。
+    inline ActiveFilterPtr filter(void) const {
+      boost::mutex::scoped_lock lock(this->_filter_mutex);
+      return this->_filter;
+    }
+  };
+}
+
+#endif /* _ACTIVE_FILTER_H */
@@ -12,11 +12,17 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 #include "picojson.h"
 #include "picojsonExt.h"
 #include "Geoword.h"
 #include "Address.h"
 #include "SelectCondition.h"
+#include "WeightGrid.h"
+#include "IdTable.h"
+#include "LatLonArray.h"
 
 namespace geonlp
 {
@@ -29,59 +35,195 @@ namespace geonlp
   };
 
   /// クラス、辞書などが共通する地名語の関係を管理するクラス
+  ///
+  /// キーと地名語は Context の StringIdTable で割り当てた整数 ID で表す。
+  /// 出現箇所は「文の先頭から n 番目の単語」の n を地名語ごとに昇順に保持し、
+  /// 地名語ごとの最初の出現箇所をまとめた配列を二分探索することで、
+  /// count() を登録数によらずほぼ O(log n) で求める。
+  /// expire() は登録順の記録から対象のキーチェーンだけを辿り、
+  /// 空になった要素は一定の割合を超えた時にまとめて詰める。
   class ContextRelation {
   private:
+    // 一つの地名語の出現箇所（重複を除いた昇順）
+    struct Occurrence {
+      boost::uint32_t geonlp_id;
+      std::vector<int> positions;
+    };
+
+    // 最初の出現箇所が同じ地名語の集まり
+    struct FirstGroup {
+      int position;                          // 最初の出現箇所
+      std::vector<boost::uint32_t> members;  // Occurrence の番号
+      // 以下は count() が必要になった時に作るキャッシュ
+      // メンバーの二番目の出現箇所ごとの地名語数を、
+      // いずれかの地名語の最初の出現箇所と一致するかどうかで分けて保持する
+      mutable unsigned int version;          // 作成時の KeyChain::version
+      mutable std::vector<std::pair<int, int> > seconds;        // 一致しないもの
+      mutable std::vector<std::pair<int, int> > seconds_first;  // 一致するもの
+    };
+
     // キー key が共通の地名語を束ねるキーチェーン
-    // 値には地名語の geonlp_id ごとにまとめた出現箇所のリストとして格納する
-    // 出現箇所は「文の先頭から n 番目の単語」の「m 番目の候補」を
-    // std::pair<n, m> という形式で保持する
-    std::map<std::string, std::map<std::string, std::vector<std::pair<int, int> > > > _chain;
+    struct KeyChain {
+      boost::uint32_t key;
+      IdHashMap index;                       // geonlp_id から Occurrence の番号を引く
+      std::vector<Occurrence> occurrences;
+      std::vector<FirstGroup> groups;        // position の昇順
+      unsigned int version;                  // 変更のたびに増やす
+      size_t removed;                        // エクスパイアで出現箇所が無くなった Occurrence の数
+      bool emptied;                          // エクスパイアで空になった
+      KeyChain(boost::uint32_t k): key(k), version(0), removed(0), emptied(false) {}
+    };
 
-  public:
-    // コンストラクタ
-    ContextRelation() {}
-    
-    // 地名語情報を登録する（キーが文字列の場合）
-    void add(const std::string& key, const std::string& geonlp_id, int n, int m);
+    IdHashMap _index;               // キーから KeyChain の番号を引く
+    std::deque<KeyChain> _chains;   // 追加で既存のキーチェーンを移動しないように deque を使う
+    mutable std::vector<int> _work; // count() の作業領域
+    std::deque<std::pair<int, boost::uint32_t> > _added; // (出現箇所, KeyChain の番号) の出現箇所の昇順
+    size_t _emptied;                // 空になったキーチェーンの数
 
-    // 地名語情報を登録する（キーが数値の場合）
-    void add(int key, const std::string& geonlp_id, int n, int m);
+    // 最初の出現箇所が position 以上である最初の FirstGroup の番号
+    static size_t lowerGroup(const KeyChain& chain, int position);
 
-    // 地名語情報を取得する（キーが文字列の場合）
-    std::map<std::string, std::vector<std::pair<int, int> > >& get(const std::string& key)
-      throw (ContextException);
+    // position が最初の出現箇所である FirstGroup の番号、無ければ -1
+    static int findGroup(const KeyChain& chain, int position);
 
-    // 地名語情報を取得する（キーが数値の場合）
-    std::map<std::string, std::vector<std::pair<int, int> > >& get(int key)
-      throw (ContextException);
+    // Occurrence を FirstGroup に加える、または取り除く
+    static void addMember(KeyChain& chain, int position, boost::uint32_t o);
+    static void removeMember(KeyChain& chain, int position, boost::uint32_t o);
 
-    // @brief 地名語数を取得する（キーが文字列の場合）
-    // @arg key キー
-    // @arg self_id   この geonlp_id を持つ地名語はカウントしない（自分自身を除く）
-    // @arg self_pos  n == self_pos となる地名語はカウントしない（自分自身を除く）
-    // @arg lb  カウントする n の下限（lb 以上の n を持つエントリのみカウントする）
-    // @arg hb  カウントする n の上限（hb 以下の n を持つエントリのみカウントする）
-    int count(const std::string& key, const std::string& self_id, int self_pos, int lb = -1, int hb = -1) const;
+    // FirstGroup の二番目の出現箇所のキャッシュを作る
+    static void updateSeconds(const KeyChain& chain, const FirstGroup& group);
+
+    // 出現箇所の範囲を限定して数える（lb を指定した場合）
+    int countInRange(const KeyChain& chain, boost::uint32_t self_id, int self_pos, int lb, int hb) const;
+
+    // キーチェーンの FirstGroup を作り直す
+    static void rebuildGroups(KeyChain& chain);
+
+    // キーチェーンから n 以下の出現箇所を取り除く
+    static void expireChain(KeyChain& chain, int n);
 
-    // @brief 地名語数を取得する（キーが数値の場合）
-    // @arg key キー
+    // キーチェーンから出現箇所が無くなった Occurrence を取り除く
+    static void compactChain(KeyChain& chain);
+
+    // 空になったキーチェーンを取り除く
+    void compact(void);
+
+  public:
+    // コンストラクタ
+    ContextRelation(): _emptied(0) {}
+    
+    // @brief 地名語情報を登録する
+    // @arg key        キーの ID
+    // @arg geonlp_id  地名語の geonlp_id の ID
+    // @arg n          出現箇所
+    void add(boost::uint32_t key, boost::uint32_t geonlp_id, int n);
+
+    // @brief 地名語数を取得する
+    // lb ≦ n ≦ hb かつ n != self_pos の出現箇所を持つ self_id 以外の地名語について
+    // それぞれ最初の出現箇所を求め、その異なり数を返す
+    // @arg key キーの ID（StringIdTable::npos の場合は 0 を返す）
     // @arg self_id   この geonlp_id を持つ地名語はカウントしない（自分自身を除く）
     // @arg self_pos  n == self_pos となる地名語はカウントしない（自分自身を除く）
     // @arg lb  カウントする n の下限（lb 以上の n を持つエントリのみカウントする）
     // @arg hb  カウントする n の上限（hb 以下の n を持つエントリのみカウントする）
-    int count(int key, const std::string& self_id, int self_pos, int lb = -1, int hb = -1) const;
+    int count(boost::uint32_t key, boost::uint32_t self_id, int self_pos, int lb = -1, int hb = -1) const;
 
     // キーチェーンを空にする
     void clear(void);
 
-    // 指定した n 以下の地名語をエクスパイアする
+    // 指定した n 以下の出現箇所をエクスパイアする
+    // 処理量は取り除く出現箇所を含むキーチェーンの大きさに比例する
     void expire(int n);
+
+    // @brief 出現箇所が無くなった要素を取り除き、使用中の ID に印を付ける
+    // @arg used  ID ごとの印、大きさは StringIdTable::size() 以上とする
+    // @arg keys  キーも StringIdTable の ID の場合は true
+    void markIds(std::vector<bool>& used, bool keys);
+
+    // @brief ID を付け替える
+    // @arg ids   古い ID から新しい ID を引く表、markIds() で印を付けた ID はすべて含む
+    // @arg keys  キーも付け替える場合は true
+    void renumber(const std::vector<boost::uint32_t>& ids, bool keys);
   };
 
   
+  /// 分布情報保持サーバ (dist-server) に地名語候補の重みを問い合わせるクラス
+  ///
+  /// 文または文書に含まれる地名語候補集合をまとめて一つの JSON-RPC バッチリクエストとし、
+  /// send() でバックグラウンドのスレッドから送信する。
+  /// 結果は get() で最初に必要になった時点で待ち合わせる。
+  class DistServerRequest {
+  private:
+    picojson::ext _server;                     // dist-server オプション
+    std::vector<picojson::value> _coords;      // 候補集合ごとの座標列
+    std::vector<std::vector<double> > _weights; // 候補集合ごとの重み
+    std::string _error;                        // 通信エラーのメッセージ
+    boost::shared_ptr<boost::thread> _thread;  // 送受信スレッド
+
+    // 送受信スレッドの本体
+    void run(void);
+
+    // @brief 一つの候補集合に対する JSON-RPC リクエストを作成する
+    // @arg i  候補集合の番号、id には i + 1 を用いる
+    picojson::value request(size_t i) const;
+
+  public:
+    // コンストラクタ
+    // @arg server  Service が検証済みの dist-server オプション
+    DistServerRequest(const picojson::value& server): _server(server) {}
+
+    // デストラクタ、送受信中であれば終了を待つ
+    ~DistServerRequest();
+
+    // @brief 一文の解析結果に含まれる地名語候補集合を追加する
+    // @arg nodes  Service::analyze_sentence の結果
+    // @return 追加した最初の候補集合の番号
+    size_t add(const picojson::array& nodes) throw (ContextException);
+
+    // 追加済みの候補集合の数
+    inline size_t size(void) const { return this->_coords.size(); }
+
+    // 問い合わせを送信する（結果を待たずに戻る）
+    void send(void);
+
+    // @brief 候補集合の重みを取得する、受信が終わっていなければ待つ
+    // @arg i  add() が返した番号を基点とする候補集合の番号
+    const std::vector<double>& get(size_t i) throw (ContextException);
+  };
+
+  typedef boost::shared_ptr<DistServerRequest> DistServerRequestPtr;
+
+  /// 地名語候補のスコア計算に使う値を取り出したもの
+  ///
+  /// Context::addNodes で地名語候補の JSON から一度だけ作成し、
+  /// evaluate では Geoword を複製せずにこれを参照する。
+  /// 文字列は Context の StringIdTable で割り当てた ID で保持する。
+  struct ContextCandidate {
+    boost::uint32_t geonlp_id;
+    boost::uint32_t ne_class;
+    boost::uint32_t dictionary_id;
+    boost::uint32_t name;                    ///< typical_name
+    boost::uint32_t full_hypernym;           ///< hypernym 全体、二つ未満の場合は StringIdTable::npos
+    std::vector<boost::uint32_t> hypernyms;
+    bool has_coordinates;                    ///< 緯度・経度とも空欄でない
+    float latitude;
+    float longitude;
+    int priority_score;
+  };
+
   /// 地名語解決用コンテキストクラス
   class Context {
   private:
+    // コンテキスト関係のキーと geonlp_id に割り当てた ID
+    // ウィンドウを使う場合、使われなくなった文字列は retire() で取り除く
+    StringIdTable _ids;
+    size_t _ids_compacted;       // 最後に取り除いた後の文字列の数
+
+    // geonlp_id の ID から _candidate_memo の番号を引く表
+    // 同じ文書には同じ地名語が何度も現れるので、Geoword の JSON からの変換は一度だけ行う
+    IdHashMap _candidate_index;
+    std::vector<ContextCandidate> _candidate_memo;
+
     // 地名語候補との関連
     ContextRelation _context_neclass;       // ne_class が共通
     ContextRelation _context_dictionary;    // dictionary_id が共通
@@ -101,40 +243,159 @@ namespace geonlp
     float _cumulative_lon;
     int   _cumulative_points;
 
+    // ウィンドウを使う場合の重心への寄与の累積値
+    struct CentroidSum {
+      int position;  // この位置までの寄与を累積する
+      double lat;
+      double lon;
+      double points;
+    };
+    std::deque<CentroidSum> _centroid_sums;  // ウィンドウ内の位置の累積値、位置の昇順
+    CentroidSum _retired_sum;                // ウィンドウから外れた位置までの累積値
+
+    // 評価中のノードに対する重心
+    float _centroid_lat;
+    float _centroid_lon;
+    int   _centroid_points;
+
+    // スライディングウィンドウ（context-window オプション）
+    // 位置 n のノードは前後 _window ノード（または文）の範囲のコンテキストで評価し、
+    // 範囲の先頭より前の関係と重心への寄与は評価の進行に合わせて取り除く
+    int  _window;                // ウィンドウの大きさ、0 の場合は文書全体
+    bool _window_in_sentences;   // 大きさを文数で数える場合は true、ノード数の場合は false
+    int  _evaluated;             // この位置より前のノードは評価済み
+    int  _retired;               // この位置より前のノードはコンテキストから取り除いた
+    std::deque<int> _sentences;  // addNodes で追加した文の先頭の位置、ウィンドウより前の文は取り除く
+
     // 関心地点 (lat, lon のフラットな配列、二次元ではない）
     std::vector<double> _topic_coords;
     double _topic_radius;
+    // 関心地点の配列、数が多い場合は近くの地点だけを取り出す格子も作る
+    LatLonArray _topic_points;
+    LatLonGrid _topic_grid;
+    std::vector<double> _topic_dists;                          // 距離の計算結果
+    std::vector<std::pair<size_t, size_t> > _topic_ranges;     // 格子から取り出した範囲
 
     // 検索条件
     std::vector<SelectCondition*> _select_conditions;
 
-    picojson::array _nodes;          // parseNode の結果、全地名語候補を含む
+    // parseNode の結果、全地名語候補を含む
+    // flushNodes で出力したノードは先頭から取り除くので、
+    // _nodes[i] の文の先頭からの位置（コンテキスト関係の n）は _base + i となる
+    std::deque<picojson::value> _nodes;
+    int _base;
     picojson::ext _options;          // parse オプション
 
-    // @brief Geoword を一つコンテキスト関係に登録する
-    // @arg geoword 地名語
-    // @arg n       この地名語が出現した位置（文の先頭から数えた単語数）
-    // @arg m       この地名語が同綴語の中で何番目の候補か
-    void addGeowordToContextRelations(const Geoword& geoword, int n, int m);
-
-    // @brief 指定した位置にある Geoword の出現スコアを計算する
-    // @arg geoword 地名語
-    // @arg n       この地名語が出現した位置（文の先頭から数えた単語数）
-    // @arg m       この地名語が同綴語の中で何番目の候補か
-    int score(const Geoword& geoword, int n, int m);
-
-    // @brief Geoword を一つ選択済みコンテキスト関係に登録する
-    // @arg geoword 地名語
-    // @arg n       この地名語が出現した位置（文の先頭から数えた単語数）
-    // @arg m       この地名語が同綴語の中で何番目の候補か
-    void addGeowordToSelectedRelations(const Geoword& geoword, int n, int m);
-
-    // @brief 指定した位置にある Geoword の
+    // 地名語候補の位置の重み（プロファイルで指定された場合のみ）
+    WeightGridPtr _weight_grid;
+
+    // 一つのノードでスコアを計算する地名語候補数の上限、0 の場合は制限しない
+    size_t _candidate_limit;
+
+    // 評価中のノードについて、キーごとに自分自身を除かずに数えた地名語数
+    // [0] から順に _context_name, _context_hypernym, _context_full_hypernym,
+    // _context_neclass, _context_dictionary、[5] からは同じ順の選択済みの関係
+    IdHashMap _bound_counts[10];
+
+    // dist-server に問い合わせた重み、ノードの位置から問い合わせと候補集合の番号を引く
+    std::map<int, std::pair<DistServerRequestPtr, size_t> > _dist_weights;
+
+    // 地名語候補ごとのスコア計算用の値、_nodes と同じ位置に格納する
+    std::deque<std::vector<ContextCandidate> > _candidates;
+
+    // キューの先頭のノードを取り除く
+    void popNode(void);
+
+    // @brief 位置 n のノードを評価する時のウィンドウの範囲を求める
+    // @arg n   ノードの位置
+    // @arg lb  範囲の先頭の位置、ウィンドウを使わない場合は 0
+    // @arg hb  範囲の末尾の位置、登録済みのノードがすべて範囲に含まれる場合は -1
+    // @return ウィンドウを使い、範囲のノードがすべて登録済みの場合 true
+    bool windowOf(int n, int& lb, int& hb) const;
+
+    // @brief 位置が lb より前のノードをコンテキスト関係と重心から取り除く
+    // @arg lb  ウィンドウの範囲の先頭の位置
+    void retire(int lb);
+
+    // @brief コンテキスト関係と未評価の地名語候補が使っていない文字列を _ids から取り除き、
+    // ID を付け替える
+    void compactIds(void);
+
+    // @brief 重心に重み付きの座標を加える
+    // @arg n       この座標の語が出現した位置
+    // @arg lat     緯度
+    // @arg lon     経度
+    // @arg weight  重み
+    void addToCentroid(int n, float lat, float lon, int weight);
+
+    // @brief 評価するノードに対する重心を求める
+    // @arg hb  ウィンドウの範囲の末尾の位置、-1 の場合は登録済みのノードすべて
+    void updateCentroid(int hb);
+
+    // @brief 位置 n のノードの地名語候補、住所候補を評価する
+    // @arg n   ノードの位置
+    void evaluateNode(int n);
+
+    // @brief Geoword からスコア計算用の値を作る
+    // 文書内で既出の geonlp_id であれば _candidate_memo から複製する
+    // @arg geoword    地名語
+    // @arg candidate  結果を格納する
+    void makeCandidate(const Geoword& geoword, ContextCandidate& candidate);
+
+    // @brief 地名語候補を一つコンテキスト関係に登録する
+    // @arg candidate 地名語候補
+    // @arg n         この地名語が出現した位置（文の先頭から数えた単語数）
+    void addGeowordToContextRelations(const ContextCandidate& candidate, int n);
+
+    // @brief 指定した位置にある地名語候補の出現スコアを計算する
+    // @arg candidate 地名語候補
+    // @arg n         この地名語が出現した位置（文の先頭から数えた単語数）
+    // @arg hb        ウィンドウの範囲の末尾の位置、-1 の場合は制限なし
+    int score(const ContextCandidate& candidate, int n, int hb = -1);
+
+    // @brief 関心地点からの距離によるスコアの加算を求める
+    // @arg lat, lon  地名語候補の緯度、経度
+    int topicBonus(double lat, double lon);
+
+    // @brief 地名語候補を一つ選択済みコンテキスト関係に登録する
+    // @arg candidate 地名語候補
+    // @arg n         この地名語が出現した位置（文の先頭から数えた単語数）
+    void addGeowordToSelectedRelations(const ContextCandidate& candidate, int n);
+
+    // @brief 指定した位置にある地名語候補の
     // 選択済みコンテキストに対する出現スコアを計算する
-    // @arg geoword 地名語
-    // @arg n       この地名語が出現した位置（文の先頭から数えた単語数）
-    // @arg m       この地名語が同綴語の中で何番目の候補か
-    int selectedScore(const Geoword& geoword, int n, int m) const;
+    // @arg candidate 地名語候補
+    // @arg n         この地名語が出現した位置（文の先頭から数えた単語数）
+    int selectedScore(const ContextCandidate& candidate, int n) const;
+
+    // @brief 地名語候補の 1 + score() + selectedScore() の上限を求める
+    // コンテキストに依存する項をすべて最大として、優先度と座標の有無だけから計算する
+    // @arg candidate 地名語候補
+    int scoreBound(const ContextCandidate& candidate) const;
+
+    // @brief 地名語候補の 1 + score() + selectedScore() の下限を求める
+    // コンテキストに依存する項と空間的な加算は 0 以上なので、優先度だけから計算する
+    // @arg candidate 地名語候補
+    int scoreFloor(const ContextCandidate& candidate) const;
+
+    // @brief スコアのうちコンテキストに依存しない項の上限
+    // @arg candidate 地名語候補
+    int staticScore(const ContextCandidate& candidate) const;
+
+    // @brief 地名語候補の 1 + score() + selectedScore() の上限を地名語数から求める
+    // scoreBound() より厳しい上限で、距離の計算と時空間条件の判定は行わない
+    // @arg candidate 地名語候補
+    // @arg n         この地名語が出現した位置（文の先頭から数えた単語数）
+    // @arg hb        ウィンドウの範囲の末尾の位置、-1 の場合は制限なし
+    int contextBound(const ContextCandidate& candidate, int n, int hb);
+
+    // @brief 自分自身を除かずに数えた地名語数を、評価中のノードについてメモして返す
+    // @arg r         メモの番号（_bound_counts の説明を参照）
+    // @arg relation  コンテキスト関係
+    // @arg key       キーの ID
+    // @arg n         評価中のノードの位置
+    // @arg hb        ウィンドウの範囲の末尾の位置、-1 の場合は制限なし
+    int boundCount(int r, const ContextRelation& relation, boost::uint32_t key, int n, int hb);
 
     // @brief 住所要素をコンテキストに登録する
     // @arg varray  住所候補を含む配列
@@ -149,15 +410,17 @@ namespace geonlp
     // @brief AddressElement を一つ空間関係に登録する
     // @arg elem    住所要素
     // @arg size    この住所が出現した単語にいくつの候補が含まれるか
-    void addAddressElementToSpatialRelations(const picojson::value& elem, int size);
+    // @arg n       この語が出現した位置（文の先頭から数えた単語数）
+    void addAddressElementToSpatialRelations(const picojson::value& elem, int size, int n);
 
     // @brief 同綴地名語をまとめて空間関係に登録する
-    // @arg geowords 同綴地名語集合を含む picojson::array
-    void addGeowordsToSpatialRelations(const picojson::array& geowords);
+    // @arg candidates 同綴地名語の候補集合
+    // @arg n          この語が出現した位置（文の先頭から数えた単語数）
+    void addGeowordsToSpatialRelations(const std::vector<ContextCandidate>& candidates, int n);
 
   public:
     // コンストラクタ
-    Context() {
+    Context(): _window(0), _window_in_sentences(true), _candidate_limit(0) {
       this->clear();
       this->_options.initByJson("{}");
     }
@@ -170,15 +433,35 @@ namespace geonlp
     // parse オプションセット
     void setOptions(const picojson::ext& options); // { this->_options = options; }
 
+    // 地名語候補の位置の重みを与えるグリッドをセットする、clear() では消去されない
+    void setWeightGrid(WeightGridPtr weight_grid) { this->_weight_grid = weight_grid; }
+
+    // ウィンドウの大きさ（context-window オプションの文数またはノード数）、0 の場合は文書全体
+    int getWindow(void) const { return this->_window; }
+
+    // 一つのノードでスコアを計算する地名語候補数の上限をセットする、clear() では消去されない
+    void setCandidateLimit(size_t limit) { this->_candidate_limit = limit; }
+
     // コンテキスト情報のクリア
     void clear(void);
 
-    // 地名語解析結果の追加
-    void addNodes(const picojson::array& nodes);
+    // @brief 地名語解析結果の追加
+    // @arg nodes    Service::analyze_sentence の結果
+    // @arg request  nodes の候補集合を追加済みの dist-server への問い合わせ
+    //               省略した場合、dist-server オプションがあればこの文だけの問い合わせを送信する
+    // @arg base     request->add(nodes) が返した番号
+    void addNodes(const picojson::array& nodes, DistServerRequestPtr request = DistServerRequestPtr(), size_t base = 0);
 
-    // 登録済みの地名語候補のスコアを評価
+    // 登録済みで未評価の地名語候補のスコアをすべて評価
     void evaluate(void);
 
+    // ウィンドウの範囲のノードがすべて登録済みになったノードまで評価
+    // ウィンドウを使わない場合は何もしない（文書全体が揃うまで評価できない）
+    void evaluateWindow(void);
+
+    // キューの先頭の文が評価済みで flushNodes で取り出せる場合 true
+    bool hasEvaluatedSentence(void) const;
+
     // 解決後の結果を取得
     picojson::array flushNodes(void);
 
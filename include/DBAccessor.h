@@ -9,15 +9,17 @@
 #ifndef _DBACCESSOR_H
 #define _DBACCESSOR_H
 
-#define GEOWORD_CACHE_SIZE  1000
-
 #include <string>
 #include <boost/shared_ptr.hpp>
 #include "Profile.h"
 #include "Geoword.h"
+#include "GeowordCache.h"
 // #include "GeowordCore.h"
 #include "Dictionary.h"
 #include "Wordlist.h"
+#include "WordlistTable.h"
+#include "GeowordStore.h"
+#include "SqliteStatementPool.h"
 #include "SqliteErrException.h"
 #include "SqliteNotInitializedException.h"
 #include "FormatException.h"
@@ -29,28 +31,67 @@
 
 struct sqlite3;
 
+/// DB のスキーマバージョン（PRAGMA user_version に記録する）
+/// - 0: 初期（インデックス無し）
+/// - 1: wordlist(key), wordlist(yomi), geoword(dictionary_id, entry_id),
+///      dictionary(user_code, code) のインデックスを追加
+/// - 2: wordlist の key, yomi のインデックスを、検索で取得するカラムを含む
+///      wordlist_key_cover, wordlist_yomi_cover に置き換え
+#define GEONLP_SCHEMA_VERSION 2
+
 namespace geonlp
 {	
+  class WordlistAttributes;
+
   ///
   /// @brief SQLiteにアクセスするためのクラス。
   ///
   class DBAccessor {
   private:
-    /// キャッシュ
-    static std::map<std::string, Geoword> geoword_cache;
-    static bool searchGeowordFromCache(const std::string& geonlp_id, Geoword& geoword);
-    static void addGeowordToCache(const Geoword& geoword);
-    static void clearGeowordCache(void);
+    /// 地名語キャッシュ
+    GeowordCachePtr geoword_cache;
 
     /// DBファイルハンドル
     sqlite3* sqlitep;      // 地名語一覧
     sqlite3* wordlistp;    // 単語表記一覧
+
+    /// DB 接続ごとのプリペアドステートメントのプール
+    SqliteStatementPoolPtr geoword_statements;   // sqlitep 用
+    SqliteStatementPoolPtr wordlist_statements;  // wordlistp 用
 		
     /// DBファイル名
     std::string sqlite3_fname;
     std::string wordlist_fname;
     /// darts ファイル名
     std::string darts_fname;
+    /// オンメモリ見出し語テーブルのファイル名
+    std::string wordlist_table_fname;
+
+    /// 見出し語テーブルをメモリ上に保持するかどうか
+    bool use_wordlist_table;
+
+    /// オンメモリ見出し語テーブル（use_wordlist_table が false の場合は NULL）
+    /// updateWordlists で作り直すため mutable
+    mutable WordlistTablePtr wordlist_table;
+
+    // オンメモリ見出し語テーブルを読み込む
+    void loadWordlistTable(void) const;
+
+    // オンメモリ見出し語テーブルとそのファイルを破棄する
+    void removeWordlistTable(void) const;
+
+    /// 地名語のバイナリ格納ファイル名
+    std::string geoword_store_fname;
+
+    /// 地名語のバイナリ格納ファイル（ファイルが無い場合は NULL）
+    /// updateWordlists で作り直すため mutable
+    mutable GeowordStorePtr geoword_store;
+
+    // 地名語のバイナリ格納ファイルを読み込む
+    void loadGeowordStore(void) const;
+
+    // 地名語のバイナリ格納ファイルを破棄する
+    void removeGeowordStore(void) const;
 
 #ifdef DEBUG
     /// DB アクセスログのファイルポインタ
@@ -69,6 +110,21 @@ namespace geonlp
     void dropTmpWordlistTable(void) const
       throw (SqliteNotInitializedException, SqliteErrException);
 
+    /// @brief 固有名クラス ID の対応表 ne_class を生成
+    void createNeClassTable(void) const
+      throw (SqliteNotInitializedException, SqliteErrException);
+
+    // geoword, dictionary テーブルのインデックスを作成する（もしなければ）
+    void createGeowordIndexes(void) const
+      throw (SqliteNotInitializedException, SqliteErrException);
+
+    // wordlist テーブルのインデックスを作成する（もしなければ）
+    void createWordlistIndexes(void) const
+      throw (SqliteNotInitializedException, SqliteErrException);
+
+    // 既存の DB を現在のスキーマバージョンに移行する
+    void migrateSchema(void) const;
+
   public:
     /// @brief コンストラクタ。
     /// @arg @c profilename プロファイルのファイル名
@@ -78,6 +134,10 @@ namespace geonlp
       sqlite3_fname = profile.get_sqlite3_file();
       wordlist_fname = profile.get_wordlist_file();
       darts_fname = profile.get_darts_file();
+      wordlist_table_fname = profile.get_wordlist_table_file();
+      geoword_store_fname = profile.get_geoword_store_file();
+      use_wordlist_table = profile.get_wordlist_in_memory();
+      geoword_cache = GeowordCachePtr(new GeowordCache(profile.get_geoword_cache_size()));
     }
     /// @brief コンストラクタ。
     /// @arg @c profile Profile オブジェクト
@@ -85,6 +145,10 @@ namespace geonlp
       sqlite3_fname = profile.get_sqlite3_file();
       wordlist_fname = profile.get_wordlist_file();
       darts_fname = profile.get_darts_file();
+      wordlist_table_fname = profile.get_wordlist_table_file();
+      geoword_store_fname = profile.get_geoword_store_file();
+      use_wordlist_table = profile.get_wordlist_in_memory();
+      geoword_cache = GeowordCachePtr(new GeowordCache(profile.get_geoword_cache_size()));
     }
 		
     // DBオープン
@@ -97,6 +161,10 @@ namespace geonlp
     // GeonlpMAImpleSq3 で利用
     bool findGeowordById(const std::string & id, Geoword& ret) const
       throw (SqliteNotInitializedException, SqliteErrException);
+
+    // 指定した GeonlpID を持つ地名語エントリをキャッシュと共有する形で取得する
+    bool findGeowordById(const std::string & id, GeowordPtr& ret) const
+      throw (SqliteNotInitializedException, SqliteErrException);
     //    const Geoword findSubsetById(const std::string & id) const
     //      throw (SqliteNotInitializedException, SqliteErrException);
 
@@ -188,6 +256,23 @@ namespace geonlp
 
     // wordlist に含まれる ID を持つ Geoword をデータベースから取得する
     int getGeowordListFromWordlist(const Wordlist& wordlist, std::vector<Geoword>& ret, int limit = 0) const;
+    int getGeowordListFromWordlist(const Wordlist& wordlist, std::vector<GeowordPtr>& ret, int limit = 0) const;
+
+    // wordlist に含まれる ID を持つ地名語を、バイナリ格納ファイルのレコードとして取得する
+    bool getGeowordViewsFromWordlist(const Wordlist& wordlist, std::vector<GeowordView>& ret, GeowordStorePtr& store) const;
+
+    /// @brief 地名語キャッシュの統計情報を取得する
+    inline GeowordCacheStats getGeowordCacheStats(void) const { return this->geoword_cache->getStats(); }
+
+    // プリペアドステートメントの統計情報（全 DB 接続の合計）を取得する
+    SqliteStatementStats getStatementStats(void) const;
+
+    // 統計情報を JSON オブジェクトとして取得する
+    picojson::value getStatistics(void) const;
+
+    // 見出し語ごとの辞書・固有名クラス所属情報を取得する
+    bool getWordlistAttributes(WordlistAttributes& ret) const
+      throw (SqliteNotInitializedException);
 
   private:
     // geowordテーブルから得られた情報が、期待する順序でカラムが並んでいることを確認する
@@ -213,6 +298,10 @@ namespace geonlp
     // wordlistテーブルから得られた情報を単語IDリストクラスに変換する
     void resultToWordlist(char** azResult, Wordlist& out) const;
 
+    // wordlist を検索するステートメントを実行し、単語IDリストクラスに変換する
+    bool stepWordlist(PooledStatement& stmt, Wordlist& out) const
+      throw (SqliteErrException);
+
     // geoword, dictionary, wordlist テーブルを作成する（もしなければ）
     void createTables() const
       throw (SqliteNotInitializedException, SqliteErrException);
@@ -24,6 +24,11 @@
 /// 地名語抽出システム
 namespace geonlp
 {
+  class MA;
+
+  /// MAのポインタ
+  typedef boost::shared_ptr<MA> MAPtr;
+
   /// @brief MAのインタフェース定義。
   class MA {
   public:
@@ -127,6 +132,13 @@ namespace geonlp
     /// @brief アクティブな固有名クラスの正規表現リストを取得する。
     virtual const std::vector<std::string>& getActiveClasses(void) const = 0;
 
+    /// @brief 利用する辞書と固有名クラスを、他の MA から取得した値のまま設定する
+    ///
+    /// setActiveDictionaries と異なり、辞書が空の場合も全辞書には置き換えない。
+    /// @arg @c dictionaries 利用する辞書（getActiveDictionaries の値）
+    /// @arg @c ne_classes   利用する固有名クラスの正規表現リスト（getActiveClasses の値）
+    virtual void assignActiveSettings(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes) = 0;
+
     virtual ~MA() {}
 
     /// @brief ID で指定した辞書情報を取得する
@@ -135,11 +147,22 @@ namespace geonlp
     /// @brief 辞書一覧を取得する
     virtual int getDictionaryList(std::map<int, Dictionary>& ret) const = 0;
 
+    /// @brief 辞書アクセスの統計情報を取得する
+    ///
+    /// セッションは作成元と共有する辞書の値を返す。
+    /// @return プリペアドステートメントの実行回数や時間、地名語キャッシュのヒット数などを含む JSON オブジェクト
+    virtual picojson::value getStatistics(void) const = 0;
+
+    /// @brief 読み込み済みの辞書を共有するセッションを作成する。
+    ///
+    /// セッションは形態素解析器、辞書、キャッシュを作成元と共有し、
+    /// 利用する辞書とクラスの指定だけを独立に持つ。
+    /// 異なるセッションは別々のスレッドから同時に利用できる。
+    /// @return 利用する辞書とクラスが作成元と同じ値で初期化された MA
+    virtual MAPtr createSession(void) const = 0;
+
   };
 	
-  /// MAのポインタ
-  typedef boost::shared_ptr<MA> MAPtr;
-	
   /// @brief MAインタフェースを取得する。
   /// 
   /// @arg @c profile プロファイル名。
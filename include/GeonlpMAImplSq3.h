@@ -12,7 +12,10 @@
 #include "GeonlpMA.h"
 #include "MeCabAdapter.h"
 #include "PHBSDefs.h"
+#include "ActiveFilter.h"
+#include "GeowordStore.h"
 #include <fstream>
+#include <boost/enable_shared_from_this.hpp>
 #include "darts.h"
 
 #ifdef GEOWORD_UNITTEST
@@ -41,7 +44,11 @@ namespace geonlp
   typedef boost::shared_ptr<Darts::DoubleArray> DoubleArrayPtr;
 	
   /// @brief MAのインタフェース実装クラス。
-  class MAImpl: public MA {
+  ///
+  /// 判定器を引数に取る const メソッドはメンバを変更しないので、
+  /// 複数のスレッドから同時に呼び出せる。スレッドごとに利用する辞書と
+  /// クラスを変える場合は createSession で作成した MASession を利用する。
+  class MAImpl: public MA, public boost::enable_shared_from_this<MAImpl> {
   private:
     /// MeCabにアクセスするためのクラスへのポインタ。
     MeCabAdapterPtr mecabp;
@@ -64,11 +71,11 @@ namespace geonlp
     /// プロファイルで指定された利用可能クラスのリスト、リセット用に記憶
     std::vector<std::string> defaultClasses;
 
-    /// 利用する辞書 ID のリスト、高速化のため記憶
-    std::map<int, Dictionary> activeDictionaries;
+    /// 見出し語ごとの辞書・クラス所属情報（wordlist が古い形式の場合は NULL）
+    WordlistAttributesPtr wordlistAttributes;
 
-    /// 利用するクラスのリスト、高速化のため記憶
-    std::vector<std::string> activeClasses;
+    /// 利用する辞書とクラス、およびそれらから構築した判定器
+    ActiveSettings active;
     
     typedef MeCabAdapter::NodeList NodeList;
 		
@@ -87,13 +94,20 @@ namespace geonlp
     // 辞書一覧を取得する
     int getDictionaryList(std::map<int, Dictionary>& ret) const;
 
+    // 辞書アクセスの統計情報を取得する
+    picojson::value getStatistics(void) const;
+
     // 引数として渡された自然文を形態素解析し、解析結果をテキストとして返す。
     std::string parse(const std::string & sentence) const
       throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException);
+    std::string parse(const std::string & sentence, const ActiveFilter& filter) const
+      throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException);
 
     // 引数として渡された自然文を形態素解析し、解析結果の各行を要素とするノードの配列を返す。
     int parseNode(const std::string & sentence, std::vector<Node>& ret) const
       throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException);
+    int parseNode(const std::string & sentence, std::vector<Node>& ret, const ActiveFilter& filter) const
+      throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException);
 
     // 引数として渡されたIDを持つ地名語エントリの全ての情報を地名語辞書システムから取得する。
     bool getGeowordEntry(const std::string& geonlp_id, Geoword& ret) const
@@ -103,6 +117,8 @@ namespace geonlp
     // 戻り値は、「keyがgeonlp_id、valueがGeowordオブジェクト」のマップ。
     int getGeowordEntries(const std::string & geoword, std::map<std::string, Geoword>& ) const
       throw (SqliteNotInitializedException, SqliteErrException);
+    int getGeowordEntries(const std::string & geoword, std::map<std::string, Geoword>&, const ActiveFilter& filter) const
+      throw (SqliteNotInitializedException, SqliteErrException);
 	  
     /// @brief Node が地名語の場合、地名語のリストを得る
     ///        地名語ではない場合は空のマップを返す
@@ -117,6 +133,8 @@ namespace geonlp
     /// @exception SqliteErrException Sqlite3でエラー。
     bool getWordlistBySurface(const std::string& key, Wordlist&) const
       throw (SqliteNotInitializedException, SqliteErrException);
+    bool getWordlistBySurface(const std::string& key, Wordlist&, const ActiveFilter& filter) const
+      throw (SqliteNotInitializedException, SqliteErrException);
 
     /// @brief 利用する辞書を辞書IDのリストで指定する。プロファイルのデフォルトに対する差分。
     /// @arg @c dics 利用する辞書ID、複数指定した場合は OR、- から始まる場合は除外
@@ -156,11 +174,26 @@ namespace geonlp
     /// @brief アクティブな固有名クラスの正規表現リストを取得する。
     const std::vector<std::string>& getActiveClasses(void) const;
 
+    // 利用する辞書と固有名クラスを、他の MA から取得した値のまま設定する
+    void assignActiveSettings(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes);
+
+    /// @brief プロファイルで指定された辞書のリストを取得する。
+    inline const std::map<int, Dictionary>& getDefaultDictionaries(void) const { return this->defaultDictionaries; }
+
+    /// @brief プロファイルで指定された固有名クラスの正規表現リストを取得する。
+    inline const std::vector<std::string>& getDefaultClasses(void) const { return this->defaultClasses; }
+
+    /// @brief 見出し語ごとの辞書・クラス所属情報を取得する（古い形式の場合は NULL）。
+    inline WordlistAttributesPtr getWordlistAttributes(void) const { return this->wordlistAttributes; }
+
+    // 読み込み済みの辞書を共有するセッションを作成する
+    MAPtr createSession(void) const;
+
   private:
     PUBLIC_IF_UNITTEST
 		
     // MeCabによるパース結果を地名語辞書を参照して変換する
-    void convertMeCabNodeToNodeList( NodeList& nodes, std::vector<Node>& nodelist) const
+    void convertMeCabNodeToNodeList( NodeList& nodes, std::vector<Node>& nodelist, const ActiveFilter& filter) const
       throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException);
 
     // 形態素情報クラスのリストを、形態素情報拡張クラスのリストに変換する。
@@ -172,7 +205,7 @@ namespace geonlp
 				     NodeExtList::iterator& s, NodeExtList::iterator& e) const;
     // 地名語を得る。
     int getLongestGeoword( const NodeExtList::iterator& s, const NodeExtList::iterator& e, 
-					 NodeExtList::iterator& next, std::vector<Node>& ret) const;
+					 NodeExtList::iterator& next, std::vector<Node>& ret, const ActiveFilter& filter) const;
 		
     // 素性の表層形を連結した文字列を得る。
     std::string joinGeowords( NodeExtList::iterator s, NodeExtList::iterator e) const;
@@ -181,7 +214,7 @@ namespace geonlp
     bool findGeowordNode( const std::string& surface, Node& node) const;
 
     // 見出し語IDから地名語Nodeを得る。
-    Node getGeowordNode(unsigned int id, std::string& alternative) const throw (SqliteNotInitializedException, SqliteErrException);
+    Node getGeowordNode(unsigned int id, std::string& alternative, const ActiveFilter& filter) const throw (SqliteNotInitializedException, SqliteErrException);
 	  
     std::string removeSuffix( const std::string& surface, const std::string &suffix) const;
 		
@@ -189,13 +222,11 @@ namespace geonlp
     Node suffixNode( const Suffix& suffix) const;
 
     // DARTS で最長一致する候補を得る。
-    Darts::DoubleArray::result_pair_type getLongestResultWithDarts(const std::string& key, bool bSurfaceOnly = true) const;
-
-    // 指定した地名語がアクティブな辞書/クラスに含まれているかチェックする
-    bool isInActiveDictionaryAndClass(const Geoword& geo) const;
+    Darts::DoubleArray::result_pair_type getLongestResultWithDarts(const std::string& key, const ActiveFilter& filter, bool bSurfaceOnly = true) const;
 
     // 指定した地名語の表記が検索表記と一致していれば true を返す
     bool isSurfaceMatched(const Geoword& geo, const std::string& surface) const;
+    bool isSurfaceMatched(const GeowordView& geo, const std::string& surface) const;
 
   };
 }
@@ -0,0 +1,115 @@
+///
+/// @file
+/// @brief 辞書を共有する MA のセッション MASession の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _GEONLP_MA_SESSION_H
+#define _GEONLP_MA_SESSION_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/shared_ptr.hpp>
+#include "GeonlpMA.h"
+#include "ActiveFilter.h"
+
+namespace geonlp
+{
+  class MAImpl;
+
+  /// @brief 読み込み済みの MAImpl を共有する MA の実装クラス。
+  ///
+  /// 形態素解析器、データベース、darts、キャッシュは MAImpl が持ち、
+  /// セッションは利用する辞書とクラス、およびそれらから構築した判定器だけを持つ。
+  /// 作成コストが小さいので、リクエストごと、スレッドごとに作成して利用する。
+  /// 一つのセッションを複数のスレッドで同時に利用してはならない。
+  class MASession: public MA {
+  private:
+    /// 共有する MA の実体
+    boost::shared_ptr<const MAImpl> core;
+
+    /// 利用する辞書とクラス、およびそれらから構築した判定器
+    ActiveSettings active;
+
+  public:
+    // コンストラクタ
+    MASession(boost::shared_ptr<const MAImpl> core, const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes);
+
+    // デストラクタ
+    ~MASession() {}
+
+    // 自然文を形態素解析し、解析結果をテキストとして返す。
+    std::string parse(const std::string & sentence) const
+      throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException);
+
+    // 自然文を形態素解析し、解析結果の各行を要素とするノードの配列を返す。
+    int parseNode(const std::string & sentence, std::vector<Node>& ret) const
+      throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException);
+
+    // 引数として渡されたIDを持つ地名語エントリの全ての情報を取得する。
+    bool getGeowordEntry(const std::string& geonlp_id, Geoword& ret) const
+      throw (SqliteNotInitializedException, SqliteErrException);
+
+    // 引数に与えられた文字列からGeoword候補を取得する。
+    int getGeowordEntries(const std::string & surface, std::map<std::string, Geoword>& ret) const
+      throw (SqliteNotInitializedException, SqliteErrException);
+
+    // Node が地名語の場合、地名語のリストを得る
+    int getGeowordEntries(const Node& node, std::map<std::string, Geoword>& ret) const
+      throw (SqliteNotInitializedException, SqliteErrException);
+
+    // 引数に与えられた文字列から Wordlist を取得する
+    bool getWordlistBySurface(const std::string& key, Wordlist& ret) const
+      throw (SqliteNotInitializedException, SqliteErrException);
+
+    // 利用する辞書を辞書IDのリストで指定する
+    void setActiveDictionaries(const std::vector<int>& dics);
+
+    // 利用する辞書を追加する
+    void addActiveDictionaries(const std::vector<int>& dics);
+
+    // 利用する辞書から除外する
+    void removeActiveDictionaries(const std::vector<int>& dics);
+
+    // 利用する辞書をプロファイルのデフォルトに戻す
+    void resetActiveDictionaries(void);
+
+    /// @brief アクティブな辞書 ID のリストを取得する。
+    inline const std::map<int, Dictionary>& getActiveDictionaries(void) const { return this->active.dictionaries(); }
+
+    // 利用する固有名クラスをクラス名正規表現のリストで指定する
+    void setActiveClasses(const std::vector<std::string>& ne_classes);
+
+    // 利用する固有名クラスの正規表現を追加する
+    void addActiveClasses(const std::vector<std::string>& ne_classes);
+
+    // 利用する固有名クラスの正規表現を除外する
+    void removeActiveClasses(const std::vector<std::string>& ne_classes);
+
+    // 利用する固有名クラスをプロファイルのデフォルトに戻す
+    void resetActiveClasses(void);
+
+    /// @brief アクティブな固有名クラスの正規表現リストを取得する。
+    inline const std::vector<std::string>& getActiveClasses(void) const { return this->active.classes(); }
+
+    // 利用する辞書と固有名クラスを、他の MA から取得した値のまま設定する
+    void assignActiveSettings(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes);
+
+    // ID で指定した辞書情報を取得する
+    bool findDictionaryById(int dictionary_id, Dictionary& ret) const;
+
+    // 辞書一覧を取得する
+    int getDictionaryList(std::map<int, Dictionary>& ret) const;
+
+    // 辞書アクセスの統計情報を取得する
+    picojson::value getStatistics(void) const;
+
+    // 同じ MAImpl を共有するセッションを作成する
+    MAPtr createSession(void) const;
+  };
+
+}
+#endif /* _GEONLP_MA_SESSION_H */
@@ -13,6 +13,8 @@
 #include <vector>
 #include <map>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
 #include "Profile.h"
 #include "Geoword.h"
 #include "Dictionary.h"
@@ -22,6 +24,7 @@
 #include "picojsonExt.h"
 #include "Context.h"
 #include "Classifier.h"
+#include "WeightGrid.h"
 
 #ifdef HAVE_LIBDAMS
 #include <dams.h>
@@ -41,6 +44,7 @@ namespace geonlp
   private:
     MAPtr _ma_ptr;
     boost::shared_ptr<Profile> _profilesp;
+    WeightGridPtr _weight_grid;
     picojson::ext _options;
     Context _context;
     //    Classifier _classifier;
@@ -74,17 +78,81 @@ namespace geonlp
     /// @return 解析結果の JSON オブジェクトの配列
     picojson::array analyze_sentence(const std::string& sentence);
 
+    /// @brief  analyze_sentences で並列に解析するスレッド数
+    /// @return プロファイルの parse_threads、0 の場合は CPU 数
+    size_t parse_threads(void) const;
+
+    /// @brief  複数の文を現在のオプションで解析する
+    ///
+    /// プロファイルの parse_threads が 2 以上（0 の場合は CPU 数）であれば、
+    /// 同じオプションと辞書の指定を持つセッションを作成して文ごとに並列に解析する。
+    /// 結果は analyze_sentence を順に呼び出した場合と同じ。
+    /// @arg @c sentences  解析する自然言語文の配列
+    /// @arg @c results    文と同じ順に解析結果を格納する配列
+    /// @exception ServiceRequestFormatException  いずれかの文の解析に失敗した場合
+    void analyze_sentences(const std::vector<std::string>& sentences, std::vector<picojson::array>& results)
+      throw (ServiceRequestFormatException);
+
+    /// @brief  analyze_sentences で使うセッションを作成する
+    ///
+    /// 現在のオプションと、利用する辞書・クラスを引き継いだセッションを作る。
+    /// 同じオプションで何度も analyze_sentences を呼ぶ場合は、一度だけ作成して使い回す。
+    /// @arg @c threads  並列に解析するスレッド数
+    /// @return スレッドごとのセッション、threads が 1 以下の場合は空
+    std::vector<boost::shared_ptr<Service> > create_parse_sessions(size_t threads);
+
+    /// @brief  作成済みのセッションを使って複数の文を解析する
+    /// @arg @c sentences  解析する自然言語文の配列
+    /// @arg @c results    文と同じ順に解析結果を格納する配列
+    /// @arg @c sessions   create_parse_sessions で作成したセッション、空の場合はこのサービスで順に解析する
+    /// @exception ServiceRequestFormatException  いずれかの文の解析に失敗した場合
+    void analyze_sentences(const std::vector<std::string>& sentences, std::vector<picojson::array>& results,
+			   const std::vector<boost::shared_ptr<Service> >& sessions)
+      throw (ServiceRequestFormatException);
+
+    /// @brief analyze_sentences で並列に実行する処理、i 番目の文を解析する
+    static void analyze_sentences_item(boost::shared_ptr<Service> session, size_t i, const std::vector<std::string>* sentences, std::vector<picojson::array>* results);
+
+    /// @brief 0 から count - 1 までの番号の処理を、セッションごとに一つのスレッドで分担して実行する
+    ///
+    /// 各スレッドは未処理の番号を一つずつ取り出して task(セッション, 番号) を呼び出す。
+    /// セッションが一つの場合は呼び出したスレッドで順に実行する。
+    /// @arg @c sessions  スレッドごとに使うセッション
+    /// @arg @c count     処理する番号の数
+    /// @arg @c task      一つの番号を処理する関数
+    /// @return task が例外を送出した場合は最初のメッセージ（残りの番号は処理しない）、成功した場合は空文字列
+    static std::string run_parallel(const std::vector<boost::shared_ptr<Service> >& sessions, size_t count,
+				    const boost::function<void (boost::shared_ptr<Service>, size_t)>& task);
+
+    /// @brief 文書全体の地名語候補の重みを dist-server に一括して問い合わせる
+    /// @arg @c analyzed  analyze_sentences の結果
+    /// @arg @c bases     文ごとに Context::addNodes に渡す候補集合の番号
+    /// @return 送信済みの問い合わせ、dist-server オプションが無い場合は空のポインタ
+    DistServerRequestPtr request_weights(const std::vector<picojson::array>& analyzed, std::vector<size_t>& bases);
+
     /// @brief １文をキューに積む
     /// @arg @c sentence  解析する自然言語文
     void queue_sentence(const std::string& sentence);
 
     /// @brief キューに積まれた文集合を評価し、地名解決を行う
-    void resolve(void);
+    /// @arg @c all  false の場合、context-window オプションの範囲が揃ったノードだけを評価する
+    /// @exception ServiceRequestFormatException  dist-server との通信エラーなど、評価に失敗した場合
+    void resolve(bool all = true) throw (ServiceRequestFormatException);
 
     /// @brief 解決済みの１文をキューから取り出す
     /// @return 解析結果の JSON オブジェクトの配列
     picojson::value dequeue_sentence(void);
 
+    /// @brief 一つの JSON-RPC リクエストを実行する
+    /// @param @c json_request  リクエストオブジェクト
+    /// @return JSON-RPC のレスポンスオブジェクト
+    picojson::value proc_request(const picojson::value& json_request);
+
+    /// @brief JSON-RPC のバッチリクエストを並列に実行する
+    /// @param @c requests  リクエストオブジェクトの配列
+    /// @return リクエストと同じ順に並べたレスポンスオブジェクトの配列
+    picojson::value proc_batch(const picojson::array& requests);
+
 #ifdef HAVE_LIBDAMS
     /// @brief 住所文字列をジオコーディングする
     /// @arg   address  ジオコーディング結果を格納する Address オブジェクト
@@ -107,30 +175,53 @@ namespace geonlp
     
   public:
     // コンストラクタ
-    Service(MAPtr maptr, boost::shared_ptr<Profile> profilesp)
+    // weight_grid はプロファイルで指定された重みのグリッド（無い場合は空のポインタ）
+    Service(MAPtr maptr, boost::shared_ptr<Profile> profilesp, WeightGridPtr weight_grid = WeightGridPtr())
       //      :_classifier(profilesp->get_log_dir() + "classify.log") { 
     {
       this->_ma_ptr = maptr;
       this->_context.clear();
+      this->_context.setWeightGrid(weight_grid);
+      this->_context.setCandidateLimit(profilesp->get_candidate_limit());
       this->_profilesp = profilesp;
+      this->_weight_grid = weight_grid;
       this->reset_options(); // コンテキストのオプションも初期化される
     }
 
     // デストラクタ
-    ~Service() {
-#ifdef HAVE_LIBDAMS
-      damswrapper::final(); // DAMS を終了する
-#endif /* HAVE_LIBDAMS */
-    }
+    // DAMS は MA の実体 (MAImpl) を破棄する際に終了する
+    ~Service() {}
 
     inline std::string version(void) { return std::string(PACKAGE_VERSION); }
 
     // 拡張形態素解析器 (MA）インタフェースの取得
     inline MAPtr getMA(void) const { return this->_ma_ptr; }
 
+    /// @brief 読み込み済みの辞書を共有するセッションを作成する
+    ///
+    /// 作成した Service は形態素解析器と辞書を共有し、利用する辞書とクラス、
+    /// オプション、コンテキストを独立に持つ。リクエストやスレッドごとに作成すれば
+    /// 一つの辞書に対して複数のリクエストを並行して処理できる。
+    /// @return オプションとコンテキストを初期化した Service
+    inline boost::shared_ptr<Service> createSession(void) const {
+      return boost::shared_ptr<Service>(new Service(this->_ma_ptr->createSession(), this->_profilesp, this->_weight_grid));
+    }
+
+    /// @brief コンテキスト、オプション、利用する辞書とクラスを初期状態に戻す
+    ///
+    /// 一つの Service で複数のリクエストを順に処理する場合、
+    /// 前のリクエストの指定を引き継がないようにリクエストごとに呼び出す。
+    inline void reset(void) {
+      this->reset_context();
+      this->reset_options();
+    }
+
     /// @brief JSON-RPC のリクエストを受け取って実行する
-    /// @param @c json_request  リクエストオブジェクト
-    /// @return JSON-RPC のレスポンスオブジェクト
+    ///
+    /// リクエストオブジェクトの配列（バッチ）を受け取った場合は、
+    /// 要素ごとに独立したセッションで並列に実行する。
+    /// @param @c json_request  リクエストオブジェクト、またはその配列
+    /// @return JSON-RPC のレスポンスオブジェクト、またはその配列
     picojson::value proc(const picojson::value& json_request);
 
     /// @brief バージョン番号を返す
@@ -64,6 +64,10 @@ namespace geonlp
     /// 一致しない場合 false, 一致する組み合わせがあれば true を返す
     bool get_parts_for_surface(const std::string& surface, std::string& prefix, std::string& suffix) const;
 
+    /// 接頭辞リスト、語幹、接尾辞リストの組み合わせで、指定した表記に一致するものを探す
+    /// prefix_no, suffix_no には何番目の接頭辞、接尾辞を利用するかが入る（省略されている場合は -1）
+    static bool match_prefix_and_suffix(std::vector<std::string> prefix, const std::string& body, std::vector<std::string> suffix, const std::string& surface, int& prefix_no, int& suffix_no);
+
     /// 指定した表記に一致するカナを得る
     /// prefix_kana, suffix_kana には対応するカナ接頭辞、カナ接尾辞が入る
     /// 一致しない場合 false, 一致する組み合わせがあれば true を返す
@@ -0,0 +1,105 @@
+///
+/// @file
+/// @brief 地名語キャッシュ GeowordCache の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _GEOWORD_CACHE_H
+#define _GEOWORD_CACHE_H
+
+#include <string>
+#include <list>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include "Geoword.h"
+
+/// キャッシュのシャード数
+#define GEOWORD_CACHE_SHARDS  16
+
+namespace geonlp
+{
+  /// キャッシュから受け取る地名語（共有されるので変更不可）
+  typedef boost::shared_ptr<const Geoword> GeowordPtr;
+
+  /// @brief キャッシュの統計情報
+  struct GeowordCacheStats {
+    unsigned long hits;       ///< ヒット数
+    unsigned long misses;     ///< ミス数
+    unsigned long evictions;  ///< 追い出した件数
+    unsigned long entries;    ///< 保持している件数
+    size_t bytes;             ///< 保持している推定バイト数
+    size_t capacity;          ///< 上限バイト数
+  };
+
+  /// @brief geonlp_id をキーとする地名語の LRU キャッシュ。
+  ///
+  /// キーのハッシュ値で GEOWORD_CACHE_SHARDS 個のシャードに分割し、
+  /// シャードごとにロックを持つため複数スレッドから同時に利用できる。
+  /// 容量は地名語の推定バイト数で制限し、シャードごとに古いものから追い出す。
+  /// 地名語は shared_ptr で共有するので、ヒット時にコピーは発生しない。
+  class GeowordCache {
+  private:
+    struct Entry {
+      std::string geonlp_id;
+      GeowordPtr geoword;
+      size_t bytes;
+      Entry(const std::string& id, GeowordPtr g, size_t b): geonlp_id(id), geoword(g), bytes(b) {}
+    };
+    typedef std::list<Entry> EntryList;
+
+    struct Shard {
+      boost::mutex mutex;
+      EntryList lru;  // 先頭が最近利用したもの
+      boost::unordered_map<std::string, EntryList::iterator> index;
+      size_t bytes;
+      unsigned long hits;
+      unsigned long misses;
+      unsigned long evictions;
+      Shard(): bytes(0), hits(0), misses(0), evictions(0) {}
+    };
+
+    /// シャード
+    std::vector<Shard*> _shards;
+
+    /// シャードごとの上限バイト数
+    size_t _shard_capacity;
+
+    // コピー禁止
+    GeowordCache(const GeowordCache&);
+    GeowordCache& operator=(const GeowordCache&);
+
+    inline Shard& shardOf(const std::string& geonlp_id) const {
+      return *(this->_shards[boost::hash<std::string>()(geonlp_id) % this->_shards.size()]);
+    }
+
+  public:
+    // コンストラクタ
+    GeowordCache(size_t capacity);
+
+    // デストラクタ
+    ~GeowordCache();
+
+    // キャッシュから地名語を取得する
+    GeowordPtr get(const std::string& geonlp_id) const;
+
+    // キャッシュに地名語を登録する
+    void put(GeowordPtr geoword, size_t bytes);
+
+    // キャッシュを空にする
+    void clear(void);
+
+    // 統計情報を取得する
+    GeowordCacheStats getStats(void) const;
+
+    /// @brief 上限バイト数を返す
+    inline size_t getCapacity(void) const { return this->_shard_capacity * this->_shards.size(); }
+  };
+
+  typedef boost::shared_ptr<GeowordCache> GeowordCachePtr;
+}
+
+#endif /* _GEOWORD_CACHE_H */
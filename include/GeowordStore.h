@@ -0,0 +1,181 @@
+///
+/// @file
+/// @brief 地名語のバイナリ格納ファイル GeowordStore の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _GEOWORD_STORE_H
+#define _GEOWORD_STORE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/interprocess_fwd.hpp>
+#include "Geoword.h"
+
+namespace geonlp
+{
+  class GeowordStore;
+
+  /// @brief 地名語一件分の固定長レコード。
+  ///
+  /// 文字列はすべて文字列プール内のオフセットで、リストは要素を
+  /// GEOWORD_STORE_LIST_SEP で区切った一つの文字列として格納する。
+  struct GeowordRecord {
+    boost::uint32_t geonlp_id;
+    boost::int32_t  dictionary_id;
+    boost::uint32_t ne_class_id;    ///< 固有名クラステーブルの添字
+    boost::uint32_t flags;          ///< GEOWORD_RECORD_HAS_COORDINATES など
+    double latitude;
+    double longitude;
+    boost::uint32_t body;
+    boost::uint32_t body_kana;
+    boost::uint32_t typical_name;
+    boost::uint32_t typical_kana;
+    boost::uint32_t prefix;
+    boost::uint32_t suffix;
+    boost::uint32_t prefix_kana;
+    boost::uint32_t suffix_kana;
+    boost::uint32_t hypernym;
+    boost::uint32_t json;           ///< 元の JSON（まれにしか使わない項目用）
+  };
+
+/// 経緯度が有効な場合に GeowordRecord::flags に立てるビット
+#define GEOWORD_RECORD_HAS_COORDINATES 0x01
+
+/// リストの要素の区切り文字（US: Unit Separator）
+#define GEOWORD_STORE_LIST_SEP '\x1f'
+
+  /// @brief GeowordStore 内の地名語レコードを参照するクラス。
+  ///
+  /// JSON を解析せずに、よく使う項目をレコードから直接取得する。
+  /// その他の項目が必要な場合は toGeoword() で Geoword に変換する。
+  /// 参照先の GeowordStore より長く保持してはならない。
+  class GeowordView {
+  private:
+    const GeowordStore* _store;
+    const GeowordRecord* _record;
+
+    // 文字列プールの文字列を得る
+    std::string string(boost::uint32_t offset) const;
+
+    // 文字列プールのリストを得る
+    std::vector<std::string> list(boost::uint32_t offset) const;
+
+  public:
+    GeowordView(): _store(NULL), _record(NULL) {}
+    GeowordView(const GeowordStore* store, const GeowordRecord* record): _store(store), _record(record) {}
+
+    /// 有効なレコードを参照しているかどうか
+    inline bool isValid(void) const { return this->_record != NULL; }
+
+    inline std::string get_geonlp_id() const { return this->string(this->_record->geonlp_id); }
+    inline int get_dictionary_id() const { return this->_record->dictionary_id; }
+    std::string get_ne_class() const;
+    inline std::string get_body() const { return this->string(this->_record->body); }
+    inline std::string get_body_kana() const { return this->string(this->_record->body_kana); }
+    inline std::string get_typical_name() const { return this->string(this->_record->typical_name); }
+    inline std::string get_typical_kana() const { return this->string(this->_record->typical_kana); }
+    inline std::vector<std::string> get_prefix() const { return this->list(this->_record->prefix); }
+    inline std::vector<std::string> get_suffix() const { return this->list(this->_record->suffix); }
+    inline std::vector<std::string> get_prefix_kana() const { return this->list(this->_record->prefix_kana); }
+    inline std::vector<std::string> get_suffix_kana() const { return this->list(this->_record->suffix_kana); }
+    inline std::vector<std::string> get_hypernym() const { return this->list(this->_record->hypernym); }
+    inline std::string get_json() const { return this->string(this->_record->json); }
+
+    /// 経緯度を実数値として取得する
+    /// 正常な値であれば true, 空欄または範囲外の場合は false を返す
+    inline bool getCoordinates(double& lat, double& lon) const {
+      if (!(this->_record->flags & GEOWORD_RECORD_HAS_COORDINATES)) return false;
+      lat = this->_record->latitude;
+      lon = this->_record->longitude;
+      return true;
+    }
+
+    // 指定した表記に一致する接頭辞、接尾辞を得る
+    bool get_parts_for_surface(const std::string& surface, std::string& prefix, std::string& suffix) const;
+
+    // JSON を解析して Geoword に変換する
+    Geoword toGeoword(void) const;
+  };
+
+  /// @brief 地名語をバイナリレコードとして格納したファイルを mmap して参照するクラス。
+  ///
+  /// DBAccessor::updateWordlists が geoword テーブルから生成する。
+  /// レコードは geonlp_id の昇順に並んでおり、二分探索で検索する。
+  ///
+  /// ファイル形式（数値はすべてネイティブバイトオーダー）
+  /// - ヘッダ: マジック "GNLPGW01"(8バイト), レコード数, 固有名クラス数, 文字列プールのバイト数, 予約（各 32 ビット）
+  /// - レコード: GeowordRecord x レコード数
+  /// - 固有名クラステーブル: 文字列プール内のオフセット x 固有名クラス数
+  /// - 文字列プール: '\0' 終端された文字列の並び
+  class GeowordStore {
+  private:
+    boost::shared_ptr<boost::interprocess::mapped_region> _region;
+    boost::uint32_t _count;
+    boost::uint32_t _class_count;
+    boost::uint32_t _pool_size;
+    const GeowordRecord* _records;
+    const boost::uint32_t* _classes;
+    const char* _pool;
+
+    // コピー禁止
+    GeowordStore(const GeowordStore&);
+    GeowordStore& operator=(const GeowordStore&);
+
+  public:
+    GeowordStore(): _count(0), _class_count(0), _pool_size(0), _records(NULL), _classes(NULL), _pool(NULL) {}
+
+    // ファイルを mmap する
+    bool load(const std::string& filename);
+
+    /// レコード数
+    inline unsigned int size(void) const { return this->_count; }
+
+    // geonlp_id で地名語を検索する
+    bool find(const std::string& geonlp_id, GeowordView& ret) const;
+
+    /// 文字列プールの文字列を得る（範囲外の場合は空文字列）
+    inline const char* get_string(boost::uint32_t offset) const {
+      return (offset < this->_pool_size) ? this->_pool + offset : "";
+    }
+
+    /// 固有名クラス ID に対応する固有名クラスを得る
+    inline const char* get_ne_class(boost::uint32_t ne_class_id) const {
+      return (ne_class_id < this->_class_count) ? this->get_string(this->_classes[ne_class_id]) : "";
+    }
+  };
+
+  typedef boost::shared_ptr<const GeowordStore> GeowordStorePtr;
+
+  /// @brief GeowordStore のファイルを生成するクラス。
+  class GeowordStoreBuilder {
+  private:
+    std::vector<GeowordRecord> _records;
+    std::string _pool;
+    std::map<std::string, boost::uint32_t> _class_ids;
+    std::vector<boost::uint32_t> _class_offsets;
+
+    // 文字列を文字列プールに追加する
+    boost::uint32_t addString(const std::string& str) throw (std::runtime_error);
+
+    // リストを文字列プールに追加する
+    boost::uint32_t addList(const std::vector<std::string>& list) throw (std::runtime_error);
+
+  public:
+    GeowordStoreBuilder() {}
+
+    // 地名語を追加する
+    void add(const Geoword& geoword, const std::string& json) throw (std::runtime_error);
+
+    // ファイルに保存する
+    void save(const std::string& filename) const throw (std::runtime_error);
+  };
+}
+
+#endif /* _GEOWORD_STORE_H */
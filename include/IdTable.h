@@ -0,0 +1,103 @@
+///
+/// @file
+/// @brief 文字列を整数 ID に変換する StringIdTable と、ID をキーとする IdHashMap の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _ID_TABLE_H
+#define _ID_TABLE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/cstdint.hpp>
+
+namespace geonlp
+{
+  /// @brief 32 ビットの ID から 32 ビットの値を引くハッシュ表。
+  ///
+  /// オープンアドレス法（線形探索）で一つの配列に格納するので、
+  /// 登録と検索でノードの割り当ては発生しない。要素の削除はできない。
+  class IdHashMap {
+  public:
+    /// 値が無いことを表す
+    static const boost::uint32_t npos = 0xffffffffU;
+
+  private:
+    // (キー, 値) の配列、値が npos のスロットは空き
+    std::vector<std::pair<boost::uint32_t, boost::uint32_t> > _slots;
+    size_t _size;
+
+    // スロット数を変更して再配置する
+    void rehash(size_t capacity);
+
+    inline size_t slotOf(boost::uint32_t key) const {
+      boost::uint32_t h = key * 0x9e3779b1U;
+      return (size_t)(h ^ (h >> 16)) & (this->_slots.size() - 1);
+    }
+
+  public:
+    IdHashMap(): _size(0) {}
+
+    /// @brief キーに対応する値を取得する
+    /// @arg @c key  キー
+    /// @return 値、登録されていない場合は npos
+    inline boost::uint32_t find(boost::uint32_t key) const {
+      if (this->_size == 0) return npos;
+      for (size_t i = this->slotOf(key); ; i = (i + 1) & (this->_slots.size() - 1)) {
+	const std::pair<boost::uint32_t, boost::uint32_t>& slot = this->_slots[i];
+	if (slot.second == npos) return npos;
+	if (slot.first == key) return slot.second;
+      }
+    }
+
+    // キーに値を登録する（登録済みなら置き換える）、値に npos は使えない
+    void insert(boost::uint32_t key, boost::uint32_t value);
+
+    /// 登録されている要素数
+    inline size_t size(void) const { return this->_size; }
+
+    // 全要素を削除する
+    void clear(void);
+  };
+
+  /// @brief 文字列に 0 から順に ID を割り当てる表。
+  ///
+  /// Context でクラス名、上位語、geonlp_id などの文字列を
+  /// 整数で比較、検索するために使う。
+  class StringIdTable {
+  private:
+    std::vector<std::string> _strings;      // ID ごとの文字列
+    std::vector<size_t> _hashes;            // ID ごとの文字列のハッシュ値
+    std::vector<boost::uint32_t> _buckets;  // ID を格納するオープンアドレス表、npos は空き
+
+    // バケット数を変更して再配置する
+    void rehash(size_t capacity);
+
+    // 文字列が格納されているか、格納すべきバケットの位置
+    size_t bucketOf(const std::string& str, size_t hash) const;
+
+  public:
+    /// ID が無いことを表す
+    static const boost::uint32_t npos = IdHashMap::npos;
+
+    // 文字列の ID を取得する、未登録の場合は新しい ID を割り当てる
+    boost::uint32_t intern(const std::string& str);
+
+    // 文字列の ID を取得する、未登録の場合は npos を返す
+    boost::uint32_t find(const std::string& str) const;
+
+    /// ID に対応する文字列
+    inline const std::string& get(boost::uint32_t id) const { return this->_strings[id]; }
+
+    /// 登録されている文字列の数
+    inline size_t size(void) const { return this->_strings.size(); }
+
+    // 全文字列を削除する
+    void clear(void);
+  };
+}
+
+#endif /* _ID_TABLE_H */
@@ -2,79 +2,106 @@
 /// @file   JsonRpcClient.h
 /// @brief  分布情報管理サーバ通信用 JSON RPC クライアントの定義
 /// @author 株式会社情報試作室
-/// 
+///
 /// Copyright (c)2014, NII
-/// 
+///
 
 #ifndef _GEONLP_JSONRPC_CLIENT_H
 #define _GEONLP_JSONRPC_CLIENT_H
 
 #include <vector>
-#include <iostream>
-#include <istream>
-#include <ostream>
+#include <map>
 #include <string>
+#include <ctime>
 #include <boost/asio.hpp>
-#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include "picojsonExt.h"
 
+// 接続の期限の既定値（ミリ秒）、名前解決を含む
+#define JSONRPC_CONNECT_TIMEOUT_DEFAULT 1000
+// リクエストの送信からレスポンスの受信完了までの期限の既定値（ミリ秒）
+#define JSONRPC_READ_TIMEOUT_DEFAULT 5000
+// 接続先ごとにプールしておく待機中の接続数の上限
+#define JSONRPC_POOL_MAX_IDLE 8
+// 連続してこの回数通信に失敗した接続先は停止中とみなす
+#define JSONRPC_BREAKER_FAILURES 3
+// 停止中とみなした接続先に再び問い合わせるまでの秒数
+#define JSONRPC_BREAKER_COOLDOWN 30
+
 using boost::asio::ip::tcp;
 namespace geonlp
 {
   // 通信時例外
   class JsonRpcClientException : public std::runtime_error {
 
-  public: 
+  public:
     JsonRpcClientException(): runtime_error("jsonrpc communication failed") {}
     JsonRpcClientException(const std::string& message): runtime_error(message.c_str()) {}
   };
 
-  // 通信インタフェース定義
-  class JsonRpcClient {
-  public:
-    std::vector<std::string> headers_; // ヘッダのリスト
-    std::string content_; // レスポンスコンテンツ
+  // 一つの持続的な HTTP/1.1 接続（実装は JsonRpcClient.cpp）
+  class JsonRpcConnection;
 
+  /// @brief 接続先 (host, port) ごとに持続的な接続をプールする JSON-RPC クライアント
+  ///
+  /// get() で接続先ごとに共有されるインスタンスを取得し、call() で POST する。
+  /// 名前解決の結果はキャッシュし、接続に失敗した場合だけ解決し直す。
+  /// JSONRPC_BREAKER_FAILURES 回続けて通信に失敗すると、JSONRPC_BREAKER_COOLDOWN 秒の間は
+  /// isAvailable() が false を返し、call() は通信せずに例外を送出する。
+  class JsonRpcClient {
   private:
-    tcp::resolver resolver_;
-    tcp::socket socket_;
-    boost::asio::streambuf request_;
-    boost::asio::streambuf response_;
+    std::string _host;
+    std::string _port;
+    boost::mutex _mutex;                   // 以下のメンバを保護する
+    std::vector<tcp::endpoint> _endpoints; // 名前解決結果のキャッシュ
+    std::vector<boost::shared_ptr<JsonRpcConnection> > _idle; // 待機中の接続
+    int _failures;                         // 連続した失敗の回数
+    time_t _open_until;                    // この時刻まで停止中とみなす
+
+    JsonRpcClient(const std::string& host, const std::string& port)
+      : _host(host), _port(port), _failures(0), _open_until(0) {}
+
+    // 待機中の接続を取り出す、無ければ空のポインタを返す
+    boost::shared_ptr<JsonRpcConnection> acquire(void);
+
+    // 接続をプールに戻す
+    void release(boost::shared_ptr<JsonRpcConnection> connection);
+
+    // 新しい接続を作成する
+    boost::shared_ptr<JsonRpcConnection> connect(long connect_timeout)
+      throw (JsonRpcClientException);
+
+    // 通信の成否をサーキットブレーカーに記録する
+    void record(bool success);
 
   public:
-    // コンストラクタ, JSON_RPC request の送信まで非同期で自動実行
-    JsonRpcClient(boost::asio::io_service& io_service,
-		  const std::string& server, const std::string& path, const std::string& message, const std::string& port = "80")
-      throw (JsonRpcClientException, picojson::PicojsonException);
-
-    // 受信したレスポンスをJSONオブジェクトとして取得
-    picojson::ext getJsonResponse(void) throw (picojson::PicojsonException);
-  
-  private:
-    // 非同期でイベントごとに実行されるメソッド群
-
-    // 名前が解決された際に呼び出される（connect に進む）
-    void handle_resolve(const boost::system::error_code& err,
-			tcp::resolver::iterator endpoint_iterator);
-    
-    // 接続された際に呼び出される（write_request に進む）
-    void handle_connect(const boost::system::error_code& err,
-			tcp::resolver::iterator endpoint_iterator);
-
-    // 送信完了時に呼び出される（read_status_line に進む）
-    void handle_write_request(const boost::system::error_code& err);
-    
-    // ステータスライン受信時に呼び出される（read_headers に進む）
-    void handle_read_status_line(const boost::system::error_code& err);
-
-    // ヘッダ受信時に呼び出される（read_content に進む）
-    void handle_read_headers(const boost::system::error_code& err);
-
-    // コンテンツ受信時に呼び出される（送受信終了）
-    void handle_read_content(const boost::system::error_code& err);
-  
+    /// @brief 接続先ごとのクライアントを取得する
+    /// @arg @c host  サーバのホスト名
+    /// @arg @c port  ポート番号またはサービス名
+    /// @return 同じ接続先に対しては同じインスタンス
+    static boost::shared_ptr<JsonRpcClient> get(const std::string& host, const std::string& port = "80");
+
+    /// @brief 接続先に問い合わせてよいかどうか
+    /// @return 停止中とみなしている間は false
+    bool isAvailable(void);
+
+    /// @brief JSON-RPC リクエストを POST し、レスポンスを受け取る
+    /// @arg @c path             接続する URL のパス
+    /// @arg @c message          ポストするメッセージ
+    /// @arg @c connect_timeout  接続の期限（ミリ秒）
+    /// @arg @c read_timeout     送信から受信完了までの期限（ミリ秒）
+    /// @return レスポンスの JSON
+    /// @exception JsonRpcClientException  通信の失敗、期限切れ、200 以外の応答、JSON でない応答
+    picojson::value call(const std::string& path, const std::string& message,
+			 long connect_timeout = JSONRPC_CONNECT_TIMEOUT_DEFAULT,
+			 long read_timeout = JSONRPC_READ_TIMEOUT_DEFAULT)
+      throw (JsonRpcClientException);
+
   }; /* class JsonRpcClient */
 
+  typedef boost::shared_ptr<JsonRpcClient> JsonRpcClientPtr;
+
 }
 
 #endif  /* _GEONLP_JSONRPC_CLIENT_H */
@@ -0,0 +1,108 @@
+///
+/// @file
+/// @brief 経緯度の点の集合 LatLonArray と、その正積グリッド LatLonGrid の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _LAT_LON_ARRAY_H
+#define _LAT_LON_ARRAY_H
+
+#include <vector>
+#include <utility>
+#include <boost/cstdint.hpp>
+#include "Util.h"
+
+namespace geonlp
+{
+  /// @brief 経緯度の点の集合を、点ごとの構造体ではなく値ごとの配列で保持するクラス。
+  ///
+  /// 一点から多数の点への距離（Util::latlonDist と同じヒュベニの公式）を
+  /// distances でまとめて計算する。点ごとの三角関数の値は追加時に求めておき、
+  /// 距離の計算は四則演算と平方根だけで行うので、SSE2 で二点ずつ計算できる。
+  /// 三角関数の加法定理を使うため、Util::latlonDist とは丸め誤差の範囲で値が異なる。
+  class LatLonArray {
+  private:
+    std::vector<double> _lat;       // 緯度（度）
+    std::vector<double> _lon;       // 経度（度）
+    std::vector<double> _x;         // 経度（ラジアン）
+    std::vector<double> _y;         // 緯度（ラジアン）
+    std::vector<double> _sin_half;  // sin(緯度 / 2)
+    std::vector<double> _cos_half;  // cos(緯度 / 2)
+    size_t _invalid;                // 緯度が範囲外の最初の点、無ければ npos
+
+  public:
+    /// 点が無いことを表す
+    static const size_t npos = (size_t)-1;
+
+    LatLonArray(): _invalid(npos) {}
+
+    // 点を追加する
+    // 緯度が範囲外の点も追加でき、distances の呼び出し時に例外になる
+    void add(double lat, double lon);
+
+    /// 点の数
+    inline size_t size(void) const { return this->_lat.size(); }
+
+    /// i 番目の点の緯度
+    inline double latitude(size_t i) const { return this->_lat[i]; }
+
+    /// i 番目の点の経度
+    inline double longitude(size_t i) const { return this->_lon[i]; }
+
+    // 全ての点を削除する
+    void clear(void);
+
+    /// @brief 一点から [begin, end) の各点への直線距離をまとめて計算する
+    /// @arg @c lat0, lon0  起点の緯度、経度
+    /// @arg @c begin, end  計算する点の範囲
+    /// @arg @c dists       結果（単位：km）を格納する、end - begin 個以上の領域
+    /// @exception UtilException  起点または集合中の点の緯度が範囲外
+    void distances(const double& lat0, const double& lon0, size_t begin, size_t end, double* dists) const throw(UtilException);
+  };
+
+  /// @brief LatLonArray の点を正積円筒図法の格子で分類し、近くの点だけを取り出すクラス。
+  ///
+  /// 行は sin(緯度) で等分するので、どのセルも面積が等しい。
+  /// 点はセルの順に並べ替えて保持するので、一つの行に含まれる経度の範囲の点は
+  /// 連続した範囲になり、そのまま LatLonArray::distances に渡せる。
+  class LatLonGrid {
+  private:
+    LatLonArray _points;  // セルの順に並べ替えた点
+    std::vector<std::pair<boost::uint32_t, boost::uint32_t> > _cells;  // 点ごとのセルの (行, 列)
+    boost::uint32_t _rows;
+    boost::uint32_t _cols;
+
+    // 点を含むセルの行と列
+    boost::uint32_t rowOf(double lat) const;
+    boost::uint32_t colOf(double lon) const;
+
+  public:
+    LatLonGrid(): _rows(0), _cols(0) {}
+
+    // 点の集合から格子を作る
+    // @arg points  点の集合
+    // @arg cell    セルの一辺の目安（単位：km）
+    void build(const LatLonArray& points, double cell);
+
+    /// 格子に含まれる点（セルの順）
+    inline const LatLonArray& points(void) const { return this->_points; }
+
+    /// 格子に含まれる点の数
+    inline size_t size(void) const { return this->_points.size(); }
+
+    // 全ての点を削除する
+    void clear(void);
+
+    // @brief 一点からの距離が radius 未満になりうる点の範囲を求める
+    // 範囲外の点は距離が radius 以上であることが保証されるが、範囲内の点の距離は
+    // LatLonArray::distances で確認する必要がある
+    // @arg lat0, lon0  起点の緯度、経度
+    // @arg radius      距離（単位：km）
+    // @arg ranges      points() の [begin, end) の範囲を追加する
+    void ranges(double lat0, double lon0, double radius, std::vector<std::pair<size_t, size_t> >& ranges) const;
+  };
+}
+
+#endif /* _LAT_LON_ARRAY_H */
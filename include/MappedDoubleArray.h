@@ -0,0 +1,50 @@
+///
+/// @file
+/// @brief darts ファイルを mmap して利用する MappedDoubleArray の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _MAPPED_DOUBLE_ARRAY_H
+#define _MAPPED_DOUBLE_ARRAY_H
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/interprocess/interprocess_fwd.hpp>
+#include "darts.h"
+
+namespace geonlp
+{
+  /// @brief darts ファイルを読み込み専用で mmap する Darts::DoubleArray。
+  ///
+  /// Darts::DoubleArray::open はファイル全体をヒープに読み込むが、
+  /// このクラスはファイルを mmap して set_array で参照するだけなので、
+  /// 起動時の読み込みが不要で、同じプロファイルを使う全プロセスで
+  /// ページキャッシュを共有できる。領域はオブジェクトの破棄時に unmap される。
+  class MappedDoubleArray : public Darts::DoubleArray {
+  private:
+    /// mmap した領域
+    boost::shared_ptr<boost::interprocess::mapped_region> _region;
+
+    // コピー禁止
+    MappedDoubleArray(const MappedDoubleArray&);
+    MappedDoubleArray& operator=(const MappedDoubleArray&);
+
+  public:
+    /// @brief コンストラクタ。
+    MappedDoubleArray() {}
+
+    // デストラクタ
+    virtual ~MappedDoubleArray();
+
+    // darts ファイルを mmap する
+    int mmap(const char* file, const std::vector<std::string>& advices = std::vector<std::string>());
+
+    // mmap した領域を解放する
+    void unmap(void);
+  };
+}
+
+#endif /* _MAPPED_DOUBLE_ARRAY_H */
@@ -10,12 +10,16 @@
 #define _MECABADAPTER_H
 
 #include <list>
+#include <vector>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <mecab.h>
 #include "Exception.h"
 
 namespace MeCab{
+	class Model;
 	class Tagger;
+	class Lattice;
 }
 
 namespace geonlp
@@ -24,6 +28,9 @@ namespace geonlp
 	class Node;
 
 	/// @brief MeCabにアクセスするためのクラス。
+	///
+	/// 辞書は一つの MeCab::Model で共有し、解析ごとに MeCab::Lattice を
+	/// プールから借りるので、複数のスレッドから同時に parse を呼び出せる。
 	class MeCabAdapter {
 
 	public:
@@ -32,7 +39,10 @@ namespace geonlp
 		
 		/// @brief コンストラクタ。
 		/// @arg @c userdic ユーザ辞書ファイル名
-		MeCabAdapter(std::string& userdic): mecabp(NULL), userdic(userdic){};
+		MeCabAdapter(std::string& userdic): modelp(NULL), mecabp(NULL), userdic(userdic){};
+
+		/// @brief デストラクタ。
+		~MeCabAdapter() { terminate(); }
 
 		// 初期化。
 		void initialize() throw(std::runtime_error);
@@ -41,8 +51,27 @@ namespace geonlp
 		void terminate();
 	
 	private:
-		/// @brief MeCabのハンドラ。
+		/// @brief 辞書を保持する MeCab のモデル（全スレッドで共有）。
+		MeCab::Model* modelp;
+
+		/// @brief MeCabのハンドラ。Lattice を渡す parse は再入可能。
 		MeCab::Tagger* mecabp;
+
+		/// @brief 未使用の Lattice。
+		std::vector<MeCab::Lattice*> lattices;
+
+		/// @brief lattices を保護するロック。
+		boost::mutex lattices_mutex;
+
+		// Lattice を借りる。
+		MeCab::Lattice* acquireLattice() throw(MeCabErrException);
+
+		// Lattice を返却する。
+		void releaseLattice(MeCab::Lattice* lattice);
+
+		// コピー禁止
+		MeCabAdapter(const MeCabAdapter&);
+		MeCabAdapter& operator=(const MeCabAdapter&);
 		
 		/// @brief ユーザ辞書名
 		std::string userdic;
@@ -23,6 +23,9 @@
 /// @brief プロファイル定義ファイルのファイル名は、プロファイル名にこの拡張子を付加したもの。
 #define PROFILE_FILE_EXT ".rc"
 
+/// @brief 地名語キャッシュの上限バイト数のデフォルト値（16MB）
+#define GEOWORD_CACHE_DEFAULT_SIZE (16 * 1024 * 1024)
+
 namespace geonlp {
 	
   class Profile {
@@ -43,6 +46,14 @@ namespace geonlp {
     boost::regex address_regex;
     std::string data_dir;
     std::string log_dir;
+    size_t geoword_cache_size;
+    bool wordlist_in_memory;
+    bool darts_mmap;
+    std::vector<std::string> darts_advice;
+    size_t batch_threads;
+    size_t parse_threads;
+    std::string weight_grid;
+    size_t candidate_limit;
 #ifdef HAVE_LIBDAMS
     std::string dams_path;
 #endif /* HAVE_LIBDAMS */
@@ -52,7 +63,7 @@ namespace geonlp {
     // デフォルトプロファイルパスを探す
     static std::string searchProfile(const std::string& basename = PACKAGE_NAME);
 		
-    Profile() {}
+    Profile(): geoword_cache_size(GEOWORD_CACHE_DEFAULT_SIZE), wordlist_in_memory(false), darts_mmap(true), batch_threads(1), parse_threads(1), candidate_limit(0) {}
     
     void load(const std::string& f) throw(std::runtime_error);
 		
@@ -115,6 +126,47 @@ namespace geonlp {
     inline const std::string& get_log_dir() const {
       return log_dir;
     }
+
+    /// @brief 地名語キャッシュの上限バイト数
+    inline size_t get_geoword_cache_size() const {
+      return geoword_cache_size;
+    }
+
+    /// @brief wordlist をメモリ上の配列として保持するかどうか
+    inline bool get_wordlist_in_memory() const {
+      return wordlist_in_memory;
+    }
+
+    /// @brief darts ファイルを mmap するかどうか
+    inline bool get_darts_mmap() const {
+      return darts_mmap;
+    }
+
+    /// @brief darts ファイルを mmap する際の madvise ヒント
+    inline const std::vector<std::string>& get_darts_advice() const {
+      return darts_advice;
+    }
+
+    /// @brief JSON-RPC のバッチリクエストを並列に処理するスレッド数（0 の場合は CPU 数）
+    inline size_t get_batch_threads() const {
+      return batch_threads;
+    }
+
+    /// @brief 複数文の形態素解析と地名語候補の検索を並列に行うスレッド数（0 の場合は CPU 数）
+    inline size_t get_parse_threads() const {
+      return parse_threads;
+    }
+
+    /// @brief 地名語候補の重みに使うグリッドファイルのパス（指定が無い場合は空文字列）
+    inline const std::string get_weight_grid_file() const {
+      if (weight_grid.empty() || weight_grid.at(0) == '/') return weight_grid;
+      return data_dir + weight_grid;
+    }
+
+    /// @brief 一つの語についてスコアを計算する地名語候補数の上限（0 の場合は制限しない）
+    inline size_t get_candidate_limit() const {
+      return candidate_limit;
+    }
 		
     inline const std::string get_sqlite3_file() const {
       return data_dir + "geodic.sq3";
@@ -127,6 +179,14 @@ namespace geonlp {
     inline const std::string get_wordlist_file() const {
       return data_dir + "wordlist.sq3";
     }
+
+    inline const std::string get_wordlist_table_file() const {
+      return data_dir + "wordlist.bin";
+    }
+
+    inline const std::string get_geoword_store_file() const {
+      return data_dir + "geoword.bin";
+    }
 		
     inline const std::string get_mecab_userdic() const {
       return data_dir + "mecabusr.dic";
@@ -58,6 +58,10 @@ namespace geonlp
     // 負の値を返した場合には制約条件を満たさない
     virtual double judge(const Geoword*);
 
+    // judge が返す重みの上限
+    // Context::evaluate でスコアの上限を求め、評価を打ち切るために使う
+    virtual double maxWeight(void) const;
+
   }; /* class SelectCondition */
 
   /*****************************************
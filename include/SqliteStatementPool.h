@@ -0,0 +1,112 @@
+///
+/// @file
+/// @brief プリペアドステートメントのプール SqliteStatementPool の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _SQLITE_STATEMENT_POOL_H
+#define _SQLITE_STATEMENT_POOL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "SqliteErrException.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace geonlp
+{
+  /// @brief プリペアドステートメントの統計情報
+  struct SqliteStatementStats {
+    unsigned long prepares;     ///< sqlite3_prepare_v2 の実行回数
+    unsigned long reuses;       ///< プールのステートメントを再利用した回数
+    unsigned long steps;        ///< sqlite3_step の実行回数
+    double prepare_usec;        ///< sqlite3_prepare_v2 の累積時間（マイクロ秒）
+    double step_usec;           ///< sqlite3_step の累積時間（マイクロ秒）
+  };
+
+  /// @brief 一つの DB 接続に対するプリペアドステートメントのプール。
+  ///
+  /// SQL 文ごとに未使用のステートメントを保持し、acquire で貸し出して
+  /// release で返却させる。貸し出し中のステートメントは他のスレッドに
+  /// 渡らないため、同じ SQL を複数のスレッドから同時に実行しても
+  /// それぞれ別のステートメントを利用する。
+  /// 通常は PooledStatement を通して利用する。
+  class SqliteStatementPool {
+  private:
+    sqlite3* _db;
+    mutable boost::mutex _mutex;
+    std::map<std::string, std::vector<sqlite3_stmt*> > _idle;
+    SqliteStatementStats _stats;
+
+    // コピー禁止
+    SqliteStatementPool(const SqliteStatementPool&);
+    SqliteStatementPool& operator=(const SqliteStatementPool&);
+
+  public:
+    // コンストラクタ
+    SqliteStatementPool(sqlite3* db);
+
+    // デストラクタ（全てのステートメントを finalize する）
+    ~SqliteStatementPool();
+
+    // ステートメントを借りる
+    sqlite3_stmt* acquire(const std::string& sql) throw (SqliteErrException);
+
+    // ステートメントを返却する
+    void release(const std::string& sql, sqlite3_stmt* stmt, unsigned long steps, double step_usec);
+
+    // 未使用のステートメントを全て finalize する
+    void clear(void);
+
+    // 統計情報を取得する
+    SqliteStatementStats getStats(void) const;
+
+    /// @brief DB 接続を返す
+    inline sqlite3* getDb(void) const { return this->_db; }
+  };
+
+  typedef boost::shared_ptr<SqliteStatementPool> SqliteStatementPoolPtr;
+
+  /// @brief SqliteStatementPool から借りたステートメント。
+  ///
+  /// コンストラクタで借り、デストラクタでリセットして返却する。
+  /// sqlite3_get_table と異なり、結果は step() で一行ずつ読み出す。
+  class PooledStatement {
+  private:
+    SqliteStatementPool& _pool;
+    std::string _sql;
+    sqlite3_stmt* _stmt;
+    unsigned long _steps;
+    double _step_usec;
+
+    // コピー禁止
+    PooledStatement(const PooledStatement&);
+    PooledStatement& operator=(const PooledStatement&);
+
+  public:
+    // コンストラクタ
+    PooledStatement(SqliteStatementPool& pool, const std::string& sql) throw (SqliteErrException);
+
+    // デストラクタ
+    ~PooledStatement();
+
+    // パラメータを設定する（index は 1 から）
+    void bind(int index, int value);
+    void bind(int index, const std::string& value);
+
+    // 次の行に進む（行があれば true、終わりなら false）
+    bool step(void) throw (SqliteErrException);
+
+    // 現在の行のカラムを取得する（index は 0 から、NULL は空文字列または 0）
+    std::string getText(int index) const;
+    int getInt(int index) const;
+  };
+}
+
+#endif /* _SQLITE_STATEMENT_POOL_H */
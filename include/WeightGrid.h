@@ -0,0 +1,105 @@
+///
+/// @file
+/// @brief 経緯度のセルごとの重みを格納したグリッドファイル WeightGrid の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _WEIGHT_GRID_H
+#define _WEIGHT_GRID_H
+
+#include <string>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/interprocess_fwd.hpp>
+
+namespace geonlp
+{
+  /// @brief グリッドファイルのヘッダ（マジックの直後に置く）。
+  struct WeightGridHeader {
+    double cell;             ///< セルの一辺の大きさ（度）
+    boost::int32_t row_min;  ///< 南端の行（緯度 lat の行は floor(lat / cell)）
+    boost::int32_t col_min;  ///< 西端の列（経度 lon の列は floor(lon / cell)）
+    boost::uint32_t rows;    ///< 緯度方向のセル数
+    boost::uint32_t cols;    ///< 経度方向のセル数
+    float default_weight;    ///< グリッドの範囲外と、値の無いセルの重み
+    boost::uint32_t reserved;
+  };
+
+  /// @brief 経緯度のセルごとの重みを格納したファイルを mmap して参照するクラス。
+  ///
+  /// 地名語候補の曖昧性解決で、人口密度などの空間的な事前分布を
+  /// dist-server に問い合わせずに重みとして利用するために使う。
+  /// ファイルは geonlp_weightgrid で (緯度, 経度, 重み) の CSV から生成する。
+  ///
+  /// ファイル形式（数値はすべてネイティブバイトオーダー）
+  /// - ヘッダ: マジック "GNLPWG02"(8バイト), WeightGridHeader
+  /// - 重み: float x rows x cols（南の行から順に、行の中は西から順に並べる）
+  class WeightGrid {
+  private:
+    boost::shared_ptr<boost::interprocess::mapped_region> _region;
+    const WeightGridHeader* _header;
+    const float* _cells;
+
+    // コピー禁止
+    WeightGrid(const WeightGrid&);
+    WeightGrid& operator=(const WeightGrid&);
+
+  public:
+    WeightGrid(): _header(NULL), _cells(NULL) {}
+
+    // ファイルを mmap する
+    bool load(const std::string& filename);
+
+    /// @brief 指定した地点の重みを得る
+    /// @arg @c lat  緯度
+    /// @arg @c lon  経度
+    /// @return 地点を含むセルの重み、グリッドの範囲外の場合は既定の重み
+    inline double get(double lat, double lon) const {
+      // WeightGridBuilder::add と同じ式でセルを求める（境界上の地点も同じセルになる）
+      double r = std::floor(lat / this->_header->cell) - this->_header->row_min;
+      double c = std::floor(lon / this->_header->cell) - this->_header->col_min;
+      if (!(r >= 0.0 && r < this->_header->rows && c >= 0.0 && c < this->_header->cols)) {
+	return this->_header->default_weight;
+      }
+      return this->_cells[(size_t)r * this->_header->cols + (size_t)c];
+    }
+  };
+
+  typedef boost::shared_ptr<const WeightGrid> WeightGridPtr;
+
+  /// @brief WeightGrid のファイルを生成するクラス。
+  ///
+  /// 同じセルに含まれる地点の重みは平均する。
+  class WeightGridBuilder {
+  private:
+    double _cell;
+    float _default_weight;
+    // セルの (行, 列) ごとの重みの合計と地点数、行と列は経緯度 0 から数える
+    std::map<std::pair<long, long>, std::pair<double, unsigned int> > _sums;
+
+  public:
+    /// @brief コンストラクタ
+    /// @arg @c cell            セルの一辺の大きさ（度）
+    /// @arg @c default_weight  グリッドの範囲外と、値の無いセルの重み
+    WeightGridBuilder(double cell, float default_weight): _cell(cell), _default_weight(default_weight) {}
+
+    // 地点の重みを追加する
+    void add(double lat, double lon, double weight);
+
+    // 最大の重みが 1.0 になるように全体を割る
+    void normalize(void);
+
+    /// 値のあるセルの数
+    inline size_t size(void) const { return this->_sums.size(); }
+
+    // ファイルに保存する
+    void save(const std::string& filename) const throw (std::runtime_error);
+  };
+}
+
+#endif /* _WEIGHT_GRID_H */
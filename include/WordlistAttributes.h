@@ -0,0 +1,92 @@
+///
+/// @file
+/// @brief 見出し語ごとの辞書・固有名クラス所属情報 WordlistAttributes の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _WORDLIST_ATTRIBUTES_H
+#define _WORDLIST_ATTRIBUTES_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <boost/shared_ptr.hpp>
+
+namespace geonlp
+{
+  /// @brief 見出し語（wordlist の各行）に含まれる地名語の辞書 ID と固有名クラスの集合。
+  ///
+  /// updateWordlists が wordlist テーブルの dictionaries, ne_classes カラムに保存した値を
+  /// 読み込んで保持する。同じ辞書・クラスの組み合わせを持つ見出し語は多いので、
+  /// 組み合わせ（シグネチャ）ごとにまとめ、見出し語 ID からシグネチャ番号を引けるようにする。
+  class WordlistAttributes {
+  private:
+    /// 見出し語 ID からシグネチャ番号へのマップ（添字が見出し語 ID）
+    std::vector<unsigned int> _signature_ids;
+
+    /// シグネチャごとの辞書 ID リスト
+    std::vector<std::vector<int> > _dictionaries;
+
+    /// シグネチャごとの固有名クラスリスト
+    std::vector<std::vector<std::string> > _ne_classes;
+
+    /// 登録済みシグネチャ（"辞書ビットマスク;クラスIDリスト"）からシグネチャ番号へのマップ
+    std::map<std::string, unsigned int> _signature_index;
+
+    /// 辞書に含まれる全ての固有名クラス（ne_class テーブルの内容）
+    std::vector<std::string> _all_ne_classes;
+
+  public:
+    /// 見出し語が登録されていないことを表すシグネチャ番号
+    static const unsigned int NO_SIGNATURE = (unsigned int)(-1);
+
+    // 辞書 ID の集合を 16 進数のビットマスク文字列に変換する
+    static std::string encodeDictionaryMask(const std::set<int>& dictionary_ids);
+
+    // 16 進数のビットマスク文字列を辞書 ID のリストに変換する
+    static void decodeDictionaryMask(const std::string& mask, std::vector<int>& dictionary_ids);
+
+    // 固有名クラス ID の集合をカンマ区切り文字列に変換する
+    static std::string encodeClassIds(const std::set<int>& ne_class_ids);
+
+    // カンマ区切り文字列を固有名クラス ID のリストに変換する
+    static void decodeClassIds(const std::string& ids, std::vector<int>& ne_class_ids);
+
+    /// @brief コンストラクタ。
+    WordlistAttributes() {}
+
+    // 辞書に含まれる全ての固有名クラスを登録する
+    void setNeClassNames(const std::map<int, std::string>& ne_class_names);
+
+    // 見出し語の属性を登録する
+    void add(unsigned int wordlist_id, const std::string& dictionary_mask, const std::string& ne_class_ids, const std::map<int, std::string>& ne_class_names);
+
+    /// @brief 登録されているシグネチャの数を返す
+    inline unsigned int getSignatureCount(void) const { return this->_dictionaries.size(); }
+
+    /// @brief 見出し語 ID に対応するシグネチャ番号を返す（未登録の場合は NO_SIGNATURE）
+    inline unsigned int getSignatureId(unsigned int wordlist_id) const {
+      if (wordlist_id >= this->_signature_ids.size()) return NO_SIGNATURE;
+      return this->_signature_ids[wordlist_id];
+    }
+
+    /// @brief シグネチャに含まれる辞書 ID リストを返す
+    inline const std::vector<int>& getDictionaries(unsigned int signature_id) const { return this->_dictionaries[signature_id]; }
+
+    /// @brief シグネチャに含まれる固有名クラスリストを返す
+    inline const std::vector<std::string>& getNeClasses(unsigned int signature_id) const { return this->_ne_classes[signature_id]; }
+
+    /// @brief 辞書に含まれる全ての固有名クラスを返す
+    inline const std::vector<std::string>& getAllNeClasses(void) const { return this->_all_ne_classes; }
+
+    /// @brief 属性が一件も登録されていないかどうか
+    inline bool empty(void) const { return this->_signature_ids.empty(); }
+  };
+
+  typedef boost::shared_ptr<const WordlistAttributes> WordlistAttributesPtr;
+}
+
+#endif /* _WORDLIST_ATTRIBUTES_H */
@@ -0,0 +1,81 @@
+///
+/// @file
+/// @brief オンメモリ見出し語テーブル WordlistTable の定義。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#ifndef _WORDLIST_TABLE_H
+#define _WORDLIST_TABLE_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/interprocess_fwd.hpp>
+#include "Wordlist.h"
+
+namespace geonlp
+{
+  /// @brief wordlist テーブルを darts の値（見出し語 ID）で引ける配列として保持するクラス。
+  ///
+  /// 文字列は一つの文字列プールにまとめ、各見出し語はプール内のオフセットだけを持つ。
+  /// DBAccessor::updateWordlists が書き出すファイルを mmap して利用するか、
+  /// wordlist テーブルから構築してメモリ上に保持する。
+  ///
+  /// ファイル形式（数値はすべてネイティブバイトオーダーの 32 ビット符号なし整数）
+  /// - ヘッダ: マジック "GNLPWL01"(8バイト), 見出し語数 n, 文字列プールのバイト数
+  /// - レコード: n 個 x (key, surface, idlist, yomi の各オフセット)
+  /// - 文字列プール: '\0' 終端された文字列の並び
+  class WordlistTable {
+  private:
+    /// 見出し語が存在しないことを表すオフセット
+    static const boost::uint32_t NO_ENTRY = 0xffffffff;
+
+    /// メモリ上に構築した場合のバッファ
+    std::vector<char> _buffer;
+
+    /// ファイルを mmap した場合の領域
+    boost::shared_ptr<boost::interprocess::mapped_region> _region;
+
+    /// 見出し語数
+    boost::uint32_t _count;
+
+    /// レコード配列の先頭
+    const boost::uint32_t* _records;
+
+    /// 文字列プールの先頭
+    const char* _pool;
+
+    /// 文字列プールのバイト数
+    boost::uint32_t _pool_size;
+
+    // ヘッダを検証してレコードと文字列プールの位置を設定する
+    bool attach(const char* data, size_t size);
+
+  public:
+    /// @brief コンストラクタ（空のテーブル）
+    WordlistTable(): _count(0), _records(NULL), _pool(NULL), _pool_size(0) {}
+
+    // Wordlist の配列からテーブルを構築する
+    void build(const std::vector<Wordlist>& wordlists) throw (std::runtime_error);
+
+    // テーブルをファイルに保存する
+    void save(const std::string& filename) const throw (std::runtime_error);
+
+    // ファイルを mmap してテーブルとして利用する
+    bool load(const std::string& filename);
+
+    /// @brief 見出し語数（最大の見出し語 ID + 1）
+    inline unsigned int size(void) const { return this->_count; }
+
+    // 見出し語 ID に対応する Wordlist を取得する
+    bool find(unsigned int id, Wordlist& ret) const;
+  };
+
+  typedef boost::shared_ptr<const WordlistTable> WordlistTablePtr;
+}
+
+#endif /* _WORDLIST_TABLE_H */
@@ -0,0 +1,256 @@
+///
+/// @file
+/// @brief アクティブな辞書・固有名クラスの判定器 ActiveFilter と、その指定を保持する ActiveSettings の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include "ActiveFilter.h"
+#include "Geoword.h"
+#include "GeonlpMA.h"
+
+namespace geonlp
+{
+  /// @brief コンストラクタ。
+  ///
+  /// 辞書 ID のビットセットを作成し、クラス指定の正規表現をコンパイルする。
+  /// @arg @c dictionaries 利用する辞書（空の場合は全辞書を利用）
+  /// @arg @c ne_classes   利用するクラスの正規表現リスト、'-' から始まる場合は除外（空の場合は全クラスを利用）
+  /// @arg @c wordlist_attributes  見出し語ごとの辞書・クラス所属情報（NULL の場合は見出し語単位の判定を行わない）
+  /// @exception boost::regex_error 正規表現が不正
+  ActiveFilter::ActiveFilter(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes, WordlistAttributesPtr wordlist_attributes):
+    _wordlist_attributes(wordlist_attributes) {
+    // 辞書
+    this->_check_dictionary = (dictionaries.size() > 0);
+    if (this->_check_dictionary) {
+      int max_id = -1;
+      for (std::map<int, Dictionary>::const_iterator it = dictionaries.begin(); it != dictionaries.end(); it++) {
+	if ((*it).first > max_id) max_id = (*it).first;
+      }
+      this->_dictionary_bits.assign(max_id + 1, false);
+      for (std::map<int, Dictionary>::const_iterator it = dictionaries.begin(); it != dictionaries.end(); it++) {
+	if ((*it).first >= 0) this->_dictionary_bits[(*it).first] = true;
+      }
+    }
+
+    // クラス
+    this->_check_class = (ne_classes.size() > 0);
+    for (std::vector<std::string>::const_iterator it = ne_classes.begin(); it != ne_classes.end(); it++) {
+      if ((*it).c_str()[0] == '-') { // 除外パターン指定
+	this->_excludes.push_back(boost::regex((*it).substr(1), boost::regex_constants::egrep));
+      } else {
+	this->_includes.push_back(boost::regex((*it), boost::regex_constants::egrep));
+      }
+    }
+
+    // 見出し語
+    this->buildClassTable();
+    this->buildSignatureBits();
+  }
+
+  /// @brief 辞書に含まれる全ての固有名クラスを判定し、結果の表を作成する
+  ///
+  /// ne_class テーブルの全クラスに加え、念のため見出し語の所属情報に現れるクラスも登録する。
+  /// 所属情報が無い（古い形式の wordlist）場合は表を作らず、毎回正規表現で判定する。
+  void ActiveFilter::buildClassTable(void) {
+    this->_class_table.clear();
+    this->_class_table_complete = false;
+    if (!this->_wordlist_attributes || !this->_check_class) return;
+
+    const std::vector<std::string>& all_classes = this->_wordlist_attributes->getAllNeClasses();
+    for (std::vector<std::string>::const_iterator it = all_classes.begin(); it != all_classes.end(); it++) {
+      if (this->_class_table.find(*it) != this->_class_table.end()) continue;
+      this->_class_table.insert(std::make_pair(*it, this->matchClass(*it)));
+    }
+    unsigned int n = this->_wordlist_attributes->getSignatureCount();
+    for (unsigned int signature_id = 0; signature_id < n; signature_id++) {
+      const std::vector<std::string>& ne_classes = this->_wordlist_attributes->getNeClasses(signature_id);
+      for (std::vector<std::string>::const_iterator it = ne_classes.begin(); it != ne_classes.end(); it++) {
+	if (this->_class_table.find(*it) != this->_class_table.end()) continue;
+	this->_class_table.insert(std::make_pair(*it, this->matchClass(*it)));
+      }
+    }
+    this->_class_table_complete = true;
+  }
+
+  /// @brief シグネチャごとにアクティブな地名語を含みうるかどうかを判定し、ビットマップを作成する
+  ///
+  /// 辞書とクラスは独立に判定するため、アクティブな辞書の地名語と
+  /// アクティブなクラスの地名語が別の語である場合も true になる（安全側の判定）。
+  void ActiveFilter::buildSignatureBits(void) {
+    this->_signature_bits.clear();
+    if (!this->_wordlist_attributes) return;
+    if (!this->_check_dictionary && !this->_check_class) return;
+
+    unsigned int n = this->_wordlist_attributes->getSignatureCount();
+    this->_signature_bits.assign(n, false);
+    for (unsigned int signature_id = 0; signature_id < n; signature_id++) {
+      bool dictionary_ok = !this->_check_dictionary;
+      const std::vector<int>& dictionaries = this->_wordlist_attributes->getDictionaries(signature_id);
+      for (std::vector<int>::const_iterator it = dictionaries.begin(); !dictionary_ok && it != dictionaries.end(); it++) {
+	if (this->acceptDictionary(*it)) dictionary_ok = true;
+      }
+      if (!dictionary_ok) continue;
+
+      bool class_ok = !this->_check_class;
+      const std::vector<std::string>& ne_classes = this->_wordlist_attributes->getNeClasses(signature_id);
+      for (std::vector<std::string>::const_iterator it = ne_classes.begin(); !class_ok && it != ne_classes.end(); it++) {
+	if (this->acceptClass(*it)) class_ok = true;
+      }
+      this->_signature_bits[signature_id] = class_ok;
+    }
+  }
+
+  /// @brief 固有名クラスを正規表現で判定する
+  /// 除外パターンに一致した場合は常に不一致とする
+  bool ActiveFilter::matchClass(const std::string& ne_class) const {
+    for (std::vector<boost::regex>::const_iterator it = this->_excludes.begin(); it != this->_excludes.end(); it++) {
+      if (boost::regex_match(ne_class, (*it))) return false;
+    }
+    for (std::vector<boost::regex>::const_iterator it = this->_includes.begin(); it != this->_includes.end(); it++) {
+      if (boost::regex_match(ne_class, (*it))) return true;
+    }
+    return false;
+  }
+
+  /// @brief 固有名クラスがアクティブかどうか判定する
+  ///
+  /// 表を作成した場合は表だけを引き、表に無いクラスは辞書に含まれない
+  /// （updateWordlists 後に追加・変更された）クラスなので非アクティブとする。
+  /// 表が無い（古い形式の wordlist）場合は正規表現で判定する。
+  bool ActiveFilter::acceptClass(const std::string& ne_class) const {
+    if (!this->_check_class) return true;
+    if (!this->_class_table_complete) return this->matchClass(ne_class);
+    boost::unordered_map<std::string, bool>::const_iterator it = this->_class_table.find(ne_class);
+    if (it != this->_class_table.end()) return (*it).second;
+    return false;
+  }
+
+  /// @brief 地名語がアクティブな辞書・クラスに含まれるかどうか判定する
+  /// @arg @c geo  地名語
+  /// @return      アクティブな辞書、クラスに含まれていれば true
+  bool ActiveFilter::accept(const Geoword& geo) const {
+    if (!this->acceptDictionary(geo.get_dictionary_id())) return false;
+    if (!this->_check_class) return true;
+    return this->acceptClass(geo.get_ne_class());
+  }
+
+  /// ActiveSettings の実装
+
+  /// @brief コンストラクタ。辞書とクラスを指定しない（全て利用する）判定器で初期化する。
+  ActiveSettings::ActiveSettings(void) {
+    this->update();
+  }
+
+  /// @brief コンストラクタ。
+  /// @arg @c dictionaries 利用する辞書の初期値
+  /// @arg @c ne_classes   利用する固有名クラスの初期値
+  /// @arg @c wordlist_attributes  見出し語ごとの辞書・クラス所属情報
+  ActiveSettings::ActiveSettings(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes, WordlistAttributesPtr wordlist_attributes):
+    _dictionaries(dictionaries), _classes(ne_classes), _wordlist_attributes(wordlist_attributes) {
+    this->update();
+  }
+
+  /// @brief コピーコンストラクタ。
+  ///
+  /// 判定器は変更しないので、コピー元と同じものを共有する。
+  ActiveSettings::ActiveSettings(const ActiveSettings& other):
+    _dictionaries(other._dictionaries), _classes(other._classes), _wordlist_attributes(other._wordlist_attributes), _filter(other.filter()) {
+  }
+
+  /// @brief 代入演算子。
+  ///
+  /// 判定器は変更しないので、代入元と同じものを共有する。
+  ActiveSettings& ActiveSettings::operator=(const ActiveSettings& other) {
+    if (this == &other) return *this;
+    this->_dictionaries = other._dictionaries;
+    this->_classes = other._classes;
+    this->_wordlist_attributes = other._wordlist_attributes;
+    ActiveFilterPtr filter = other.filter();
+    boost::mutex::scoped_lock lock(this->_filter_mutex);
+    this->_filter.swap(filter);
+    return *this;
+  }
+
+  /// @brief 利用する辞書を指定する
+  /// @arg @c dics   利用する辞書のIDリスト
+  ///                空の場合、登録されている全辞書を利用する
+  /// @arg @c ma     辞書情報を取得する MA
+  void ActiveSettings::setDictionaries(const std::vector<int>& dics, const MA& ma) {
+    this->_dictionaries.clear();
+    if (dics.size() == 0) {
+      ma.getDictionaryList(this->_dictionaries);
+      this->update();
+    } else {
+      this->addDictionaries(dics, ma); // 判定器も再構築される
+    }
+  }
+
+  /// @brief 利用する辞書を追加する
+  /// @arg @c dics 追加する辞書IDのリスト
+  /// @arg @c ma   辞書情報を取得する MA
+  void ActiveSettings::addDictionaries(const std::vector<int>& dics, const MA& ma) {
+    Dictionary dictionary;
+    for (std::vector<int>::const_iterator it = dics.begin(); it != dics.end(); it++) {
+      if (ma.findDictionaryById((*it), dictionary)) this->_dictionaries[(*it)] = dictionary;
+    }
+    this->update();
+  }
+
+  /// @brief 利用する辞書から除外する
+  /// @arg @c dics 除外する辞書IDのリスト
+  void ActiveSettings::removeDictionaries(const std::vector<int>& dics) {
+    for (std::vector<int>::const_iterator it = dics.begin(); it != dics.end(); it++) {
+      this->_dictionaries.erase((*it));
+    }
+    this->update();
+  }
+
+  /// @brief 利用する固有名クラスの正規表現を追加する
+  /// @arg @c ne_classes 追加するクラスの正規表現リスト
+  void ActiveSettings::addClasses(const std::vector<std::string>& ne_classes) {
+    for (std::vector<std::string>::const_iterator it = ne_classes.begin(); it != ne_classes.end(); it++) {
+      bool is_exist = false;
+      for (std::vector<std::string>::iterator it2 = this->_classes.begin(); it2 != this->_classes.end(); it2++) {
+	if (*it2 == *it) {
+	  is_exist = true;
+	  break;
+	}
+      }
+      if (!is_exist) this->_classes.push_back((*it));
+    }
+    this->update();
+  }
+
+  /// @brief 利用する固有名クラスの正規表現を除外する
+  /// @arg @c ne_classes 除外するクラスの正規表現リスト
+  void ActiveSettings::removeClasses(const std::vector<std::string>& ne_classes) {
+    for (std::vector<std::string>::const_iterator it = ne_classes.begin(); it != ne_classes.end(); it++) {
+      for (std::vector<std::string>::iterator it2 = this->_classes.begin(); it2 != this->_classes.end(); it2++) {
+	if (*it2 == *it) {
+	  this->_classes.erase(it2);
+	  break;
+	}
+      }
+    }
+    this->update();
+  }
+
+  /// @brief 利用する辞書と固有名クラスを与えられた値のまま設定する
+  /// 辞書が空の場合も全辞書には置き換えない
+  void ActiveSettings::assign(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes) {
+    this->_dictionaries = dictionaries;
+    this->_classes = ne_classes;
+    this->update();
+  }
+
+  // 判定器を再構築する
+  // 辞書/クラスの設定を変更した場合は必ず呼び出すこと
+  // 取得済みの判定器は変更せず、新しく構築したものに差し替える
+  void ActiveSettings::update(void) {
+    ActiveFilterPtr filter(new ActiveFilter(this->_dictionaries, this->_classes, this->_wordlist_attributes));
+    boost::mutex::scoped_lock lock(this->_filter_mutex);
+    this->_filter.swap(filter);
+  }
+
+}
@@ -8,6 +8,8 @@
 #include <config.h>
 #include <sstream>
 #include <cmath>
+#include <climits>
+#include <algorithm>
 #include "Context.h"
 //#define CONTEXT_LOG 1 // デバッグ用、コメントアウトすると /tmp/geonlp.debug にスコア計算結果を出力する
 #ifdef CONTEXT_LOG
@@ -16,8 +18,22 @@
 #include <string>
 #endif /* CONTEXT_LOG */
 #include "Util.h"
+#include <boost/bind.hpp>
 #include "JsonRpcClient.h"
 
+// score(), selectedScore() のコンテキストに依存する項の最大値の和
+// 1500 (fullsibling) + 500 (sibling) + 1500 (child) + 2000 (parent) + 200 (class) + 100 (dictionary)
+#define CONTEXT_SCORE_MAX 5800
+
+// 関心地点がこの数以上の場合は格子で近くの地点だけを取り出す
+#define CONTEXT_TOPIC_GRID_SIZE 64
+
+// 文書内で変換結果を再利用する地名語の最大数
+#define CONTEXT_CANDIDATE_MEMO_SIZE 65536
+
+// ウィンドウを使う場合、文字列の ID の表がこの大きさ以上になったら使われなくなった文字列を取り除く
+#define CONTEXT_ID_COMPACT_SIZE 65536
+
 // シグモイド関数
 // -1.0 ≦ v ≦ 1.0
 // v =  0 | x = 0
@@ -28,142 +44,367 @@ static double _sigmoid(double a, double x) {
   return v;
 }
 
+// コンテキストに依存する項のスコア、パラメータは要調整
+// 各項は地名語数について単調増加で、最大値の和は CONTEXT_SCORE_MAX になる
+static int _context_score(int nfullsibling, int nsibling, int nchild, int nparent, int nclass, int ndictionary) {
+  int score = 0;
+  score += int(1500.0 * _sigmoid(1.0, nfullsibling));
+  score += int( 500.0 * _sigmoid(1.0, nsibling));
+  score += int(1500.0 * _sigmoid(1.0, nchild));
+  score += int(2000.0 * _sigmoid(1.0, nparent));
+  score += int( 200.0 * _sigmoid(1.0, nclass));
+  score += int( 100.0 * _sigmoid(1.0, ndictionary));
+  return score;
+}
+
+// 重みを乗じたスコアの上限
+// スコアが [lower, upper]、重みが [weight_lo, weight_hi] の範囲にあるときの積の最大値
+// 優先度が負の候補はスコアも負になりうるので、負の重み（時空間条件を満たさない場合の -1.0 など）
+// を乗じると正になる。そのため両端の積をすべて比べる
+static int _weighted_bound(int lower, int upper, double weight_lo, double weight_hi) {
+  double weighted = std::max(std::max(lower * weight_lo, lower * weight_hi),
+			     std::max(upper * weight_lo, upper * weight_hi));
+  if (weighted >= (double)INT_MAX) return INT_MAX;
+  if (weighted <= (double)INT_MIN) return INT_MIN;
+  int result = (int)weighted; // 0 方向への切り捨ては単調なので上限のまま
+  if (weight_hi > 0.001 && result < 1) result = 1; // 重みが小さくてもスコアは 1 になる場合がある
+  return result;
+}
+
 namespace geonlp
 {
 
   /// ContextRelation の実装
 
-  // 地名語情報をコンテキスト関係に登録する
-  void ContextRelation::add(const std::string& key, const std::string& geonlp_id, int n, int m) {
-    if (this->_chain.count(key) > 0) {  // このキーは存在する
-      std::map<std::string, std::vector<std::pair<int, int> > >& v = this->_chain[key];
-      
-      if (v.count(geonlp_id) > 0) { // このgeonlp_idは登録済み
-	std::vector<std::pair<int, int> >& v2 = v[geonlp_id];
-	v2.push_back(std::make_pair(n, m));
-      } else { // この geonlp_id は未登録
-	std::vector<std::pair<int, int> > v2;
-	v2.push_back(std::make_pair(n, m));
-	v.insert(make_pair(geonlp_id, v2));
-      }
-    } else { // キーも未登録
-      std::map<std::string, std::vector<std::pair<int, int> > > v;
-      std::vector<std::pair<int, int> > v2;
-      v2.push_back(std::make_pair(n, m));
-      v.insert(make_pair(geonlp_id, v2));
-      this->_chain.insert(make_pair(key, v));
+  // 最初の出現箇所が position 以上である最初の FirstGroup の番号
+  size_t ContextRelation::lowerGroup(const KeyChain& chain, int position) {
+    size_t lo = 0, hi = chain.groups.size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (chain.groups[mid].position < position) {
+	lo = mid + 1;
+      } else {
+	hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  // position が最初の出現箇所である FirstGroup の番号、無ければ -1
+  int ContextRelation::findGroup(const KeyChain& chain, int position) {
+    size_t g = lowerGroup(chain, position);
+    if (g < chain.groups.size() && chain.groups[g].position == position) return (int)g;
+    return -1;
+  }
+
+  // Occurrence を FirstGroup に加える
+  void ContextRelation::addMember(KeyChain& chain, int position, boost::uint32_t o) {
+    size_t g = lowerGroup(chain, position);
+    if (g == chain.groups.size() || chain.groups[g].position != position) {
+      FirstGroup group;
+      group.position = position;
+      group.version = chain.version; // 登録後に version を増やすので未作成扱いになる
+      chain.groups.insert(chain.groups.begin() + g, group);
+    }
+    chain.groups[g].members.push_back(o);
+  }
+
+  // Occurrence を FirstGroup から取り除く
+  void ContextRelation::removeMember(KeyChain& chain, int position, boost::uint32_t o) {
+    int g = findGroup(chain, position);
+    if (g < 0) return;
+    std::vector<boost::uint32_t>& members = chain.groups[g].members;
+    members.erase(std::find(members.begin(), members.end(), o));
+    if (members.size() == 0) chain.groups.erase(chain.groups.begin() + g);
+  }
+
+  // キーチェーンの FirstGroup を作り直す
+  void ContextRelation::rebuildGroups(KeyChain& chain) {
+    std::vector<std::pair<int, boost::uint32_t> > firsts;
+    for (size_t o = 0; o < chain.occurrences.size(); o++) {
+      firsts.push_back(std::make_pair(chain.occurrences[o].positions.front(), (boost::uint32_t)o));
+    }
+    std::sort(firsts.begin(), firsts.end());
+    chain.groups.clear();
+    for (size_t i = 0; i < firsts.size(); i++) {
+      if (chain.groups.size() == 0 || chain.groups.back().position != firsts[i].first) {
+	FirstGroup group;
+	group.position = firsts[i].first;
+	group.version = chain.version;
+	chain.groups.push_back(group);
+      }
+      chain.groups.back().members.push_back(firsts[i].second);
     }
+    chain.version++;
+  }
+
+  // FirstGroup の二番目の出現箇所のキャッシュを作る
+  // Context::evaluate の間は地名語候補との関連は変更されないので、一度作れば使い回せる
+  void ContextRelation::updateSeconds(const KeyChain& chain, const FirstGroup& group) {
+    std::vector<int> seconds;
+    for (std::vector<boost::uint32_t>::const_iterator it = group.members.begin(); it != group.members.end(); it++) {
+      const std::vector<int>& positions = chain.occurrences[*it].positions;
+      if (positions.size() >= 2) seconds.push_back(positions[1]);
+    }
+    std::sort(seconds.begin(), seconds.end());
+    group.seconds.clear();
+    group.seconds_first.clear();
+    for (size_t i = 0; i < seconds.size(); i++) {
+      std::vector<std::pair<int, int> >& v = (findGroup(chain, seconds[i]) < 0) ? group.seconds : group.seconds_first;
+      if (v.size() > 0 && v.back().first == seconds[i]) {
+	v.back().second++;
+      } else {
+	v.push_back(std::make_pair(seconds[i], 1));
+      }
+    }
+    group.version = chain.version;
   }
 
   // 地名語情報をコンテキスト関係に登録する
-  void ContextRelation::add(int int_key, const std::string& geonlp_id, int n, int m) {
-    std::string key;
-    std::stringstream ss;
-    ss << int_key;
-    ss >> key;
-    this->add(key, geonlp_id, n, m);
-  }
-
-  // 地名語情報をコンテキスト関係から取得する
-  std::map<std::string, std::vector<std::pair<int, int> > >& ContextRelation::get(const std::string& key)
-    throw (ContextException) {
-    if (this->_chain.count(key) == 0) {  // このキーは存在しない
-      throw ContextException(key + "がコンテキスト関係に見つかりません。");
-    }
-    return this->_chain[key];
-  }
-  
-  // 地名語情報をコンテキスト関係から取得する
-  std::map<std::string, std::vector<std::pair<int, int> > >& ContextRelation::get(int int_key)
-    throw (ContextException) {
-    std::string key;
-    std::stringstream ss;
-    ss << int_key;
-    ss >> key;
-    return this->get(key);
-  }
-
-  // @brief 地名語数を取得する（キーが文字列の場合）
-  // @arg key キー
+  // 出現箇所は通常昇順に登録されるので、配列の末尾への追加で済む
+  void ContextRelation::add(boost::uint32_t key, boost::uint32_t geonlp_id, int n) {
+    boost::uint32_t c = this->_index.find(key);
+    if (c == IdHashMap::npos) { // キーも未登録
+      c = (boost::uint32_t)this->_chains.size();
+      this->_chains.push_back(KeyChain(key));
+      this->_index.insert(key, c);
+    }
+    KeyChain& chain = this->_chains[c];
+    boost::uint32_t o = chain.index.find(geonlp_id);
+    if (o == IdHashMap::npos) { // この geonlp_id は未登録
+      o = (boost::uint32_t)chain.occurrences.size();
+      chain.occurrences.push_back(Occurrence());
+      chain.occurrences.back().geonlp_id = geonlp_id;
+      chain.occurrences.back().positions.push_back(n);
+      chain.index.insert(geonlp_id, o);
+      addMember(chain, n, o);
+    } else if (chain.occurrences[o].positions.size() == 0) { // エクスパイア済みの geonlp_id
+      chain.occurrences[o].positions.push_back(n);
+      chain.removed--;
+      addMember(chain, n, o);
+    } else { // この geonlp_id は登録済み
+      std::vector<int>& positions = chain.occurrences[o].positions;
+      std::vector<int>::iterator it = std::lower_bound(positions.begin(), positions.end(), n);
+      if (it != positions.end() && (*it) == n) return; // 同じ位置は一度だけ数える
+      int first = positions.front();
+      positions.insert(it, n);
+      if (n < first) { // 最初の出現箇所が変わる
+	removeMember(chain, first, o);
+	addMember(chain, n, o);
+      }
+    }
+    chain.version++;
+    if (chain.emptied) {
+      chain.emptied = false;
+      this->_emptied--;
+    }
+
+    // エクスパイア用に登録順を記録する、昇順でなければ挿入する
+    std::pair<int, boost::uint32_t> added(n, c);
+    if (this->_added.size() == 0 || this->_added.back().first < n) {
+      this->_added.push_back(added);
+    } else if (this->_added.back() != added) {
+      std::deque<std::pair<int, boost::uint32_t> >::iterator it = std::lower_bound(this->_added.begin(), this->_added.end(), added);
+      if (it == this->_added.end() || (*it) != added) this->_added.insert(it, added);
+    }
+  }
+
+  // @brief 地名語数を取得する
+  // 各地名語が数えられる出現箇所は、最初の出現箇所か、それが self_pos の場合は二番目の出現箇所になる
+  // 前者の異なり数は FirstGroup の数から求まるので、self_pos を最初の出現箇所とする地名語の
+  // 二番目の出現箇所のうち、他の地名語の最初の出現箇所と一致しないものを加え、
+  // self_id の分を補正する
+  // @arg key キーの ID
   // @arg self_id   この geonlp_id を持つ地名語はカウントしない（自分自身を除く）
   // @arg self_pos  n == self_pos となる地名語はカウントしない（自分自身を除く）
   // @arg lb  カウントする n の下限（lb 以上の n を持つエントリのみカウントする）
   // @arg hb  カウントする n の上限（hb 以下の n を持つエントリのみカウントする）
-  int ContextRelation::count(const std::string& key, const std::string& self_id, int self_pos, int lb, int hb) const {
-    std::map<int, int> counter; // m 番目の単語の地名語候補が key を持つ頻度
-    counter.clear();
-
-    int c = 0;
-    std::map<std::string, std::map<std::string, std::vector<std::pair<int, int> > > >::const_iterator it = this->_chain.find(key);
-    if (it == this->_chain.end()) return 0; // このキーを持つ地名語は存在しない
-    const std::map<std::string, std::vector<std::pair<int, int> > >& v = (*it).second;
-    for (std::map<std::string, std::vector<std::pair<int, int> > >::const_iterator it2 = v.begin(); it2 != v.end(); it2++) {
-      const std::string& geonlp_id = (*it2).first;
-      const std::vector<std::pair<int, int> >& v2 = (*it2).second;
-      if (geonlp_id == self_id) continue; // 自分自身と同じ地名語はカウントしない
-      for (std::vector<std::pair<int, int> >::const_iterator it3 = v2.begin(); it3 != v2.end(); it3++) {
-	int n = (*it3).first;
-	if ((lb < 0 || n >= lb) && (hb < 0 || n <= hb) && (n != self_pos)) {
-	  // (*it2).first を geonlp_id とする地名語が
-	  // lb ≦ n ≦ hb に一回以上出現した
-	  if (counter.count(n) > 0) {
-	    counter[n] = counter[n]++;
-	  } else {
-	    counter[n] = 1;
-	  }
-	  break;
+  int ContextRelation::count(boost::uint32_t key, boost::uint32_t self_id, int self_pos, int lb, int hb) const {
+    boost::uint32_t c = this->_index.find(key);
+    if (c == IdHashMap::npos) return 0; // このキーを持つ地名語は存在しない
+    const KeyChain& chain = this->_chains[c];
+    if (lb >= 0) return this->countInRange(chain, self_id, self_pos, lb, hb);
+
+    // hb 以下の最初の出現箇所の異なり数、self_pos は除く
+    int count = (hb < 0) ? (int)chain.groups.size() : (int)lowerGroup(chain, hb) + (findGroup(chain, hb) >= 0 ? 1 : 0);
+    int g = (hb < 0 || self_pos <= hb) ? findGroup(chain, self_pos) : -1;
+    if (g >= 0) count--;
+
+    // 自分自身と同じ地名語の最初の出現箇所を除く
+    boost::uint32_t o = chain.index.find(self_id);
+    const Occurrence* self = (o == IdHashMap::npos || chain.occurrences[o].positions.size() == 0) ? NULL : &(chain.occurrences[o]);
+    if (self != NULL) {
+      int first = self->positions.front();
+      if (first != self_pos && (hb < 0 || first <= hb)
+	  && chain.groups[findGroup(chain, first)].members.size() == 1) {
+	count--;
+	if (g >= 0 && first > self_pos) {
+	  // self_pos を最初の出現箇所とする地名語の二番目の出現箇所と一致すれば数える
+	  const FirstGroup& group = chain.groups[g];
+	  if (group.version != chain.version) updateSeconds(chain, group);
+	  std::vector<std::pair<int, int> >::const_iterator it =
+	    std::lower_bound(group.seconds_first.begin(), group.seconds_first.end(), std::make_pair(first, 0));
+	  if (it != group.seconds_first.end() && (*it).first == first) count++;
 	}
       }
     }
 
-    // カウンタから出現頻度を計算
-    for (std::map<int, int>::iterator it = counter.begin(); it != counter.end(); it++) {
-      c++;
+    // self_pos を最初の出現箇所とする地名語は二番目の出現箇所で数える
+    if (g >= 0) {
+      const FirstGroup& group = chain.groups[g];
+      if (group.version != chain.version) updateSeconds(chain, group);
+      if (hb < 0) {
+	count += group.seconds.size();
+      } else {
+	count += std::upper_bound(group.seconds.begin(), group.seconds.end(), std::make_pair(hb, INT_MAX)) - group.seconds.begin();
+      }
+      if (self != NULL && self->positions.front() == self_pos && self->positions.size() >= 2) {
+	int second = self->positions[1];
+	if (hb < 0 || second <= hb) {
+	  std::vector<std::pair<int, int> >::const_iterator it =
+	    std::lower_bound(group.seconds.begin(), group.seconds.end(), std::make_pair(second, 0));
+	  if (it != group.seconds.end() && (*it).first == second && (*it).second == 1) count--;
+	}
+      }
     }
-    return c;
+    return count;
   }
 
-  // @brief 地名語数を取得する（キーが数値の場合）
-  // @arg key キー
-  // @arg self_id   この geonlp_id を持つ地名語はカウントしない（自分自身を除く）
-  // @arg self_pos  n == self_pos となる地名語はカウントしない（自分自身を除く）
-  // @arg lb  カウントする n の下限（lb 以上の n を持つエントリのみカウントする）
-  // @arg hb  カウントする n の上限（hb 以下の n を持つエントリのみカウントする）
-  int ContextRelation::count(int int_key, const std::string& self_id, int self_pos, int lb, int hb) const {
-    std::string key;
-    std::stringstream ss;
-    ss << int_key;
-    ss >> key;
-    return this->count(key, self_id, self_pos, lb, hb);
+  // 出現箇所の範囲を限定して数える
+  // 下限を指定すると最初の出現箇所が変わるので、地名語ごとに調べる
+  int ContextRelation::countInRange(const KeyChain& chain, boost::uint32_t self_id, int self_pos, int lb, int hb) const {
+    this->_work.clear();
+    for (size_t o = 0; o < chain.occurrences.size(); o++) {
+      const Occurrence& occurrence = chain.occurrences[o];
+      if (occurrence.geonlp_id == self_id) continue; // 自分自身と同じ地名語はカウントしない
+      std::vector<int>::const_iterator it = std::lower_bound(occurrence.positions.begin(), occurrence.positions.end(), lb);
+      if (it != occurrence.positions.end() && (*it) == self_pos) it++;
+      if (it == occurrence.positions.end() || (hb >= 0 && (*it) > hb)) continue;
+      this->_work.push_back(*it);
+    }
+    std::sort(this->_work.begin(), this->_work.end());
+    return std::unique(this->_work.begin(), this->_work.end()) - this->_work.begin();
   }
 
   // コンテキスト関係のキーチェーンを空にする
   void ContextRelation::clear(void) {
-    this->_chain.clear();
+    this->_index.clear();
+    this->_chains.clear();
+    this->_added.clear();
+    this->_emptied = 0;
   }
 
-  // 指定した n 以下の地名語をコンテキスト関係からエクスパイアする
+  // 指定した n 以下の出現箇所をコンテキスト関係からエクスパイアする
+  // 登録順の記録を先頭から辿り、n 以下の出現箇所を含むキーチェーンだけを処理する
   void ContextRelation::expire(int n) {
-    std::map<std::string, std::map<std::string, std::vector<std::pair<int, int> > > >::iterator it;
-    for (it = this->_chain.begin(); it != this->_chain.end(); it++) {
-      std::map<std::string, std::vector<std::pair<int, int> > >& v0 = (*it).second;
-      int len0 = v0.size();
-      for (std::map<std::string, std::vector<std::pair<int, int> > >::iterator it0 = v0.begin(); it0 != v0.end(); it0++) {
-	std::vector<std::pair<int, int> >& v = (*it0).second;
-	int len = v.size();
-	for (std::vector<std::pair<int, int> >::iterator it2 = v.begin(); it2 != v.end(); it2++) {
-	  if ((*it2).first <= n) {
-	    v.erase(it2);
-	    len--;
-	  }
-	}
-	if (len == 0) {
-	  v0.erase(it0);
-	  len0--;
+    while (this->_added.size() > 0 && this->_added.front().first <= n) {
+      KeyChain& chain = this->_chains[this->_added.front().second];
+      this->_added.pop_front();
+      if (chain.groups.size() == 0 || chain.groups.front().position > n) continue; // 処理済み
+      expireChain(chain, n);
+      if (chain.groups.size() == 0) {
+	chain.emptied = true;
+	this->_emptied++;
+      }
+    }
+    // 空になったキーチェーンが半数を超えたら詰める
+    if (this->_emptied * 2 > this->_chains.size()) this->compact();
+  }
+
+  // キーチェーンから n 以下の出現箇所を取り除く
+  // 最初の出現箇所が n 以下の地名語だけが対象になる
+  void ContextRelation::expireChain(KeyChain& chain, int n) {
+    size_t k = lowerGroup(chain, n + 1);
+    std::vector<boost::uint32_t> moved;
+    for (size_t g = 0; g < k; g++) {
+      const std::vector<boost::uint32_t>& members = chain.groups[g].members;
+      for (std::vector<boost::uint32_t>::const_iterator it = members.begin(); it != members.end(); it++) {
+	std::vector<int>& positions = chain.occurrences[*it].positions;
+	positions.erase(positions.begin(), std::upper_bound(positions.begin(), positions.end(), n));
+	if (positions.size() == 0) {
+	  chain.removed++;
+	} else {
+	  moved.push_back(*it);
 	}
       }
-      if (len0 == 0) {
-	this->_chain.erase(it);
+    }
+    chain.groups.erase(chain.groups.begin(), chain.groups.begin() + k);
+    // 残った出現箇所があれば新しい最初の出現箇所で登録し直す
+    for (std::vector<boost::uint32_t>::iterator it = moved.begin(); it != moved.end(); it++) {
+      addMember(chain, chain.occurrences[*it].positions.front(), (*it));
+    }
+    chain.version++;
+    // 出現箇所が無くなった Occurrence が半数を超えたら詰める
+    if (chain.removed * 2 > chain.occurrences.size()) compactChain(chain);
+  }
+
+  // キーチェーンから出現箇所が無くなった Occurrence を取り除く
+  void ContextRelation::compactChain(KeyChain& chain) {
+    std::vector<Occurrence> occurrences;
+    chain.index.clear();
+    for (size_t o = 0; o < chain.occurrences.size(); o++) {
+      std::vector<int>& positions = chain.occurrences[o].positions;
+      if (positions.size() == 0) continue;
+      chain.index.insert(chain.occurrences[o].geonlp_id, (boost::uint32_t)occurrences.size());
+      occurrences.push_back(Occurrence());
+      occurrences.back().geonlp_id = chain.occurrences[o].geonlp_id;
+      occurrences.back().positions.swap(positions);
+    }
+    chain.occurrences.swap(occurrences);
+    chain.removed = 0;
+    rebuildGroups(chain);
+  }
+
+  // 空になったキーチェーンを取り除く
+  // 登録順の記録のキーチェーンの番号も付け替える
+  void ContextRelation::compact(void) {
+    std::vector<boost::uint32_t> renumber(this->_chains.size(), IdHashMap::npos);
+    std::deque<KeyChain> chains;
+    this->_index.clear();
+    for (size_t c = 0; c < this->_chains.size(); c++) {
+      if (this->_chains[c].groups.size() == 0) continue;
+      renumber[c] = (boost::uint32_t)chains.size();
+      this->_index.insert(this->_chains[c].key, renumber[c]);
+      chains.push_back(this->_chains[c]);
+    }
+    this->_chains.swap(chains);
+    std::deque<std::pair<int, boost::uint32_t> > added;
+    for (std::deque<std::pair<int, boost::uint32_t> >::iterator it = this->_added.begin(); it != this->_added.end(); it++) {
+      if (renumber[(*it).second] != IdHashMap::npos) added.push_back(std::make_pair((*it).first, renumber[(*it).second]));
+    }
+    this->_added.swap(added);
+    this->_emptied = 0;
+  }
+
+  // 出現箇所が無くなった要素を取り除き、使用中の ID に印を付ける
+  void ContextRelation::markIds(std::vector<bool>& used, bool keys) {
+    for (size_t c = 0; c < this->_chains.size(); c++) {
+      if (this->_chains[c].removed > 0) compactChain(this->_chains[c]);
+    }
+    if (this->_emptied > 0) this->compact();
+    for (size_t c = 0; c < this->_chains.size(); c++) {
+      const KeyChain& chain = this->_chains[c];
+      if (keys) used[chain.key] = true;
+      for (size_t o = 0; o < chain.occurrences.size(); o++) {
+	used[chain.occurrences[o].geonlp_id] = true;
+      }
+    }
+  }
+
+  // ID を付け替える
+  // Occurrence と KeyChain の番号は変わらないので、ID から番号を引く表だけを作り直す
+  void ContextRelation::renumber(const std::vector<boost::uint32_t>& ids, bool keys) {
+    if (keys) this->_index.clear();
+    for (size_t c = 0; c < this->_chains.size(); c++) {
+      KeyChain& chain = this->_chains[c];
+      if (keys) {
+	chain.key = ids[chain.key];
+	this->_index.insert(chain.key, (boost::uint32_t)c);
+      }
+      chain.index.clear();
+      for (size_t o = 0; o < chain.occurrences.size(); o++) {
+	chain.occurrences[o].geonlp_id = ids[chain.occurrences[o].geonlp_id];
+	chain.index.insert(chain.occurrences[o].geonlp_id, (boost::uint32_t)o);
       }
     }
   }
@@ -183,6 +424,26 @@ namespace geonlp
     } else {
       this->_topic_radius = 10.0; // 関心範囲のデフォルトは 10km
     }
+    for (size_t i = 0; i + 1 < this->_topic_coords.size(); i += 2) {
+      this->_topic_points.add(this->_topic_coords[i], this->_topic_coords[i + 1]);
+    }
+    if (this->_topic_points.size() >= CONTEXT_TOPIC_GRID_SIZE) {
+      this->_topic_grid.build(this->_topic_points, this->_topic_radius);
+    }
+    this->_topic_dists.resize(this->_topic_points.size());
+
+    // context-window（Service で検証済み）
+    this->_window = 0;
+    this->_window_in_sentences = true;
+    if (!this->_options.is_null("context-window")) {
+      picojson::ext window(this->_options.get_value("context-window"));
+      if (window.has_key("sentences")) {
+	this->_window = window._get_int("sentences");
+      } else {
+	this->_window = window._get_int("nodes");
+	this->_window_in_sentences = false;
+      }
+    }
 
     // geo-contains
     if (!this->_options.is_null("geo-contains")) {
@@ -236,12 +497,19 @@ namespace geonlp
   }
 
   void Context::clear(void) {
+    this->_ids.clear();
+    this->_ids_compacted = 0;
+    this->_candidate_index.clear();
+    this->_candidate_memo.clear();
     this->_context_neclass.clear();
     this->_context_dictionary.clear();
     this->_context_hypernym.clear();
     this->_context_full_hypernym.clear();
     this->_context_name.clear();
     this->_nodes.clear();
+    this->_candidates.clear();
+    this->_base = 0;
+    this->_dist_weights.clear();
     this->_selected_neclass.clear();
     this->_selected_dictionary.clear();
     this->_selected_hypernym.clear();
@@ -249,8 +517,17 @@ namespace geonlp
     this->_selected_name.clear();
     this->_cumulative_lat = this->_cumulative_lon = .0;
     this->_cumulative_points = 0;
+    this->_centroid_sums.clear();
+    this->_retired_sum.position = -1;
+    this->_retired_sum.lat = this->_retired_sum.lon = this->_retired_sum.points = .0;
+    this->_centroid_lat = this->_centroid_lon = .0;
+    this->_centroid_points = 0;
+    this->_evaluated = this->_retired = 0;
+    this->_sentences.clear();
     this->_topic_coords.clear();
     this->_topic_radius = -1.0;
+    this->_topic_points.clear();
+    this->_topic_grid.clear();
     for (std::vector<SelectCondition*>::iterator it = this->_select_conditions.begin();
 	 it != this->_select_conditions.end(); it++) {
       delete (*it);
@@ -258,23 +535,60 @@ namespace geonlp
     this->_select_conditions.clear();
   }
 
-  // Geoword を一つコンテキスト関係に登録する
-  void Context::addGeowordToContextRelations(const Geoword& geoword, int n, int m) {
-    std::string geonlp_id = geoword.get_geonlp_id();
+  // Geoword からスコア計算用の値を作る
+  // 地名語の属性は geonlp_id で決まるので、文書内で既出の地名語は変換結果を再利用する
+  void Context::makeCandidate(const Geoword& geoword, ContextCandidate& candidate) {
+    boost::uint32_t geonlp_id = this->_ids.intern(geoword.get_geonlp_id());
+    boost::uint32_t index = this->_candidate_index.find(geonlp_id);
+    if (index != IdHashMap::npos) {
+      candidate = this->_candidate_memo[index];
+      return;
+    }
+    candidate.geonlp_id = geonlp_id;
+    candidate.ne_class = this->_ids.intern(geoword.get_ne_class());
+    candidate.dictionary_id = (boost::uint32_t)geoword.get_dictionary_id();
+    candidate.name = this->_ids.intern(geoword.get_typical_name());
     const std::vector<std::string>& hypernyms = geoword.get_hypernym();
-    this->_context_neclass.add(geoword.get_ne_class(), geonlp_id, n, m);
-    this->_context_dictionary.add(geoword.get_dictionary_id(), geonlp_id, n, m);
+    candidate.hypernyms.clear();
     for (std::vector<std::string>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
-      this->_context_hypernym.add((*it), geonlp_id, n, m);
+      candidate.hypernyms.push_back(this->_ids.intern(*it));
     }
+    candidate.full_hypernym = StringIdTable::npos;
     if (hypernyms.size() >= 2)
-      this->_context_full_hypernym.add(geoword.get_value("hypernym").serialize(), geonlp_id, n, m);
-    this->_context_name.add(geoword.get_typical_name(), geonlp_id, n, m);
+      candidate.full_hypernym = this->_ids.intern(geoword.get_value("hypernym").serialize());
+    candidate.has_coordinates = (geoword.get_latitude().length() > 0 && geoword.get_longitude().length() > 0);
+    candidate.latitude = candidate.longitude = 0.0;
+    if (candidate.has_coordinates) {
+      std::istringstream is_lat(geoword.get_latitude());
+      std::istringstream is_lon(geoword.get_longitude());
+      is_lat >> candidate.latitude;
+      is_lon >> candidate.longitude;
+    }
+    candidate.priority_score = geoword.get_priority_score();
+    // 異なり語数が多すぎる場合はメモを作り直す
+    if (this->_candidate_memo.size() >= CONTEXT_CANDIDATE_MEMO_SIZE) {
+      this->_candidate_index.clear();
+      this->_candidate_memo.clear();
+    }
+    this->_candidate_index.insert(geonlp_id, (boost::uint32_t)this->_candidate_memo.size());
+    this->_candidate_memo.push_back(candidate);
+  }
+
+  // 地名語候補を一つコンテキスト関係に登録する
+  void Context::addGeowordToContextRelations(const ContextCandidate& candidate, int n) {
+    this->_context_neclass.add(candidate.ne_class, candidate.geonlp_id, n);
+    this->_context_dictionary.add(candidate.dictionary_id, candidate.geonlp_id, n);
+    for (std::vector<boost::uint32_t>::const_iterator it = candidate.hypernyms.begin(); it != candidate.hypernyms.end(); it++) {
+      this->_context_hypernym.add((*it), candidate.geonlp_id, n);
+    }
+    if (candidate.full_hypernym != StringIdTable::npos)
+      this->_context_full_hypernym.add(candidate.full_hypernym, candidate.geonlp_id, n);
+    this->_context_name.add(candidate.name, candidate.geonlp_id, n);
   }
 
   // AddressElement を一つ空間関係に登録する
   // i.e. 重み付きで重心を取る
-  void Context::addAddressElementToSpatialRelations(const picojson::value& elem, int size) {
+  void Context::addAddressElementToSpatialRelations(const picojson::value& elem, int size, int n) {
     picojson::ext e(elem);
     int weight;
     switch (size) {
@@ -294,24 +608,17 @@ namespace geonlp
       level = e._get_int("level");
       lat   = e._get_double("latitude");
       lon   = e._get_double("longitude");
-      this->_cumulative_lat += weight * level * lat;
-      this->_cumulative_lon += weight * level * lon;
-      this->_cumulative_points += weight * level;
+      this->addToCentroid(n, lat, lon, weight * level);
     }
   }
 
   // Geoword を一つ空間関係に登録する
   // i.e. 重み付きで重心を取る
-  void Context::addGeowordsToSpatialRelations(const picojson::array& geowords) {
-    // Geoword& geoword, int size) {
+  void Context::addGeowordsToSpatialRelations(const std::vector<ContextCandidate>& candidates, int n) {
     std::vector<std::pair<float, float> > latlon;
-    for (picojson::array::const_iterator it = geowords.begin(); it != geowords.end(); it++) {
-      Geoword geoword(*it);
-      if (geoword.get_latitude().length() == 0 || geoword.get_longitude().length() == 0) continue;
-      float lat, lon;
-      std::stringstream is_lat(geoword.get_latitude()), is_lon(geoword.get_longitude());
-      is_lat >> lat;
-      is_lon >> lon;
+    for (std::vector<ContextCandidate>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+      if (!(*it).has_coordinates) continue;
+      float lat = (*it).latitude, lon = (*it).longitude;
       bool bIdentical = false;
       for (std::vector<std::pair<float, float> >::iterator it_latlon = latlon.begin(); it_latlon != latlon.end(); it_latlon++) {
 	float lat_i, lon_i, dist;
@@ -344,176 +651,402 @@ namespace geonlp
 	float lat_i, lon_i;
 	lat_i = (*it_latlon).first;
 	lon_i = (*it_latlon).second;
-	this->_cumulative_lat += weight * lat_i;
-	this->_cumulative_lon += weight * lon_i;
-	this->_cumulative_points += weight;
+	this->addToCentroid(n, lat_i, lon_i, weight);
       }
     }
   }
 
-  // Geoword の出現スコアを計算する
-  int Context::score(const Geoword& geoword, int n, int m) {
-    std::string geonlp_id = geoword.get_geonlp_id();
+  // 重心に重み付きの座標を加える
+  // ウィンドウを使う場合は、範囲から外れた時に取り除けるよう位置ごとの累積値も記録する
+  void Context::addToCentroid(int n, float lat, float lon, int weight) {
+    this->_cumulative_lat += weight * lat;
+    this->_cumulative_lon += weight * lon;
+    this->_cumulative_points += weight;
+    if (this->_window <= 0) return;
+    if (this->_centroid_sums.size() == 0 || this->_centroid_sums.back().position != n) {
+      CentroidSum sum = (this->_centroid_sums.size() > 0) ? this->_centroid_sums.back() : this->_retired_sum;
+      sum.position = n;
+      this->_centroid_sums.push_back(sum);
+    }
+    CentroidSum& sum = this->_centroid_sums.back();
+    sum.lat += (double)weight * lat;
+    sum.lon += (double)weight * lon;
+    sum.points += weight;
+  }
+
+  // 評価するノードに対する重心を求める
+  // ウィンドウを使う場合は、取り除いていない寄与のうち位置が hb 以下のものを使う
+  void Context::updateCentroid(int hb) {
+    if (this->_window <= 0) {
+      this->_centroid_points = this->getCentroid(this->_centroid_lat, this->_centroid_lon);
+      return;
+    }
+    // 位置が hb 以下の最後の累積値を二分探索する
+    size_t lo = 0, hi = this->_centroid_sums.size();
+    if (hb >= 0) {
+      while (lo < hi) {
+	size_t mid = (lo + hi) / 2;
+	if (this->_centroid_sums[mid].position <= hb) {
+	  lo = mid + 1;
+	} else {
+	  hi = mid;
+	}
+      }
+    }
+    const CentroidSum& upper = (hi > 0) ? this->_centroid_sums[hi - 1] : this->_retired_sum;
+    double points = upper.points - this->_retired_sum.points;
+    this->_centroid_points = (int)(points + 0.5);
+    if (this->_centroid_points > 0) {
+      this->_centroid_lat = (upper.lat - this->_retired_sum.lat) / points;
+      this->_centroid_lon = (upper.lon - this->_retired_sum.lon) / points;
+    }
+  }
+
+  // 地名語候補の出現スコアを計算する
+  int Context::score(const ContextCandidate& candidate, int n, int hb) {
+    boost::uint32_t geonlp_id = candidate.geonlp_id;
     // コンテキスト中に存在する親地名語数をカウント
-    const std::vector<std::string>& hypernyms = geoword.get_hypernym();
+    const std::vector<boost::uint32_t>& hypernyms = candidate.hypernyms;
     int nparent = 0;
-    for (std::vector<std::string>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
-      nparent += this->_context_name.count((*it), geonlp_id, n);
+    for (std::vector<boost::uint32_t>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
+      nparent += this->_context_name.count((*it), geonlp_id, n, -1, hb);
     }
 
     // コンテキスト中に存在する子地名語数をカウント
-    int nchild = this->_context_hypernym.count(geoword.get_typical_name(), geonlp_id, n);
+    int nchild = this->_context_hypernym.count(candidate.name, geonlp_id, n, -1, hb);
     
     // コンテキスト中に存在する同クラス地名語数をカウント
-    int nclass  = this->_context_neclass.count(geoword.get_ne_class(), geonlp_id, n);
+    int nclass  = this->_context_neclass.count(candidate.ne_class, geonlp_id, n, -1, hb);
 
     // コンテキスト中に存在する同辞書地名語数をカウント
-    int ndictionary = this->_context_dictionary.count(geoword.get_dictionary_id(), geonlp_id, n);
+    int ndictionary = this->_context_dictionary.count(candidate.dictionary_id, geonlp_id, n, -1, hb);
 
     // コンテキスト中に存在する、親地名が一つでも重複する兄弟地名語数をカウント
     int nsibling = 0;
-    for (std::vector<std::string>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
-      nsibling += this->_context_hypernym.count((*it), geonlp_id, n);
+    for (std::vector<boost::uint32_t>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
+      nsibling += this->_context_hypernym.count((*it), geonlp_id, n, -1, hb);
     }
 
     // コンテキスト中に存在する、親地名が完全に一致する兄弟地名語数をカウント
     int nfullsibling = 0;
-    if (hypernyms.size() >= 2)
-      nfullsibling = this->_context_full_hypernym.count(geoword.get_value("hypernym").serialize(), geonlp_id, n);
+    if (candidate.full_hypernym != StringIdTable::npos)
+      nfullsibling = this->_context_full_hypernym.count(candidate.full_hypernym, geonlp_id, n, -1, hb);
 
     // 重心からの距離によるスコア加算
     int spatial_bonus = 0;
-    if (geoword.get_latitude().length() > 0 && geoword.get_longitude().length() > 0) {
-      // std::cerr << "Geoword:" << geoword.toJson() << std::endl;
-      float lat, lon;
-      std::istringstream is_lat(geoword.get_latitude());
-      std::istringstream is_lon(geoword.get_longitude());
-      is_lat >> lat;
-      is_lon >> lon;
+    if (candidate.has_coordinates) {
+      float lat = candidate.latitude, lon = candidate.longitude;
 
       if (this->_topic_coords.size() < 2) { // 関心地点が指定されていない場合、全体の重心を利用する
-	float clat, clon;
-	int npoints = this->getCentroid(clat, clon);
+	float clat = this->_centroid_lat, clon = this->_centroid_lon;
 	double dist = Util::latlonDist(lat, lon, clat, clon);
 	if (dist < this->_topic_radius) {
 	  spatial_bonus = (int)(100 * (this->_topic_radius - dist) / this->_topic_radius);
 	}
       } else {
-	spatial_bonus = 0;
-	for (int i = 0; i < this->_topic_coords.size() / 2; i++) {
-	  double& clat = this->_topic_coords.at(i * 2);
-	  double& clon = this->_topic_coords.at(i * 2 + 1);
-	  double dist = Util::latlonDist(lat, lon, clat, clon);
-	  if (dist < this->_topic_radius) {
-	    spatial_bonus += (int)(100 * (this->_topic_radius - dist) / this->_topic_radius);
-	  }
-	}
+	spatial_bonus = this->topicBonus(lat, lon);
       }
     }
 
-    // スコア計算、パラメータは要調整
-    int score = 0;
-    score += int(1500.0 * _sigmoid(1.0, nfullsibling));
-    score += int( 500.0 * _sigmoid(1.0, nsibling));
-    score += int(1500.0 * _sigmoid(1.0, nchild));
-    score += int(2000.0 * _sigmoid(1.0, nparent));
-    score += int( 200.0 * _sigmoid(1.0, nclass));
-    score += int( 100.0 * _sigmoid(1.0, ndictionary));
+    // スコア計算
+    int score = _context_score(nfullsibling, nsibling, nchild, nparent, nclass, ndictionary);
     score += spatial_bonus;
-    score += geoword.get_priority_score() * 100;
+    score += candidate.priority_score * 100;
     // debug 出力
 #ifdef CONTEXT_LOG
     std::ofstream ofs("/tmp/geonlp.debug", std::ios::out | std::ios::app);
-    ofs << geoword.get_typical_name() << ", hypernym:[";
-    for (std::vector<std::string>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
-      ofs << (*it) << ",";
+    ofs << this->_ids.get(candidate.name) << ", hypernym:[";
+    for (std::vector<boost::uint32_t>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
+      ofs << this->_ids.get(*it) << ",";
     }
-    ofs << "], address:" << geoword.get_address() << ", ne_class:" << geoword.get_ne_class() << ", score:" << score << ", items(fullsibling:" << nfullsibling << ", sibling;" << nsibling << ", nchild:" << nchild << ", nparent:" << nparent << ", nclass:" << nclass << ", ndictionary:" << ndictionary << ",spatial_bonus:" << spatial_bonus << ", priority:" << geoword.get_priority_score() << ")" << std::endl;
+    ofs << "], geonlp_id:" << this->_ids.get(geonlp_id) << ", ne_class:" << this->_ids.get(candidate.ne_class) << ", score:" << score << ", items(fullsibling:" << nfullsibling << ", sibling;" << nsibling << ", nchild:" << nchild << ", nparent:" << nparent << ", nclass:" << nclass << ", ndictionary:" << ndictionary << ",spatial_bonus:" << spatial_bonus << ", priority:" << candidate.priority_score << ")" << std::endl;
     ofs.close();
 #endif /* CONTEXT_LOG */
     return score;
   }
 
-  // Geoword を一つ選択済みコンテキスト関係に登録する
-  void Context::addGeowordToSelectedRelations(const Geoword& geoword, int n, int m) {
-    std::string geonlp_id = geoword.get_geonlp_id();
-    const std::vector<std::string>& hypernyms = geoword.get_hypernym();
-    this->_selected_neclass.add(geoword.get_ne_class(), geonlp_id, n, m);
-    this->_selected_dictionary.add(geoword.get_dictionary_id(), geonlp_id, n, m);
-    for (std::vector<std::string>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
-      this->_selected_hypernym.add((*it), geonlp_id, n, m);
+  // 関心地点からの距離によるスコアの加算を求める
+  // 関心範囲内の地点ごとに、近いほど大きな値（100 未満）を加算する
+  int Context::topicBonus(double lat, double lon) {
+    int bonus = 0;
+    double* dists = &(this->_topic_dists[0]);
+    if (this->_topic_grid.size() > 0) { // 格子から関心範囲に入りうる地点だけを取り出す
+      const LatLonArray& points = this->_topic_grid.points();
+      this->_topic_ranges.clear();
+      this->_topic_grid.ranges(lat, lon, this->_topic_radius, this->_topic_ranges);
+      for (size_t k = 0; k < this->_topic_ranges.size(); k++) {
+	size_t begin = this->_topic_ranges[k].first, end = this->_topic_ranges[k].second;
+	points.distances(lat, lon, begin, end, dists);
+	for (size_t i = 0; i < end - begin; i++) {
+	  if (dists[i] < this->_topic_radius) bonus += (int)(100 * (this->_topic_radius - dists[i]) / this->_topic_radius);
+	}
+      }
+    } else {
+      this->_topic_points.distances(lat, lon, 0, this->_topic_points.size(), dists);
+      for (size_t i = 0; i < this->_topic_points.size(); i++) {
+	if (dists[i] < this->_topic_radius) bonus += (int)(100 * (this->_topic_radius - dists[i]) / this->_topic_radius);
+      }
     }
-    if (hypernyms.size() >= 2)
-      this->_selected_full_hypernym.add(geoword.get_value("hypernym").serialize(), geonlp_id, n, m);
-    this->_selected_name.add(geoword.get_typical_name(), geonlp_id, n, m);
+    return bonus;
+  }
+
+  // 地名語候補の 1 + score() + selectedScore() の、コンテキストに依存しない上限を求める
+  // 各項の sigmoid は 1.0 以下、空間的な加算は関心地点（または重心）ごとに 100 以下
+  int Context::scoreBound(const ContextCandidate& candidate) const {
+    return 1 + 2 * CONTEXT_SCORE_MAX + this->staticScore(candidate);
   }
 
-  // Geoword の選択済みコンテキストに対する出現スコアを計算する
-  int Context::selectedScore(const Geoword& geoword, int n, int m) const {
-    std::string geonlp_id = geoword.get_geonlp_id();
+  // 地名語候補の 1 + score() + selectedScore() の下限
+  int Context::scoreFloor(const ContextCandidate& candidate) const {
+    return 1 + candidate.priority_score * 200;
+  }
+
+  // コンテキストに依存しない項（優先度と空間的な加算の上限）
+  int Context::staticScore(const ContextCandidate& candidate) const {
+    int bound = candidate.priority_score * 200;
+    if (candidate.has_coordinates) {
+      bound += (this->_topic_coords.size() < 2) ? 100 : 100 * (int)(this->_topic_coords.size() / 2);
+    }
+    return bound;
+  }
+
+  // 自分自身を除かずに数えた地名語数を返す
+  // 除いた場合以上になるので score() の各地名語数の上限になる
+  // 同じ語の候補はキーが共通することが多いので、キーごとにノード単位でメモする
+  int Context::boundCount(int r, const ContextRelation& relation, boost::uint32_t key, int n, int hb) {
+    boost::uint32_t count = this->_bound_counts[r].find(key);
+    if (count == IdHashMap::npos) {
+      count = (boost::uint32_t)relation.count(key, StringIdTable::npos, n, -1, hb);
+      this->_bound_counts[r].insert(key, count);
+    }
+    return (int)count;
+  }
+
+  // 地名語候補の 1 + score() + selectedScore() の上限を地名語数から求める
+  int Context::contextBound(const ContextCandidate& candidate, int n, int hb) {
+    const std::vector<boost::uint32_t>& hypernyms = candidate.hypernyms;
+    int nparent = 0, nsibling = 0, sparent = 0, ssibling = 0;
+    for (std::vector<boost::uint32_t>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
+      nparent += this->boundCount(0, this->_context_name, (*it), n, hb);
+      nsibling += this->boundCount(1, this->_context_hypernym, (*it), n, hb);
+      sparent += this->boundCount(5, this->_selected_name, (*it), n, -1);
+      ssibling += this->boundCount(6, this->_selected_hypernym, (*it), n, -1);
+    }
+    int nfullsibling = 0, sfullsibling = 0;
+    if (candidate.full_hypernym != StringIdTable::npos) {
+      nfullsibling = this->boundCount(2, this->_context_full_hypernym, candidate.full_hypernym, n, hb);
+      sfullsibling = this->boundCount(7, this->_selected_full_hypernym, candidate.full_hypernym, n, -1);
+    }
+    int bound = 1 + this->staticScore(candidate);
+    bound += _context_score(nfullsibling, nsibling,
+			    this->boundCount(1, this->_context_hypernym, candidate.name, n, hb), nparent,
+			    this->boundCount(3, this->_context_neclass, candidate.ne_class, n, hb),
+			    this->boundCount(4, this->_context_dictionary, candidate.dictionary_id, n, hb));
+    bound += _context_score(sfullsibling, ssibling,
+			    this->boundCount(6, this->_selected_hypernym, candidate.name, n, -1), sparent,
+			    this->boundCount(8, this->_selected_neclass, candidate.ne_class, n, -1),
+			    this->boundCount(9, this->_selected_dictionary, candidate.dictionary_id, n, -1));
+    return bound;
+  }
+
+  // 地名語候補を一つ選択済みコンテキスト関係に登録する
+  void Context::addGeowordToSelectedRelations(const ContextCandidate& candidate, int n) {
+    this->_selected_neclass.add(candidate.ne_class, candidate.geonlp_id, n);
+    this->_selected_dictionary.add(candidate.dictionary_id, candidate.geonlp_id, n);
+    for (std::vector<boost::uint32_t>::const_iterator it = candidate.hypernyms.begin(); it != candidate.hypernyms.end(); it++) {
+      this->_selected_hypernym.add((*it), candidate.geonlp_id, n);
+    }
+    if (candidate.full_hypernym != StringIdTable::npos)
+      this->_selected_full_hypernym.add(candidate.full_hypernym, candidate.geonlp_id, n);
+    this->_selected_name.add(candidate.name, candidate.geonlp_id, n);
+  }
+
+  // 地名語候補の選択済みコンテキストに対する出現スコアを計算する
+  int Context::selectedScore(const ContextCandidate& candidate, int n) const {
+    boost::uint32_t geonlp_id = candidate.geonlp_id;
     // コンテキスト中に存在する親地名語数をカウント
-    const std::vector<std::string>& hypernyms = geoword.get_hypernym();
+    const std::vector<boost::uint32_t>& hypernyms = candidate.hypernyms;
     int nparent = 0;
-    for (std::vector<std::string>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
+    for (std::vector<boost::uint32_t>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
       nparent += this->_selected_name.count((*it), geonlp_id, n);
     }
 
     // コンテキスト中に存在する子地名語数をカウント
-    int nchild = this->_selected_hypernym.count(geoword.get_typical_name(), geonlp_id, n);
+    int nchild = this->_selected_hypernym.count(candidate.name, geonlp_id, n);
     
     // コンテキスト中に存在する同クラス地名語数をカウント
-    int nclass  = this->_selected_neclass.count(geoword.get_ne_class(), geonlp_id, n);
+    int nclass  = this->_selected_neclass.count(candidate.ne_class, geonlp_id, n);
 
     // コンテキスト中に存在する同辞書地名語数をカウント
-    int ndictionary = this->_selected_dictionary.count(geoword.get_dictionary_id(), geonlp_id, n);
+    int ndictionary = this->_selected_dictionary.count(candidate.dictionary_id, geonlp_id, n);
 
     // コンテキスト中に存在する、親地名が一つでも重複する兄弟地名語数をカウント
     int nsibling = 0;
-    for (std::vector<std::string>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
+    for (std::vector<boost::uint32_t>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
       nsibling += this->_selected_hypernym.count((*it), geonlp_id, n);
     }
 
     // コンテキスト中に存在する、親地名が完全に一致する兄弟地名語数をカウント
     int nfullsibling = 0;
-    if (hypernyms.size() >= 2)
-      nfullsibling = this->_selected_full_hypernym.count(geoword.get_value("hypernym").serialize(), geonlp_id, n);
+    if (candidate.full_hypernym != StringIdTable::npos)
+      nfullsibling = this->_selected_full_hypernym.count(candidate.full_hypernym, geonlp_id, n);
     
-    // スコア計算、パラメータは要調整
-    int score = 0;
-    score += int(1500.0 * _sigmoid(1.0, nfullsibling));
-    score += int( 500.0 * _sigmoid(1.0, nsibling));
-    score += int(1500.0 * _sigmoid(1.0, nchild));
-    score += int(2000.0 * _sigmoid(1.0, nparent));
-    score += int( 200.0 * _sigmoid(1.0, nclass));
-    score += int( 100.0 * _sigmoid(1.0, ndictionary));
-    score += geoword.get_priority_score() * 100;
+    // スコア計算
+    int score = _context_score(nfullsibling, nsibling, nchild, nparent, nclass, ndictionary);
+    score += candidate.priority_score * 100;
     // debug 出力
 #ifdef CONTEXT_LOG
     std::ofstream ofs("/tmp/geonlp.debug", std::ios::out | std::ios::app);
-    ofs << geoword.get_typical_name() << ", hypernym:[";
-    for (std::vector<std::string>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
-      ofs << (*it) << ",";
+    ofs << this->_ids.get(candidate.name) << ", hypernym:[";
+    for (std::vector<boost::uint32_t>::const_iterator it = hypernyms.begin(); it != hypernyms.end(); it++) {
+      ofs << this->_ids.get(*it) << ",";
     }
-    ofs << "], ne_class:" << geoword.get_ne_class() << ", score:" << score << ", items(fullsibling:" << nfullsibling << ", sibling;" << nsibling << ", nchild:" << nchild << ", nparent:" << nparent << ", nclass:" << nclass << ", ndictionary:" << ndictionary << ", priority:" << geoword.get_priority_score() << ")" << std::endl;
+    ofs << "], ne_class:" << this->_ids.get(candidate.ne_class) << ", score:" << score << ", items(fullsibling:" << nfullsibling << ", sibling;" << nsibling << ", nchild:" << nchild << ", nparent:" << nparent << ", nclass:" << nclass << ", ndictionary:" << ndictionary << ", priority:" << candidate.priority_score << ")" << std::endl;
     ofs.close();
 #endif /* CONTEXT_LOG */
     return score;
   }
 
+  // 送受信中であれば終了を待つ
+  DistServerRequest::~DistServerRequest() {
+    if (this->_thread && this->_thread->joinable()) this->_thread->join();
+  }
+
+  // 一文の解析結果に含まれる地名語候補集合を追加する
+  // 候補集合の番号は Context::addNodes が候補を持つノードを数える順と一致させる
+  size_t DistServerRequest::add(const picojson::array& nodes) throw (ContextException) {
+    size_t base = this->_coords.size();
+    for (picojson::array::const_iterator it = nodes.begin(); it != nodes.end(); it++) {
+      if (!(*it).is<picojson::object>()) continue;
+      const picojson::object& o = (*it).get<picojson::object>();
+      if (o.count("address-candidates") > 0) continue;
+      picojson::object::const_iterator it_geowords = o.find("candidates");
+      if (it_geowords == o.end()) continue;
+      // 座標列を用意
+      picojson::array coords;
+      const picojson::array& varray = (*it_geowords).second.get<picojson::array>();
+      for (picojson::array::const_iterator it2 = varray.begin(); it2 != varray.end(); it2++) {
+	Geoword geoword(*it2);
+	if (!geoword.isValid()) throw ContextException(geoword.toJson());
+	picojson::array latlon;
+	latlon.push_back(picojson::value(geoword.get_latitude()));
+	latlon.push_back(picojson::value(geoword.get_longitude()));
+	coords.push_back(picojson::value(latlon));
+      }
+      this->_coords.push_back(picojson::value(coords));
+    }
+    return base;
+  }
+
+  // 一つの候補集合に対する JSON-RPC リクエストを作成する
+  picojson::value DistServerRequest::request(size_t i) const {
+    picojson::ext json_request;
+    json_request.set_value("method", this->_server._get_string("method"));
+    json_request.set_value("id", (int)(i + 1));
+    picojson::array params;
+    params.push_back(this->_coords[i]);
+    if (!this->_server.is_null("option")) {
+      params.push_back(this->_server.get_value("option"));
+    }
+    json_request.set_value("params", picojson::value(params));
+    return json_request;
+  }
+
+  // 問い合わせを送信する
+  void DistServerRequest::send(void) {
+    this->_weights.resize(this->_coords.size());
+    if (this->_coords.size() == 0 || this->_thread) return;
+    this->_thread.reset(new boost::thread(boost::bind(&DistServerRequest::run, this)));
+  }
+
+  // 送受信スレッドの本体
+  // 例外はスレッドの外に送れないので、メッセージを記録して get() で改めて送出する
+  // dist-server と通信できない場合や停止中とみなしている場合は、重みを使わずに評価する
+  void DistServerRequest::run(void) {
+    const std::string path = this->_server._get_string("path");
+    const picojson::value batch = this->_server.get_value("batch");
+    long connect_timeout = JSONRPC_CONNECT_TIMEOUT_DEFAULT;
+    long read_timeout = JSONRPC_READ_TIMEOUT_DEFAULT;
+    if (!this->_server.is_null("connect-timeout")) connect_timeout = this->_server._get_int("connect-timeout");
+    if (!this->_server.is_null("read-timeout")) read_timeout = this->_server._get_int("read-timeout");
+    JsonRpcClientPtr client = JsonRpcClient::get(this->_server._get_string("host"), this->_server._get_string("port"));
+    if (!client->isAvailable()) return;
+    try {
+      bool each = (batch.is<bool>() && !batch.get<bool>());
+      if (!each) {
+	// 全候補集合を一つのバッチリクエストにまとめる
+	picojson::array requests;
+	for (size_t i = 0; i < this->_coords.size(); i++) {
+	  requests.push_back(this->request(i));
+	}
+	picojson::value response = client->call(path, picojson::value(requests).serialize(), connect_timeout, read_timeout);
+	if (!response.is<picojson::array>()) {
+	  // バッチに対応していないサーバは配列以外（エラーオブジェクト等）を返すので、
+	  // 候補集合ごとの問い合わせに切り替える
+	  each = true;
+	} else {
+	  // レスポンスの順序は不定なので id で対応付ける
+	  std::vector<bool> received(this->_coords.size(), false);
+	  const picojson::array& responses = response.get<picojson::array>();
+	  for (picojson::array::const_iterator it = responses.begin(); it != responses.end(); it++) {
+	    picojson::ext e(*it);
+	    int id = e._get_int("id");
+	    if (id < 1 || id > (int)this->_coords.size()) continue;
+	    this->_weights[id - 1] = e._get_double_list("result");
+	    received[id - 1] = true;
+	  }
+	  for (size_t i = 0; i < received.size(); i++) {
+	    if (!received[i]) throw ContextException("dist-server did not return all responses in the batch.");
+	  }
+	}
+      }
+      if (each) {
+	// バッチに対応していないサーバには候補集合ごとに問い合わせる
+	for (size_t i = 0; i < this->_coords.size(); i++) {
+	  picojson::ext e(client->call(path, this->request(i).serialize(), connect_timeout, read_timeout));
+	  this->_weights[i] = e._get_double_list("result");
+	}
+      }
+    } catch (JsonRpcClientException& e) {
+      // 通信の失敗は重み無しで評価する
+      this->_weights.assign(this->_coords.size(), std::vector<double>());
+    } catch (std::exception& e) {
+      this->_error = e.what();
+      if (this->_error.length() == 0) this->_error = "dist-server communication failed.";
+    }
+  }
+
+  // 候補集合の重みを取得する
+  const std::vector<double>& DistServerRequest::get(size_t i) throw (ContextException) {
+    if (this->_thread && this->_thread->joinable()) this->_thread->join();
+    if (this->_error.length() > 0) throw ContextException(this->_error);
+    if (i >= this->_weights.size()) throw ContextException("No weight is requested for the candidates.");
+    return this->_weights[i];
+  }
+
   // parseNode の結果を追加する
-  void Context::addNodes(const picojson::array& nodes) {
-    int n = this->_nodes.size();
+  void Context::addNodes(const picojson::array& nodes, DistServerRequestPtr request, size_t base) {
+    // dist-server への問い合わせを先に送信し、コンテキストへの登録と並行して待つ
+    if (!request && !this->_options.is_null("dist-server")) {
+      request.reset(new DistServerRequest(this->_options.get_value("dist-server")));
+      base = request->add(nodes);
+      request->send();
+    }
+    int n = this->_base + this->_nodes.size();
+    this->_sentences.push_back(n);
     for (picojson::array::const_iterator it = nodes.begin(); it != nodes.end(); it++) {
-      if (! (*it).is<picojson::null>()) {
-	picojson::ext e((*it));
-	if (e.has_key("address-candidates")) {
-	  picojson::array varray = e.get_value("address-candidates").get<picojson::array>();
-	  this->_addAddresses(varray, n); // 住所候補リストを登録
+      this->_candidates.push_back(std::vector<ContextCandidate>());
+      if ((*it).is<picojson::object>()) {
+	const picojson::object& o = (*it).get<picojson::object>();
+	picojson::object::const_iterator it_addresses = o.find("address-candidates");
+	picojson::object::const_iterator it_geowords = o.find("candidates");
+	if (it_addresses != o.end()) {
+	  this->_addAddresses((*it_addresses).second.get<picojson::array>(), n); // 住所候補リストを登録
 	  // Address address(e.get_value("address"));
 	  // this->_addAddress(address, n); 
-	} else if (e.has_key("candidates")) {
-	  picojson::array varray = e.get_value("candidates").get<picojson::array>();
-	  this->_addGeowords(varray, n); // 地名語候補リストを登録
+	} else if (it_geowords != o.end()) {
+	  this->_addGeowords((*it_geowords).second.get<picojson::array>(), n); // 地名語候補リストを登録
+	  if (request) this->_dist_weights[n] = std::make_pair(request, base++);
 	}
       }
       this->_nodes.push_back(*it);
@@ -527,208 +1060,374 @@ namespace geonlp
       picojson::ext e(*it);
       Address address(e.get_value("candidate"));
       picojson::array elements = address.get_address_element().get<picojson::array>();
-      int m = 0;
       for (picojson::array::iterator it_elem = elements.begin(); it_elem != elements.end(); it_elem++) {
 	picojson::ext e(*it_elem);
 	if (e.has_key("geoword")) {
 	  Geoword geoword(e.get_value("geoword"));
 	  if (!geoword.isValid()) throw ContextException(e.toJson());
-	  this->addGeowordToContextRelations(geoword, n, m);
+	  ContextCandidate candidate;
+	  this->makeCandidate(geoword, candidate);
+	  this->addGeowordToContextRelations(candidate, n);
 	}
-	m++;
       }
       // 空間的位置を登録する
       {
 	picojson::array::reverse_iterator it_elem = elements.rbegin();
-	this->addAddressElementToSpatialRelations((*it_elem), size);
+	this->addAddressElementToSpatialRelations((*it_elem), size, n);
       }
     }
   }
 
   // １つの単語表記に割り当てられた地名語候補を登録する
+  // スコア計算用の値は位置 n の _candidates に格納する
   void Context::_addGeowords(const picojson::array& varray, int n) {
-    int m = 0;
-    for (picojson::array::const_iterator it = varray.begin(); it != varray.end(); it++) {
-      Geoword geoword(*it);
-      if (!geoword.isValid()) throw ContextException(geoword.toJson());
+    std::vector<ContextCandidate>& candidates = this->_candidates[n - this->_base];
+    candidates.resize(varray.size());
+    for (size_t i = 0; i < varray.size(); i++) {
+      const Geoword* pGeoword = (const Geoword*)&(varray[i]);
+      if (!pGeoword->isValid()) throw ContextException(pGeoword->toJson());
+      this->makeCandidate(*pGeoword, candidates[i]);
       // 上位語を利用した関係を登録する
-      this->addGeowordToContextRelations(geoword, n, m);
-      m++;
+      this->addGeowordToContextRelations(candidates[i], n);
     }
     // 空間的位置を登録する
-    this->addGeowordsToSpatialRelations(varray); //geoword, size);
+    this->addGeowordsToSpatialRelations(candidates, n);
   }
 
-  // 登録済みの地名語候補のスコアを計算して評価する
-  // スコアが最高となる候補の情報で geo 要素を更新する
+  // 登録済みで未評価の地名語候補のスコアをすべて計算して評価する
   void Context::evaluate(void) {
-    int n = 0;
+    int end = this->_base + (int)this->_nodes.size();
+    while (this->_evaluated < end) {
+      this->evaluateNode(this->_evaluated);
+      this->_evaluated++;
+    }
+  }
+
+  // ウィンドウの範囲のノードがすべて登録済みになったノードまで評価する
+  void Context::evaluateWindow(void) {
+    int end = this->_base + (int)this->_nodes.size();
+    int lb, hb;
+    while (this->_evaluated < end && this->windowOf(this->_evaluated, lb, hb)) {
+      this->evaluateNode(this->_evaluated);
+      this->_evaluated++;
+    }
+  }
+
+  // 位置 n のノードを評価する時のウィンドウの範囲を求める
+  bool Context::windowOf(int n, int& lb, int& hb) const {
+    lb = 0;
+    hb = -1;
+    if (this->_window <= 0) return false;
+    int end = this->_base + (int)this->_nodes.size();
+    if (!this->_window_in_sentences) { // ノード数で数える
+      lb = std::max(0, n - this->_window);
+      if (n + this->_window >= end) return false;
+      hb = n + this->_window;
+      return true;
+    }
+    // 文数で数える、n を含む文の番号 s を二分探索する
+    size_t s = std::upper_bound(this->_sentences.begin(), this->_sentences.end(), n) - this->_sentences.begin() - 1;
+    size_t w = (size_t)this->_window;
+    lb = (s >= w) ? this->_sentences[s - w] : this->_sentences.front();
+    if (s + w + 1 < this->_sentences.size()) hb = this->_sentences[s + w + 1] - 1;
+    return s + w < this->_sentences.size();
+  }
+
+  // 位置が lb より前のノードをコンテキスト関係と重心から取り除く
+  void Context::retire(int lb) {
+    if (lb <= this->_retired) return;
+    this->_retired = lb;
+    this->_context_neclass.expire(lb - 1);
+    this->_context_dictionary.expire(lb - 1);
+    this->_context_hypernym.expire(lb - 1);
+    this->_context_full_hypernym.expire(lb - 1);
+    this->_context_name.expire(lb - 1);
+    this->_selected_neclass.expire(lb - 1);
+    this->_selected_dictionary.expire(lb - 1);
+    this->_selected_hypernym.expire(lb - 1);
+    this->_selected_full_hypernym.expire(lb - 1);
+    this->_selected_name.expire(lb - 1);
+    while (this->_centroid_sums.size() > 0 && this->_centroid_sums.front().position < lb) {
+      this->_retired_sum = this->_centroid_sums.front();
+      this->_centroid_sums.pop_front();
+    }
+    while (this->_sentences.size() >= 2 && this->_sentences[1] <= lb) this->_sentences.pop_front();
+    // ウィンドウから外れた地名語の文字列が溜まらないよう、表が倍になるたびに取り除く
+    if (this->_ids.size() >= CONTEXT_ID_COMPACT_SIZE && this->_ids.size() > 2 * this->_ids_compacted) this->compactIds();
+  }
+
+  // 地名語候補が使っている文字列の ID に印を付ける
+  static void _mark_candidate_ids(const ContextCandidate& candidate, std::vector<bool>& used) {
+    used[candidate.geonlp_id] = used[candidate.ne_class] = used[candidate.name] = true;
+    if (candidate.full_hypernym != StringIdTable::npos) used[candidate.full_hypernym] = true;
+    for (std::vector<boost::uint32_t>::const_iterator it = candidate.hypernyms.begin(); it != candidate.hypernyms.end(); it++) {
+      used[*it] = true;
+    }
+  }
+
+  // 地名語候補の文字列の ID を付け替える
+  static void _renumber_candidate_ids(ContextCandidate& candidate, const std::vector<boost::uint32_t>& ids) {
+    candidate.geonlp_id = ids[candidate.geonlp_id];
+    candidate.ne_class = ids[candidate.ne_class];
+    candidate.name = ids[candidate.name];
+    if (candidate.full_hypernym != StringIdTable::npos) candidate.full_hypernym = ids[candidate.full_hypernym];
+    for (std::vector<boost::uint32_t>::iterator it = candidate.hypernyms.begin(); it != candidate.hypernyms.end(); it++) {
+      (*it) = ids[*it];
+    }
+  }
+
+  // コンテキスト関係と未評価の地名語候補が使っていない文字列を _ids から取り除く
+  // 地名語候補の変換結果のメモは作り直す
+  void Context::compactIds(void) {
+    ContextRelation* relations[] = {
+      &this->_context_neclass, &this->_context_dictionary, &this->_context_hypernym,
+      &this->_context_full_hypernym, &this->_context_name,
+      &this->_selected_neclass, &this->_selected_dictionary, &this->_selected_hypernym,
+      &this->_selected_full_hypernym, &this->_selected_name };
+    const size_t nrelations = sizeof(relations) / sizeof(relations[0]);
+
+    // dictionary_id は StringIdTable の ID ではないので、キーは付け替えない
+    std::vector<bool> used(this->_ids.size(), false);
+    for (size_t r = 0; r < nrelations; r++) {
+      relations[r]->markIds(used, relations[r] != &this->_context_dictionary && relations[r] != &this->_selected_dictionary);
+    }
+    for (std::deque<std::vector<ContextCandidate> >::const_iterator it = this->_candidates.begin(); it != this->_candidates.end(); it++) {
+      for (std::vector<ContextCandidate>::const_iterator it2 = (*it).begin(); it2 != (*it).end(); it2++) {
+	_mark_candidate_ids(*it2, used);
+      }
+    }
+
+    // 使用中の文字列を元の順に登録し直す
+    StringIdTable compacted;
+    std::vector<boost::uint32_t> ids(this->_ids.size(), StringIdTable::npos);
+    for (size_t i = 0; i < used.size(); i++) {
+      if (used[i]) ids[i] = compacted.intern(this->_ids.get((boost::uint32_t)i));
+    }
+    for (size_t r = 0; r < nrelations; r++) {
+      relations[r]->renumber(ids, relations[r] != &this->_context_dictionary && relations[r] != &this->_selected_dictionary);
+    }
+    for (std::deque<std::vector<ContextCandidate> >::iterator it = this->_candidates.begin(); it != this->_candidates.end(); it++) {
+      for (std::vector<ContextCandidate>::iterator it2 = (*it).begin(); it2 != (*it).end(); it2++) {
+	_renumber_candidate_ids(*it2, ids);
+      }
+    }
+    this->_candidate_index.clear();
+    this->_candidate_memo.clear();
+    this->_ids = compacted;
+    this->_ids_compacted = this->_ids.size();
+  }
+
+  // 位置 n のノードの地名語候補のスコアを計算して評価する
+  // スコアが最高となる候補の情報で geo 要素を更新する
+  void Context::evaluateNode(int n) {
+    int lb, hb;
+    this->windowOf(n, lb, hb);
+    this->retire(lb);
+    picojson::value& node = this->_nodes[n - this->_base];
+    if (node.is<picojson::null>()) return;
     std::string prefix, suffix, surface;
-    for (picojson::array::iterator it = this->_nodes.begin(); it != this->_nodes.end(); it++) {
-      if ((*it).is<picojson::null>()) {
-	n++;
-	continue;
-      }
-      picojson::object& o = (*it).get<picojson::object>();
-      surface = (*(o.find("surface"))).second.to_str();
-
-      // 候補一覧に対してスコアを計算
-      picojson::object::iterator it_geowords = o.find("candidates");
-      if (it_geowords != o.end()) {
-	int m = 0;
-	int hiscore = -1, selected_hiscore = -1;
-	Geoword bestGeoword;
-	picojson::value& v_geowords = (*it_geowords).second;
-	picojson::array& varray = v_geowords.get<picojson::array>();
-	std::vector<double> weights; // スコアに乗じるファクター
-	for (int i = 0; i < varray.size(); i++) weights.push_back(1.0); // 1.0 で初期化
-
-	// dist-server が指定されていれば分布情報保持サーバと通信して重みを取得
-	// note: host, path, port, method, がパラメータとして必ず含まれる
-	//       option は含まれていない可能性がある
-	if (!this->_options.is_null("dist-server")) {
-	  picojson::ext e;
-	  picojson::ext op(this->_options.get_value("dist-server"));
-	  // リクエストの構築
-	  std::string req;
-	  {
-	    picojson::ext json_request;
-	    json_request.set_value("method", op._get_string("method"));
-	    json_request.set_value("id", rand() % 10000 + 1);
-	    // 座標列を用意
-	    picojson::array coords;
-	    for (picojson::array::iterator it2 = varray.begin(); it2 != varray.end(); it2++) {
-	      Geoword geoword(*it2);
-	      if (!geoword.isValid()) throw ContextException(geoword.toJson());
-	      picojson::array latlon;
-	      latlon.push_back(picojson::value(geoword.get_latitude()));
-	      latlon.push_back(picojson::value(geoword.get_longitude()));
-	      coords.push_back(picojson::value(latlon));
-	    }
-	    // params を用意
-	    picojson::array params;
-	    params.push_back(picojson::value(coords));
-	    if (!op.is_null("option")) {
-	      params.push_back(op.get_value("option"));
-	    }
-	    json_request.set_value("params", picojson::value(params));
-	    req = json_request.toJson();
-	    // std::cout << "JSON_REQUEST: '" << req << "'" << std::endl;
-	  }
-	  // JSON_RPC を利用して結果を取得
-	  boost::asio::io_service io_service;
-	  geonlp::JsonRpcClient c(io_service, op._get_string("host"), op._get_string("path"), req, op._get_string("port"));
-	  io_service.run();
-	  e = c.getJsonResponse();
-	  weights = e._get_double_list("result");
-	  // std::cout << "JSON_RESPONSE: '" << e.toJson() << "'" << std::endl;
+    // 候補ごとのスコアは候補一覧を出力する場合のみ書き込む
+    bool show_candidate = this->_options.has_key("show-candidate") && this->_options.get_value("show-candidate");
+    picojson::object& o = node.get<picojson::object>();
+    surface = (*(o.find("surface"))).second.to_str();
+
+    // 候補一覧に対してスコアを計算
+    picojson::object::iterator it_geowords = o.find("candidates");
+    if (it_geowords != o.end()) {
+      int hiscore = -1, best = -1;
+      picojson::value& v_geowords = (*it_geowords).second;
+      picojson::array& varray = v_geowords.get<picojson::array>();
+      std::vector<ContextCandidate>& candidates = this->_candidates[n - this->_base];
+      if (candidates.size() != varray.size()) { // 住所候補と共に登録されたノード
+	candidates.resize(varray.size());
+	for (size_t i = 0; i < varray.size(); i++) {
+	  const Geoword* pGeoword = (const Geoword*)&(varray[i]);
+	  if (!pGeoword->isValid()) throw ContextException(pGeoword->toJson());
+	  this->makeCandidate(*pGeoword, candidates[i]);
 	}
+      }
+      std::vector<double> weights(varray.size(), 1.0); // スコアに乗じるファクター、1.0 で初期化
 
-	// 時空間条件を適用
-	for (int i = 0; i < weights.size(); i++) {
+      // 重みのグリッドがあれば候補の位置のセルの重みを使う
+      if (this->_weight_grid && this->_options._get_bool("weight-grid")) {
+	double lat, lon;
+	for (int i = 0; i < varray.size(); i++) {
 	  Geoword* pGeoword = (Geoword*)&(varray[i]);
-	  if (!pGeoword->isValid()) throw ContextException(pGeoword->toJson());
-	  // 登録されている全検索条件を用いて判定
-	  for (std::vector<SelectCondition*>::iterator it_condition = this->_select_conditions.begin();
-	       it_condition != this->_select_conditions.end();
-	       it_condition++) {
-	    if (weights[i] < 0.0) break; // 既に検索対象外なら以降の判定はスキップ
-	    SelectCondition* condition = (*it_condition);
-	    double result = condition->judge(pGeoword);
-	    if (result < 0.0) {
-	      weights[i] = -1.0;
-	    } else {
-	      weights[i] *= result;
-	    }
-	  }
+	  if (pGeoword->getCoordinates(lat, lon)) weights[i] = this->_weight_grid->get(lat, lon);
 	}
+      }
 
-	// 個々の地名語のスコアを取得
-	int idx = 0;
-	for (picojson::array::iterator it2 = varray.begin(); it2 != varray.end(); it2++) {
-	  Geoword geoword(*it2);
-	  if (!geoword.isValid()) throw ContextException(geoword.toJson());
-	  int score = 1 + this->score(geoword, n, m) + this->selectedScore(geoword, n, m); // 最低でも 1
-	  if (weights.size() > 0) {
-	    score *= weights[idx];
-	    if (weights[idx] > 0.001 && score == 0) score = 1;
-	    idx++;
-	  }
-	  if (score > hiscore) {
-	    hiscore = score;
-	    bestGeoword = geoword;
+      // dist-server に問い合わせていれば重みを取得（受信が終わっていなければ待つ）
+      std::map<int, std::pair<DistServerRequestPtr, size_t> >::iterator it_dist = this->_dist_weights.find(n);
+      if (it_dist != this->_dist_weights.end()) {
+	const std::vector<double>& dist_weights = (*it_dist).second.first->get((*it_dist).second.second);
+	if (dist_weights.size() > 0) { // 取得できなければ 1.0 のまま
+	  weights = dist_weights;
+	  weights.resize(varray.size(), 1.0);
+	}
+      }
+
+      // 時空間条件で乗じる重みの上限
+      std::vector<double> condition_max;
+      for (std::vector<SelectCondition*>::iterator it_condition = this->_select_conditions.begin();
+	   it_condition != this->_select_conditions.end();
+	   it_condition++) {
+	condition_max.push_back((*it_condition)->maxWeight());
+      }
+      // 時空間条件を適用した後の重みの範囲
+      // 候補の重みが負なら判定は行わない。それ以外は judge の結果を乗じた値か、
+      // いずれかの条件を満たさない場合の -1.0 になる
+      std::vector<double> weight_lo(weights), weight_hi(weights);
+      for (size_t i = 0; i < weights.size(); i++) {
+	if (weights[i] < 0.0 || condition_max.size() == 0) continue;
+	weight_lo[i] = -1.0;
+	for (size_t j = 0; j < condition_max.size(); j++) weight_hi[i] *= std::max(condition_max[j], 0.0);
+      }
+
+      // 優先度から求めたスコアの上限が高い順（同じなら候補の順）に評価する
+      std::vector<std::pair<int, int> > order; // (-上限, 候補の番号)
+      for (size_t i = 0; i < candidates.size(); i++) {
+	int bound = _weighted_bound(this->scoreFloor(candidates[i]), this->scoreBound(candidates[i]), weight_lo[i], weight_hi[i]);
+	order.push_back(std::make_pair(-bound, (int)i));
+      }
+      std::sort(order.begin(), order.end());
+      // 候補数の上限を超える分は評価しない
+      size_t limit = order.size();
+      if (this->_candidate_limit > 0 && this->_candidate_limit < limit) limit = this->_candidate_limit;
+
+      // 個々の地名語のスコアを取得
+      // 候補一覧を出力しない場合、上限が最高スコアに届かない候補は評価しない
+      // 同点の場合は番号の小さい候補を選ぶので、結果は全候補を評価した場合と変わらない
+      this->updateCentroid(hb);
+      for (int r = 0; r < 10; r++) this->_bound_counts[r].clear();
+      std::vector<std::pair<int, int> > scores; // (候補の番号, スコア)
+      for (size_t k = 0; k < limit; k++) {
+	int bound = -order[k].first, i = order[k].second;
+	if (!show_candidate && best >= 0) {
+	  // 以降の候補も上限が届かないので打ち切る
+	  if (bound < hiscore || (bound == hiscore && i > best)) break;
+	  // 地名語数から求めた上限が届かなければ、距離の計算と時空間条件の判定を省く
+	  bound = _weighted_bound(this->scoreFloor(candidates[i]), this->contextBound(candidates[i], n, hb), weight_lo[i], weight_hi[i]);
+	  if (bound < hiscore || (bound == hiscore && i > best)) continue;
+	}
+	// 時空間条件を適用
+	double weight = weights[i];
+	Geoword* pGeoword = (Geoword*)&(varray[i]);
+	// 登録されている全検索条件を用いて判定
+	for (std::vector<SelectCondition*>::iterator it_condition = this->_select_conditions.begin();
+	     it_condition != this->_select_conditions.end();
+	     it_condition++) {
+	  if (weight < 0.0) break; // 既に検索対象外なら以降の判定はスキップ
+	  SelectCondition* condition = (*it_condition);
+	  double result = condition->judge(pGeoword);
+	  if (result < 0.0) {
+	    weight = -1.0;
+	  } else {
+	    weight *= result;
 	  }
-	  (*it2).get<picojson::object>().insert(std::make_pair("score", picojson::value((long)score)));
-	  m++;
 	}
-	// 接頭辞・接尾辞が含まれているかチェック
-	if (bestGeoword.get_parts_for_surface(surface, prefix, suffix)) {
-	  if (prefix.length() > 0) o.insert(std::make_pair("with_prefix", (picojson::value)prefix));
-	  if (suffix.length() > 0) o.insert(std::make_pair("with_suffix", (picojson::value)suffix));
+	int score = 1 + this->score(candidates[i], n, hb) + this->selectedScore(candidates[i], n); // 最低でも 1
+	score *= weight;
+	if (weight > 0.001 && score == 0) score = 1;
+	if (score > hiscore || (score == hiscore && i < best)) {
+	  hiscore = score;
+	  best = i;
 	}
-	// geo 要素を更新
-	picojson::object::iterator it_geo = o.find("geo");
-	if (it_geo != o.end()) o.erase(it_geo);
-	o.insert(std::make_pair("geo", (picojson::value)bestGeoword.getGeoObject()));
-	o.insert(std::make_pair("score", (picojson::value)((double)hiscore)));
-	// 選択済みコンテキストに追加
-	this->addGeowordToSelectedRelations(bestGeoword, n, 0);
+	if (show_candidate) scores.push_back(std::make_pair(i, score));
+      }
+      // 選択された候補だけ Geoword にする
+      Geoword bestGeoword;
+      if (best >= 0) bestGeoword = Geoword(varray[best]);
+      for (size_t k = 0; k < scores.size(); k++) {
+	varray[scores[k].first].get<picojson::object>().insert(std::make_pair("score", picojson::value((long)scores[k].second)));
+      }
+      // 接頭辞・接尾辞が含まれているかチェック
+      if (bestGeoword.get_parts_for_surface(surface, prefix, suffix)) {
+	if (prefix.length() > 0) o.insert(std::make_pair("with_prefix", (picojson::value)prefix));
+	if (suffix.length() > 0) o.insert(std::make_pair("with_suffix", (picojson::value)suffix));
+      }
+      // geo 要素を更新
+      picojson::object::iterator it_geo = o.find("geo");
+      if (it_geo != o.end()) o.erase(it_geo);
+      o.insert(std::make_pair("geo", (picojson::value)bestGeoword.getGeoObject()));
+      o.insert(std::make_pair("score", (picojson::value)((double)hiscore)));
+      // 選択済みコンテキストに追加
+      if (best >= 0) {
+	this->addGeowordToSelectedRelations(candidates[best], n);
       } else {
-	picojson::object::iterator it_addresses = o.find("address-candidates");
-	if (it_addresses != o.end()) {
-	  float clat, clon;
-	  this->getCentroid(clat, clon);
-	  float min_dist = -1;
-	  Address best_address;
-	  picojson::array& varray = (*it_addresses).second.get<picojson::array>();
-	  for (picojson::array::iterator it2 = varray.begin(); it2 != varray.end(); it2++) {
-	    picojson::ext e(*it2);
-	    Address address(e.get_value("candidate"));
-	    if (!address.isValid()) throw ContextException(address.toJson());
-	    float lat = address.get_latitude();
-	    float lon = address.get_longitude();
-	    float square_dist = (clat - lat) * (clat - lat) + (clon - lon) * (clon - lon);
-	    if (min_dist < 0 || square_dist < min_dist) {
-	      min_dist = square_dist;
-	      best_address = address;
-	    }
-#ifdef CONTEXT_LOG
-	    std::ofstream ofs("/tmp/geonlp.debug", std::ios::out | std::ios::app);
-	    ofs << address.get_standard_form() << "(" << lat << ", " << lon << ": dist= " << square_dist << ")" << std::endl;
-	    ofs.close();
-#endif /* CONTEXT_LOG */
+	ContextCandidate candidate;
+	this->makeCandidate(bestGeoword, candidate);
+	this->addGeowordToSelectedRelations(candidate, n);
+      }
+    } else {
+      picojson::object::iterator it_addresses = o.find("address-candidates");
+      if (it_addresses != o.end()) {
+	this->updateCentroid(hb);
+	float clat = this->_centroid_lat, clon = this->_centroid_lon;
+	float min_dist = -1;
+	Address best_address;
+	picojson::array& varray = (*it_addresses).second.get<picojson::array>();
+	for (picojson::array::iterator it2 = varray.begin(); it2 != varray.end(); it2++) {
+	  picojson::ext e(*it2);
+	  Address address(e.get_value("candidate"));
+	  if (!address.isValid()) throw ContextException(address.toJson());
+	  float lat = address.get_latitude();
+	  float lon = address.get_longitude();
+	  float square_dist = (clat - lat) * (clat - lat) + (clon - lon) * (clon - lon);
+	  if (min_dist < 0 || square_dist < min_dist) {
+	    min_dist = square_dist;
+	    best_address = address;
 	  }
 #ifdef CONTEXT_LOG
 	  std::ofstream ofs("/tmp/geonlp.debug", std::ios::out | std::ios::app);
-	  ofs << "selected: " << best_address.get_standard_form() << "(" << clat << ", " << clon << ": dist= " << min_dist << ")" << std::endl;
+	  ofs << address.get_standard_form() << "(" << lat << ", " << lon << ": dist= " << square_dist << ")" << std::endl;
 	  ofs.close();
 #endif /* CONTEXT_LOG */
-	  o.insert(std::make_pair("address", picojson::value(best_address)));
-	  o.insert(std::make_pair("geo", (picojson::value)best_address.getGeoObject()));
 	}
+#ifdef CONTEXT_LOG
+	std::ofstream ofs("/tmp/geonlp.debug", std::ios::out | std::ios::app);
+	ofs << "selected: " << best_address.get_standard_form() << "(" << clat << ", " << clon << ": dist= " << min_dist << ")" << std::endl;
+	ofs.close();
+#endif /* CONTEXT_LOG */
+	o.insert(std::make_pair("address", picojson::value(best_address)));
+	o.insert(std::make_pair("geo", (picojson::value)best_address.getGeoObject()));
       }
-      n++;
     }
   }
 
+  // キューの先頭の文が評価済みで flushNodes で取り出せるか
+  // 前の文のエンドマークを読み飛ばし、次のエンドマークまでが評価済みかを調べる
+  bool Context::hasEvaluatedSentence(void) const {
+    size_t i = 0;
+    while (i < this->_nodes.size() && this->_nodes[i].is<picojson::null>()) i++;
+    if (i == this->_nodes.size()) return false;
+    while (i < this->_nodes.size() && !this->_nodes[i].is<picojson::null>()) i++;
+    return i < this->_nodes.size() && this->_base + (int)i < this->_evaluated;
+  }
+
+  // キューの先頭のノードを取り除く
+  void Context::popNode(void) {
+    this->_nodes.pop_front();
+    this->_candidates.pop_front();
+    this->_dist_weights.erase(this->_base);
+    this->_base++;
+  }
+
   // 登録済みの地名語候補配列を返し、メモリから除去する
   // コンテキスト情報は消去されない
   picojson::array Context::flushNodes() {
-    picojson::ext enull("null");
     picojson::array tmp_results, results;
     picojson::array::iterator it;
     std::string surface;
     // しきい値設定
     int threshold = 0;
     if (this->_options.has_key("threshold")) threshold = this->_options._get_int("threshold");
-    // flush 済みの部分を早送りして頭出し
-    for (it = this->_nodes.begin(); it != this->_nodes.end(); it++) {
-      if (! (*it).is<picojson::null>()) break; 
-    }
+    // 前の文のエンドマークを取り除いて頭出し
+    while (this->_nodes.size() > 0 && this->_nodes.front().is<picojson::null>()) this->popNode();
     // キューの先頭
-    for (; it != this->_nodes.end(); it++) {
-      if ((*it).is<picojson::null>()) break; // センテンスのエンドマーク
-      picojson::ext e((*it));
+    while (this->_nodes.size() > 0) {
+      if (this->_nodes.front().is<picojson::null>()) break; // センテンスのエンドマーク
+      picojson::ext e(this->_nodes.front());
       if (e.has_key("address")) { // 住所要素
 	e.erase("address");
 	if (!this->_options.has_key("show-candidate") || !this->_options.get_value("show-candidate")) {
@@ -759,9 +1458,8 @@ namespace geonlp
       } else { // 非地名語
 	tmp_results.push_back((picojson::value)e);
       }
-      // 処理済みのノードを空に
-      it = this->_nodes.erase(it);
-      this->_nodes.insert(it, (picojson::value)enull);
+      // 処理済みのノードをキューから取り除く
+      this->popNode();
     }
     // 分割されている surface を連結する
     surface = "";
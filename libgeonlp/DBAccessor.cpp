@@ -15,6 +15,7 @@
 #include "config.h"
 #include "darts.h"
 #include "DBAccessor.h"
+#include "WordlistAttributes.h"
 #include "Util.h"
 #ifdef HAVE_LIBDAMS
 #include <dams.h>
@@ -30,8 +31,10 @@ public:
   std::string val;
   std::string surface;
   std::string yomi;
+  std::string dictionaries; // 辞書 ID のビットマスク
+  std::string ne_classes;   // 固有名クラス ID リスト
 public:
-  tmp_wordlist(const std::string& k, const std::string& v, const std::string& s, const std::string& y):key(k), val(v), surface(s), yomi(y) {}
+  tmp_wordlist(const std::string& k, const std::string& v, const std::string& s, const std::string& y, const std::string& d, const std::string& c):key(k), val(v), surface(s), yomi(y), dictionaries(d), ne_classes(c) {}
 };
 bool operator<(const tmp_wordlist& kv0, const tmp_wordlist& kv1) {
   return kv0.key < kv1.key;
@@ -68,6 +71,66 @@ namespace geonlp
     if ( SQLITE_OK != ret){
       throw std::runtime_error(sqlite3_errmsg(wordlistp));
     }
+    geoword_statements = SqliteStatementPoolPtr(new SqliteStatementPool(sqlitep));
+    wordlist_statements = SqliteStatementPoolPtr(new SqliteStatementPool(wordlistp));
+    this->migrateSchema();
+
+    if (this->use_wordlist_table) this->loadWordlistTable();
+    this->loadGeowordStore();
+  }
+
+  /// @brief オンメモリ見出し語テーブルを読み込む
+  ///
+  /// updateWordlists が保存したファイルがあれば mmap し、
+  /// 無い場合は wordlist テーブルから構築する。
+  /// wordlist テーブルも無い場合（updateWordlists 実行前）は保持しない。
+  void DBAccessor::loadWordlistTable(void) const {
+    WordlistTable* table = new WordlistTable();
+    WordlistTablePtr new_table(table);
+    if (!table->load(this->wordlist_table_fname)) {
+      std::vector<Wordlist> wordlists;
+      try {
+	this->findAllWordlist(wordlists);
+	table->build(wordlists);
+      } catch (SqliteErrException& e) {
+	return;
+      } catch (std::runtime_error& e) {
+	return; // 大きすぎる場合は wordlist テーブルから取得する
+      }
+    }
+    this->wordlist_table = new_table;
+  }
+
+  /// @brief オンメモリ見出し語テーブルとそのファイルを破棄する
+  ///
+  /// wordlist テーブルを変更すると内容が古くなるので、
+  /// 次に updateWordlists を実行するまでは wordlist テーブルから取得する。
+  void DBAccessor::removeWordlistTable(void) const {
+    this->wordlist_table.reset();
+    boost::filesystem::remove(boost::filesystem::path(this->wordlist_table_fname));
+  }
+
+  /// @brief 地名語のバイナリ格納ファイルを読み込む
+  ///
+  /// updateWordlists が保存したファイルがあれば mmap する。
+  /// 無い場合は保持せず、地名語は geoword テーブルから取得する。
+  void DBAccessor::loadGeowordStore(void) const {
+    GeowordStore* store = new GeowordStore();
+    GeowordStorePtr new_store(store);
+    if (!store->load(this->geoword_store_fname)) {
+      this->geoword_store.reset();
+      return;
+    }
+    this->geoword_store = new_store;
+  }
+
+  /// @brief 地名語のバイナリ格納ファイルを破棄する
+  ///
+  /// geoword テーブルを変更すると内容が古くなるので、
+  /// 次に updateWordlists を実行するまでは geoword テーブルから取得する。
+  void DBAccessor::removeGeowordStore(void) const {
+    this->geoword_store.reset();
+    boost::filesystem::remove(boost::filesystem::path(this->geoword_store_fname));
   }
 	
   /// @brief DBクローズ。
@@ -76,10 +139,15 @@ namespace geonlp
   /// @note 戻り値が0以外の場合(SQLITE_BUSYなど)には、厳密にいうと再試行をすべきである。
   int DBAccessor::close() {
     int ret;
+    // ステートメントを finalize してから接続を閉じる
+    geoword_statements.reset();
+    wordlist_statements.reset();
     ret = sqlite3_close(sqlitep);
     sqlitep = NULL;
     ret = sqlite3_close(wordlistp);
     wordlistp = NULL;
+    wordlist_table.reset();
+    geoword_store.reset();
 #ifdef DEBUG
     fprintf(fplog, "sqlite3_close()\n");
     fclose(fplog);
@@ -87,6 +155,53 @@ namespace geonlp
     return ret;
   }
 	
+  /// @brief プリペアドステートメントの統計情報を取得する
+  ///
+  /// 地名語 DB と単語表記 DB のプールの合計を返す。
+  /// @return 統計情報、open 前はすべて 0
+  SqliteStatementStats DBAccessor::getStatementStats(void) const {
+    SqliteStatementStats ret;
+    std::memset(&ret, 0, sizeof(ret));
+    SqliteStatementPoolPtr pools[2] = { this->geoword_statements, this->wordlist_statements };
+    for (int i = 0; i < 2; i++) {
+      if (!pools[i]) continue;
+      SqliteStatementStats stats = pools[i]->getStats();
+      ret.prepares += stats.prepares;
+      ret.reuses += stats.reuses;
+      ret.steps += stats.steps;
+      ret.prepare_usec += stats.prepare_usec;
+      ret.step_usec += stats.step_usec;
+    }
+    return ret;
+  }
+
+  /// @brief 統計情報を JSON オブジェクトとして取得する
+  ///
+  /// geonlp_api の --stats オプションなどで出力する。
+  /// @return {"statements": {"prepares", "reuses", "steps", "prepare_usec", "step_usec"},
+  ///          "geoword_cache": {"hits", "misses", "evictions", "entries", "bytes", "capacity"}}
+  picojson::value DBAccessor::getStatistics(void) const {
+    SqliteStatementStats stats = this->getStatementStats();
+    picojson::object statements;
+    statements.insert(std::make_pair("prepares", picojson::value((long)stats.prepares)));
+    statements.insert(std::make_pair("reuses", picojson::value((long)stats.reuses)));
+    statements.insert(std::make_pair("steps", picojson::value((long)stats.steps)));
+    statements.insert(std::make_pair("prepare_usec", picojson::value(stats.prepare_usec)));
+    statements.insert(std::make_pair("step_usec", picojson::value(stats.step_usec)));
+    GeowordCacheStats cache_stats = this->getGeowordCacheStats();
+    picojson::object cache;
+    cache.insert(std::make_pair("hits", picojson::value((long)cache_stats.hits)));
+    cache.insert(std::make_pair("misses", picojson::value((long)cache_stats.misses)));
+    cache.insert(std::make_pair("evictions", picojson::value((long)cache_stats.evictions)));
+    cache.insert(std::make_pair("entries", picojson::value((long)cache_stats.entries)));
+    cache.insert(std::make_pair("bytes", picojson::value((long)cache_stats.bytes)));
+    cache.insert(std::make_pair("capacity", picojson::value((long)cache_stats.capacity)));
+    picojson::object ret;
+    ret.insert(std::make_pair("statements", picojson::value(statements)));
+    ret.insert(std::make_pair("geoword_cache", picojson::value(cache)));
+    return picojson::value(ret);
+  }
+
   /// @brief 引数として渡されたIDを持つ地名語エントリの全ての情報を地名語辞書システムから取得する。
   ///
   /// 一致するエントリが見つからない場合には、戻り値の地名語エントリクラスのget_geonlp_id()が空文字列となる。
@@ -99,44 +214,80 @@ namespace geonlp
   bool DBAccessor::findGeowordById(const std::string& id, Geoword& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
   {
-    char **azResult;
-    int row, column, rc;
-    char *zErrMsg;
-    std::ostringstream oss;
-		
+    GeowordPtr geoword;
+    if (!this->findGeowordById(id, geoword)) {
+      // 結果が０件の場合
+      ret.initByJson("{\"geonlp_id\":\"\"}");
+      return false;
+    }
+    ret = *geoword;
+    return true;
+  }
+
+  /// @brief 引数として渡されたIDを持つ地名語エントリを取得する（キャッシュと共有）
+  ///
+  /// 取得した地名語はキャッシュと共有されるのでコピーは発生しない。
+  /// @arg @c id 地名語ID (GeonlpID)
+  /// @arg ret   結果の地名語、見つからない場合は NULL
+  /// @return 該当する地名語が見つかった場合 true
+  /// @exception SqliteNotInitializedException Sqlite3が未初期化。
+  /// @exception SqliteErrException Sqlite3でエラー。
+  bool DBAccessor::findGeowordById(const std::string& id, GeowordPtr& ret) const
+    throw (SqliteNotInitializedException, SqliteErrException)
+  {
     if ( NULL == sqlitep) throw SqliteNotInitializedException();
 
     // キャッシュチェック
-    if (DBAccessor::searchGeowordFromCache(id, ret)) {
+    ret = this->geoword_cache->get(id);
+    if (ret) return true;
+
+    // バイナリ格納ファイルから検索
+    // updateWordlists 以降の geoword テーブルの内容をすべて含むので、無ければ該当なし
+    // キャッシュに無い場合は格納した JSON 全体を解析する。GeowordRecord は
+    // よく使う項目しか持たず、この関数の呼び出し元（getGeowordEntry, 検索）は
+    // 辞書独自の項目も含む全項目を返すため、レコードの項目だけからは作れない。
+    // 候補の絞り込みなど一部の項目だけが必要な処理は GeowordView を直接使うこと。
+    GeowordStorePtr store = this->geoword_store;
+    if (store) {
+      GeowordView view;
+      if (!store->find(id, view)) {
+	ret = GeowordPtr();
+	return false;
+      }
+      std::string json = view.get_json();
+      Geoword* geoword = new Geoword();
+      ret = GeowordPtr(geoword);
+      geoword->initByJson(json);
+      this->geoword_cache->put(ret, sizeof(Geoword) + json.length() * 2);
       return true;
     }
 
     // DB から検索
-    oss << "select * from geoword where geonlp_id = '" << id << "';";
-    std::string sql =  oss.str();
-    rc = sqlite3_get_table(sqlitep, sql.c_str(), &azResult, &row, &column, &zErrMsg);
+    size_t bytes = 0;
+    {
+      PooledStatement stmt(*this->geoword_statements, "SELECT json FROM geoword WHERE geonlp_id = ?");
+      stmt.bind(1, id);
 #ifdef DEBUG
-    fprintf(fplog, "sqlite3_get_table('%s')\n", sql.c_str());
+      fprintf(fplog, "sqlite3_step('SELECT json FROM geoword WHERE geonlp_id = %s')\n", id.c_str());
 #endif /* DEBUG */
-    if( zErrMsg || rc != SQLITE_OK){
-      std::string errmsg = zErrMsg;
-      sqlite3_free(zErrMsg);
-      sqlite3_free_table(azResult);
-      throw SqliteErrException( rc, errmsg.c_str());
+      if (stmt.step()) {
+	std::string json = stmt.getText(0);
+	Geoword* geoword = new Geoword();
+	ret = GeowordPtr(geoword);
+	geoword->initByJson(json);
+	// 展開後の大きさは JSON 文字列の 2 倍程度と見積もる
+	bytes = sizeof(Geoword) + json.length() * 2;
+      }
     }
-    if ( row != 0){
-      assertGeowordColumns( azResult, column);
-      resultToGeoword( &azResult[column], ret);
-    } else {
-      // 結果が０件の場合
-      ret.initByJson("{\"geonlp_id\":\"\"}");
+    if (!ret || !ret->isValid()) {
+      ret = GeowordPtr();
+      return false;
     }
-    sqlite3_free_table(azResult);
 
     // キャッシュに登録
-    DBAccessor::addGeowordToCache(ret);
+    this->geoword_cache->put(ret, bytes);
 
-    return ret.isValid();
+    return true;
   }
 	
   /// @brief 引数として渡された辞書IDとentry_idのペアを持つ地名語エントリの情報を DB から取得する
@@ -151,32 +302,19 @@ namespace geonlp
   bool DBAccessor::findGeowordByDictionaryIdAndEntryId(int dictionary_id, const std::string& entry_id, Geoword& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
   {
-    char **azResult;
-    int row, column, rc;
-    char *zErrMsg;
-    std::ostringstream oss;
-		
     if ( NULL == sqlitep) throw SqliteNotInitializedException();
-    oss << "SELECT * FROM geoword WHERE dictionary_id = " << dictionary_id << " AND entry_id = '" << entry_id << "';";
-    std::string sql =  oss.str();
-    rc = sqlite3_get_table(sqlitep, sql.c_str(), &azResult, &row, &column, &zErrMsg);
+    PooledStatement stmt(*this->geoword_statements, "SELECT json FROM geoword WHERE dictionary_id = ? AND entry_id = ?");
+    stmt.bind(1, dictionary_id);
+    stmt.bind(2, entry_id);
 #ifdef DEBUG
-    fprintf(fplog, "sqlite3_get_table('%s')\n", sql.c_str());
+    fprintf(fplog, "sqlite3_step('SELECT json FROM geoword WHERE dictionary_id = %d AND entry_id = %s')\n", dictionary_id, entry_id.c_str());
 #endif /* DEBUG */
-    if( zErrMsg || rc != SQLITE_OK){
-      std::string errmsg = zErrMsg;
-      sqlite3_free(zErrMsg);
-      sqlite3_free_table(azResult);
-      throw SqliteErrException( rc, errmsg.c_str());
-    }
-    if ( row != 0){
-      assertGeowordColumns( azResult, column);
-      resultToGeoword( &azResult[column], ret);
+    if (stmt.step()) {
+      ret.initByJson(stmt.getText(0));
     } else {
       // 結果が０件の場合
       ret.initByJson("{\"geonlp_id\":\"\"}");
     }
-    sqlite3_free_table(azResult);
 
     return ret.isValid();
   }
@@ -240,34 +378,19 @@ namespace geonlp
   bool DBAccessor::findDictionaryById(const int id, Dictionary& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
   {
-    std::ostringstream oss;
-    char **azResult;
-    int row, column, rc;
-    char *zErrMsg;
-		
     if ( NULL == sqlitep) throw SqliteNotInitializedException();
-    oss.str("");
-    oss << "select * from dictionary where id = " << id << ";";
-    std::string sql = oss.str();
-    rc = sqlite3_get_table(sqlitep, sql.c_str(), &azResult, &row, &column, &zErrMsg);
+    PooledStatement stmt(*this->geoword_statements, "SELECT json FROM dictionary WHERE id = ?");
+    stmt.bind(1, id);
 #ifdef DEBUG
-    fprintf(fplog, "sqlite3_get_table('%s')\n", sql.c_str());
+    fprintf(fplog, "sqlite3_step('SELECT json FROM dictionary WHERE id = %d')\n", id);
 #endif /* DEBUG */
-    if( zErrMsg || rc != SQLITE_OK){
-      std::string errmsg = zErrMsg;
-      sqlite3_free(zErrMsg);
-      sqlite3_free_table(azResult);
-      throw SqliteErrException( rc, errmsg.c_str());
-    }
-    if ( row != 0){
-      assertDictionaryColumns( azResult, column);
-      resultToDictionary( &azResult[column], ret);
+    if (stmt.step()) {
+      ret.initByJson(stmt.getText(0));
     } else {
       // 結果が０件の場合
       ret.initByJson("{\"id\":0}");
     }
-    sqlite3_free_table(azResult);
-    
+
     return ret.isValid();
   }
 	
@@ -282,33 +405,19 @@ namespace geonlp
   bool DBAccessor::findDictionaryByUserCodeAndCode(const std::string& user_code, const std::string& code, Dictionary& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
   {
-    std::ostringstream oss;
-    char **azResult;
-    int row, column, rc;
-    char *zErrMsg;
-		
     if ( NULL == sqlitep) throw SqliteNotInitializedException();
-    oss.str("");
-    oss << "select * from dictionary where user_code = '" << user_code << "' AND code = '" << code << "';";
-    std::string sql = oss.str();
-    rc = sqlite3_get_table(wordlistp, sql.c_str(), &azResult, &row, &column, &zErrMsg);
+    PooledStatement stmt(*this->geoword_statements, "SELECT json FROM dictionary WHERE user_code = ? AND code = ?");
+    stmt.bind(1, user_code);
+    stmt.bind(2, code);
 #ifdef DEBUG
-    fprintf(fplog, "sqlite3_get_table('%s')\n", sql.c_str());
+    fprintf(fplog, "sqlite3_step('SELECT json FROM dictionary WHERE user_code = %s AND code = %s')\n", user_code.c_str(), code.c_str());
 #endif /* DEBUG */
-    if( zErrMsg || rc != SQLITE_OK){
-      std::string errmsg = zErrMsg;
-      sqlite3_free(zErrMsg);
-      sqlite3_free_table(azResult);
-      throw SqliteErrException( rc, errmsg.c_str());
-    }
-    if ( row != 0){
-      assertDictionaryColumns( azResult, column);
-      resultToDictionary( &azResult[column], ret);
+    if (stmt.step()) {
+      ret.initByJson(stmt.getText(0));
     } else {
       // 結果が０件の場合
-      ret.initByJson("{'id':0}");
+      ret.initByJson("{\"id\":0}");
     }
-    sqlite3_free_table(azResult);
 
     return ret.isValid();
   }
@@ -329,7 +438,7 @@ namespace geonlp
 		
     if ( NULL == wordlistp) throw SqliteNotInitializedException();
     oss.str("");
-    oss << "select * from wordlist";
+    oss << "select id, key, surface, idlist, yomi from wordlist";
     std::string sql = oss.str();
     rc = sqlite3_get_table(wordlistp, sql.c_str(), &azResult, &row, &column, &zErrMsg);
 #ifdef DEBUG
@@ -364,35 +473,17 @@ namespace geonlp
   bool DBAccessor::findWordlistById(const unsigned int id, Wordlist& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
   {
-    std::ostringstream oss;
-    char **azResult;
-    int row, column, rc;
-    char *zErrMsg;
-		
     if ( NULL == wordlistp) throw SqliteNotInitializedException();
-    oss.str("");
-    oss << "select * from wordlist where id = " << id << ";";
-    std::string sql = oss.str();
-    rc = sqlite3_get_table(wordlistp, sql.c_str(), &azResult, &row, &column, &zErrMsg);
-#ifdef DEBUG
-    fprintf(fplog, "sqlite3_get_table('%s')\n", sql.c_str());
-#endif /* DEBUG */
-    if( zErrMsg || rc != SQLITE_OK){
-      std::string errmsg = zErrMsg;
-      sqlite3_free(zErrMsg);
-      sqlite3_free_table(azResult);
-      throw SqliteErrException( rc, errmsg.c_str());
-    }
-    if ( row != 0){
-      assertWordlistColumns( azResult, column);
-      resultToWordlist( &azResult[column], ret);
-    } else {
-      // 結果が０件の場合
-      ret.set_surface("");
-    }
-    sqlite3_free_table(azResult);
 
-    return ret.isValid();
+    // オンメモリ見出し語テーブルを利用する場合は SQL を実行しない
+    if (this->wordlist_table) {
+      if (this->wordlist_table->find(id, ret)) return true;
+      ret = Wordlist();
+      return false;
+    }
+    PooledStatement stmt(*this->wordlist_statements, "SELECT id, key, surface, idlist, yomi FROM wordlist WHERE id = ?");
+    stmt.bind(1, (int)id);
+    return this->stepWordlist(stmt, ret);
   }
 
   /// @brief 引数として渡された見出し語を持つ単語IDリストの情報を取得する。
@@ -405,38 +496,15 @@ namespace geonlp
   bool DBAccessor::findWordlistBySurface(const std::string& surface, Wordlist& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
   {
-    char **azResult;
-    int row, column, rc;
-    char *zErrMsg;
-		
     if ( NULL == wordlistp) throw SqliteNotInitializedException();
 
+    PooledStatement stmt(*this->wordlist_statements, "SELECT id, key, surface, idlist, yomi FROM wordlist WHERE key = ?");
 #ifdef HAVE_LIBDAMS
-    std::string standardized_surface(damswrapper::get_standardized_string(surface));
-    std::string sql = "select * from wordlist where key = '" + standardized_surface + "';";
+    stmt.bind(1, std::string(damswrapper::get_standardized_string(surface)));
 #else
-    std::string sql = "select * from wordlist where key = '" + surface + "';";
+    stmt.bind(1, surface);
 #endif /* HAVE_LIBDAMS */
-
-    rc = sqlite3_get_table(wordlistp, sql.c_str(), &azResult, &row, &column, &zErrMsg);
-#ifdef DEBUG
-    fprintf(fplog, "sqlite3_get_table('%s')\n", sql.c_str());
-#endif /* DEBUG */
-    if( zErrMsg || rc != SQLITE_OK){
-      std::string errmsg = zErrMsg;
-      sqlite3_free(zErrMsg);
-      sqlite3_free_table(azResult);
-      throw SqliteErrException( rc, errmsg.c_str());
-    }
-    if ( row != 0){
-      assertWordlistColumns( azResult, column);
-      resultToWordlist( &azResult[column], ret);
-    } else {
-      // 結果が０件の場合
-      ret.set_surface("");
-    }
-    sqlite3_free_table(azResult);
-    return ret.isValid();
+    return this->stepWordlist(stmt, ret);
   }
 
   /// @brief 引数として渡された読みを持つ単語IDリストの情報を取得する。
@@ -449,31 +517,10 @@ namespace geonlp
   bool DBAccessor::findWordlistByYomi(const std::string& yomi, Wordlist& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
   {
-    char **azResult;
-    int row, column, rc;
-    char *zErrMsg;
-		
     if ( NULL == wordlistp) throw SqliteNotInitializedException();
-    std::string sql = "select * from wordlist where yomi = '" + yomi + "';";
-    rc = sqlite3_get_table(wordlistp, sql.c_str(), &azResult, &row, &column, &zErrMsg);
-#ifdef DEBUG
-    fprintf(fplog, "sqlite3_get_table('%s')\n", sql.c_str());
-#endif /* DEBUG */
-    if( zErrMsg || rc != SQLITE_OK){
-      std::string errmsg = zErrMsg;
-      sqlite3_free(zErrMsg);
-      sqlite3_free_table(azResult);
-      throw SqliteErrException( rc, errmsg.c_str());
-    }
-    if ( row != 0){
-      assertWordlistColumns( azResult, column);
-      resultToWordlist( &azResult[column], ret);
-    } else {
-      // 結果が０件の場合
-      ret.set_surface("");
-    }
-    sqlite3_free_table(azResult);
-    return ret.isValid();
+    PooledStatement stmt(*this->wordlist_statements, "SELECT id, key, surface, idlist, yomi FROM wordlist WHERE yomi = ?");
+    stmt.bind(1, yomi);
+    return this->stepWordlist(stmt, ret);
   }
 
   /// @brief 地名語を一括でDBにセットする
@@ -493,6 +540,8 @@ namespace geonlp
 
     // テーブルの作成
     this->createTables();
+    this->geoword_cache->clear(); // 更新前の地名語がキャッシュに残らないようにする
+    this->removeGeowordStore();
 
     /*
     // 既存テーブル上のデータの削除
@@ -684,6 +733,7 @@ namespace geonlp
 
     // テーブルの作成
     this->createTables();
+    this->removeWordlistTable(); // 更新前の見出し語がオンメモリテーブルに残らないようにする
 
     /*
     // 既存テーブル上のデータの削除
@@ -707,7 +757,7 @@ namespace geonlp
     // 行の作成ループ
     sqlite3_stmt *stm = NULL;
 
-    rc = sqlite3_prepare(wordlistp, "INSERT OR REPLACE INTO wordlist VALUES (?, ?, ?, ?, ?);", -1, &stm, NULL);
+    rc = sqlite3_prepare(wordlistp, "INSERT OR REPLACE INTO wordlist (id, key, surface, idlist, yomi) VALUES (?, ?, ?, ?, ?);", -1, &stm, NULL);
     if (rc != SQLITE_OK || !stm) {
       std::string errmsg = "failed to prepare statement.";
       throw SqliteErrException(rc, errmsg.c_str());
@@ -718,9 +768,10 @@ namespace geonlp
 	const Wordlist* wp = &(wordlists[i]);
 	// パラメータのバインド
 	sqlite3_bind_int(stm, 1, wp->get_id());
-	sqlite3_bind_text(stm, 2, wp->get_surface().c_str(), wp->get_surface().length(), SQLITE_TRANSIENT);
-	sqlite3_bind_text(stm, 3, wp->get_idlist().c_str(), wp->get_idlist().length(), SQLITE_TRANSIENT);
-	sqlite3_bind_text(stm, 4, wp->get_yomi().c_str(), wp->get_yomi().length(), SQLITE_TRANSIENT);
+	sqlite3_bind_text(stm, 2, wp->get_key().c_str(), wp->get_key().length(), SQLITE_TRANSIENT);
+	sqlite3_bind_text(stm, 3, wp->get_surface().c_str(), wp->get_surface().length(), SQLITE_TRANSIENT);
+	sqlite3_bind_text(stm, 4, wp->get_idlist().c_str(), wp->get_idlist().length(), SQLITE_TRANSIENT);
+	sqlite3_bind_text(stm, 5, wp->get_yomi().c_str(), wp->get_yomi().length(), SQLITE_TRANSIENT);
 
 	// 実行
 	rc = sqlite3_step(stm);
@@ -779,6 +830,8 @@ namespace geonlp
 		
     if ( NULL == sqlitep) throw SqliteNotInitializedException();
     this->createTables(); // テーブルが存在していなければ作成しておく
+    this->geoword_cache->clear(); // 古い地名語がキャッシュに残らないようにする
+    this->removeGeowordStore();
 
     // 既存テーブル上のデータの削除
     rc = sqlite3_exec(sqlitep, "DELETE FROM geoword;", NULL, NULL, &zErrMsg);
@@ -829,6 +882,7 @@ namespace geonlp
 		
     if ( NULL == wordlistp) throw SqliteNotInitializedException();
     this->createTables(); // テーブルが存在していなければ作成しておく
+    this->removeWordlistTable(); // 古い見出し語がオンメモリテーブルに残らないようにする
 
     // 既存テーブル上のデータの削除
     rc = sqlite3_exec(wordlistp, "DELETE FROM wordlist;", NULL, NULL, &zErrMsg);
@@ -867,6 +921,9 @@ namespace geonlp
   {
     std::string empty_str("");
     std::map<std::string, std::vector<std::string> > surface_idlist;
+    std::map<std::string, std::pair<std::set<int>, std::set<int> > > surface_attrs; // 表記ごとの辞書 ID, 固有名クラス ID
+    std::map<std::string, int> ne_class_ids; // 固有名クラスから固有名クラス ID へのマップ
+    GeowordStoreBuilder store_builder;
     sqlite3_stmt* stmt;
     Geoword geo_in;
     int rc;
@@ -889,6 +946,22 @@ namespace geonlp
       std::string json_str = (const char*)(sqlite3_column_text(stmt, 1));
       geo_in.initByJson(json_str);
       std::string geonlp_id = geo_in.get_geonlp_id();
+      try {
+	store_builder.add(geo_in, json_str);
+      } catch (std::runtime_error& e) {
+	sqlite3_finalize(stmt);
+	throw DartsException(e.what());
+      }
+
+      // 固有名クラスに ID を割り当てる
+      int dictionary_id = geo_in.get_dictionary_id();
+      std::string ne_class = geo_in.get_ne_class();
+      std::map<std::string, int>::iterator it_class = ne_class_ids.find(ne_class);
+      if (it_class == ne_class_ids.end()) {
+	int class_id = ne_class_ids.size();
+	it_class = ne_class_ids.insert(std::make_pair(ne_class, class_id)).first;
+      }
+      int ne_class_id = (*it_class).second;
 
       // 可能な全ての表記を登録 
       std::vector<std::string> prefixes = geo_in.get_prefix();
@@ -936,6 +1009,8 @@ namespace geonlp
 	    surface_idlist[standardized][0] += "/";
 	  }
 	  surface_idlist[standardized][0] += geonlp_id + ":" + typical_name;
+	  surface_attrs[standardized].first.insert(dictionary_id);
+	  surface_attrs[standardized].second.insert(ne_class_id);
 
 	  if (yomi.length() > 0) {
 	    if (surface_idlist[yomi].size() == 0) {
@@ -946,6 +1021,8 @@ namespace geonlp
 	      surface_idlist[yomi][0] += "/";
 	    }
 	    surface_idlist[yomi][0] += geonlp_id + ":" + typical_name;
+	    surface_attrs[yomi].first.insert(dictionary_id);
+	    surface_attrs[yomi].second.insert(ne_class_id);
 	  }
 	  
 	  i_suffix++;
@@ -968,13 +1045,17 @@ namespace geonlp
     std::vector<tmp_wordlist> tmp_wordlists;
     for (std::map<std::string, std::vector<std::string> >::iterator it = surface_idlist.begin(); it != surface_idlist.end(); it++) {
       const std::vector<std::string>& elem = (*it).second;
-      tmp_wordlists.push_back(tmp_wordlist( (*it).first, elem[0], elem[1], elem[2]));  // 標準表記, idlist, 表記, 読み
+      const std::pair<std::set<int>, std::set<int> >& attrs = surface_attrs[(*it).first];
+      tmp_wordlists.push_back(tmp_wordlist( (*it).first, elem[0], elem[1], elem[2],  // 標準表記, idlist, 表記, 読み
+					    WordlistAttributes::encodeDictionaryMask(attrs.first),
+					    WordlistAttributes::encodeClassIds(attrs.second)));
     }
     std::sort(tmp_wordlists.begin(), tmp_wordlists.end());
 
     // darts 用テーブル作成
     Wordlist* wp;
     std::vector<const char*> keys;
+    wordlists.clear();
     for (int seq_id = 0; seq_id < tmp_wordlists.size(); seq_id++) {
       tmp_wordlist& w = tmp_wordlists[seq_id];
       char* tmp = new char[w.key.size() + 1];
@@ -994,6 +1075,29 @@ namespace geonlp
 
     // darts 用テーブル（オンメモリ）の削除
     for (int i = 0; i < keys.size(); i++) delete[] keys[i];
+
+    // オンメモリ見出し語テーブルの構築と一時ファイルへの保存
+    // 利用しない場合は構築もファイルへの保存もしない
+    WordlistTablePtr new_table;
+    std::string tmp_table_fname = this->wordlist_table_fname + ".tmp";
+    if (this->use_wordlist_table) {
+      WordlistTable* table = new WordlistTable();
+      new_table = WordlistTablePtr(table);
+      try {
+	table->build(wordlists);
+	table->save(tmp_table_fname);
+      } catch (std::runtime_error& e) {
+	throw DartsException(e.what());
+      }
+    }
+
+    // 地名語のバイナリ格納ファイルを一時ファイルに保存
+    std::string tmp_store_fname = this->geoword_store_fname + ".tmp";
+    try {
+      store_builder.save(tmp_store_fname);
+    } catch (std::runtime_error& e) {
+      throw DartsException(e.what());
+    }
     
     // Wordlist を DB に書き込むトランザクションの開始
     rc = sqlite3_prepare_v2(wordlistp, "BEGIN", -1, &stmt, NULL);
@@ -1010,7 +1114,7 @@ namespace geonlp
     this->createTmpWordlistTable();
 
     // 単語リストを一時テーブルに登録
-    const char* insert_sql = "INSERT INTO wordlist_tmp VALUES (?,?,?,?,?)"; // id, surface, idlist, yomi
+    const char* insert_sql = "INSERT INTO wordlist_tmp VALUES (?,?,?,?,?,?,?)"; // id, key, surface, idlist, yomi, dictionaries, ne_classes
     rc = sqlite3_prepare_v2(wordlistp, insert_sql, -1, &stmt, NULL);
     if (SQLITE_OK != rc) {
       throw SqliteErrException(rc, sqlite3_errmsg(wordlistp));
@@ -1019,11 +1123,14 @@ namespace geonlp
     try {
       unsigned int id = 0;
       for (std::vector<Wordlist>::iterator it = wordlists.begin(); it != wordlists.end(); it++) {
+	const tmp_wordlist& w = tmp_wordlists[(*it).get_id()];
 	sqlite3_bind_int(stmt, 1, (*it).get_id());
 	sqlite3_bind_text(stmt, 2, (*it).get_key().c_str(), (*it).get_key().length(), SQLITE_TRANSIENT);
 	sqlite3_bind_text(stmt, 3, (*it).get_surface().c_str(), (*it).get_surface().length(), SQLITE_TRANSIENT);
 	sqlite3_bind_text(stmt, 4, (*it).get_idlist().c_str(), (*it).get_idlist().length(), SQLITE_TRANSIENT);
 	sqlite3_bind_text(stmt, 5, (*it).get_yomi().c_str(), (*it).get_yomi().length(), SQLITE_TRANSIENT);
+	sqlite3_bind_text(stmt, 6, w.dictionaries.c_str(), w.dictionaries.length(), SQLITE_TRANSIENT);
+	sqlite3_bind_text(stmt, 7, w.ne_classes.c_str(), w.ne_classes.length(), SQLITE_TRANSIENT);
 	
 	rc = sqlite3_step(stmt);
 	if (rc != SQLITE_DONE) {
@@ -1047,6 +1154,30 @@ namespace geonlp
     }
     sqlite3_finalize(stmt);
 
+    // 固有名クラス ID の対応表を登録
+    this->createNeClassTable();
+    rc = sqlite3_prepare_v2(wordlistp, "INSERT INTO ne_class VALUES (?,?)", -1, &stmt, NULL); // id, ne_class
+    if (SQLITE_OK != rc) {
+      throw SqliteErrException(rc, sqlite3_errmsg(wordlistp));
+    }
+    try {
+      for (std::map<std::string, int>::iterator it = ne_class_ids.begin(); it != ne_class_ids.end(); it++) {
+	sqlite3_bind_int(stmt, 1, (*it).second);
+	sqlite3_bind_text(stmt, 2, (*it).first.c_str(), (*it).first.length(), SQLITE_TRANSIENT);
+	rc = sqlite3_step(stmt);
+	if (rc != SQLITE_DONE) {
+	  std::string errmsg = sqlite3_errmsg(wordlistp);
+	  throw SqliteErrException(rc, errmsg.c_str());
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+      }
+    } catch (SqliteErrException e) {
+      sqlite3_finalize(stmt);
+      throw e;
+    }
+    sqlite3_finalize(stmt);
+
     // 一時テーブルを正規テーブルにコピー
     rc = sqlite3_prepare_v2(wordlistp, "DROP TABLE wordlist", -1, &stmt, NULL);
     if (SQLITE_OK != rc) {
@@ -1068,6 +1199,9 @@ namespace geonlp
     }
     sqlite3_finalize(stmt);
 
+    // DROP TABLE でインデックスも削除されたので作り直す
+    this->createWordlistIndexes();
+
     // コミット
     rc = sqlite3_prepare_v2(wordlistp, "COMMIT", -1, &stmt, NULL);
     if (SQLITE_OK != rc) {
@@ -1084,6 +1218,22 @@ namespace geonlp
     boost::filesystem::path regpath(this->darts_fname);
     boost::filesystem::remove(regpath);
     boost::filesystem::rename(tmppath, regpath);
+
+    // 利用しない場合も、以前のファイルは内容が古くなったので削除する
+    boost::filesystem::path table_tmppath(tmp_table_fname);
+    boost::filesystem::path table_regpath(this->wordlist_table_fname);
+    boost::filesystem::remove(table_regpath);
+    if (this->use_wordlist_table) {
+      boost::filesystem::rename(table_tmppath, table_regpath);
+      this->wordlist_table = new_table;
+    }
+
+    boost::filesystem::path store_tmppath(tmp_store_fname);
+    boost::filesystem::path store_regpath(this->geoword_store_fname);
+    this->geoword_store.reset();
+    boost::filesystem::remove(store_regpath);
+    boost::filesystem::rename(store_tmppath, store_regpath);
+    this->loadGeowordStore();
   }
 
   /// @brief geowordテーブルから得られた情報が、期待する順序でカラムが並んでいることを確認する
@@ -1171,6 +1321,34 @@ namespace geonlp
     out.set_yomi( *azResult ? *azResult : ""); azResult++;
   }
 
+  /// @brief wordlist を検索するステートメントを実行し、最初の行を単語IDリストクラスに変換する。
+  ///
+  /// @arg @c stmt [in] パラメータを設定済みの "SELECT id, key, surface, idlist, yomi FROM wordlist ..."
+  /// @arg @c out [out] 単語IDリストクラス、見つからない場合は表記が空になる
+  /// @return 見つかった場合は true
+  bool DBAccessor::stepWordlist(PooledStatement& stmt, Wordlist& out) const
+    throw (SqliteErrException)
+  {
+    if (stmt.step()) {
+      out.set_id(stmt.getInt(0));
+      out.set_key(stmt.getText(1));
+      out.set_surface(stmt.getText(2));
+      out.set_idlist(stmt.getText(3));
+      out.set_yomi(stmt.getText(4));
+    } else {
+      // 結果が０件の場合
+      out.set_surface("");
+    }
+    return out.isValid();
+  }
+
+  /// PRAGMA user_version に現在のスキーマバージョンを記録する
+  static void setSchemaVersion(sqlite3* db) {
+    std::ostringstream oss;
+    oss << "PRAGMA user_version = " << GEONLP_SCHEMA_VERSION;
+    sqlite3_exec(db, oss.str().c_str(), NULL, NULL, NULL);
+  }
+
   /// @breaf geoword, dictionary, wordlist テーブルを作成する
   /// 既にテーブルが存在すれば何もしない
   void DBAccessor::createTables() const
@@ -1195,7 +1373,61 @@ namespace geonlp
       throw SqliteErrException(rc, errmsg.c_str());
     }
 
-    rc = sqlite3_exec(wordlistp, "CREATE TABLE IF NOT EXISTS wordlist(id INTEGER PRIMARY KEY, key VARCHAR, surface VARCHAR, idlist VARCHAR, yomi VARCHAR);", NULL, NULL, &zErrMsg);
+    rc = sqlite3_exec(wordlistp, "CREATE TABLE IF NOT EXISTS wordlist(id INTEGER PRIMARY KEY, key VARCHAR, surface VARCHAR, idlist VARCHAR, yomi VARCHAR, dictionaries VARCHAR, ne_classes VARCHAR);", NULL, NULL, &zErrMsg);
+    if (zErrMsg || rc != SQLITE_OK) {
+      std::string errmsg = zErrMsg;
+      sqlite3_free(zErrMsg);
+      throw SqliteErrException(rc, errmsg.c_str());
+    }
+
+    this->createGeowordIndexes();
+    this->createWordlistIndexes();
+
+    // テーブルとインデックスが揃ったので現在のスキーマバージョンを記録する
+    setSchemaVersion(sqlitep);
+    setSchemaVersion(wordlistp);
+  }
+
+  /// @brief geoword, dictionary テーブルのインデックスを作成する
+  ///
+  /// findGeowordByDictionaryIdAndEntryId, findDictionaryByUserCodeAndCode で利用する。
+  /// 既にインデックスが存在すれば何もしない
+  void DBAccessor::createGeowordIndexes(void) const
+    throw (SqliteNotInitializedException, SqliteErrException) {
+    int rc;
+    char *zErrMsg;
+
+    if ( NULL == sqlitep) throw SqliteNotInitializedException();
+
+    rc = sqlite3_exec(sqlitep,
+		      "CREATE INDEX IF NOT EXISTS geoword_dictionary_entry ON geoword(dictionary_id, entry_id);"
+		      "CREATE INDEX IF NOT EXISTS dictionary_user_code ON dictionary(user_code, code);",
+		      NULL, NULL, &zErrMsg);
+    if (zErrMsg || rc != SQLITE_OK) {
+      std::string errmsg = zErrMsg;
+      sqlite3_free(zErrMsg);
+      throw SqliteErrException(rc, errmsg.c_str());
+    }
+  }
+
+  /// @brief wordlist テーブルのインデックスを作成する
+  ///
+  /// findWordlistBySurface, findWordlistByYomi で利用する。
+  /// 検索で取得するカラムをすべて含めて、テーブル本体を参照せずに済むようにする
+  /// （id は INTEGER PRIMARY KEY なのでインデックスに含まれる）。
+  /// updateWordlists は wordlist テーブルを作り直すので、その都度呼び出す。
+  /// 既にインデックスが存在すれば何もしない
+  void DBAccessor::createWordlistIndexes(void) const
+    throw (SqliteNotInitializedException, SqliteErrException) {
+    int rc;
+    char *zErrMsg;
+
+    if ( NULL == wordlistp) throw SqliteNotInitializedException();
+
+    rc = sqlite3_exec(wordlistp,
+		      "CREATE INDEX IF NOT EXISTS wordlist_key_cover ON wordlist(key, surface, idlist, yomi);"
+		      "CREATE INDEX IF NOT EXISTS wordlist_yomi_cover ON wordlist(yomi, key, surface, idlist);",
+		      NULL, NULL, &zErrMsg);
     if (zErrMsg || rc != SQLITE_OK) {
       std::string errmsg = zErrMsg;
       sqlite3_free(zErrMsg);
@@ -1203,6 +1435,61 @@ namespace geonlp
     }
   }
 
+  /// PRAGMA user_version を取得する
+  static int getSchemaVersion(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    int version = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, NULL) != SQLITE_OK) return 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) version = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return version;
+  }
+
+  /// 指定したテーブルが存在するかどうか
+  static bool hasTable(sqlite3* db, const char* table) {
+    sqlite3_stmt* stmt;
+    bool ret = false;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?", -1, &stmt, NULL) != SQLITE_OK) return false;
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) ret = true;
+    sqlite3_finalize(stmt);
+    return ret;
+  }
+
+  /// @brief 既存の DB を現在のスキーマバージョンに移行する
+  ///
+  /// open 時に呼び出し、PRAGMA user_version が GEONLP_SCHEMA_VERSION より
+  /// 古い DB に対して不足しているインデックスなどを追加する。
+  /// wordlist の再構築は行わない。テーブルがまだ無い場合は移行せず、
+  /// createTables がテーブルとインデックスを作成した時点でバージョンを記録する。
+  /// 書き込みできない DB の場合は移行せず、そのまま利用する。
+  void DBAccessor::migrateSchema(void) const {
+    sqlite3* dbs[2] = { sqlitep, wordlistp };
+    for (int i = 0; i < 2; i++) {
+      sqlite3* db = dbs[i];
+      int version = getSchemaVersion(db);
+      if (version >= GEONLP_SCHEMA_VERSION) continue;
+      try {
+	if (db == sqlitep) {
+	  // バージョン 0 -> 1: 検索用インデックスの追加
+	  if (!hasTable(db, "geoword") || !hasTable(db, "dictionary")) continue;
+	  if (version < 1) this->createGeowordIndexes();
+	}
+	if (db == wordlistp) {
+	  // バージョン 0, 1 -> 2: カラムを含むインデックスに置き換え
+	  if (!hasTable(db, "wordlist")) continue;
+	  if (version < 2) {
+	    this->createWordlistIndexes();
+	    sqlite3_exec(db, "DROP INDEX IF EXISTS wordlist_key; DROP INDEX IF EXISTS wordlist_yomi;", NULL, NULL, NULL);
+	  }
+	}
+      } catch (SqliteErrException& e) {
+	continue; // 読み込み専用など
+      }
+      setSchemaVersion(db);
+    }
+  }
+
   /// @brief wordlist 更新時の一時テーブルを削除する
   void DBAccessor::dropTmpWordlistTable(void) const
     throw (SqliteNotInitializedException, SqliteErrException) {
@@ -1234,7 +1521,24 @@ namespace geonlp
 
     // wordlist と同じスキーマを持つテーブルを作成する
     // create table .. as select は PRIMARY KEY がコピーされないので不可
-    rc = sqlite3_exec(wordlistp, "CREATE TABLE wordlist_tmp(id INTEGER PRIMARY KEY, key VARCHAR, surface VARCHAR, idlist VARCHAR, yomi VARCHAR);", NULL, NULL, &zErrMsg);
+    rc = sqlite3_exec(wordlistp, "CREATE TABLE wordlist_tmp(id INTEGER PRIMARY KEY, key VARCHAR, surface VARCHAR, idlist VARCHAR, yomi VARCHAR, dictionaries VARCHAR, ne_classes VARCHAR);", NULL, NULL, &zErrMsg);
+    if (zErrMsg || rc != SQLITE_OK) {
+      std::string errmsg = zErrMsg;
+      sqlite3_free(zErrMsg);
+      throw SqliteErrException(rc, errmsg.c_str());
+    }
+  }
+
+  /// @breaf wordlist の ne_classes カラムが参照する固有名クラス ID の対応表を生成する
+  /// 既にテーブルが存在していても生成しなおす
+  void DBAccessor::createNeClassTable(void) const
+    throw (SqliteNotInitializedException, SqliteErrException) {
+    int rc;
+    char *zErrMsg;
+
+    if ( NULL == wordlistp) throw SqliteNotInitializedException();
+
+    rc = sqlite3_exec(wordlistp, "DROP TABLE IF EXISTS ne_class; CREATE TABLE ne_class(id INTEGER PRIMARY KEY, ne_class VARCHAR);", NULL, NULL, &zErrMsg);
     if (zErrMsg || rc != SQLITE_OK) {
       std::string errmsg = zErrMsg;
       sqlite3_free(zErrMsg);
@@ -1242,6 +1546,47 @@ namespace geonlp
     }
   }
 
+  /// @brief 見出し語ごとの辞書・固有名クラス所属情報を取得する
+  ///
+  /// updateWordlists 実行前に作成された（dictionaries, ne_classes カラムを持たない）
+  /// wordlist テーブルの場合は false を返す。
+  /// @arg ret  見出し語ごとの辞書・固有名クラス所属情報
+  /// @return   取得できた場合 true
+  /// @exception SqliteNotInitializedException Sqlite3が未初期化。
+  bool DBAccessor::getWordlistAttributes(WordlistAttributes& ret) const
+    throw (SqliteNotInitializedException)
+  {
+    sqlite3_stmt* stmt;
+    std::map<int, std::string> ne_class_names;
+    int rc;
+
+    if ( NULL == wordlistp) throw SqliteNotInitializedException();
+
+    rc = sqlite3_prepare_v2(wordlistp, "SELECT id, ne_class FROM ne_class", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      const char* ne_class = (const char*)sqlite3_column_text(stmt, 1);
+      ne_class_names[sqlite3_column_int(stmt, 0)] = ne_class ? ne_class : "";
+    }
+    sqlite3_finalize(stmt);
+    ret.setNeClassNames(ne_class_names);
+
+    rc = sqlite3_prepare_v2(wordlistp, "SELECT id, dictionaries, ne_classes FROM wordlist", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      const char* dictionaries = (const char*)sqlite3_column_text(stmt, 1);
+      const char* ne_classes = (const char*)sqlite3_column_text(stmt, 2);
+      if (!dictionaries || !ne_classes) {
+	// 属性が保存されていない行がある場合は利用しない
+	sqlite3_finalize(stmt);
+	return false;
+      }
+      ret.add(sqlite3_column_int(stmt, 0), dictionaries, ne_classes, ne_class_names);
+    }
+    sqlite3_finalize(stmt);
+    return true;
+  }
+
   /// @brief wordlist に含まれる ID を持つ Geoword をデータベースから取得する
   /// @arg @c wordlist  ID リストを含む wordlist
   /// @arg ret          地名語エントリのリスト
@@ -1258,30 +1603,59 @@ namespace geonlp
       std::string geonlp_id = (*it)[1]; // geonlp_id
       // (*it)[2]; // typical name
       if (this->findGeowordById(geonlp_id, geoword)) ret.push_back(geoword);
-      if (limit > 0 && ret.size() >= limit) break;
+      if (limit > 0 && ret.size() >= (size_t)limit) break;
     }
     return ret.size();
   }
 
-  /// キャッシュ関連メソッド
-  std::map<std::string, Geoword> DBAccessor::geoword_cache;
+  /// @brief wordlist に含まれる ID を持つ Geoword を取得する（キャッシュと共有）
+  /// @arg @c wordlist  ID リストを含む wordlist
+  /// @arg ret          地名語のリスト
+  /// @arg limit        取得する Geoword 件数の上限、0 の場合全件
+  /// @return           取得した件数
+  int DBAccessor::getGeowordListFromWordlist(const Wordlist& wordlist, std::vector<GeowordPtr>& ret, int limit) const {
+    const std::string& idlist = wordlist.get_idlist();
+    GeowordPtr geoword;
 
-  bool DBAccessor::searchGeowordFromCache(const std::string& geonlp_id, Geoword& geoword) {
-    std::map<std::string, Geoword>::iterator it = DBAccessor::geoword_cache.find(geonlp_id);
-    if (it == DBAccessor::geoword_cache.end()) return false;
-    geoword = (*it).second;
-    return true;
-  }
+    ret.clear();
+    boost::regex pattern = boost::regex("([^\\/:]+):([^\\/:]*)", boost::regex_constants::egrep);
 
-  void DBAccessor::addGeowordToCache(const Geoword& geoword) {
-    if (!geoword.isValid()) return;
-    if (DBAccessor::geoword_cache.size() > GEOWORD_CACHE_SIZE) DBAccessor::clearGeowordCache();
-    const std::string& geonlp_id = geoword.get_geonlp_id();
-    DBAccessor::geoword_cache[geonlp_id] = geoword;
+    for (boost::sregex_iterator it = boost::make_regex_iterator(idlist, pattern); it != boost::sregex_iterator(); it++) {
+      std::string geonlp_id = (*it)[1]; // geonlp_id
+      if (this->findGeowordById(geonlp_id, geoword)) ret.push_back(geoword);
+      if (limit > 0 && ret.size() >= (size_t)limit) break;
+    }
+    return ret.size();
   }
 
-  void DBAccessor::clearGeowordCache(void) {
-    DBAccessor::geoword_cache.clear();
+  /// @brief wordlist に含まれる ID を持つ地名語を、バイナリ格納ファイルのレコードとして取得する
+  ///
+  /// JSON を解析しないので、辞書・固有名クラスや表記の判定だけを行う場合に利用する。
+  /// 返したレコードは store が参照するファイル上にあるため、
+  /// 利用し終わるまで store を保持しておくこと。
+  /// @arg @c wordlist  ID リストを含む wordlist
+  /// @arg ret          地名語レコードのリスト
+  /// @arg store        レコードを含む GeowordStore
+  /// @return           バイナリ格納ファイルが無い場合は false（getGeowordListFromWordlist を利用する）
+  bool DBAccessor::getGeowordViewsFromWordlist(const Wordlist& wordlist, std::vector<GeowordView>& ret, GeowordStorePtr& store) const {
+    ret.clear();
+    store = this->geoword_store;
+    if (!store) return false;
+
+    // idlist は "geonlp_id:typical_name/geonlp_id:typical_name/..." の形式
+    const std::string& idlist = wordlist.get_idlist();
+    GeowordView view;
+    std::string::size_type pos = 0;
+    while (pos < idlist.length()) {
+      std::string::size_type end = idlist.find('/', pos);
+      if (end == std::string::npos) end = idlist.length();
+      std::string::size_type colon = idlist.find(':', pos);
+      if (colon != std::string::npos && colon < end && colon > pos) {
+	if (store->find(idlist.substr(pos, colon - pos), view)) ret.push_back(view);
+      }
+      pos = end + 1;
+    }
+    return true;
   }
 
 }
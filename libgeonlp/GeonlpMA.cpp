@@ -15,6 +15,7 @@
 #include "MeCabAdapter.h"
 #include "DBAccessor.h"
 #include "GeonlpMAImplSq3.h"
+#include "MappedDoubleArray.h"
 
 /// @brief プロファイル定義ファイルのデフォルトディレクトリ
 /// @note configure 時の prefix に合わせて Makefile 中に定義される
@@ -62,8 +63,17 @@ namespace geonlp
     try {
       darts = profilesp->get_darts_file();
       if (darts.length() > 0) {
-	dap = DoubleArrayPtr(new Darts::DoubleArray());
-	dap->open(darts.c_str());
+	int rc;
+	if (profilesp->get_darts_mmap()) {
+	  // mmap した領域は MAImpl の破棄時に unmap される
+	  MappedDoubleArray* mdap = new MappedDoubleArray();
+	  dap = DoubleArrayPtr(mdap);
+	  rc = mdap->mmap(darts.c_str(), profilesp->get_darts_advice());
+	} else {
+	  dap = DoubleArrayPtr(new Darts::DoubleArray());
+	  rc = dap->open(darts.c_str());
+	}
+	if (rc != 0) throw std::runtime_error(std::string("Cannot open darts file '") + darts + "'.");
       }
     } catch (std::runtime_error& e) {
       throw ServiceCreateFailedException(e.what(), ServiceCreateFailedException::DARTS);
@@ -22,6 +22,7 @@
 #include "Profile.h"
 #include "Suffix.h"
 #include "GeowordFormatter.h"
+#include "GeonlpMASession.h"
 #ifdef HAVE_LIBDAMS
 #include <dams.h>
 #endif /* HAVE_LIBDAMS */
@@ -127,9 +128,16 @@ namespace geonlp
     // クラスは正規表現の配列で指定する
     this->defaultClasses = profilesp->get_ne_class();
 
+    // 見出し語ごとの辞書・クラス所属情報を読み込む
+    WordlistAttributes* attributes = new WordlistAttributes();
+    if (this->dbap->getWordlistAttributes(*attributes)) {
+      this->wordlistAttributes = WordlistAttributesPtr(attributes);
+    } else {
+      delete attributes; // 古い形式の wordlist なので見出し語単位の判定は行わない
+    }
+
     // アクティブな辞書とクラスをデフォルト値からコピーする
-    this->resetActiveDictionaries();
-    this->resetActiveClasses();
+    this->active = ActiveSettings(this->defaultDictionaries, this->defaultClasses, this->wordlistAttributes);
   }
 	
   /// @brief デストラクタ。
@@ -142,7 +150,7 @@ namespace geonlp
       dbap->close();
     }
     if (dap.get()) {
-      ; // darts はクローズ処理不要？
+      ; // darts は dap の解放時に破棄される（mmap している場合は unmap される）
     }
 #ifdef HAVE_LIBDAMS
     damswrapper::final();
@@ -161,86 +169,70 @@ namespace geonlp
     return ret.size();
   }
 
+  /// @brief 辞書アクセスの統計情報を取得する
+  picojson::value MAImpl::getStatistics(void) const {
+    return this->dbap->getStatistics();
+  }
+
   /// @brief 利用する辞書を指定する
   /// @arg @c dics   利用する辞書のIDリスト
   ///                空の場合、登録されている全辞書を利用する
   void MAImpl::setActiveDictionaries(const std::vector<int>& dics) {
-    this->activeDictionaries.clear();
-    if (dics.size() == 0) {
-      this->getDictionaryList(this->activeDictionaries);
-    } else {
-      this->addActiveDictionaries(dics);
-    }
+    this->active.setDictionaries(dics, *this);
   }
 
   /// @brief 利用する辞書をリセットする（デフォルトに戻す）
   void MAImpl::resetActiveDictionaries() {
-    this->activeDictionaries = this->defaultDictionaries;
+    this->active.assignDictionaries(this->defaultDictionaries);
   }
 
   /// @brief 利用する辞書を追加する
   /// @arg @c dics 追加する辞書IDのリスト
   void MAImpl::addActiveDictionaries(const std::vector<int>& dics) {
-    Dictionary dictionary;
-    for (std::vector<int>::const_iterator it = dics.begin(); it != dics.end(); it++) {
-      if (this->findDictionaryById((*it), dictionary)) this->activeDictionaries[(*it)] = dictionary;
-    }
+    this->active.addDictionaries(dics, *this);
   }
 
   /// @brief 利用する辞書から除外する
   /// @arg @c dics 除外する辞書IDのリスト
   void MAImpl::removeActiveDictionaries(const std::vector<int>& dics) {
-    for (std::vector<int>::const_iterator it = dics.begin(); it != dics.end(); it++) {
-      this->activeDictionaries.erase((*it));
-    }
+    this->active.removeDictionaries(dics);
   }
 
   /// @brief 利用している辞書を返す
   const std::map<int, Dictionary>& MAImpl::getActiveDictionaries(void) const {
-    return this->activeDictionaries;
+    return this->active.dictionaries();
   }
 
   /// @brief 利用するクラス正規表現を指定する
   void MAImpl::setActiveClasses(const std::vector<std::string>& ne_classes) {
-    this->activeClasses = ne_classes;
+    this->active.assignClasses(ne_classes);
   }
 
   /// @brief 利用する固有名クラスの正規表現を追加する
   /// @arg @c ne_classes 追加するクラスの正規表現リスト
   void MAImpl::addActiveClasses(const std::vector<std::string>& ne_classes) {
-    for (std::vector<std::string>::const_iterator it = ne_classes.begin(); it != ne_classes.end(); it++) {
-      bool is_exist = false;
-      for (std::vector<std::string>::iterator it2 = this->activeClasses.begin(); it2 != this->activeClasses.end(); it2++) {
-	if (*it2 == *it) {
-	  is_exist = true;
-	  break;
-	}
-      }
-      if (!is_exist) this->activeClasses.push_back((*it));
-    }
+    this->active.addClasses(ne_classes);
   }
 
   /// @brief 利用する固有名クラスの正規表現を除外する
   /// @arg @c ne_classes 除外するクラスの正規表現リスト
   void MAImpl::removeActiveClasses(const std::vector<std::string>& ne_classes) {
-    for (std::vector<std::string>::const_iterator it = ne_classes.begin(); it != ne_classes.end(); it++) {
-      for (std::vector<std::string>::iterator it2 = this->activeClasses.begin(); it2 != this->activeClasses.end(); it2++) {
-	if (*it2 == *it) {
-	  this->activeClasses.erase(it2);
-	  break;
-	}
-      }
-    }
+    this->active.removeClasses(ne_classes);
   }
 
   /// @brief 利用するクラス正規表現をリセットする（デフォルトに戻す）
   void MAImpl::resetActiveClasses() {
-    this->activeClasses = this->defaultClasses;
+    this->active.assignClasses(this->defaultClasses);
   }
 
   /// @brief 利用しているクラス正規表現のリストを返す
   const std::vector<std::string>& MAImpl::getActiveClasses() const {
-    return this->activeClasses;
+    return this->active.classes();
+  }
+
+  /// @brief 利用する辞書と固有名クラスを、他の MA から取得した値のまま設定する
+  void MAImpl::assignActiveSettings(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes) {
+    this->active.assign(dictionaries, ne_classes);
   }
 	
   /// @brief 引数として渡された自然文を形態素解析し、解析結果をテキストとして返す。
@@ -255,9 +247,21 @@ namespace geonlp
   std::string MAImpl::parse(const std::string & sentence) const
     throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException)
   {
-    std::ostringstream oss;
+    ActiveFilterPtr filter = this->active.filter();
+    return this->parse(sentence, *filter);
+  }
+
+  /// @brief 指定した判定器で自然文を形態素解析し、解析結果をテキストとして返す。
+  ///
+  /// MAImpl の状態を変更しないので、複数のスレッドから同時に呼び出せる。
+  /// @arg @c sentence 解析対象の自然文。
+  /// @arg @c filter   利用する辞書とクラスの判定器。
+  /// @return 解析結果としてのテキスト。
+  std::string MAImpl::parse(const std::string & sentence, const ActiveFilter& filter) const
+    throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException)
+  {
     std::vector<Node> nodelist; 
-    this->parseNode(sentence, nodelist);
+    this->parseNode(sentence, nodelist, filter);
     return formatter->formatNodeList(nodelist);
   }
 	
@@ -272,6 +276,20 @@ namespace geonlp
   /// @exception MeCabErrException MeCabでエラー。	
   int MAImpl::parseNode(const std::string & sentence, std::vector<Node>& ret) const
     throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException)
+  {
+    ActiveFilterPtr filter = this->active.filter();
+    return this->parseNode(sentence, ret, *filter);
+  }
+
+  /// @brief 指定した判定器で自然文を形態素解析し、ノードの配列を返す。
+  ///
+  /// MAImpl の状態を変更しないので、複数のスレッドから同時に呼び出せる。
+  /// @arg @c sentence 解析対象の自然文。
+  /// @arg ret 解析結果。形態素情報クラスの配列。 
+  /// @arg @c filter   利用する辞書とクラスの判定器。
+  /// @return 結果のノード数
+  int MAImpl::parseNode(const std::string & sentence, std::vector<Node>& ret, const ActiveFilter& filter) const
+    throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException)
   {
     // 改行コードをエスケープする
     std::string sentence_for_mecab("");
@@ -309,7 +327,7 @@ namespace geonlp
     ret.clear();
     ret.reserve(nodes.size()); 
     // MeCabによるパース結果を地名語辞書を参照して変換する
-    convertMeCabNodeToNodeList(nodes, ret);
+    convertMeCabNodeToNodeList(nodes, ret, filter);
     return ret.size();
   }
 	
@@ -317,7 +335,8 @@ namespace geonlp
   ///
   /// @arg @c nodes [in] MeCabによるパース結果としての、形態素情報リスト。
   /// @arg @c nodelist [out] 地名語辞書を参照して地名語変換を行った後の形態素情報リスト。
-  void MAImpl::convertMeCabNodeToNodeList( NodeList& nodes, std::vector<Node>& nodelist) const
+  /// @arg @c filter [in] 利用する辞書とクラスの判定器。
+  void MAImpl::convertMeCabNodeToNodeList( NodeList& nodes, std::vector<Node>& nodelist, const ActiveFilter& filter) const
     throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException)
   {
     nodelist.clear();
@@ -380,7 +399,7 @@ namespace geonlp
       std::vector<Node> geowords;
       int l;
       
-      l = getLongestGeoword( s, e, next, geowords);
+      l = getLongestGeoword( s, e, next, geowords, filter);
       if (l > 0){
 	// 地名語が得られた
 	if (l > 1) {
@@ -456,14 +475,26 @@ namespace geonlp
   /// @exception SqliteErrException Sqlite3でエラー。	
   int MAImpl::getGeowordEntries(const std::string & surface, std::map<std::string, Geoword>& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
+  {
+    ActiveFilterPtr filter = this->active.filter();
+    return this->getGeowordEntries(surface, ret, *filter);
+  }
+
+  /// @brief 引数に与えられた文字列に一致し、判定器が受け付ける Geoword 候補を取得する。
+  /// @arg @c surface
+  /// @arg ret 地名語エントリクラスのマップ。keyがgeonlp_id、valueがGeoword(地名語エントリクラス)オブジェクト。 
+  /// @arg @c filter 利用する辞書とクラスの判定器。
+  /// @return 取得した地名語エントリの数
+  int MAImpl::getGeowordEntries(const std::string & surface, std::map<std::string, Geoword>& ret, const ActiveFilter& filter) const
+    throw (SqliteNotInitializedException, SqliteErrException)
   {
     Wordlist wordlist;
-    if (!this->getWordlistBySurface(surface, wordlist)) return 0;
+    if (!this->getWordlistBySurface(surface, wordlist, filter)) return 0;
     std::vector<Geoword> vec;
     dbap->getGeowordListFromWordlist(wordlist, vec); //dbap->findGeowordListBySurface(surface);
     ret.clear();
     for (std::vector<Geoword>::iterator it = vec.begin(); it != vec.end(); it++) {
-      if (this->isInActiveDictionaryAndClass(*it)) {
+      if (filter.accept(*it)) {
 	// アクティブな辞書/クラスに含まれる
 	ret.insert(std::make_pair((*it).get_geonlp_id(), (*it)));
       }
@@ -479,9 +510,21 @@ namespace geonlp
   /// @exception SqliteErrException Sqlite3でエラー。
   bool MAImpl::getWordlistBySurface(const std::string& key, Wordlist& ret) const
     throw (SqliteNotInitializedException, SqliteErrException)
+  {
+    ActiveFilterPtr filter = this->active.filter();
+    return this->getWordlistBySurface(key, ret, *filter);
+  }
+
+  /// @brief 引数に与えられた文字列から、判定器が受け付ける地名語を含む Wordlist を取得する。
+  /// @arg @c key    語幹または全体の表記
+  /// @arg ret       Wordlist オブジェクト
+  /// @arg @c filter 利用する辞書とクラスの判定器。
+  /// @return 対応するWordlistが存在した場合はtrue
+  bool MAImpl::getWordlistBySurface(const std::string& key, Wordlist& ret, const ActiveFilter& filter) const
+    throw (SqliteNotInitializedException, SqliteErrException)
   {
     // 表記に一致する Wordlist を Darts で検索する
-    Darts::DoubleArray::result_pair_type lpair = this->getLongestResultWithDarts(key, false);
+    Darts::DoubleArray::result_pair_type lpair = this->getLongestResultWithDarts(key, filter, false);
 #ifdef HAVE_LIBDAMS
     if (lpair.length != damswrapper::get_standardized_string(key).length()) return false; // 見つからない
 #else
@@ -552,8 +595,9 @@ namespace geonlp
   /// @arg @c e [in] 地名語候補を構成する素性シーケンスの末尾
   /// @arg @c next [out] 地名語に合致しない最初の素性
   /// @arg ret 地名語のリスト
+  /// @arg @c filter [in] 利用する辞書とクラスの判定器
   /// @return 得られた地名語の数
-  int MAImpl::getLongestGeoword( const NodeExtList::iterator& s, const NodeExtList::iterator& e, NodeExtList::iterator& next, std::vector<Node>& ret) const
+  int MAImpl::getLongestGeoword( const NodeExtList::iterator& s, const NodeExtList::iterator& e, NodeExtList::iterator& next, std::vector<Node>& ret, const ActiveFilter& filter) const
   {
     NodeExtList::iterator end = e;
     next = e; next++;
@@ -564,7 +608,7 @@ namespace geonlp
 		
     // Darts で最長一致する候補を絞り込む
     std::string key = joinGeowords(s, end);
-    lpair = getLongestResultWithDarts(key);
+    lpair = getLongestResultWithDarts(key, filter);
 
     for (end = e; ; end--, next--) {
 
@@ -604,7 +648,7 @@ namespace geonlp
 	    } else {
 	      // 短くなった文字列に対し、Darts の最長一致候補を再検索
 	      surface = joinGeowords(s, end);
-	      lpair = getLongestResultWithDarts(surface);
+	      lpair = getLongestResultWithDarts(surface, filter);
 	      if (lpair.length == 0) {
 		// これより短い地名語は存在しない
 		return ret.size();
@@ -655,7 +699,7 @@ namespace geonlp
 	    ; // 人名-姓, 人名-名の場合は alternative に素性を入れる
 	  }
 	}
-	node = getGeowordNode(lpair.value, alternative);
+	node = getGeowordNode(lpair.value, alternative, filter);
 	node.set_surface(surface);
 	ret.push_back(node);
 	return ret.size();
@@ -674,7 +718,7 @@ namespace geonlp
 	//	if ( findGeowordNode( withoutSuffix, node)){
 	if (withoutSuffix.length() == lpair.length) {
 	  std::string alternative = "*";
-	  node = getGeowordNode(lpair.value, alternative);
+	  node = getGeowordNode(lpair.value, alternative, filter);
 	  ret.push_back( node);
 	  ret.push_back( suffixNode( end->get_suffix()));
 	  return ret.size();
@@ -682,7 +726,7 @@ namespace geonlp
       }
 
       // darts 候補の方が短いので、もう一度候補を取得しなおす
-      lpair = getLongestResultWithDarts(key);
+      lpair = getLongestResultWithDarts(key, filter);
 			
     }
     return ret.size();
@@ -742,8 +786,9 @@ namespace geonlp
   /// @brief darts 見出し語IDから、地名語Nodeを得る。
   ///              読みしか一致しない場合は結果に含めない。
   /// @arg @c lpair [in] darts 見出し語ID
+  /// @arg @c filter [in] 利用する辞書とクラスの判定器
   /// @retval 地名語Node
-  Node MAImpl::getGeowordNode(unsigned int id, std::string& alternative) const
+  Node MAImpl::getGeowordNode(unsigned int id, std::string& alternative, const ActiveFilter& filter) const
     throw (SqliteNotInitializedException, SqliteErrException)
   {
     std::string surface;
@@ -762,12 +807,30 @@ namespace geonlp
     node.set_pronunciation(wordlist.get_yomi());
 
     // アクティブな地名語に限定した idlist を再構築
-    std::vector<Geoword> geowords;
-    this->dbap->getGeowordListFromWordlist(wordlist, geowords);
     std::string new_idlist = "";
-    for (std::vector<Geoword>::iterator it = geowords.begin(); it != geowords.end(); it++) {
-      if (this->isInActiveDictionaryAndClass(*it) && this->isSurfaceMatched(*it, surface)) { // アクティブ
-	Geoword geoword = (*it);
+    std::vector<GeowordView> views;
+    GeowordStorePtr store;
+    if (this->dbap->getGeowordViewsFromWordlist(wordlist, views, store)) {
+      // バイナリ格納ファイルのレコードで判定する（JSON を解析しない）
+      for (std::vector<GeowordView>::iterator it = views.begin(); it != views.end(); it++) {
+	if (filter.accept(*it) && this->isSurfaceMatched(*it, surface)) { // アクティブ
+	  std::string elem = (*it).get_geonlp_id() + ":" + (*it).get_typical_name();
+	  if (new_idlist.length() == 0) {
+	    new_idlist = elem;
+	  } else {
+	    new_idlist += "/" + elem;
+	  }
+	}
+      }
+      node.set_subclassification3(new_idlist);
+      return node;
+    }
+
+    std::vector<GeowordPtr> geowords;
+    this->dbap->getGeowordListFromWordlist(wordlist, geowords);
+    for (std::vector<GeowordPtr>::iterator it = geowords.begin(); it != geowords.end(); it++) {
+      if (filter.accept(**it) && this->isSurfaceMatched(**it, surface)) { // アクティブ
+	const Geoword& geoword = (**it);
 	std::string elem = geoword.get_geonlp_id() + ":" + geoword.get_typical_name();
 	if (new_idlist.length() == 0) {
 	  new_idlist = elem;
@@ -795,14 +858,17 @@ namespace geonlp
 
   /// @brief darts を利用して与えられた文字列に前方最長一致する wordlist を探す。
   /// @arg @c key [in] 先頭が地名の可能性のある検索対象文字列
+  /// @arg @c filter [in] 利用する辞書とクラスの判定器
   /// @arg bSurfaceOnly true の時、読みしか一致しない地名語は含めない。
   /// @return 最長一致する lpair 構造体、 lpair.length に一致したバイト数、 lpair.value に wordlist_id
-  Darts::DoubleArray::result_pair_type MAImpl::getLongestResultWithDarts(const std::string& key, bool bSurfaceOnly) const
+  Darts::DoubleArray::result_pair_type MAImpl::getLongestResultWithDarts(const std::string& key, const ActiveFilter& filter, bool bSurfaceOnly) const
   {
     Darts::DoubleArray::result_pair_type result_pair[1024];
     Darts::DoubleArray::result_pair_type lpair;
     geonlp::Wordlist wordlist;
-    std::vector<geonlp::Geoword> geowords;
+    std::vector<GeowordPtr> geowords;
+    std::vector<GeowordView> views;
+    GeowordStorePtr store;
     std::string idlist;
     bool in_active_theme;
 
@@ -817,14 +883,27 @@ namespace geonlp
 
     for (size_t i = 0; i < num; ++i) {
       if (result_pair[i].length > lpair.length) {
+	// アクティブな地名語を含まない見出し語は DB を参照せずに除外する
+	if (!filter.acceptWordlist(result_pair[i].value)) continue;
 	std::string surface = key_standardized.substr(0, result_pair[i].length); // 一致した文字列
 	// wordlist を取得し、 idlist を展開する
 	if (dbap->findWordlistById(result_pair[i].value, wordlist)) {
+	  if (this->dbap->getGeowordViewsFromWordlist(wordlist, views, store)) {
+	    // バイナリ格納ファイルのレコードで判定する（JSON を解析しない）
+	    for (std::vector<GeowordView>::iterator it = views.begin(); it != views.end(); it++) {
+	      if (bSurfaceOnly && !this->isSurfaceMatched(*it, surface)) continue;
+	      if (filter.accept(*it)) {
+		lpair = result_pair[i]; // アクティブな地名語を含む
+		break;
+	      }
+	    }
+	    continue;
+	  }
 	  this->dbap->getGeowordListFromWordlist(wordlist, geowords, 0);
 	  // アクティブな辞書／クラスに含まれる地名語が一つでも存在するかチェック
-	  for (std::vector<Geoword>::iterator it = geowords.begin(); it != geowords.end(); it++) {
-	    if (bSurfaceOnly && !this->isSurfaceMatched(*it, surface)) continue;
-	    if (this->isInActiveDictionaryAndClass(*it)) {
+	  for (std::vector<GeowordPtr>::iterator it = geowords.begin(); it != geowords.end(); it++) {
+	    if (bSurfaceOnly && !this->isSurfaceMatched(**it, surface)) continue;
+	    if (filter.accept(**it)) {
 	      lpair = result_pair[i]; // アクティブな地名語を含む
 	      break;
 	    }
@@ -835,42 +914,13 @@ namespace geonlp
     return lpair;
   }
 
-  // アクティブな辞書/クラスに含まれているかチェックする
-  // @arg @c geo  地名語
-  // @return      アクティブな辞書、クラスに含まれていれば true を
-  //              含まれていなければ false を返す
-  bool MAImpl::isInActiveDictionaryAndClass(const Geoword& geo) const {
-    bool is_in = false;
-    // 辞書チェック
-    if (this->activeDictionaries.size() > 0) {
-      for (std::map<int, Dictionary>::const_iterator it = this->activeDictionaries.begin(); it != this->activeDictionaries.end(); it++) {
-	if ((*it).first == geo.get_dictionary_id()) {
-	  is_in = true;
-	  break;
-	}
-      }
-      if (!is_in) return false;
-    }
-    is_in = false;
-
-    // クラスのチェック
-    if (this->activeClasses.size() > 0) {
-      std::string ne_class = geo.get_ne_class();
-      boost::regex pattern;
-      for (std::vector<std::string>::const_iterator it = this->activeClasses.begin(); it != this->activeClasses.end(); it++) {
-	if ((*it).c_str()[0] == '-') { // 除外パターン指定
-	  pattern = boost::regex((*it).substr(1), boost::regex_constants::egrep);
-	  if (boost::regex_match(ne_class, pattern)) {
-	    return false; // 除外パターンに一致したら常に不一致とする
-	  }
-	} else if (!is_in) { // まだ一致するパターンが見つかっていない場合は探す
-	  pattern = boost::regex((*it), boost::regex_constants::egrep);
-	  if (boost::regex_match(geo.get_ne_class(), pattern)) is_in = true;
-	}
-      }
-      if (!is_in) return false;
-    }
-    return true;
+  /// @brief 読み込み済みの辞書を共有するセッションを作成する。
+  ///
+  /// セッションはこの MAImpl を共有し、利用する辞書とクラスだけを独立に持つ。
+  /// MAImpl は最後のセッションが破棄されるまで解放されない。
+  /// @return 現在の利用する辞書とクラスで初期化した MASession
+  MAPtr MAImpl::createSession(void) const {
+    return MAPtr(new MASession(this->shared_from_this(), this->active.dictionaries(), this->active.classes()));
   }
 
   // 表記で一致しているかチェックする
@@ -883,6 +933,12 @@ namespace geonlp
     return false;
   }
 
+  // 表記で一致しているかチェックする（バイナリ格納ファイルのレコード）
+  bool MAImpl::isSurfaceMatched(const GeowordView& geo, const std::string& surface) const {
+    std::string prefix_str, suffix_str;
+    return geo.get_parts_for_surface(surface, prefix_str, suffix_str);
+  }
+
   /// @brief Node が地名語の場合、地名語のリストを得る
   ///        地名語ではない場合は空のマップを返す
   /// @arg   node idlist を含む Node
@@ -0,0 +1,141 @@
+///
+/// @file
+/// @brief 辞書を共有する MA のセッション MASession の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include "config.h"
+#include "GeonlpMASession.h"
+#include "GeonlpMAImplSq3.h"
+
+namespace geonlp
+{
+  /// @brief コンストラクタ。
+  /// @arg @c core          共有する MAImpl
+  /// @arg @c dictionaries  利用する辞書の初期値
+  /// @arg @c ne_classes    利用する固有名クラスの初期値
+  MASession::MASession(boost::shared_ptr<const MAImpl> core, const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes):
+    core(core), active(dictionaries, ne_classes, core->getWordlistAttributes())
+  {
+  }
+
+  /// @brief 自然文を形態素解析し、解析結果をテキストとして返す。
+  std::string MASession::parse(const std::string & sentence) const
+    throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException)
+  {
+    ActiveFilterPtr filter = this->active.filter();
+    return this->core->parse(sentence, *filter);
+  }
+
+  /// @brief 自然文を形態素解析し、解析結果の各行を要素とするノードの配列を返す。
+  int MASession::parseNode(const std::string & sentence, std::vector<Node>& ret) const
+    throw (SqliteNotInitializedException, SqliteErrException, MeCabNotInitializedException, MeCabErrException)
+  {
+    ActiveFilterPtr filter = this->active.filter();
+    return this->core->parseNode(sentence, ret, *filter);
+  }
+
+  /// @brief 引数として渡されたIDを持つ地名語エントリの全ての情報を取得する。
+  bool MASession::getGeowordEntry(const std::string& geonlp_id, Geoword& ret) const
+    throw (SqliteNotInitializedException, SqliteErrException)
+  {
+    return this->core->getGeowordEntry(geonlp_id, ret);
+  }
+
+  /// @brief 引数に与えられた文字列からGeoword候補を取得する。
+  int MASession::getGeowordEntries(const std::string & surface, std::map<std::string, Geoword>& ret) const
+    throw (SqliteNotInitializedException, SqliteErrException)
+  {
+    ActiveFilterPtr filter = this->active.filter();
+    return this->core->getGeowordEntries(surface, ret, *filter);
+  }
+
+  /// @brief Node が地名語の場合、地名語のリストを得る
+  int MASession::getGeowordEntries(const Node& node, std::map<std::string, Geoword>& ret) const
+    throw (SqliteNotInitializedException, SqliteErrException)
+  {
+    return this->core->getGeowordEntries(node, ret);
+  }
+
+  /// @brief 引数に与えられた文字列から Wordlist を取得する
+  bool MASession::getWordlistBySurface(const std::string& key, Wordlist& ret) const
+    throw (SqliteNotInitializedException, SqliteErrException)
+  {
+    ActiveFilterPtr filter = this->active.filter();
+    return this->core->getWordlistBySurface(key, ret, *filter);
+  }
+
+  /// @brief 利用する辞書を指定する
+  /// @arg @c dics   利用する辞書のIDリスト
+  ///                空の場合、登録されている全辞書を利用する
+  void MASession::setActiveDictionaries(const std::vector<int>& dics) {
+    this->active.setDictionaries(dics, *this);
+  }
+
+  /// @brief 利用する辞書を追加する
+  /// @arg @c dics 追加する辞書IDのリスト
+  void MASession::addActiveDictionaries(const std::vector<int>& dics) {
+    this->active.addDictionaries(dics, *this);
+  }
+
+  /// @brief 利用する辞書から除外する
+  /// @arg @c dics 除外する辞書IDのリスト
+  void MASession::removeActiveDictionaries(const std::vector<int>& dics) {
+    this->active.removeDictionaries(dics);
+  }
+
+  /// @brief 利用する辞書をリセットする（プロファイルのデフォルトに戻す）
+  void MASession::resetActiveDictionaries(void) {
+    this->active.assignDictionaries(this->core->getDefaultDictionaries());
+  }
+
+  /// @brief 利用するクラス正規表現を指定する
+  void MASession::setActiveClasses(const std::vector<std::string>& ne_classes) {
+    this->active.assignClasses(ne_classes);
+  }
+
+  /// @brief 利用する固有名クラスの正規表現を追加する
+  /// @arg @c ne_classes 追加するクラスの正規表現リスト
+  void MASession::addActiveClasses(const std::vector<std::string>& ne_classes) {
+    this->active.addClasses(ne_classes);
+  }
+
+  /// @brief 利用する固有名クラスの正規表現を除外する
+  /// @arg @c ne_classes 除外するクラスの正規表現リスト
+  void MASession::removeActiveClasses(const std::vector<std::string>& ne_classes) {
+    this->active.removeClasses(ne_classes);
+  }
+
+  /// @brief 利用するクラス正規表現をリセットする（プロファイルのデフォルトに戻す）
+  void MASession::resetActiveClasses(void) {
+    this->active.assignClasses(this->core->getDefaultClasses());
+  }
+
+  /// @brief 利用する辞書と固有名クラスを、他の MA から取得した値のまま設定する
+  void MASession::assignActiveSettings(const std::map<int, Dictionary>& dictionaries, const std::vector<std::string>& ne_classes) {
+    this->active.assign(dictionaries, ne_classes);
+  }
+
+  /// @brief ID で指定した辞書情報を取得する
+  bool MASession::findDictionaryById(int dictionary_id, Dictionary& ret) const {
+    return this->core->findDictionaryById(dictionary_id, ret);
+  }
+
+  /// @brief 辞書一覧を取得する
+  int MASession::getDictionaryList(std::map<int, Dictionary>& ret) const {
+    return this->core->getDictionaryList(ret);
+  }
+
+  /// @brief 辞書アクセスの統計情報を取得する
+  picojson::value MASession::getStatistics(void) const {
+    return this->core->getStatistics();
+  }
+
+  /// @brief 同じ MAImpl を共有するセッションを作成する
+  /// @return 現在の利用する辞書とクラスで初期化した MASession
+  MAPtr MASession::createSession(void) const {
+    return MAPtr(new MASession(this->core, this->active.dictionaries(), this->active.classes()));
+  }
+
+}
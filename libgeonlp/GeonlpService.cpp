@@ -10,7 +10,11 @@
 #include <string.h>
 #include <string>
 #include <sstream>
+#include <algorithm>
 #include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 #include "GeonlpService.h"
 #include "Profile.h"
 #include "Util.h"
@@ -74,6 +78,17 @@ namespace geonlp
     return picojson::value(result);
   }
 
+#ifdef HAVE_LIBDAMS
+  // DAMS はプロセス全体で一つの状態を持つため、セッション間で排他する
+  static boost::mutex dams_mutex;
+
+  // 排他制御を行って DAMS で住所を検索する
+  static void dams_retrieve(int& score, std::string& tail, std::vector<damswrapper::Candidate>& candidates, const std::string& query) {
+    boost::mutex::scoped_lock lock(dams_mutex);
+    damswrapper::retrieve(score, tail, candidates, query);
+  }
+#endif /* HAVE_LIBDAMS */
+
   // サービスを作成する
   // ジオコーダも初期化する
   ServicePtr createService(const std::string& profile) throw (ServiceCreateFailedException)
@@ -102,8 +117,20 @@ namespace geonlp
     }
 #endif /* HAVE_LIBDAMS */
 
+    // 重みのグリッドを mmap する
+    WeightGridPtr weight_grid;
+    std::string weight_grid_file = profilesp->get_weight_grid_file();
+    if (!weight_grid_file.empty()) {
+      boost::shared_ptr<WeightGrid> grid(new WeightGrid());
+      if (!grid->load(weight_grid_file)) {
+	std::string msg = std::string("Cannot load the weight grid file '") + weight_grid_file + "'.";
+	throw ServiceCreateFailedException(msg.c_str(), ServiceCreateFailedException::SERVICE);
+      }
+      weight_grid = grid;
+    }
+
     try {
-      ServicePtr servicep = ServicePtr(new Service(ma_ptr, profilesp));
+      ServicePtr servicep = ServicePtr(new Service(ma_ptr, profilesp, weight_grid));
       return servicep;
     } catch (std::runtime_error& e) {
       throw ServiceCreateFailedException(e.what(), ServiceCreateFailedException::SERVICE);
@@ -114,9 +141,121 @@ namespace geonlp
   /// GeonlpService の実装
 
   /// @brief JSON-RPC のリクエストを受け取って実行する
+  /// @param @c json_request  リクエストオブジェクト、またはその配列
+  /// @return JSON-RPC のレスポンスオブジェクト、またはその配列
+  picojson::value Service::proc(const picojson::value& json_request) {
+    if (json_request.is<picojson::array>()) {
+      return this->proc_batch(json_request.get<picojson::array>());
+    }
+    return this->proc_request(json_request);
+  }
+
+  // バッチリクエストの i 番目を、初期状態に戻したセッションで実行する
+  static void proc_batch_item(ServicePtr session, size_t i, const picojson::array* requests, std::vector<picojson::value>* responses) {
+    session->reset();
+    if ((*requests)[i].is<picojson::array>()) {
+      // バッチの入れ子は受け付けない
+      picojson::ext response;
+      response.set_value("result", picojson::value());
+      response.set_value("error", "Invalid request format");
+      response.set_value("id", picojson::value());
+      (*responses)[i] = response;
+    } else {
+      (*responses)[i] = session->proc((*requests)[i]);
+    }
+  }
+
+  /// @brief JSON-RPC のバッチリクエストを並列に実行する
+  ///
+  /// 各要素は自身のオプションと id を持つ独立したリクエストとして扱い、
+  /// このオブジェクトのオプションやコンテキストは参照も変更もしない。
+  /// @param @c requests  リクエストオブジェクトの配列
+  /// @return リクエストと同じ順に並べたレスポンスオブジェクトの配列
+  picojson::value Service::proc_batch(const picojson::array& requests) {
+    if (requests.size() == 0) {
+      picojson::ext response;
+      response.set_value("result", picojson::value());
+      response.set_value("error", "Batch request must not be empty.");
+      response.set_value("id", picojson::value());
+      return response;
+    }
+
+    size_t threads = this->_profilesp->get_batch_threads();
+    if (threads == 0) threads = boost::thread::hardware_concurrency();
+    if (threads > requests.size()) threads = requests.size();
+    if (threads < 1) threads = 1;
+
+    std::vector<picojson::value> responses(requests.size());
+    std::vector<ServicePtr> sessions;
+    for (size_t i = 0; i < threads; i++) sessions.push_back(this->createSession());
+    std::string error = run_parallel(sessions, requests.size(), boost::bind(&proc_batch_item, _1, _2, &requests, &responses));
+    if (error.length() > 0) {
+      // 実行できなかったリクエストにはエラーを返す
+      for (size_t i = 0; i < responses.size(); i++) {
+	if (!responses[i].is<picojson::null>()) continue;
+	picojson::ext response;
+	response.set_value("result", picojson::value());
+	response.set_value("error", error);
+	response.set_value("id", picojson::value());
+	if (requests[i].is<picojson::object>()) {
+	  const picojson::object& o = requests[i].get<picojson::object>();
+	  picojson::object::const_iterator it = o.find("id");
+	  if (it != o.end()) response.set_value("id", (*it).second);
+	}
+	responses[i] = response;
+      }
+    }
+    return _v_array(responses);
+  }
+
+  // run_parallel のワーカー
+  // 例外はスレッドの外に送れないので、最初のエラーメッセージを記録して残りの番号の処理を打ち切る
+  static void run_parallel_worker(ServicePtr session, size_t count, const boost::function<void (ServicePtr, size_t)>* task,
+				  size_t* next, boost::mutex* mutex, std::string* error) {
+    for (;;) {
+      size_t i;
+      {
+	boost::mutex::scoped_lock lock(*mutex);
+	if (*next >= count || error->length() > 0) return;
+	i = (*next)++;
+      }
+      try {
+	(*task)(session, i);
+      } catch (std::exception& e) {
+	boost::mutex::scoped_lock lock(*mutex);
+	if (error->length() == 0) *error = e.what();
+	if (error->length() == 0) *error = "Failed to process in a worker thread.";
+	return;
+      } catch (...) {
+	boost::mutex::scoped_lock lock(*mutex);
+	if (error->length() == 0) *error = "Failed to process in a worker thread.";
+	return;
+      }
+    }
+  }
+
+  // 0 から count - 1 までの番号の処理を、セッションごとに一つのスレッドで分担して実行する
+  std::string Service::run_parallel(const std::vector<ServicePtr>& sessions, size_t count,
+				    const boost::function<void (ServicePtr, size_t)>& task) {
+    size_t next = 0;
+    boost::mutex mutex;
+    std::string error;
+    if (sessions.size() == 1) {
+      run_parallel_worker(sessions[0], count, &task, &next, &mutex, &error);
+    } else {
+      boost::thread_group workers;
+      for (size_t i = 0; i < sessions.size(); i++) {
+	workers.create_thread(boost::bind(&run_parallel_worker, sessions[i], count, &task, &next, &mutex, &error));
+      }
+      workers.join_all();
+    }
+    return error;
+  }
+
+  /// @brief 一つの JSON-RPC リクエストを実行する
   /// @param @c json_request  リクエストオブジェクト
   /// @return JSON-RPC のレスポンスオブジェクト
-  picojson::value Service::proc(const picojson::value& json_request) {
+  picojson::value Service::proc_request(const picojson::value& json_request) {
     std::string method;
     picojson::array params;
     picojson::value id;
@@ -431,6 +570,39 @@ namespace geonlp
       if (e.has_key("option")) {
 	o.set_value("option", e.get_value("option"));
       }
+      if (e.has_key("batch")) {
+	try {
+	  o.set_value("batch", e._get_bool("batch"));
+	} catch (picojson::PicojsonException& e) {
+	  throw ServiceRequestFormatException("The \"batch\" parameter for option \"dist-server\" must be a boolean value (default:true).");
+	}
+      } else {
+	o.set_value("batch", true);
+      }
+      if (e.has_key("connect-timeout")) {
+	int timeout = 0;
+	try {
+	  timeout = e._get_int("connect-timeout");
+	} catch (picojson::PicojsonException& e) {
+	  ;
+	}
+	if (timeout <= 0) {
+	  throw ServiceRequestFormatException("The \"connect-timeout\" parameter for option \"dist-server\" must be a positive integer value in milliseconds.");
+	}
+	o.set_value("connect-timeout", timeout);
+      }
+      if (e.has_key("read-timeout")) {
+	int timeout = 0;
+	try {
+	  timeout = e._get_int("read-timeout");
+	} catch (picojson::PicojsonException& e) {
+	  ;
+	}
+	if (timeout <= 0) {
+	  throw ServiceRequestFormatException("The \"read-timeout\" parameter for option \"dist-server\" must be a positive integer value in milliseconds.");
+	}
+	o.set_value("read-timeout", timeout);
+      }
       this->_options.set_value("dist-server", o);
 
       op.erase("dist-server");
@@ -470,6 +642,41 @@ namespace geonlp
       op.erase("geojson");
     }
     
+    // 重みのグリッドを使うかどうか（プロファイルで指定されている場合のみ有効）
+    if (op.has_key("weight-grid")) {
+      picojson::value v = op.get_value("weight-grid");
+      if (v.is<bool>()) {
+	this->_options.set_value("weight-grid", v.get<bool>());
+      } else {
+	throw ServiceRequestFormatException("Option \"weight-grid\" must be a boolean value.");
+      }
+      op.erase("weight-grid");
+    }
+
+    // スライディングウィンドウ、{"sentences":<文数>} または {"nodes":<ノード数>}
+    // 前後の指定した範囲だけをコンテキストとして評価し、評価済みの文から順に結果を取り出す
+    if (op.has_key("context-window")) {
+      picojson::value v = op.get_value("context-window");
+      if (!v.is<picojson::null>()) {
+	picojson::ext window(v);
+	std::vector<std::string> keys;
+	if (v.is<picojson::object>()) keys = window.get_keys();
+	int size = 0;
+	if (keys.size() == 1 && (keys[0] == "sentences" || keys[0] == "nodes")) {
+	  try {
+	    size = window._get_int(keys[0]);
+	  } catch (picojson::PicojsonException& e) {
+	    ;
+	  }
+	}
+	if (size <= 0) {
+	  throw ServiceRequestFormatException("Option \"context-window\" must be {\"sentences\":<positive integer>} or {\"nodes\":<positive integer>}.");
+	}
+      }
+      this->_options.set_value("context-window", v);
+      op.erase("context-window");
+    }
+
     // 未処理のオプションがあればエラー
     if (op.get_keys().size() > 0) {
       std::string errmsg = "Unknown option -> ";
@@ -481,7 +688,12 @@ namespace geonlp
     }
 
     // コンテキストにもオプションをセット
-    this->_context.setOptions(this->_options);
+    // 時空間条件の書式の誤りはリクエストの誤りとして返す
+    try {
+      this->_context.setOptions(this->_options);
+    } catch (SelectConditionException& e) {
+      throw ServiceRequestFormatException(e.what());
+    }
   }
 
   // parse オプションのリセット
@@ -495,6 +707,8 @@ namespace geonlp
     this->_options.set_value("geocoding", "normal");
 #endif /* HAVE_LIBDAMS */
     this->_options.set_value("temporal-condition", picojson::null());
+    this->_options.set_value("weight-grid", true);
+    this->_options.set_value("context-window", picojson::null());
     this->_ma_ptr->resetActiveDictionaries();
     this->_ma_ptr->resetActiveClasses();
     this->_context.setOptions(this->_options);
@@ -711,6 +925,72 @@ namespace geonlp
     return varray;
   }
 
+  // i 番目の文を解析する
+  void Service::analyze_sentences_item(ServicePtr session, size_t i, const std::vector<std::string>* sentences, std::vector<picojson::array>* results) {
+    (*results)[i] = session->analyze_sentence((*sentences)[i]);
+  }
+
+  /// analyze_sentences で並列に解析するスレッド数
+  size_t Service::parse_threads(void) const {
+    size_t threads = this->_profilesp->get_parse_threads();
+    if (threads == 0) threads = boost::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+  }
+
+  /// 複数の文を現在のオプションで解析する
+  /// 文ごとの解析は独立しているので、セッションを作成して並列に実行できる
+  void Service::analyze_sentences(const std::vector<std::string>& sentences, std::vector<picojson::array>& results)
+    throw (ServiceRequestFormatException) {
+    size_t threads = this->parse_threads();
+    if (threads > sentences.size()) threads = sentences.size();
+    this->analyze_sentences(sentences, results, this->create_parse_sessions(threads));
+  }
+
+  /// analyze_sentences で使うセッションを作成する
+  /// 辞書は空でも全辞書に置き換えないよう、取得した値のまま設定する
+  std::vector<ServicePtr> Service::create_parse_sessions(size_t threads) {
+    std::vector<ServicePtr> sessions;
+    if (threads <= 1) return sessions;
+    for (size_t i = 0; i < threads; i++) {
+      ServicePtr session = this->createSession();
+      session->_options = this->_options;
+      session->_ma_ptr->assignActiveSettings(this->_ma_ptr->getActiveDictionaries(), this->_ma_ptr->getActiveClasses());
+      sessions.push_back(session);
+    }
+    return sessions;
+  }
+
+  /// 作成済みのセッションを使って複数の文を解析する
+  /// 文の数がセッションより少ない場合は、文の数だけのセッションを使う
+  void Service::analyze_sentences(const std::vector<std::string>& sentences, std::vector<picojson::array>& results,
+				  const std::vector<ServicePtr>& sessions)
+    throw (ServiceRequestFormatException) {
+    results.resize(sentences.size());
+    if (sessions.size() <= 1 || sentences.size() <= 1) {
+      for (size_t i = 0; i < sentences.size(); i++) {
+	results[i] = this->analyze_sentence(sentences[i]);
+      }
+      return;
+    }
+
+    std::vector<ServicePtr> workers(sessions.begin(), sessions.begin() + std::min(sessions.size(), sentences.size()));
+    std::string error = run_parallel(workers, sentences.size(), boost::bind(&Service::analyze_sentences_item, _1, _2, &sentences, &results));
+    if (error.length() > 0) throw ServiceRequestFormatException(error);
+  }
+
+  /// 文書全体の地名語候補の重みを dist-server に一括して問い合わせる
+  /// 問い合わせは送信だけ行い、結果は Context::evaluate で必要になった時点で待つ
+  DistServerRequestPtr Service::request_weights(const std::vector<picojson::array>& analyzed, std::vector<size_t>& bases) {
+    bases.clear();
+    if (this->_options.is_null("dist-server")) return DistServerRequestPtr();
+    DistServerRequestPtr request(new DistServerRequest(this->_options.get_value("dist-server")));
+    for (std::vector<picojson::array>::const_iterator it = analyzed.begin(); it != analyzed.end(); it++) {
+      bases.push_back(request->add(*it));
+    }
+    request->send();
+    return request;
+  }
+
   /// 一文をジオパース処理後、コンテキストキューに積む
   /// コンテキスト、オプションはクラスの状態のまま
   void Service::queue_sentence(const std::string& sentence) {
@@ -720,8 +1000,17 @@ namespace geonlp
   }
   
   /// キューに積まれている地名を解決する
-  void Service::resolve(void) {
-    this->_context.evaluate();
+  /// dist-server との通信エラーはリクエストのエラーとして返す
+  void Service::resolve(bool all) throw (ServiceRequestFormatException) {
+    try {
+      if (all) {
+	this->_context.evaluate();
+      } else {
+	this->_context.evaluateWindow();
+      }
+    } catch (ContextException& e) {
+      throw ServiceRequestFormatException(e.what());
+    }
   }
   
   /// 一文の地名解決後の結果をコンテキストキューから取得する
@@ -767,14 +1056,23 @@ namespace geonlp
       }
     } else if (params[0].is<picojson::array>()) {
       // 複数文のジオパース処理
+      // 文ごとの解析を先に（並列に）済ませ、曖昧性解決は文ごとに順に行う
       picojson::array rarray;
-      picojson::array sentences = params[0].get<picojson::array>();
-      for (std::vector<picojson::value>::iterator it = sentences.begin(); it != sentences.end(); it++) {
+      const picojson::array& params0 = params[0].get<picojson::array>();
+      std::vector<std::string> sentences;
+      for (picojson::array::const_iterator it = params0.begin(); it != params0.end(); it++) {
 	if (!(*it).is<std::string>()) throw ServiceRequestFormatException();
-	std::string& str = (*it).get<std::string>();
+	sentences.push_back((*it).get<std::string>());
+      }
+      std::vector<picojson::array> analyzed;
+      std::vector<size_t> bases;
+      this->analyze_sentences(sentences, analyzed);
+      DistServerRequestPtr request = this->request_weights(analyzed, bases);
+      for (size_t i = 0; i < analyzed.size(); i++) {
 	this->reset_context();
-	picojson::value v = this->parse_sentence(str);
-	rarray.push_back(v);
+	this->_context.addNodes(analyzed[i], request, request ? bases[i] : 0);
+	this->resolve();
+	rarray.push_back(this->dequeue_sentence());
       }
       result = _v_array(rarray);
     }
@@ -809,22 +1107,47 @@ namespace geonlp
     } else {
       picojson::array params0 = params[0].get<picojson::array>();
       picojson::array rarray;
+      std::vector<std::string> sentences;
       for (picojson::array::iterator it = params0.begin(); it != params0.end(); it++) {
 	// パラメータ 1 の要素をチェック
-	if ((*it).is<std::string>()) { // 文字列要素はキューに積む
-	  this->queue_sentence((*it).get<std::string>());
+	if ((*it).is<std::string>()) { // 文字列要素は解析対象にする
+	  sentences.push_back((*it).get<std::string>());
 	  rarray.push_back(vnull); // 代わりに null を入れておく
 	} else { // それ以外の要素はそのまま返す
 	  rarray.push_back(*it);
 	}
       }
-      this->resolve(); // 地名解決実行
+      // 文を「ウィンドウの大きさ + スレッド数」ずつまとめて解析し、元の順にキューに積む
+      // context-window オプションがあれば、範囲が揃って評価済みになった文から順に結果を戻し、
+      // コンテキストと解析済みの文に保持するノードを一定の数に抑える
+      // dist-server への問い合わせも、まとめて解析した文ごとに送信する
+      // 並列に解析するセッションは最初に一度だけ作り、すべてのまとまりで使い回す
+      size_t chunk = (size_t)std::max(0, this->_context.getWindow()) + this->parse_threads();
+      std::vector<ServicePtr> sessions = this->create_parse_sessions(std::min(this->parse_threads(), sentences.size()));
+      picojson::array::iterator it_result = rarray.begin();
+      for (size_t begin = 0; begin < sentences.size(); begin += chunk) {
+	size_t end = std::min(begin + chunk, sentences.size());
+	std::vector<std::string> part(sentences.begin() + begin, sentences.begin() + end);
+	std::vector<picojson::array> analyzed;
+	std::vector<size_t> bases;
+	this->analyze_sentences(part, analyzed, sessions);
+	DistServerRequestPtr request = this->request_weights(analyzed, bases);
+	for (size_t i = 0; i < analyzed.size(); i++) {
+	  this->_context.addNodes(analyzed[i], request, request ? bases[i] : 0);
+	  picojson::array().swap(analyzed[i]);
+	  this->resolve(false);
+	  while (this->_context.hasEvaluatedSentence()) {
+	    while (it_result != rarray.end() && !(*it_result).is<picojson::null>()) it_result++;
+	    if (it_result == rarray.end()) break;
+	    (*it_result) = this->dequeue_sentence();
+	    it_result++;
+	  }
+	}
+      }
+      this->resolve(); // 残りの地名解決実行
       // 解析結果を戻す
-      for (picojson::array::iterator it = rarray.begin(); it != rarray.end(); it++) {
-	if (!(*it).is<picojson::null>()) continue;
-	const picojson::value& v = this->dequeue_sentence();
-	it = rarray.erase(it);
-	rarray.insert(it, v);
+      for (; it_result != rarray.end(); it_result++) {
+	if ((*it_result).is<picojson::null>()) (*it_result) = this->dequeue_sentence();
       }
       
       result = _v_array(rarray);
@@ -1128,7 +1451,7 @@ namespace geonlp
 
     while (tail.length() > 0) {
       // std::cerr << "retrieve::surface:'" << surface << "'\n";
-      damswrapper::retrieve(score, tail, candidates, surface);
+      dams_retrieve(score, tail, candidates, surface);
 
       if (score < 4) return false; // 二階層以上が一致する候補なし
 
@@ -1187,7 +1510,7 @@ namespace geonlp
     if (params[0].is<std::string>()) {
       // １つの住所文字列のジオコーディング処理
       std::string address_string = params[0].get<std::string>();
-      damswrapper::retrieve(score, tail, candidates, address_string);
+      dams_retrieve(score, tail, candidates, address_string);
       surface = address_string.substr(0, address_string.length() - tail.length());
       if (score < 1) {
 	address.set_surface(surface);
@@ -1202,7 +1525,7 @@ namespace geonlp
       for (std::vector<picojson::value>::iterator it = params0.begin(); it != params0.end(); it++) {
 	if (!(*it).is<std::string>()) throw ServiceRequestFormatException();
 	std::string& address_string = (*it).get<std::string>();
-	damswrapper::retrieve(score, tail, candidates, address_string);
+	dams_retrieve(score, tail, candidates, address_string);
 	surface = address_string.substr(0, address_string.length() - tail.length());
 	address.clear();
 	if (score < 1) {
@@ -105,11 +105,15 @@ namespace geonlp
   /// prefix_no, suffix_no には何番目の接頭辞、接尾辞を利用するかが入る
   /// 一致しない場合 false, 一致する組み合わせがあれば true を返す
   bool Geoword::get_prefix_and_suffix_no(const std::string& surface, int& prefix_no, int& suffix_no) const {
+    return Geoword::match_prefix_and_suffix(this->get_prefix(), this->get_body(), this->get_suffix(), surface, prefix_no, suffix_no);
+  }
+
+  /// 接頭辞リスト、語幹、接尾辞リストの組み合わせで、指定した表記に一致するものを探す
+  /// prefix_no, suffix_no には何番目の接頭辞、接尾辞を利用するかが入る（省略されている場合は -1）
+  /// 一致しない場合 false, 一致する組み合わせがあれば true を返す
+  bool Geoword::match_prefix_and_suffix(std::vector<std::string> prefix, const std::string& body, std::vector<std::string> suffix, const std::string& surface, int& prefix_no, int& suffix_no) {
     bool is_prefix_omitted = false;
     bool is_suffix_omitted = false;
-    std::vector<std::string> prefix = this->get_prefix();
-    std::vector<std::string> suffix = this->get_suffix();
-    std::string body = this->get_body();
     std::string standardized = surface;
     if (prefix.size() == 0) {
       is_prefix_omitted = true;
@@ -0,0 +1,105 @@
+///
+/// @file
+/// @brief 地名語キャッシュ GeowordCache の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include "GeowordCache.h"
+
+namespace geonlp
+{
+  /// @brief コンストラクタ。
+  /// @arg @c capacity  上限バイト数（0 の場合はキャッシュしない）
+  GeowordCache::GeowordCache(size_t capacity) {
+    for (int i = 0; i < GEOWORD_CACHE_SHARDS; i++) {
+      this->_shards.push_back(new Shard());
+    }
+    this->_shard_capacity = capacity / GEOWORD_CACHE_SHARDS;
+  }
+
+  /// @brief デストラクタ。
+  GeowordCache::~GeowordCache() {
+    for (std::vector<Shard*>::iterator it = this->_shards.begin(); it != this->_shards.end(); it++) {
+      delete (*it);
+    }
+  }
+
+  /// @brief キャッシュから地名語を取得する
+  /// @arg @c geonlp_id  地名語 ID
+  /// @return 地名語、キャッシュに無い場合は NULL
+  GeowordPtr GeowordCache::get(const std::string& geonlp_id) const {
+    Shard& shard = this->shardOf(geonlp_id);
+    boost::mutex::scoped_lock lock(shard.mutex);
+    boost::unordered_map<std::string, EntryList::iterator>::iterator it = shard.index.find(geonlp_id);
+    if (it == shard.index.end()) {
+      shard.misses++;
+      return GeowordPtr();
+    }
+    // 最近利用したものとして先頭に移動
+    shard.lru.splice(shard.lru.begin(), shard.lru, (*it).second);
+    shard.hits++;
+    return (*it).second->geoword;
+  }
+
+  /// @brief キャッシュに地名語を登録する
+  ///
+  /// 上限を超えた場合は、同じシャード内で最も長く利用されていないものから追い出す。
+  /// @arg @c geoword  地名語
+  /// @arg @c bytes    地名語の推定バイト数
+  void GeowordCache::put(GeowordPtr geoword, size_t bytes) {
+    if (!geoword || !geoword->isValid()) return;
+    const std::string geonlp_id = geoword->get_geonlp_id();
+    bytes += geonlp_id.length();
+    if (bytes > this->_shard_capacity) return; // 容量不足
+
+    Shard& shard = this->shardOf(geonlp_id);
+    boost::mutex::scoped_lock lock(shard.mutex);
+    boost::unordered_map<std::string, EntryList::iterator>::iterator it = shard.index.find(geonlp_id);
+    if (it != shard.index.end()) {
+      // 置き換え
+      shard.bytes -= (*it).second->bytes;
+      shard.lru.erase((*it).second);
+      shard.index.erase(it);
+    }
+    shard.lru.push_front(Entry(geonlp_id, geoword, bytes));
+    shard.index[geonlp_id] = shard.lru.begin();
+    shard.bytes += bytes;
+
+    while (shard.bytes > this->_shard_capacity && !shard.lru.empty()) {
+      Entry& last = shard.lru.back();
+      shard.bytes -= last.bytes;
+      shard.index.erase(last.geonlp_id);
+      shard.lru.pop_back();
+      shard.evictions++;
+    }
+  }
+
+  /// @brief キャッシュを空にする（統計情報は保持する）
+  void GeowordCache::clear(void) {
+    for (std::vector<Shard*>::iterator it = this->_shards.begin(); it != this->_shards.end(); it++) {
+      boost::mutex::scoped_lock lock((*it)->mutex);
+      (*it)->lru.clear();
+      (*it)->index.clear();
+      (*it)->bytes = 0;
+    }
+  }
+
+  /// @brief 統計情報を取得する
+  GeowordCacheStats GeowordCache::getStats(void) const {
+    GeowordCacheStats stats;
+    stats.hits = stats.misses = stats.evictions = stats.entries = 0;
+    stats.bytes = 0;
+    stats.capacity = this->getCapacity();
+    for (std::vector<Shard*>::const_iterator it = this->_shards.begin(); it != this->_shards.end(); it++) {
+      boost::mutex::scoped_lock lock((*it)->mutex);
+      stats.hits += (*it)->hits;
+      stats.misses += (*it)->misses;
+      stats.evictions += (*it)->evictions;
+      stats.entries += (*it)->lru.size();
+      stats.bytes += (*it)->bytes;
+    }
+    return stats;
+  }
+
+}
@@ -0,0 +1,213 @@
+///
+/// @file
+/// @brief 地名語のバイナリ格納ファイル GeowordStore の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "GeowordStore.h"
+
+/// ファイルの先頭に置くマジック
+#define GEOWORD_STORE_MAGIC      "GNLPGW01"
+#define GEOWORD_STORE_MAGIC_LEN  8
+
+/// ヘッダのバイト数（マジック, レコード数, 固有名クラス数, 文字列プールのバイト数, 予約）
+#define GEOWORD_STORE_HEADER_LEN (GEOWORD_STORE_MAGIC_LEN + sizeof(boost::uint32_t) * 4)
+
+namespace geonlp
+{
+  /// @brief 文字列プールの文字列を得る
+  std::string GeowordView::string(boost::uint32_t offset) const {
+    return std::string(this->_store->get_string(offset));
+  }
+
+  /// @brief 文字列プールのリストを得る
+  std::vector<std::string> GeowordView::list(boost::uint32_t offset) const {
+    std::vector<std::string> ret;
+    const char* p = this->_store->get_string(offset);
+    if (*p == '\0') return ret;
+    for (;;) {
+      const char* q = std::strchr(p, GEOWORD_STORE_LIST_SEP);
+      if (q == NULL) {
+	ret.push_back(std::string(p));
+	break;
+      }
+      ret.push_back(std::string(p, q - p));
+      p = q + 1;
+    }
+    return ret;
+  }
+
+  /// @brief 固有名クラスを得る
+  std::string GeowordView::get_ne_class() const {
+    return std::string(this->_store->get_ne_class(this->_record->ne_class_id));
+  }
+
+  /// @brief 指定した表記に一致する接頭辞、接尾辞を得る
+  /// 一致しない場合 false, 一致する組み合わせがあれば true を返す
+  /// @note Geoword::get_parts_for_surface と同じ結果を返す
+  bool GeowordView::get_parts_for_surface(const std::string& surface, std::string& prefix, std::string& suffix) const {
+    int prefix_no, suffix_no;
+    std::vector<std::string> prefixes = this->get_prefix();
+    std::vector<std::string> suffixes = this->get_suffix();
+    prefix = "";
+    suffix = "";
+    if (!Geoword::match_prefix_and_suffix(prefixes, this->get_body(), suffixes, surface, prefix_no, suffix_no)) return false;
+    if (prefix_no >= 0) prefix = prefixes[prefix_no];
+    if (suffix_no >= 0) suffix = suffixes[suffix_no];
+    return true;
+  }
+
+  /// @brief JSON を解析して Geoword に変換する
+  Geoword GeowordView::toGeoword(void) const {
+    Geoword geoword;
+    geoword.initByJson(this->get_json());
+    return geoword;
+  }
+
+  /// @brief ファイルを mmap する
+  /// @arg @c filename  updateWordlists が保存したファイル名
+  /// @return 読み込めた場合は true、ファイルが無いか形式が不正な場合は false
+  bool GeowordStore::load(const std::string& filename) {
+    boost::shared_ptr<boost::interprocess::mapped_region> region;
+    try {
+      boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+      region = boost::shared_ptr<boost::interprocess::mapped_region>(new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only));
+    } catch (boost::interprocess::interprocess_exception& e) {
+      return false;
+    }
+
+    const char* data = (const char*)region->get_address();
+    size_t size = region->get_size();
+    if (size < GEOWORD_STORE_HEADER_LEN) return false;
+    if (std::memcmp(data, GEOWORD_STORE_MAGIC, GEOWORD_STORE_MAGIC_LEN) != 0) return false;
+    const boost::uint32_t* header = (const boost::uint32_t*)(data + GEOWORD_STORE_MAGIC_LEN);
+    size_t records_len = sizeof(GeowordRecord) * (size_t)header[0];
+    size_t classes_len = sizeof(boost::uint32_t) * (size_t)header[1];
+    if (size != GEOWORD_STORE_HEADER_LEN + records_len + classes_len + header[2]) return false;
+
+    this->_count = header[0];
+    this->_class_count = header[1];
+    this->_pool_size = header[2];
+    this->_records = (const GeowordRecord*)(data + GEOWORD_STORE_HEADER_LEN);
+    this->_classes = (const boost::uint32_t*)(data + GEOWORD_STORE_HEADER_LEN + records_len);
+    this->_pool = data + GEOWORD_STORE_HEADER_LEN + records_len + classes_len;
+    this->_region = region;
+    return true;
+  }
+
+  /// @brief geonlp_id で地名語を検索する
+  /// @arg @c geonlp_id  地名語 ID
+  /// @arg ret           地名語レコードの参照
+  /// @return 見つかった場合は true
+  bool GeowordStore::find(const std::string& geonlp_id, GeowordView& ret) const {
+    const char* key = geonlp_id.c_str();
+    size_t lo = 0, hi = this->_count;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      int c = std::strcmp(this->get_string(this->_records[mid].geonlp_id), key);
+      if (c == 0) {
+	ret = GeowordView(this, &this->_records[mid]);
+	return true;
+      }
+      if (c < 0) lo = mid + 1;
+      else hi = mid;
+    }
+    ret = GeowordView();
+    return false;
+  }
+
+  /// @brief 文字列を文字列プールに追加する
+  /// @exception std::runtime_error 文字列プールが 32 ビットのオフセットで表せない大きさになる
+  boost::uint32_t GeowordStoreBuilder::addString(const std::string& str) throw (std::runtime_error) {
+    if ((boost::uint64_t)this->_pool.size() + str.size() + 1 > (boost::uint64_t)0xffffffffU)
+      throw std::runtime_error("Geoword store is too large.");
+    boost::uint32_t offset = this->_pool.size();
+    this->_pool.append(str);
+    this->_pool.push_back('\0');
+    return offset;
+  }
+
+  /// @brief リストを文字列プールに追加する
+  boost::uint32_t GeowordStoreBuilder::addList(const std::vector<std::string>& list) throw (std::runtime_error) {
+    std::string joined;
+    for (std::vector<std::string>::const_iterator it = list.begin(); it != list.end(); it++) {
+      if (it != list.begin()) joined += GEOWORD_STORE_LIST_SEP;
+      joined += (*it);
+    }
+    return this->addString(joined);
+  }
+
+  /// @brief 地名語を追加する
+  /// @arg @c geoword  地名語
+  /// @arg @c json     地名語の JSON 表記（geoword テーブルの json カラム）
+  /// @exception std::runtime_error 文字列プールが 32 ビットのオフセットで表せない大きさになる
+  void GeowordStoreBuilder::add(const Geoword& geoword, const std::string& json) throw (std::runtime_error) {
+    GeowordRecord record;
+    std::memset(&record, 0, sizeof(record));
+
+    std::string ne_class = geoword.get_ne_class();
+    std::map<std::string, boost::uint32_t>::iterator it = this->_class_ids.find(ne_class);
+    if (it == this->_class_ids.end()) {
+      it = this->_class_ids.insert(std::make_pair(ne_class, (boost::uint32_t)this->_class_offsets.size())).first;
+      this->_class_offsets.push_back(this->addString(ne_class));
+    }
+
+    record.geonlp_id = this->addString(geoword.get_geonlp_id());
+    record.dictionary_id = geoword.get_dictionary_id();
+    record.ne_class_id = (*it).second;
+    if (geoword.getCoordinates(record.latitude, record.longitude)) {
+      record.flags |= GEOWORD_RECORD_HAS_COORDINATES;
+    } else {
+      record.latitude = record.longitude = 0.0;
+    }
+    record.body = this->addString(geoword.get_body());
+    record.body_kana = this->addString(geoword.get_body_kana());
+    record.typical_name = this->addString(geoword.get_typical_name());
+    record.typical_kana = this->addString(geoword.get_typical_kana());
+    record.prefix = this->addList(geoword.get_prefix());
+    record.suffix = this->addList(geoword.get_suffix());
+    record.prefix_kana = this->addList(geoword.get_prefix_kana());
+    record.suffix_kana = this->addList(geoword.get_suffix_kana());
+    record.hypernym = this->addList(geoword.get_hypernym());
+    record.json = this->addString(json);
+    this->_records.push_back(record);
+  }
+
+  /// geonlp_id の昇順に並べるための比較関数
+  struct GeowordRecordLess {
+    const std::string& pool;
+    GeowordRecordLess(const std::string& p): pool(p) {}
+    bool operator()(const GeowordRecord& a, const GeowordRecord& b) const {
+      return std::strcmp(pool.c_str() + a.geonlp_id, pool.c_str() + b.geonlp_id) < 0;
+    }
+  };
+
+  /// @brief ファイルに保存する
+  /// @arg @c filename  保存するファイル名
+  /// @exception std::runtime_error 書き込みに失敗
+  void GeowordStoreBuilder::save(const std::string& filename) const throw (std::runtime_error) {
+    std::vector<GeowordRecord> records(this->_records);
+    std::sort(records.begin(), records.end(), GeowordRecordLess(this->_pool));
+
+    boost::uint32_t header[4] = {
+      (boost::uint32_t)records.size(), (boost::uint32_t)this->_class_offsets.size(), (boost::uint32_t)this->_pool.size(), 0
+    };
+
+    std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs) throw std::runtime_error(std::string("Cannot open '") + filename + "' for writing.");
+    ofs.write(GEOWORD_STORE_MAGIC, GEOWORD_STORE_MAGIC_LEN);
+    ofs.write((const char*)header, sizeof(header));
+    if (records.size() > 0) ofs.write((const char*)&records[0], sizeof(GeowordRecord) * records.size());
+    if (this->_class_offsets.size() > 0) ofs.write((const char*)&this->_class_offsets[0], sizeof(boost::uint32_t) * this->_class_offsets.size());
+    ofs.write(this->_pool.data(), this->_pool.size());
+    ofs.close();
+    if (!ofs) throw std::runtime_error(std::string("Cannot write geoword store to '") + filename + "'.");
+  }
+
+}
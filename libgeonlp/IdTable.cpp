@@ -0,0 +1,109 @@
+///
+/// @file
+/// @brief 文字列を整数 ID に変換する StringIdTable と、ID をキーとする IdHashMap の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include <boost/functional/hash.hpp>
+#include "IdTable.h"
+
+/// 表の最小のスロット数（2 のべき乗）
+#define ID_TABLE_MIN_CAPACITY 8
+
+namespace geonlp
+{
+  const boost::uint32_t IdHashMap::npos;
+  const boost::uint32_t StringIdTable::npos;
+
+  /// IdHashMap の実装
+
+  // スロット数を変更して再配置する
+  void IdHashMap::rehash(size_t capacity) {
+    std::vector<std::pair<boost::uint32_t, boost::uint32_t> > old;
+    old.swap(this->_slots);
+    this->_slots.assign(capacity, std::make_pair((boost::uint32_t)0, npos));
+    for (size_t i = 0; i < old.size(); i++) {
+      if (old[i].second == npos) continue;
+      size_t j = this->slotOf(old[i].first);
+      while (this->_slots[j].second != npos) j = (j + 1) & (capacity - 1);
+      this->_slots[j] = old[i];
+    }
+  }
+
+  // キーに値を登録する（登録済みなら置き換える）
+  // 使用率が 1/2 を超えないようにスロット数を倍にする
+  void IdHashMap::insert(boost::uint32_t key, boost::uint32_t value) {
+    if (this->_slots.size() == 0) {
+      this->rehash(ID_TABLE_MIN_CAPACITY);
+    } else if ((this->_size + 1) * 2 > this->_slots.size()) {
+      this->rehash(this->_slots.size() * 2);
+    }
+    size_t i = this->slotOf(key);
+    while (this->_slots[i].second != npos && this->_slots[i].first != key) {
+      i = (i + 1) & (this->_slots.size() - 1);
+    }
+    if (this->_slots[i].second == npos) this->_size++;
+    this->_slots[i] = std::make_pair(key, value);
+  }
+
+  // 全要素を削除する
+  void IdHashMap::clear(void) {
+    this->_slots.clear();
+    this->_size = 0;
+  }
+
+  /// StringIdTable の実装
+
+  // バケット数を変更して再配置する
+  void StringIdTable::rehash(size_t capacity) {
+    this->_buckets.assign(capacity, npos);
+    for (size_t id = 0; id < this->_strings.size(); id++) {
+      size_t i = this->_hashes[id] & (capacity - 1);
+      while (this->_buckets[i] != npos) i = (i + 1) & (capacity - 1);
+      this->_buckets[i] = (boost::uint32_t)id;
+    }
+  }
+
+  // 文字列が格納されているか、格納すべきバケットの位置
+  size_t StringIdTable::bucketOf(const std::string& str, size_t hash) const {
+    size_t mask = this->_buckets.size() - 1;
+    size_t i = hash & mask;
+    while (this->_buckets[i] != npos) {
+      boost::uint32_t id = this->_buckets[i];
+      if (this->_hashes[id] == hash && this->_strings[id] == str) break;
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  // 文字列の ID を取得する、未登録の場合は新しい ID を割り当てる
+  boost::uint32_t StringIdTable::intern(const std::string& str) {
+    if (this->_buckets.size() == 0) {
+      this->rehash(ID_TABLE_MIN_CAPACITY);
+    } else if ((this->_strings.size() + 1) * 2 > this->_buckets.size()) {
+      this->rehash(this->_buckets.size() * 2);
+    }
+    size_t hash = boost::hash<std::string>()(str);
+    size_t i = this->bucketOf(str, hash);
+    if (this->_buckets[i] == npos) {
+      this->_buckets[i] = (boost::uint32_t)this->_strings.size();
+      this->_strings.push_back(str);
+      this->_hashes.push_back(hash);
+    }
+    return this->_buckets[i];
+  }
+
+  // 文字列の ID を取得する、未登録の場合は npos を返す
+  boost::uint32_t StringIdTable::find(const std::string& str) const {
+    if (this->_strings.size() == 0) return npos;
+    return this->_buckets[this->bucketOf(str, boost::hash<std::string>()(str))];
+  }
+
+  // 全文字列を削除する
+  void StringIdTable::clear(void) {
+    this->_strings.clear();
+    this->_hashes.clear();
+    this->_buckets.clear();
+  }
+}
@@ -2,113 +2,186 @@
 /// @file   JsonRpcClient.cpp
 /// @brief  分布情報管理サーバ通信用 JSON RPC クライアントの実装
 /// @author 株式会社情報試作室
-/// 
+///
 /// Copyright (c)2014, NII
-/// 
+///
 
 #include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/algorithm/string.hpp>
 #include "JsonRpcClient.h"
 
 using boost::asio::ip::tcp;
 namespace geonlp
 {
 
-  // コンストラクタ
-  // @param server   サーバのホスト名
-  // @param path     接続する URL のパス
-  // @param message  ポストするメッセージ
-  JsonRpcClient::JsonRpcClient(boost::asio::io_service& io_service,
-			       const std::string& server, const std::string& path, const std::string& message, const std::string& port)
-    throw (JsonRpcClientException, picojson::PicojsonException)
-    :resolver_(io_service), socket_(io_service) {
-
-    headers_.clear();
-    content_ = "";
-    
-    std::ostream request_stream(&request_);
-    request_stream << "POST " << path << " HTTP/1.0\r\n";
-    request_stream << "Host: " << server << "\r\n";
-    request_stream << "Accept: */*\r\n";
-    if (message.length() > 0) {
-      request_stream << "Content-Type: text/plain\r\n";
-      request_stream << "Content-Length: " << message.length() << "\r\n";
-    }
-    request_stream << "Connection: close\r\n\r\n";
-    
-    if (message.length() > 0) {
-      request_stream << message << "\r\n";
-    }
-
-    // HTTP でサーバに接続を開始する
-    // tcp::resolver::query query(server, "http");
-    tcp::resolver::query query(server, port);
-
-    resolver_.async_resolve(query,
-			    boost::bind(&JsonRpcClient::handle_resolve, this,
-					boost::asio::placeholders::error,
-					boost::asio::placeholders::iterator));
-  }
+  /// @brief 一つの持続的な HTTP/1.1 接続
+  ///
+  /// 接続ごとに io_service を持ち、非同期処理を期限付きで完了まで待つことで
+  /// 同期的に利用する。同時に利用できるのは一つのスレッドだけ。
+  class JsonRpcConnection {
+  private:
+    boost::asio::io_service _io_service;
+    tcp::resolver _resolver;
+    tcp::socket _socket;
+    boost::asio::deadline_timer _timer;
+    boost::asio::streambuf _response;
+    boost::system::error_code _ec; // 実行中の非同期処理の結果
+    bool _timed_out;
+    bool _received;                // レスポンスを受信し始めたかどうか
 
-  // サーバレスポンスを JSON オブジェクトとして取得
-  // @result    json オブジェクト (picojson::ext オブジェクト）
-  picojson::ext JsonRpcClient::getJsonResponse(void) throw (picojson::PicojsonException) {
-    return picojson::ext(this->content_);
-  }
+    // 非同期処理の完了時に呼び出される
+    void handle_io(const boost::system::error_code& err) {
+      this->_ec = err;
+    }
 
-  void JsonRpcClient::handle_resolve(const boost::system::error_code& err,
-				     tcp::resolver::iterator endpoint_iterator) {
-    if (!err) {
-      // 名前を解決して、得られたリストに順番に接続を試す
-      tcp::endpoint endpoint = *endpoint_iterator;
-      socket_.async_connect(endpoint,
-			    boost::bind(&JsonRpcClient::handle_connect, this,
-					boost::asio::placeholders::error, ++endpoint_iterator));
-    } else {
-      throw JsonRpcClientException(err.message());
+    // 名前解決の完了時に呼び出される
+    void handle_resolve(const boost::system::error_code& err, tcp::resolver::iterator it,
+			std::vector<tcp::endpoint>* endpoints) {
+      for (; !err && it != tcp::resolver::iterator(); it++) endpoints->push_back(*it);
+      this->_ec = err;
     }
-  }
 
-  void JsonRpcClient::handle_connect(const boost::system::error_code& err,
-				     tcp::resolver::iterator endpoint_iterator) {
-    if (!err) {
-      // 接続成功、リクエストメッセージ送信に進む
-      boost::asio::async_write(socket_, request_,
-			       boost::bind(&JsonRpcClient::handle_write_request, this,
-					   boost::asio::placeholders::error));
-    } else if (endpoint_iterator != tcp::resolver::iterator()) {
-      // 接続失敗したので次のエンドポイントを試す
-      socket_.close();
-      tcp::endpoint endpoint = *endpoint_iterator;
-      socket_.async_connect(endpoint,
-			    boost::bind(&JsonRpcClient::handle_connect, this,
-					boost::asio::placeholders::error, ++endpoint_iterator));
-    } else {
-      throw JsonRpcClientException(err.message());
+    // 期限を迎えた場合に呼び出される、実行中の処理を中断する
+    void handle_timeout(const boost::system::error_code& err) {
+      if (err) return; // 期限前に処理が完了してキャンセルされた
+      this->_timed_out = true;
+      boost::system::error_code ignored;
+      this->_resolver.cancel();
+      this->_socket.close(ignored);
     }
-  }
 
-  void JsonRpcClient::handle_write_request(const boost::system::error_code& err) {
-    if (!err) {
-      // ステータスラインの読み込みに進む
-      boost::asio::async_read_until(socket_, response_, "\r\n",
-				    boost::bind(&JsonRpcClient::handle_read_status_line, this,
-						boost::asio::placeholders::error));
-    } else {
-      throw JsonRpcClientException(err.message());
+    // @brief 開始済みの非同期処理が完了するか、期限を迎えるまで待つ
+    // @arg allow_eof  true の場合、接続が閉じられても例外にせず false を返す
+    bool wait(const boost::posix_time::ptime& deadline, bool allow_eof = false)
+      throw (JsonRpcClientException) {
+      this->_timed_out = false;
+      this->_timer.expires_at(deadline);
+      this->_timer.async_wait(boost::bind(&JsonRpcConnection::handle_timeout, this,
+					  boost::asio::placeholders::error));
+      while (this->_ec == boost::asio::error::would_block) this->_io_service.run_one();
+      this->_timer.cancel();
+      this->_io_service.run(); // タイマーのハンドラを回収する
+      this->_io_service.reset();
+      if (this->_timed_out) throw JsonRpcClientException("Request timed out");
+      if (allow_eof && this->_ec == boost::asio::error::eof) return false;
+      if (this->_ec) throw JsonRpcClientException(this->_ec.message());
+      return true;
     }
-  }
 
-  void JsonRpcClient::handle_read_status_line(const boost::system::error_code& err) {
-    if (!err) {
-      // HTTP レスポンスが OK であることを確認する
-      std::istream response_stream(&response_);
+    // 受信済みのデータが n バイト以上になるまで読み込む
+    void fill(size_t n, const boost::posix_time::ptime& deadline) throw (JsonRpcClientException) {
+      if (this->_response.size() >= n) return;
+      this->_ec = boost::asio::error::would_block;
+      boost::asio::async_read(this->_socket, this->_response,
+			      boost::asio::transfer_exactly(n - this->_response.size()),
+			      boost::bind(&JsonRpcConnection::handle_io, this, boost::asio::placeholders::error));
+      this->wait(deadline);
+    }
+
+    // 受信済みのデータに区切り文字列が含まれるまで読み込み、その行を返す
+    std::string read_line(const boost::posix_time::ptime& deadline) throw (JsonRpcClientException) {
+      this->_ec = boost::asio::error::would_block;
+      boost::asio::async_read_until(this->_socket, this->_response, "\r\n",
+				    boost::bind(&JsonRpcConnection::handle_io, this, boost::asio::placeholders::error));
+      this->wait(deadline);
+      std::istream is(&this->_response);
+      std::string line;
+      std::getline(is, line);
+      if (line.length() > 0 && line[line.length() - 1] == '\r') line.erase(line.length() - 1);
+      return line;
+    }
+
+    // 受信済みのデータの先頭 n バイトを取り出す
+    std::string take(size_t n) {
+      boost::asio::streambuf::const_buffers_type data = this->_response.data();
+      std::string s(boost::asio::buffers_begin(data), boost::asio::buffers_begin(data) + n);
+      this->_response.consume(n);
+      return s;
+    }
+
+  public:
+    JsonRpcConnection(): _resolver(_io_service), _socket(_io_service), _timer(_io_service),
+			 _timed_out(false), _received(false) {}
+
+    // @brief 直前の post の失敗が、サーバ側で閉じられていた接続によるものかどうか
+    // 期限切れではなく、レスポンスを 1 バイトも受信しないうちに eof または
+    // connection reset で失敗した場合に限る。この場合はサーバはリクエストを処理していない。
+    inline bool closedByPeer(void) const {
+      if (this->_timed_out || this->_received || this->_response.size() > 0) return false;
+      return this->_ec == boost::asio::error::eof
+	|| this->_ec == boost::asio::error::connection_reset
+	|| this->_ec == boost::asio::error::broken_pipe;
+    }
+
+    // 名前を解決する
+    void resolve(const std::string& host, const std::string& port,
+		 const boost::posix_time::ptime& deadline, std::vector<tcp::endpoint>& endpoints)
+      throw (JsonRpcClientException) {
+      tcp::resolver::query query(host, port);
+      this->_ec = boost::asio::error::would_block;
+      this->_resolver.async_resolve(query,
+				    boost::bind(&JsonRpcConnection::handle_resolve, this,
+						boost::asio::placeholders::error,
+						boost::asio::placeholders::iterator, &endpoints));
+      this->wait(deadline);
+    }
+
+    // 得られたエンドポイントに順番に接続を試す
+    void connect(const std::vector<tcp::endpoint>& endpoints, const boost::posix_time::ptime& deadline)
+      throw (JsonRpcClientException) {
+      std::string message = "No address found";
+      for (std::vector<tcp::endpoint>::const_iterator it = endpoints.begin(); it != endpoints.end(); it++) {
+	boost::system::error_code ignored;
+	this->_socket.close(ignored);
+	this->_ec = boost::asio::error::would_block;
+	this->_socket.async_connect(*it, boost::bind(&JsonRpcConnection::handle_io, this,
+						     boost::asio::placeholders::error));
+	try {
+	  this->wait(deadline);
+	  this->_socket.set_option(tcp::no_delay(true), ignored);
+	  return;
+	} catch (JsonRpcClientException& e) {
+	  if (this->_timed_out) throw;
+	  message = e.what();
+	}
+      }
+      throw JsonRpcClientException(message);
+    }
+
+    // @brief メッセージを POST してレスポンスのコンテンツを受信する
+    // @arg keep_alive  接続を再利用できる場合に true がセットされる
+    std::string post(const std::string& host, const std::string& path, const std::string& message,
+		     const boost::posix_time::ptime& deadline, bool& keep_alive)
+      throw (JsonRpcClientException) {
+      keep_alive = false;
+      this->_received = false;
+      this->_response.consume(this->_response.size());
+
+      std::ostringstream request;
+      request << "POST " << path << " HTTP/1.1\r\n";
+      request << "Host: " << host << "\r\n";
+      request << "Accept: */*\r\n";
+      request << "Content-Type: text/plain\r\n";
+      request << "Content-Length: " << message.length() << "\r\n";
+      request << "Connection: keep-alive\r\n\r\n";
+      request << message;
+      std::string request_str = request.str();
+      this->_ec = boost::asio::error::would_block;
+      boost::asio::async_write(this->_socket, boost::asio::buffer(request_str),
+			       boost::bind(&JsonRpcConnection::handle_io, this, boost::asio::placeholders::error));
+      this->wait(deadline);
+
+      // ステータスライン
+      std::string line = this->read_line(deadline);
+      this->_received = true;
+      std::istringstream status_stream(line);
       std::string http_version;
-      response_stream >> http_version;
-      unsigned int status_code;
-      response_stream >> status_code;
-      std::string status_message;
-      std::getline(response_stream, status_message);
-      if (!response_stream || http_version.substr(0, 5) != "HTTP/") {
+      unsigned int status_code = 0;
+      status_stream >> http_version >> status_code;
+      if (!status_stream || http_version.substr(0, 5) != "HTTP/") {
 	throw JsonRpcClientException("Invalid response");
       }
       if (status_code != 200) {
@@ -117,65 +190,182 @@ namespace geonlp
 	throw JsonRpcClientException(ss.str());
       }
 
-      // レスポンスヘッダを読み込む（空行区切）
-      boost::asio::async_read_until(socket_, response_, "\r\n\r\n",
-				    boost::bind(&JsonRpcClient::handle_read_headers, this,
-						boost::asio::placeholders::error));
-    } else {
-      std::stringstream ss;
-      ss << "Error: " << err;
-      throw JsonRpcClientException(ss.str());
+      // レスポンスヘッダ（空行区切）
+      keep_alive = (http_version != "HTTP/1.0");
+      bool chunked = false;
+      long content_length = -1;
+      while ((line = this->read_line(deadline)).length() > 0) {
+	std::string::size_type pos = line.find(':');
+	if (pos == std::string::npos) continue;
+	std::string name = boost::algorithm::to_lower_copy(line.substr(0, pos));
+	std::string value = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(line.substr(pos + 1)));
+	if (name == "content-length") {
+	  content_length = atol(value.c_str());
+	} else if (name == "transfer-encoding") {
+	  chunked = (value.find("chunked") != std::string::npos);
+	} else if (name == "connection") {
+	  if (value == "close") keep_alive = false;
+	  if (value == "keep-alive") keep_alive = true;
+	}
+      }
+
+      // コンテンツ
+      std::string content;
+      if (chunked) {
+	for (;;) {
+	  size_t size = strtoul(this->read_line(deadline).c_str(), NULL, 16);
+	  if (size == 0) break;
+	  this->fill(size + 2, deadline); // チャンクと続く CRLF
+	  content += this->take(size);
+	  this->_response.consume(2);
+	}
+	while (this->read_line(deadline).length() > 0); // トレイラ
+      } else if (content_length >= 0) {
+	this->fill(content_length, deadline);
+	content = this->take(content_length);
+      } else {
+	// 長さが分からない場合は EOF まで読む
+	for (;;) {
+	  this->_ec = boost::asio::error::would_block;
+	  boost::asio::async_read(this->_socket, this->_response, boost::asio::transfer_at_least(1),
+				  boost::bind(&JsonRpcConnection::handle_io, this, boost::asio::placeholders::error));
+	  if (!this->wait(deadline, true)) break;
+	}
+	content = this->take(this->_response.size());
+	keep_alive = false;
+      }
+      return content;
     }
+  };
+
+  // 接続先ごとのクライアント
+  static boost::mutex clients_mutex;
+  static std::map<std::string, JsonRpcClientPtr> clients;
+
+  // 接続先ごとのクライアントを取得する
+  JsonRpcClientPtr JsonRpcClient::get(const std::string& host, const std::string& port) {
+    boost::mutex::scoped_lock lock(clients_mutex);
+    const std::string key = host + ":" + port;
+    std::map<std::string, JsonRpcClientPtr>::iterator it = clients.find(key);
+    if (it != clients.end()) return (*it).second;
+    JsonRpcClientPtr client(new JsonRpcClient(host, port));
+    clients.insert(std::make_pair(key, client));
+    return client;
   }
 
-  void JsonRpcClient::handle_read_headers(const boost::system::error_code& err) {
-    if (!err) {
-      // レスポンスヘッダを解析
-      std::istream response_stream(&response_);
-      std::string header;
-      while (std::getline(response_stream, header) && header != "\r") {
-	//	std::cout << header << "\n";
-	headers_.push_back(header);
-      }
-      // std::cout << "----\n";
+  // 接続先に問い合わせてよいかどうか
+  // 停止中とみなす期間を過ぎた後は、次の問い合わせの成否で判断する
+  bool JsonRpcClient::isAvailable(void) {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    return time(NULL) >= this->_open_until;
+  }
 
-      // ヘッダの残りはコンテンツ
-      if (response_.size() > 0) {
-	std::stringstream ss;
-	ss << &response_;
-	content_ += ss.str();
+  // 通信の成否を記録する
+  void JsonRpcClient::record(bool success) {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    if (success) {
+      this->_failures = 0;
+      this->_open_until = 0;
+    } else if (++this->_failures >= JSONRPC_BREAKER_FAILURES) {
+      this->_open_until = time(NULL) + JSONRPC_BREAKER_COOLDOWN;
+    }
+  }
+
+  // 待機中の接続を取り出す
+  boost::shared_ptr<JsonRpcConnection> JsonRpcClient::acquire(void) {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    boost::shared_ptr<JsonRpcConnection> connection;
+    if (this->_idle.size() > 0) {
+      connection = this->_idle.back();
+      this->_idle.pop_back();
+    }
+    return connection;
+  }
+
+  // 接続をプールに戻す
+  void JsonRpcClient::release(boost::shared_ptr<JsonRpcConnection> connection) {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    if (this->_idle.size() < JSONRPC_POOL_MAX_IDLE) this->_idle.push_back(connection);
+  }
+
+  // 新しい接続を作成する
+  // キャッシュした名前解決の結果で接続できなかった場合は、次回は解決し直す
+  boost::shared_ptr<JsonRpcConnection> JsonRpcClient::connect(long connect_timeout)
+    throw (JsonRpcClientException) {
+    boost::posix_time::ptime deadline = boost::asio::deadline_timer::traits_type::now()
+      + boost::posix_time::milliseconds(connect_timeout);
+    boost::shared_ptr<JsonRpcConnection> connection(new JsonRpcConnection());
+    std::vector<tcp::endpoint> endpoints;
+    {
+      boost::mutex::scoped_lock lock(this->_mutex);
+      endpoints = this->_endpoints;
+    }
+    bool cached = (endpoints.size() > 0);
+    if (!cached) connection->resolve(this->_host, this->_port, deadline, endpoints);
+    try {
+      connection->connect(endpoints, deadline);
+    } catch (JsonRpcClientException& e) {
+      if (cached) {
+	boost::mutex::scoped_lock lock(this->_mutex);
+	this->_endpoints.clear();
       }
-      
-      // 残りを EOF まで読む
-      boost::asio::async_read(socket_, response_,
-			      boost::asio::transfer_at_least(1),
-			      boost::bind(&JsonRpcClient::handle_read_content, this,
-					  boost::asio::placeholders::error));
-    } else {
-      std::stringstream ss;
-      ss << "Error: " << err;
-      throw JsonRpcClientException(ss.str());
+      throw;
+    }
+    if (!cached) {
+      boost::mutex::scoped_lock lock(this->_mutex);
+      this->_endpoints = endpoints;
     }
+    return connection;
   }
 
-  void JsonRpcClient::handle_read_content(const boost::system::error_code& err) {
-    if (!err) {
-      // 読み込み済みのコンテンツを保存
-      std::stringstream ss;
-      ss << &response_;
-      // std::cout << ss.str();
-      content_ += ss.str();
-      
-      // EOF まで読み込みを繰り返す
-      boost::asio::async_read(socket_, response_,
-			      boost::asio::transfer_at_least(1),
-			      boost::bind(&JsonRpcClient::handle_read_content, this,
-					  boost::asio::placeholders::error));
-    } else if (err != boost::asio::error::eof) {
-      std::stringstream ss;
-      ss << "Error: " << err;
-      throw JsonRpcClientException(ss.str());
+  // JSON-RPC リクエストを POST し、レスポンスを受け取る
+  picojson::value JsonRpcClient::call(const std::string& path, const std::string& message,
+				      long connect_timeout, long read_timeout)
+    throw (JsonRpcClientException) {
+    if (!this->isAvailable()) {
+      throw JsonRpcClientException("Server " + this->_host + ":" + this->_port + " is unavailable");
+    }
+
+    std::string content;
+    boost::shared_ptr<JsonRpcConnection> connection = this->acquire();
+    boost::posix_time::ptime deadline(boost::posix_time::not_a_date_time);
+    for (;;) {
+      bool reused = (connection != NULL);
+      try {
+	if (deadline.is_not_a_date_time()) {
+	  if (!connection) connection = this->connect(connect_timeout);
+	  deadline = boost::asio::deadline_timer::traits_type::now() + boost::posix_time::milliseconds(read_timeout);
+	} else {
+	  // やり直しの接続と送受信は、最初の送信からの期限の残りで行う
+	  long remaining = (deadline - boost::asio::deadline_timer::traits_type::now()).total_milliseconds();
+	  if (remaining <= 0) throw JsonRpcClientException("Request timed out");
+	  connection = this->connect(std::min(connect_timeout, remaining));
+	}
+	bool keep_alive;
+	content = connection->post(this->_host, path, message, deadline, keep_alive);
+	if (keep_alive) this->release(connection);
+	break;
+      } catch (JsonRpcClientException& e) {
+	// プールしていた接続はサーバ側で閉じられている場合があるので、新しい接続で一度だけやり直す
+	// 期限切れや受信開始後の失敗は、サーバが処理済みの可能性があるのでやり直さない
+	if (reused && connection && connection->closedByPeer()) {
+	  connection.reset();
+	  continue;
+	}
+	this->record(false);
+	throw;
+      }
+    }
+
+    picojson::value v;
+    std::string err;
+    picojson::parse(v, content.begin(), content.end(), &err);
+    if (err.length() > 0) {
+      this->record(false);
+      throw JsonRpcClientException("Invalid JSON response: " + err);
     }
+    this->record(true);
+    return v;
   }
 
 };
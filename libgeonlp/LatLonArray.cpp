@@ -0,0 +1,195 @@
+///
+/// @file
+/// @brief 経緯度の点の集合 LatLonArray と、その正積グリッド LatLonGrid の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif /* _USE_MATH_DEFINES */
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+#include "LatLonArray.h"
+
+// ヒュベニの公式の定数（Util::latlonDist と同じ値）
+#define HUBENY_E2 0.00669438         // 離心率^2
+#define HUBENY_M_RADIUS 6335.439     // a(1 - e^2)（km）
+#define HUBENY_N_RADIUS 6378.137     // 長半径 a（km）
+
+// 格子のセル数を決めるための地球の平均半径（km）
+#define GRID_EARTH_RADIUS 6371.0
+// セルの一辺の最小値（km）、行と列の数が大きくなりすぎないようにする
+#define GRID_MIN_CELL 0.1
+// 範囲を求めるときの丸め誤差に対する余裕
+#define GRID_MARGIN (1.0 + 1.0e-9)
+
+namespace geonlp
+{
+  const size_t LatLonArray::npos;
+
+  /// LatLonArray の実装
+
+  // 点を追加する
+  void LatLonArray::add(double lat, double lon) {
+    if ((lat > 90.0 || lat < -90.0) && this->_invalid == npos) this->_invalid = this->_lat.size();
+    double y = lat * M_PI / 180.0;
+    this->_lat.push_back(lat);
+    this->_lon.push_back(lon);
+    this->_x.push_back(lon * M_PI / 180.0);
+    this->_y.push_back(y);
+    this->_sin_half.push_back(sin(y / 2.0));
+    this->_cos_half.push_back(cos(y / 2.0));
+  }
+
+  // 全ての点を削除する
+  void LatLonArray::clear(void) {
+    this->_lat.clear();
+    this->_lon.clear();
+    this->_x.clear();
+    this->_y.clear();
+    this->_sin_half.clear();
+    this->_cos_half.clear();
+    this->_invalid = npos;
+  }
+
+  // 一点から [begin, end) の各点への直線距離をまとめて計算する
+  // 平均緯度の sin, cos は加法定理で、それぞれの緯度の半分の sin, cos から求める
+  void LatLonArray::distances(const double& lat0, const double& lon0, size_t begin, size_t end, double* dists) const
+    throw(UtilException)
+  {
+    if (lat0 > 90.0 || lat0 < -90.0) {
+      std::stringstream sstr;
+      sstr << "The 1st latitude value is invalid (" << lat0 << ").";
+      throw UtilException(sstr.str());
+    }
+    if (this->_invalid != npos) {
+      std::stringstream sstr;
+      sstr << "The 2nd latitude value is invalid (" << this->_lat[this->_invalid] << ").";
+      throw UtilException(sstr.str());
+    }
+
+    double x0 = lon0 * M_PI / 180.0;
+    double y0 = lat0 * M_PI / 180.0;
+    double s0 = sin(y0 / 2.0);
+    double c0 = cos(y0 / 2.0);
+    size_t i = begin;
+
+#ifdef __SSE2__
+    // 二点ずつ計算する、演算の順序は下のスカラー版と同じ
+    const __m128d v_x0 = _mm_set1_pd(x0);
+    const __m128d v_y0 = _mm_set1_pd(y0);
+    const __m128d v_s0 = _mm_set1_pd(s0);
+    const __m128d v_c0 = _mm_set1_pd(c0);
+    const __m128d v_one = _mm_set1_pd(1.0);
+    const __m128d v_e2 = _mm_set1_pd(HUBENY_E2);
+    const __m128d v_m = _mm_set1_pd(HUBENY_M_RADIUS);
+    const __m128d v_n = _mm_set1_pd(HUBENY_N_RADIUS);
+    for (; i + 2 <= end; i += 2, dists += 2) {
+      __m128d sj = _mm_loadu_pd(&this->_sin_half[i]);
+      __m128d cj = _mm_loadu_pd(&this->_cos_half[i]);
+      __m128d sin_ave = _mm_add_pd(_mm_mul_pd(v_s0, cj), _mm_mul_pd(v_c0, sj));
+      __m128d cos_ave = _mm_sub_pd(_mm_mul_pd(v_c0, cj), _mm_mul_pd(v_s0, sj));
+      __m128d w = _mm_sqrt_pd(_mm_sub_pd(v_one, _mm_mul_pd(_mm_mul_pd(v_e2, sin_ave), sin_ave)));
+      __m128d m = _mm_div_pd(v_m, _mm_mul_pd(_mm_mul_pd(w, w), w));
+      __m128d n = _mm_div_pd(v_n, w);
+      __m128d dy = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&this->_y[i]), v_y0), m);
+      __m128d dx = _mm_mul_pd(_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&this->_x[i]), v_x0), n), cos_ave);
+      _mm_storeu_pd(dists, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dy, dy), _mm_mul_pd(dx, dx))));
+    }
+#endif /* __SSE2__ */
+
+    // スカラー版（SSE2 が使えない場合と、端数の点）
+    for (; i < end; i++, dists++) {
+      double sin_ave = s0 * this->_cos_half[i] + c0 * this->_sin_half[i];
+      double cos_ave = c0 * this->_cos_half[i] - s0 * this->_sin_half[i];
+      double w = sqrt(1.0 - HUBENY_E2 * sin_ave * sin_ave);
+      double m = HUBENY_M_RADIUS / (w * w * w);  // 子午線曲率半径
+      double n = HUBENY_N_RADIUS / w;            // 卯酉線曲率半径
+      double dy = (this->_y[i] - y0) * m;
+      double dx = (this->_x[i] - x0) * n * cos_ave;
+      *dists = sqrt(dy * dy + dx * dx);
+    }
+  }
+
+  /// LatLonGrid の実装
+
+  // 点を含むセルの行、緯度の sin で等分する
+  boost::uint32_t LatLonGrid::rowOf(double lat) const {
+    if (lat > 90.0) lat = 90.0;
+    if (lat < -90.0) lat = -90.0;
+    double r = (sin(lat * M_PI / 180.0) + 1.0) / 2.0 * this->_rows;
+    if (!(r > 0.0)) return 0;
+    if (r >= this->_rows) return this->_rows - 1;
+    return (boost::uint32_t)r;
+  }
+
+  // 点を含むセルの列、経度で等分する
+  boost::uint32_t LatLonGrid::colOf(double lon) const {
+    double c = (lon + 180.0) / 360.0 * this->_cols;
+    if (!(c > 0.0)) return 0;
+    if (c >= this->_cols) return this->_cols - 1;
+    return (boost::uint32_t)c;
+  }
+
+  // 点の集合から格子を作る
+  // 赤道上でセルの縦横が cell km 程度になるように行と列の数を決める
+  void LatLonGrid::build(const LatLonArray& points, double cell) {
+    this->clear();
+    if (!(cell > GRID_MIN_CELL)) cell = GRID_MIN_CELL;
+    this->_rows = (boost::uint32_t)ceil(2.0 * GRID_EARTH_RADIUS / cell);
+    this->_cols = (boost::uint32_t)ceil(2.0 * M_PI * GRID_EARTH_RADIUS / cell);
+
+    // (セル, 元の順番) で並べ替える
+    std::vector<std::pair<std::pair<boost::uint32_t, boost::uint32_t>, size_t> > order;
+    for (size_t i = 0; i < points.size(); i++) {
+      std::pair<boost::uint32_t, boost::uint32_t> c(this->rowOf(points.latitude(i)), this->colOf(points.longitude(i)));
+      order.push_back(std::make_pair(c, i));
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t k = 0; k < order.size(); k++) {
+      size_t i = order[k].second;
+      this->_points.add(points.latitude(i), points.longitude(i));
+      this->_cells.push_back(order[k].first);
+    }
+  }
+
+  // 全ての点を削除する
+  void LatLonGrid::clear(void) {
+    this->_points.clear();
+    this->_cells.clear();
+    this->_rows = this->_cols = 0;
+  }
+
+  // 一点からの距離が radius 未満になりうる点の範囲を求める
+  // ヒュベニの公式の距離は、曲率半径の最小値から
+  //   |緯度差| * a(1 - e^2) 以上、|経度差| * a * cos(平均緯度) 以上
+  // になるので、これを満たさない行と列を除く
+  void LatLonGrid::ranges(double lat0, double lon0, double radius, std::vector<std::pair<size_t, size_t> >& ranges) const {
+    if (this->_cells.size() == 0 || !(radius > 0.0)) return;
+    double dlat = radius / HUBENY_M_RADIUS * GRID_MARGIN;  // ラジアン
+    double y0 = lat0 * M_PI / 180.0;
+    double ylo = y0 - dlat, yhi = y0 + dlat;
+    double maxabs = std::max(fabs(ylo), fabs(yhi));
+    boost::uint32_t row_lo = this->rowOf(ylo * 180.0 / M_PI);
+    boost::uint32_t row_hi = this->rowOf(yhi * 180.0 / M_PI);
+    boost::uint32_t col_lo = 0, col_hi = this->_cols - 1;
+    if (maxabs < M_PI / 2.0) { // 極を含む場合は全ての経度
+      double dlon = radius / (HUBENY_N_RADIUS * cos(maxabs)) * GRID_MARGIN * 180.0 / M_PI; // 度
+      col_lo = this->colOf(lon0 - dlon);
+      col_hi = this->colOf(lon0 + dlon);
+    }
+    for (boost::uint32_t row = row_lo; row <= row_hi; row++) {
+      std::vector<std::pair<boost::uint32_t, boost::uint32_t> >::const_iterator it_begin, it_end;
+      it_begin = std::lower_bound(this->_cells.begin(), this->_cells.end(), std::make_pair(row, col_lo));
+      it_end = std::upper_bound(it_begin, this->_cells.end(), std::make_pair(row, col_hi));
+      if (it_begin != it_end) {
+	ranges.push_back(std::make_pair((size_t)(it_begin - this->_cells.begin()), (size_t)(it_end - this->_cells.begin())));
+      }
+    }
+  }
+}
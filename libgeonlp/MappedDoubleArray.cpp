@@ -0,0 +1,66 @@
+///
+/// @file
+/// @brief darts ファイルを mmap して利用する MappedDoubleArray の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif /* __linux__ */
+#include "MappedDoubleArray.h"
+
+namespace geonlp
+{
+  /// @brief デストラクタ。mmap した領域を解放する。
+  MappedDoubleArray::~MappedDoubleArray() {
+    this->unmap();
+  }
+
+  /// @brief darts ファイルを読み込み専用で mmap する
+  ///
+  /// advices には次のヒントを指定できる（対応していないものは無視する）。
+  /// - "willneed"  先読みを促す
+  /// - "random"    ランダムアクセスであることを伝え、先読みを抑制する
+  /// - "hugepage"  透過的ヒュージページを利用する（Linux のみ）
+  /// @arg @c file     darts ファイル名
+  /// @arg @c advices  madvise のヒント
+  /// @return 成功した場合 0、失敗した場合 -1（Darts::DoubleArray::open と同じ）
+  int MappedDoubleArray::mmap(const char* file, const std::vector<std::string>& advices) {
+    boost::shared_ptr<boost::interprocess::mapped_region> region;
+    try {
+      boost::interprocess::file_mapping mapping(file, boost::interprocess::read_only);
+      region = boost::shared_ptr<boost::interprocess::mapped_region>(new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only));
+    } catch (boost::interprocess::interprocess_exception& e) {
+      return -1;
+    }
+    if (region->get_size() == 0 || region->get_size() % this->unit_size() != 0) return -1;
+
+    for (std::vector<std::string>::const_iterator it = advices.begin(); it != advices.end(); it++) {
+      if ((*it) == "willneed") {
+	region->advise(boost::interprocess::mapped_region::advice_willneed);
+      } else if ((*it) == "random") {
+	region->advise(boost::interprocess::mapped_region::advice_random);
+      } else if ((*it) == "hugepage") {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	::madvise(region->get_address(), region->get_size(), MADV_HUGEPAGE);
+#endif /* __linux__ && MADV_HUGEPAGE */
+      }
+    }
+
+    this->unmap();
+    this->set_array(region->get_address(), region->get_size() / this->unit_size());
+    this->_region = region;
+    return 0;
+  }
+
+  /// @brief mmap した領域を解放する
+  void MappedDoubleArray::unmap(void) {
+    if (!this->_region) return;
+    this->clear(); // set_array で設定した領域は delete されない
+    this->_region.reset();
+  }
+
+}
@@ -35,16 +35,55 @@ namespace geonlp
     if ( userdic.length() > 0) {
       initparam = std::string("--userdic=") + userdic;
     }
-    mecabp = MeCab::createTagger( initparam.c_str());
+    modelp = MeCab::createModel( initparam.c_str());
+    if ( modelp == NULL){
+      throw std::runtime_error( MeCab::getLastError());
+    }
+    mecabp = modelp->createTagger();
     if ( mecabp == NULL){
-      throw std::runtime_error( MeCab::getTaggerError());
+      delete modelp;
+      modelp = NULL;
+      throw std::runtime_error( MeCab::getLastError());
     }
   }
 	
   /// @brief 終了処理。
+  ///
+  /// 解析中のスレッドが無い状態で呼び出すこと。
   void MeCabAdapter::terminate() {
+    boost::mutex::scoped_lock lock(lattices_mutex);
+    for (std::vector<MeCab::Lattice*>::iterator it = lattices.begin(); it != lattices.end(); it++) {
+      delete (*it);
+    }
+    lattices.clear();
     if (mecabp) delete mecabp;
     mecabp = NULL;
+    if (modelp) delete modelp;
+    modelp = NULL;
+  }
+
+  /// @brief Lattice を借りる。
+  ///
+  /// 未使用の Lattice が無ければモデルから作成する。
+  /// @exception MeCabErrException Lattice の作成に失敗した。
+  MeCab::Lattice* MeCabAdapter::acquireLattice() throw(MeCabErrException) {
+    {
+      boost::mutex::scoped_lock lock(lattices_mutex);
+      if (!lattices.empty()) {
+	MeCab::Lattice* lattice = lattices.back();
+	lattices.pop_back();
+	return lattice;
+      }
+    }
+    MeCab::Lattice* lattice = modelp->createLattice();
+    if (lattice == NULL) throw MeCabErrException( MeCab::getLastError());
+    return lattice;
+  }
+
+  /// @brief Lattice を返却する。
+  void MeCabAdapter::releaseLattice(MeCab::Lattice* lattice) {
+    boost::mutex::scoped_lock lock(lattices_mutex);
+    lattices.push_back(lattice);
   }
 	
   /// @brief 引数として渡された自然文を形態素解析し、解析結果の各行を要素とするノードの配列を返す。
@@ -57,16 +96,20 @@ namespace geonlp
     throw(MeCabNotInitializedException, MeCabErrException) {
 			
     if ( mecabp ==NULL) throw MeCabNotInitializedException();
-    const MeCab::Node *mecab_node = mecabp->parseToNode( sentence.c_str());
-    if (! mecab_node) {
-      throw MeCabErrException( mecabp->what());
+    MeCab::Lattice* lattice = acquireLattice();
+    lattice->set_sentence( sentence.c_str());
+    if (! mecabp->parse( lattice)) {
+      std::string errmsg = lattice->what();
+      releaseLattice( lattice);
+      throw MeCabErrException( errmsg.c_str());
     }
 			
     MeCabAdapter::NodeList nodelist;
-    for (;  mecab_node; mecab_node = mecab_node->next) {
+    for (const MeCab::Node *mecab_node = lattice->bos_node(); mecab_node; mecab_node = mecab_node->next) {
       Node node( std::string( mecab_node->surface, mecab_node->length), mecab_node->feature);
       nodelist.push_back(node);
     }
+    releaseLattice( lattice);
     return nodelist;
   }
 }
@@ -128,6 +128,36 @@ namespace geonlp {
       if (log_dir.empty()) log_dir = "";
       else if (log_dir.at(log_dir.length() - 1) != '/') log_dir += "/";
 
+      // geoword_cache_size（メガバイト単位、0 の場合はキャッシュしない）
+      int cache_mb = prop.get<int>("geoword_cache_size", GEOWORD_CACHE_DEFAULT_SIZE / (1024 * 1024));
+      if (cache_mb < 0) cache_mb = 0;
+      geoword_cache_size = (size_t)cache_mb * 1024 * 1024;
+
+      // wordlist_in_memory
+      wordlist_in_memory = prop.get<bool>("wordlist_in_memory", false);
+
+      // darts_mmap, darts_advice
+      darts_mmap = prop.get<bool>("darts_mmap", true);
+      darts_advice.clear();
+      std::string darts_advice_str = prop.get<std::string>("darts_advice", "");
+      if (!darts_advice_str.empty()) boost::split(darts_advice, darts_advice_str, boost::is_any_of("|"));
+
+      // batch_threads（0 の場合は CPU 数）
+      // geonlp_server や geonlp_api --lines はリクエストごとにスレッドを使うので、既定では並列化しない
+      int threads = prop.get<int>("batch_threads", 1);
+      batch_threads = threads < 0 ? 0 : (size_t)threads;
+
+      // parse_threads（0 の場合は CPU 数）
+      threads = prop.get<int>("parse_threads", 1);
+      parse_threads = threads < 0 ? 0 : (size_t)threads;
+
+      // weight_grid（相対パスの場合は data_dir から）
+      weight_grid = prop.get<std::string>("weight_grid", "");
+
+      // candidate_limit（0 の場合は制限しない）
+      int limit = prop.get<int>("candidate_limit", 0);
+      candidate_limit = limit < 0 ? 0 : (size_t)limit;
+
 #ifdef HAVE_LIBDAMS
       // dams_path
       dams_path = prop.get<std::string>("dams_path", "");
@@ -70,6 +70,11 @@ namespace geonlp
     return 1.0;
   }
 
+  // 各条件の judge は 1.0（条件を満たす）か -1.0（満たさない）を返す
+  double SelectCondition::maxWeight(void) const {
+    return 1.0;
+  }
+
   /*****************************
    * SelectConditionGeoContains
    *****************************/
@@ -0,0 +1,152 @@
+///
+/// @file
+/// @brief プリペアドステートメントのプール SqliteStatementPool の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include <cstring>
+#include <sys/time.h>
+#include <sqlite3.h>
+#include "SqliteStatementPool.h"
+
+namespace geonlp
+{
+  /// 経過時間（マイクロ秒）を得る
+  static double elapsed_usec(const struct timeval& from) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - from.tv_sec) * 1000000.0 + (now.tv_usec - from.tv_usec);
+  }
+
+  /// @brief コンストラクタ。
+  /// @arg @c db  オープン済みの DB 接続
+  SqliteStatementPool::SqliteStatementPool(sqlite3* db): _db(db) {
+    std::memset(&this->_stats, 0, sizeof(this->_stats));
+  }
+
+  /// @brief デストラクタ。
+  ///
+  /// DB 接続を閉じる前に破棄すること。
+  SqliteStatementPool::~SqliteStatementPool() {
+    this->clear();
+  }
+
+  /// @brief ステートメントを借りる
+  ///
+  /// 未使用のステートメントがあれば再利用し、無ければ prepare する。
+  /// @arg @c sql  SQL 文（パラメータは ? で指定する）
+  /// @return ステートメント、利用後は release で返却すること
+  /// @exception SqliteErrException prepare に失敗
+  sqlite3_stmt* SqliteStatementPool::acquire(const std::string& sql) throw (SqliteErrException) {
+    {
+      boost::mutex::scoped_lock lock(this->_mutex);
+      std::map<std::string, std::vector<sqlite3_stmt*> >::iterator it = this->_idle.find(sql);
+      if (it != this->_idle.end() && !(*it).second.empty()) {
+	sqlite3_stmt* stmt = (*it).second.back();
+	(*it).second.pop_back();
+	this->_stats.reuses++;
+	return stmt;
+      }
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    int rc = sqlite3_prepare_v2(this->_db, sql.c_str(), sql.length(), &stmt, NULL);
+    double usec = elapsed_usec(start);
+    if (rc != SQLITE_OK || !stmt) {
+      if (stmt) sqlite3_finalize(stmt);
+      throw SqliteErrException(rc, sqlite3_errmsg(this->_db));
+    }
+
+    boost::mutex::scoped_lock lock(this->_mutex);
+    this->_stats.prepares++;
+    this->_stats.prepare_usec += usec;
+    return stmt;
+  }
+
+  /// @brief ステートメントを返却する
+  /// @arg @c sql        acquire に渡した SQL 文
+  /// @arg @c stmt       ステートメント
+  /// @arg @c steps      利用中に実行した sqlite3_step の回数
+  /// @arg @c step_usec  利用中に sqlite3_step に要した時間
+  void SqliteStatementPool::release(const std::string& sql, sqlite3_stmt* stmt, unsigned long steps, double step_usec) {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    boost::mutex::scoped_lock lock(this->_mutex);
+    this->_idle[sql].push_back(stmt);
+    this->_stats.steps += steps;
+    this->_stats.step_usec += step_usec;
+  }
+
+  /// @brief 未使用のステートメントを全て finalize する
+  ///
+  /// テーブルの削除など、スキーマを変更する前に呼び出す。
+  void SqliteStatementPool::clear(void) {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    for (std::map<std::string, std::vector<sqlite3_stmt*> >::iterator it = this->_idle.begin(); it != this->_idle.end(); it++) {
+      for (std::vector<sqlite3_stmt*>::iterator it_stmt = (*it).second.begin(); it_stmt != (*it).second.end(); it_stmt++) {
+	sqlite3_finalize(*it_stmt);
+      }
+    }
+    this->_idle.clear();
+  }
+
+  /// @brief 統計情報を取得する
+  SqliteStatementStats SqliteStatementPool::getStats(void) const {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    return this->_stats;
+  }
+
+  /// @brief コンストラクタ。プールからステートメントを借りる。
+  /// @arg @c pool  ステートメントのプール
+  /// @arg @c sql   SQL 文
+  /// @exception SqliteErrException prepare に失敗
+  PooledStatement::PooledStatement(SqliteStatementPool& pool, const std::string& sql) throw (SqliteErrException)
+    : _pool(pool), _sql(sql), _stmt(NULL), _steps(0), _step_usec(0.0) {
+    this->_stmt = pool.acquire(sql);
+  }
+
+  /// @brief デストラクタ。ステートメントをプールに返却する。
+  PooledStatement::~PooledStatement() {
+    this->_pool.release(this->_sql, this->_stmt, this->_steps, this->_step_usec);
+  }
+
+  /// @brief 整数パラメータを設定する
+  void PooledStatement::bind(int index, int value) {
+    sqlite3_bind_int(this->_stmt, index, value);
+  }
+
+  /// @brief 文字列パラメータを設定する
+  void PooledStatement::bind(int index, const std::string& value) {
+    sqlite3_bind_text(this->_stmt, index, value.c_str(), value.length(), SQLITE_TRANSIENT);
+  }
+
+  /// @brief 次の行に進む
+  /// @return 行があれば true、終わりなら false
+  /// @exception SqliteErrException sqlite3_step でエラー
+  bool PooledStatement::step(void) throw (SqliteErrException) {
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    int rc = sqlite3_step(this->_stmt);
+    this->_step_usec += elapsed_usec(start);
+    this->_steps++;
+    if (rc == SQLITE_ROW) return true;
+    if (rc == SQLITE_DONE) return false;
+    throw SqliteErrException(rc, sqlite3_errmsg(this->_pool.getDb()));
+  }
+
+  /// @brief 現在の行の文字列カラムを取得する
+  std::string PooledStatement::getText(int index) const {
+    const unsigned char* text = sqlite3_column_text(this->_stmt, index);
+    if (!text) return std::string("");
+    return std::string((const char*)text, sqlite3_column_bytes(this->_stmt, index));
+  }
+
+  /// @brief 現在の行の整数カラムを取得する
+  int PooledStatement::getInt(int index) const {
+    return sqlite3_column_int(this->_stmt, index);
+  }
+
+}
@@ -0,0 +1,135 @@
+///
+/// @file
+/// @brief 経緯度のセルごとの重みを格納したグリッドファイル WeightGrid の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include <cmath>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "WeightGrid.h"
+
+/// ファイルの先頭に置くマジック
+#define WEIGHT_GRID_MAGIC      "GNLPWG02"
+#define WEIGHT_GRID_MAGIC_LEN  8
+
+/// ヘッダのバイト数
+#define WEIGHT_GRID_HEADER_LEN (WEIGHT_GRID_MAGIC_LEN + sizeof(WeightGridHeader))
+
+/// 生成できるセル数の上限（ファイルサイズ 2GB）
+#define WEIGHT_GRID_MAX_CELLS  (512UL * 1024 * 1024)
+
+namespace geonlp
+{
+  /// @brief グリッドファイルを読み込み専用で mmap する
+  /// @arg @c filename  グリッドファイル名
+  /// @return 読み込めた場合は true、ファイルが無いか形式が不正な場合は false
+  bool WeightGrid::load(const std::string& filename) {
+    boost::shared_ptr<boost::interprocess::mapped_region> region;
+    try {
+      boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+      region = boost::shared_ptr<boost::interprocess::mapped_region>(new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only));
+    } catch (boost::interprocess::interprocess_exception& e) {
+      return false;
+    }
+
+    const char* data = (const char*)region->get_address();
+    size_t size = region->get_size();
+    if (size < WEIGHT_GRID_HEADER_LEN) return false;
+    if (std::memcmp(data, WEIGHT_GRID_MAGIC, WEIGHT_GRID_MAGIC_LEN) != 0) return false;
+    const WeightGridHeader* header = (const WeightGridHeader*)(data + WEIGHT_GRID_MAGIC_LEN);
+    if (!(header->cell > 0.0)) return false;
+    if (size != WEIGHT_GRID_HEADER_LEN + sizeof(float) * (size_t)header->rows * header->cols) return false;
+
+    this->_header = header;
+    this->_cells = (const float*)(data + WEIGHT_GRID_HEADER_LEN);
+    this->_region = region;
+    return true;
+  }
+
+  /// @brief 地点の重みを追加する
+  /// @arg @c lat     緯度
+  /// @arg @c lon     経度
+  /// @arg @c weight  重み
+  void WeightGridBuilder::add(double lat, double lon, double weight) {
+    std::pair<long, long> key((long)std::floor(lat / this->_cell), (long)std::floor(lon / this->_cell));
+    std::pair<double, unsigned int>& sum = this->_sums[key];
+    sum.first += weight;
+    sum.second++;
+  }
+
+  /// @brief 最大の重みが 1.0 になるように全体を割る
+  ///
+  /// 人口などの値をそのまま重みにするとスコアが大きくなりすぎるので、
+  /// dist-server の重みと同じく 0.0 から 1.0 の係数にそろえる場合に使う。
+  void WeightGridBuilder::normalize(void) {
+    double max_weight = 0.0;
+    std::map<std::pair<long, long>, std::pair<double, unsigned int> >::iterator it;
+    for (it = this->_sums.begin(); it != this->_sums.end(); it++) {
+      double w = (*it).second.first / (*it).second.second;
+      if (w > max_weight) max_weight = w;
+    }
+    if (max_weight <= 0.0) return;
+    for (it = this->_sums.begin(); it != this->_sums.end(); it++) {
+      (*it).second.first /= max_weight;
+    }
+    this->_default_weight /= max_weight;
+  }
+
+  /// @brief ファイルに保存する
+  ///
+  /// 値のあるセルをすべて含む最小の矩形をグリッドとし、
+  /// 値の無いセルには既定の重みを入れる。
+  /// @arg @c filename  グリッドファイル名
+  void WeightGridBuilder::save(const std::string& filename) const throw (std::runtime_error) {
+    WeightGridHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.cell = this->_cell;
+    header.default_weight = this->_default_weight;
+
+    std::vector<float> cells;
+    long row_min = 0, col_min = 0;
+    if (this->_sums.size() > 0) {
+      long row_max, col_max;
+      std::map<std::pair<long, long>, std::pair<double, unsigned int> >::const_iterator it = this->_sums.begin();
+      row_min = row_max = (*it).first.first;
+      col_min = col_max = (*it).first.second;
+      for (; it != this->_sums.end(); it++) {
+	if ((*it).first.first < row_min) row_min = (*it).first.first;
+	if ((*it).first.first > row_max) row_max = (*it).first.first;
+	if ((*it).first.second < col_min) col_min = (*it).first.second;
+	if ((*it).first.second > col_max) col_max = (*it).first.second;
+      }
+      if (row_min < INT_MIN || row_max > INT_MAX || col_min < INT_MIN || col_max > INT_MAX) {
+	throw std::runtime_error("The grid is out of range. Use a larger cell size.");
+      }
+      header.rows = (boost::uint32_t)(row_max - row_min + 1);
+      header.cols = (boost::uint32_t)(col_max - col_min + 1);
+      if ((double)header.rows * header.cols > WEIGHT_GRID_MAX_CELLS) {
+	throw std::runtime_error("The grid is too large. Use a larger cell size.");
+      }
+      cells.assign((size_t)header.rows * header.cols, this->_default_weight);
+      for (it = this->_sums.begin(); it != this->_sums.end(); it++) {
+	size_t r = (size_t)((*it).first.first - row_min);
+	size_t c = (size_t)((*it).first.second - col_min);
+	cells[r * header.cols + c] = (float)((*it).second.first / (*it).second.second);
+      }
+    }
+    header.row_min = (boost::int32_t)row_min;
+    header.col_min = (boost::int32_t)col_min;
+
+    std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs) throw std::runtime_error(std::string("Cannot open '") + filename + "' for writing.");
+    ofs.write(WEIGHT_GRID_MAGIC, WEIGHT_GRID_MAGIC_LEN);
+    ofs.write((const char*)&header, sizeof(header));
+    if (cells.size() > 0) ofs.write((const char*)&cells[0], sizeof(float) * cells.size());
+    ofs.close();
+    if (!ofs) throw std::runtime_error(std::string("Cannot write weight grid to '") + filename + "'.");
+  }
+
+}
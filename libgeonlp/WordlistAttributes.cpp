@@ -0,0 +1,126 @@
+///
+/// @file
+/// @brief 見出し語ごとの辞書・固有名クラス所属情報 WordlistAttributes の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include <cstdlib>
+#include <sstream>
+#include "WordlistAttributes.h"
+
+namespace geonlp
+{
+  const unsigned int WordlistAttributes::NO_SIGNATURE;
+
+  /// @brief 辞書 ID の集合を 16 進数のビットマスク文字列に変換する
+  ///
+  /// 先頭から k 文字目の 16 進数字が辞書 ID 4k〜4k+3 を表し、
+  /// 辞書 ID n はその数字の (n % 4) ビット目に対応する。負の ID は無視する。
+  /// @arg @c dictionary_ids  辞書 ID の集合
+  /// @return ビットマスク文字列（空集合の場合は空文字列）
+  std::string WordlistAttributes::encodeDictionaryMask(const std::set<int>& dictionary_ids) {
+    static const char* hex = "0123456789abcdef";
+    if (dictionary_ids.empty() || *(dictionary_ids.rbegin()) < 0) return std::string("");
+    std::vector<int> digits(*(dictionary_ids.rbegin()) / 4 + 1, 0);
+    for (std::set<int>::const_iterator it = dictionary_ids.begin(); it != dictionary_ids.end(); it++) {
+      if ((*it) < 0) continue;
+      digits[(*it) / 4] |= (1 << ((*it) % 4));
+    }
+    std::string mask;
+    for (std::vector<int>::const_iterator it = digits.begin(); it != digits.end(); it++) {
+      mask += hex[(*it)];
+    }
+    return mask;
+  }
+
+  /// @brief 16 進数のビットマスク文字列を辞書 ID のリストに変換する
+  /// @arg @c mask            encodeDictionaryMask で生成したビットマスク文字列
+  /// @arg @c dictionary_ids  辞書 ID のリスト（昇順）
+  void WordlistAttributes::decodeDictionaryMask(const std::string& mask, std::vector<int>& dictionary_ids) {
+    dictionary_ids.clear();
+    for (unsigned int k = 0; k < mask.length(); k++) {
+      char c = mask[k];
+      int v;
+      if (c >= '0' && c <= '9') v = c - '0';
+      else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+      else continue;
+      for (int b = 0; b < 4; b++) {
+	if (v & (1 << b)) dictionary_ids.push_back(k * 4 + b);
+      }
+    }
+  }
+
+  /// @brief 固有名クラス ID の集合をカンマ区切り文字列に変換する
+  std::string WordlistAttributes::encodeClassIds(const std::set<int>& ne_class_ids) {
+    std::ostringstream oss;
+    for (std::set<int>::const_iterator it = ne_class_ids.begin(); it != ne_class_ids.end(); it++) {
+      if (it != ne_class_ids.begin()) oss << ",";
+      oss << (*it);
+    }
+    return oss.str();
+  }
+
+  /// @brief カンマ区切り文字列を固有名クラス ID のリストに変換する
+  void WordlistAttributes::decodeClassIds(const std::string& ids, std::vector<int>& ne_class_ids) {
+    ne_class_ids.clear();
+    std::string::size_type pos = 0;
+    while (pos < ids.length()) {
+      std::string::size_type next = ids.find(',', pos);
+      if (next == std::string::npos) next = ids.length();
+      if (next > pos) ne_class_ids.push_back(atoi(ids.substr(pos, next - pos).c_str()));
+      pos = next + 1;
+    }
+  }
+
+  /// @brief 辞書に含まれる全ての固有名クラスを登録する
+  ///
+  /// updateWordlists 時点の地名語が持つ固有名クラスの一覧で、
+  /// ActiveFilter が判定結果の表を作成するために利用する。
+  /// @arg @c ne_class_names   固有名クラス ID から固有名クラスへのマップ
+  void WordlistAttributes::setNeClassNames(const std::map<int, std::string>& ne_class_names) {
+    this->_all_ne_classes.clear();
+    for (std::map<int, std::string>::const_iterator it = ne_class_names.begin(); it != ne_class_names.end(); it++) {
+      this->_all_ne_classes.push_back((*it).second);
+    }
+  }
+
+  /// @brief 見出し語の属性を登録する
+  ///
+  /// 同じ組み合わせが既に登録されていれば、そのシグネチャを共有する。
+  /// @arg @c wordlist_id      見出し語 ID
+  /// @arg @c dictionary_mask  辞書 ID のビットマスク文字列
+  /// @arg @c ne_class_ids     固有名クラス ID のカンマ区切り文字列
+  /// @arg @c ne_class_names   固有名クラス ID から固有名クラスへのマップ
+  void WordlistAttributes::add(unsigned int wordlist_id, const std::string& dictionary_mask, const std::string& ne_class_ids, const std::map<int, std::string>& ne_class_names) {
+    std::string signature = dictionary_mask + ";" + ne_class_ids;
+    unsigned int signature_id;
+    std::map<std::string, unsigned int>::iterator it = this->_signature_index.find(signature);
+    if (it != this->_signature_index.end()) {
+      signature_id = (*it).second;
+    } else {
+      signature_id = this->_dictionaries.size();
+      this->_signature_index.insert(std::make_pair(signature, signature_id));
+
+      std::vector<int> dictionary_ids;
+      decodeDictionaryMask(dictionary_mask, dictionary_ids);
+      this->_dictionaries.push_back(dictionary_ids);
+
+      std::vector<int> class_ids;
+      std::vector<std::string> classes;
+      decodeClassIds(ne_class_ids, class_ids);
+      for (std::vector<int>::iterator cit = class_ids.begin(); cit != class_ids.end(); cit++) {
+	std::map<int, std::string>::const_iterator nit = ne_class_names.find(*cit);
+	if (nit != ne_class_names.end()) classes.push_back((*nit).second);
+      }
+      this->_ne_classes.push_back(classes);
+    }
+
+    if (wordlist_id >= this->_signature_ids.size()) {
+      this->_signature_ids.resize(wordlist_id + 1, NO_SIGNATURE);
+    }
+    this->_signature_ids[wordlist_id] = signature_id;
+  }
+
+}
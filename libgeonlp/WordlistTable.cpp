@@ -0,0 +1,147 @@
+///
+/// @file
+/// @brief オンメモリ見出し語テーブル WordlistTable の実装。
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+#include <cstring>
+#include <fstream>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "WordlistTable.h"
+
+/// ファイルの先頭に置くマジック
+#define WORDLIST_TABLE_MAGIC     "GNLPWL01"
+#define WORDLIST_TABLE_MAGIC_LEN 8
+
+/// ヘッダのバイト数（マジック, 見出し語数, 文字列プールのバイト数）
+#define WORDLIST_TABLE_HEADER_LEN (WORDLIST_TABLE_MAGIC_LEN + sizeof(boost::uint32_t) * 2)
+
+/// 一レコードあたりのオフセット数（key, surface, idlist, yomi）
+#define WORDLIST_TABLE_FIELDS    4
+
+namespace geonlp
+{
+  const boost::uint32_t WordlistTable::NO_ENTRY;
+
+  /// @brief ヘッダを検証してレコードと文字列プールの位置を設定する
+  /// @arg @c data  テーブルの先頭
+  /// @arg @c size  テーブルのバイト数
+  /// @return 正しい形式であれば true
+  bool WordlistTable::attach(const char* data, size_t size) {
+    if (size < WORDLIST_TABLE_HEADER_LEN) return false;
+    if (std::memcmp(data, WORDLIST_TABLE_MAGIC, WORDLIST_TABLE_MAGIC_LEN) != 0) return false;
+    const boost::uint32_t* header = (const boost::uint32_t*)(data + WORDLIST_TABLE_MAGIC_LEN);
+    boost::uint32_t count = header[0];
+    boost::uint32_t pool_size = header[1];
+    size_t records_len = sizeof(boost::uint32_t) * WORDLIST_TABLE_FIELDS * (size_t)count;
+    if (size != WORDLIST_TABLE_HEADER_LEN + records_len + pool_size) return false;
+
+    this->_count = count;
+    this->_records = (const boost::uint32_t*)(data + WORDLIST_TABLE_HEADER_LEN);
+    this->_pool = data + WORDLIST_TABLE_HEADER_LEN + records_len;
+    this->_pool_size = pool_size;
+    return true;
+  }
+
+  /// @brief Wordlist の配列からテーブルを構築する
+  ///
+  /// 見出し語 ID は連番でなくてもよい。欠番は find で false を返す。
+  /// @arg @c wordlists  見出し語の配列
+  /// @exception std::runtime_error 文字列プールが 32 ビットのオフセットで表せない大きさになる
+  void WordlistTable::build(const std::vector<Wordlist>& wordlists) throw (std::runtime_error) {
+    boost::uint32_t count = 0;
+    for (std::vector<Wordlist>::const_iterator it = wordlists.begin(); it != wordlists.end(); it++) {
+      if ((*it).get_id() + 1 > count) count = (*it).get_id() + 1;
+    }
+
+    std::vector<boost::uint32_t> records(WORDLIST_TABLE_FIELDS * (size_t)count, NO_ENTRY);
+    std::string pool;
+    for (std::vector<Wordlist>::const_iterator it = wordlists.begin(); it != wordlists.end(); it++) {
+      boost::uint32_t* record = &records[WORDLIST_TABLE_FIELDS * (size_t)(*it).get_id()];
+      const std::string fields[WORDLIST_TABLE_FIELDS] = {
+	(*it).get_key(), (*it).get_surface(), (*it).get_idlist(), (*it).get_yomi()
+      };
+      for (int i = 0; i < WORDLIST_TABLE_FIELDS; i++) {
+	// オフセットもプールのバイト数も NO_ENTRY 未満でなければならない
+	if ((boost::uint64_t)pool.size() + fields[i].size() + 1 >= (boost::uint64_t)NO_ENTRY)
+	  throw std::runtime_error("Wordlist table is too large.");
+	record[i] = pool.size();
+	pool.append(fields[i]);
+	pool.push_back('\0');
+      }
+    }
+
+    boost::uint32_t header[2] = { count, (boost::uint32_t)pool.size() };
+    this->_region.reset();
+    this->_buffer.clear();
+    this->_buffer.reserve(WORDLIST_TABLE_HEADER_LEN + sizeof(boost::uint32_t) * records.size() + pool.size());
+    this->_buffer.insert(this->_buffer.end(), WORDLIST_TABLE_MAGIC, WORDLIST_TABLE_MAGIC + WORDLIST_TABLE_MAGIC_LEN);
+    this->_buffer.insert(this->_buffer.end(), (const char*)header, (const char*)header + sizeof(header));
+    if (records.size() > 0) {
+      this->_buffer.insert(this->_buffer.end(), (const char*)&records[0], (const char*)&records[0] + sizeof(boost::uint32_t) * records.size());
+    }
+    this->_buffer.insert(this->_buffer.end(), pool.begin(), pool.end());
+    this->attach(&this->_buffer[0], this->_buffer.size());
+  }
+
+  /// @brief テーブルをファイルに保存する
+  /// @arg @c filename  保存するファイル名
+  /// @exception std::runtime_error 書き込みに失敗
+  void WordlistTable::save(const std::string& filename) const throw (std::runtime_error) {
+    const char* data;
+    size_t size;
+    if (this->_region) {
+      data = (const char*)this->_region->get_address();
+      size = this->_region->get_size();
+    } else if (!this->_buffer.empty()) {
+      data = &this->_buffer[0];
+      size = this->_buffer.size();
+    } else {
+      throw std::runtime_error("Wordlist table is empty.");
+    }
+
+    std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs) throw std::runtime_error(std::string("Cannot open '") + filename + "' for writing.");
+    ofs.write(data, size);
+    ofs.close();
+    if (!ofs) throw std::runtime_error(std::string("Cannot write wordlist table to '") + filename + "'.");
+  }
+
+  /// @brief ファイルを mmap してテーブルとして利用する
+  /// @arg @c filename  updateWordlists が保存したファイル名
+  /// @return 読み込めた場合は true、ファイルが無いか形式が不正な場合は false
+  bool WordlistTable::load(const std::string& filename) {
+    boost::shared_ptr<boost::interprocess::mapped_region> region;
+    try {
+      boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+      region = boost::shared_ptr<boost::interprocess::mapped_region>(new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only));
+    } catch (boost::interprocess::interprocess_exception& e) {
+      return false;
+    }
+    if (!this->attach((const char*)region->get_address(), region->get_size())) return false;
+    this->_buffer.clear();
+    this->_region = region;
+    return true;
+  }
+
+  /// @brief 見出し語 ID に対応する Wordlist を取得する
+  /// @arg @c id   見出し語 ID（darts の値）
+  /// @arg ret     見出し語
+  /// @return 見つかった場合は true
+  bool WordlistTable::find(unsigned int id, Wordlist& ret) const {
+    if (id >= this->_count) return false;
+    const boost::uint32_t* record = this->_records + WORDLIST_TABLE_FIELDS * (size_t)id;
+    for (int i = 0; i < WORDLIST_TABLE_FIELDS; i++) {
+      if (record[i] >= this->_pool_size) return false;
+    }
+    ret.set_id(id);
+    ret.set_key(this->_pool + record[0]);
+    ret.set_surface(this->_pool + record[1]);
+    ret.set_idlist(this->_pool + record[2]);
+    ret.set_yomi(this->_pool + record[3]);
+    return true;
+  }
+
+}
@@ -0,0 +1,129 @@
+/*
+ * ContextRelation のユニットテスト
+ *
+ * 乱数で作った追加・エクスパイアの列について、ContextRelation::count() の結果を
+ * 出現箇所を単純に保持して数える実装（元の数え方）と比較する
+ * 途中で使われなくなった ID を取り除いて付け替えても結果が変わらないことも確かめる
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include "Context.h"
+#include "IdTable.h"
+
+// 元の数え方の実装
+// キーごと、地名語ごとに出現箇所を追加した順に保持し、
+// 範囲に入る最初の出現箇所の異なり数を数える
+class NaiveRelation {
+private:
+  typedef std::map<std::string, std::vector<int> > Occurrences;
+  std::map<std::string, Occurrences> _chains;
+
+public:
+  void add(const std::string& key, const std::string& geonlp_id, int n) {
+    this->_chains[key][geonlp_id].push_back(n);
+  }
+
+  // n 以下の出現箇所を取り除く
+  void expire(int n) {
+    for (std::map<std::string, Occurrences>::iterator it = this->_chains.begin(); it != this->_chains.end(); it++) {
+      for (Occurrences::iterator it2 = (*it).second.begin(); it2 != (*it).second.end(); it2++) {
+	std::vector<int> rest;
+	for (size_t i = 0; i < (*it2).second.size(); i++) {
+	  if ((*it2).second[i] > n) rest.push_back((*it2).second[i]);
+	}
+	(*it2).second.swap(rest);
+      }
+    }
+  }
+
+  int count(const std::string& key, const std::string& self_id, int self_pos, int lb, int hb) const {
+    std::map<std::string, Occurrences>::const_iterator it = this->_chains.find(key);
+    if (it == this->_chains.end()) return 0;
+    std::map<int, int> firsts;
+    for (Occurrences::const_iterator it2 = (*it).second.begin(); it2 != (*it).second.end(); it2++) {
+      if ((*it2).first == self_id) continue;
+      for (size_t i = 0; i < (*it2).second.size(); i++) {
+	int n = (*it2).second[i];
+	if ((lb < 0 || n >= lb) && (hb < 0 || n <= hb) && n != self_pos) {
+	  firsts[n] = 1;
+	  break;
+	}
+      }
+    }
+    return firsts.size();
+  }
+};
+
+static std::string name(const char* prefix, int i) {
+  std::stringstream ss;
+  ss << prefix << i;
+  return ss.str();
+}
+
+int main(int argc, char** argv) {
+  int ntrials = 2000;
+  long nchecks = 0, nerror = 0;
+
+  for (int trial = 0; trial < ntrials; trial++) {
+    srand(trial);
+    NaiveRelation naive;
+    geonlp::ContextRelation relation;
+    geonlp::StringIdTable ids;
+    int nkeys = 1 + rand() % 4, ngeowords = 1 + rand() % 12;
+
+    // Context と同じく、出現箇所は昇順に追加し、エクスパイアは現在の位置より前に行う
+    int n = 0;
+    int nadds = rand() % 200;
+    for (int a = 0; a < nadds; a++) {
+      if (rand() % 3 == 0) n++;
+      std::string key = name("k", rand() % nkeys);
+      std::string geonlp_id = name("g", rand() % ngeowords);
+      naive.add(key, geonlp_id, n);
+      relation.add(ids.intern(key), ids.intern(geonlp_id), n);
+      if (rand() % 4 == 0) {
+	int e = n - 1 - rand() % 6;
+	naive.expire(e);
+	relation.expire(e);
+      }
+      if (rand() % 16 == 0) {
+	// Context::compactIds と同じく、使用中の文字列だけを登録し直す
+	std::vector<bool> used(ids.size(), false);
+	relation.markIds(used, true);
+	geonlp::StringIdTable compacted;
+	std::vector<boost::uint32_t> renumber(ids.size(), geonlp::StringIdTable::npos);
+	for (size_t i = 0; i < used.size(); i++) {
+	  if (used[i]) renumber[i] = compacted.intern(ids.get((boost::uint32_t)i));
+	}
+	relation.renumber(renumber, true);
+	ids = compacted;
+      }
+
+      // 登録されていないキー、地名語も含めて比較する
+      for (int q = 0; q < 20; q++) {
+	std::string key = name("k", rand() % (nkeys + 1));
+	std::string self_id = name("g", rand() % (ngeowords + 1));
+	int self_pos = rand() % (n + 3) - 1;
+	int lb = (rand() % 3 == 0) ? rand() % (n + 2) : -1;
+	int hb = (rand() % 3 == 0) ? rand() % (n + 2) : -1;
+	int expected = naive.count(key, self_id, self_pos, lb, hb);
+	int result = relation.count(ids.find(key), ids.find(self_id), self_pos, lb, hb);
+	nchecks++;
+	if (result != expected) {
+	  if (nerror < 10) {
+	    std::cout << "trial=" << trial << " key=" << key << " self_id=" << self_id << " self_pos=" << self_pos
+		      << " lb=" << lb << " hb=" << hb << " の地名語数：" << result << ", 正解：" << expected << std::endl;
+	  }
+	  nerror++;
+	}
+      }
+    }
+  }
+
+  std::cout << nchecks << " 件中、誤り " << nerror << " 件" << std::endl;
+  return nerror > 0 ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * GeowordCache のユニットテスト
+ *
+ * 乱数で作った登録・取得の列について、キャッシュに残る地名語と統計情報を
+ * シャードごとに単純なリストで LRU を再現した結果と比較する
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <list>
+#include <string>
+#include <vector>
+#include "GeowordCache.h"
+
+// シャードごとの LRU の単純な実装
+// 先頭が最近利用したもの
+class NaiveShard {
+public:
+  std::list<std::pair<std::string, size_t> > lru;
+  size_t bytes;
+  NaiveShard(): bytes(0) {}
+
+  std::list<std::pair<std::string, size_t> >::iterator find(const std::string& geonlp_id) {
+    std::list<std::pair<std::string, size_t> >::iterator it = this->lru.begin();
+    while (it != this->lru.end() && (*it).first != geonlp_id) it++;
+    return it;
+  }
+};
+
+static std::string name(int i) {
+  std::stringstream ss;
+  ss << "g" << i;
+  return ss.str();
+}
+
+int main(int argc, char** argv) {
+  const size_t shard_capacity = 600;
+  const int ngeowords = 200;
+  long nchecks = 0, nerror = 0;
+
+  // 地名語を作成する
+  std::vector<geonlp::GeowordPtr> geowords;
+  for (int i = 0; i < ngeowords; i++) {
+    geonlp::Geoword* geoword = new geonlp::Geoword();
+    geoword->initByJson("{\"geonlp_id\":\"" + name(i) + "\",\"dictionary_id\":1,\"body\":\"地名\",\"typical_name\":\"地名\","
+			"\"kana\":\"ちめい\",\"ne_class\":\"City\",\"latitude\":\"35\",\"longitude\":\"139\"}");
+    geowords.push_back(geonlp::GeowordPtr(geoword));
+  }
+
+  geonlp::GeowordCache cache(shard_capacity * GEOWORD_CACHE_SHARDS);
+  std::vector<NaiveShard> shards(GEOWORD_CACHE_SHARDS);
+  unsigned long hits = 0, misses = 0, evictions = 0;
+
+  srand(1);
+  for (int op = 0; op < 100000; op++) {
+    int i = rand() % ngeowords;
+    std::string geonlp_id = name(i);
+    NaiveShard& shard = shards[boost::hash<std::string>()(geonlp_id) % GEOWORD_CACHE_SHARDS];
+    std::list<std::pair<std::string, size_t> >::iterator it = shard.find(geonlp_id);
+
+    if (rand() % 2 == 0) {
+      // 取得、キャッシュにあれば登録した地名語そのものが返る
+      geonlp::GeowordPtr result = cache.get(geonlp_id);
+      bool expected = (it != shard.lru.end());
+      if (expected) {
+	shard.lru.splice(shard.lru.begin(), shard.lru, it);
+	hits++;
+      } else {
+	misses++;
+      }
+      nchecks++;
+      if ((expected && result != geowords[i]) || (!expected && result)) {
+	if (nerror < 10) std::cout << "op=" << op << " " << geonlp_id << " の取得結果：" << (result ? "有" : "無") << ", 正解：" << (expected ? "有" : "無") << std::endl;
+	nerror++;
+      }
+    } else {
+      // 登録、推定バイト数には geonlp_id の長さを加える
+      size_t bytes = 50 + rand() % 300;
+      cache.put(geowords[i], bytes);
+      bytes += geonlp_id.length();
+      if (bytes > shard_capacity) continue; // 容量を超えるものは登録しない
+      if (it != shard.lru.end()) {
+	shard.bytes -= (*it).second;
+	shard.lru.erase(it);
+      }
+      shard.lru.push_front(std::make_pair(geonlp_id, bytes));
+      shard.bytes += bytes;
+      while (shard.bytes > shard_capacity) {
+	shard.bytes -= shard.lru.back().second;
+	shard.lru.pop_back();
+	evictions++;
+      }
+    }
+  }
+
+  // 統計情報
+  unsigned long entries = 0;
+  size_t bytes = 0;
+  for (size_t s = 0; s < shards.size(); s++) {
+    entries += shards[s].lru.size();
+    bytes += shards[s].bytes;
+  }
+  geonlp::GeowordCacheStats stats = cache.getStats();
+  const char* names[] = { "ヒット数", "ミス数", "追い出した件数", "件数", "バイト数", "上限バイト数" };
+  unsigned long results[] = { stats.hits, stats.misses, stats.evictions, stats.entries, stats.bytes, stats.capacity };
+  unsigned long expected[] = { hits, misses, evictions, entries, bytes, shard_capacity * GEOWORD_CACHE_SHARDS };
+  for (int k = 0; k < 6; k++) {
+    nchecks++;
+    if (results[k] != expected[k]) {
+      std::cout << names[k] << "：" << results[k] << ", 正解：" << expected[k] << std::endl;
+      nerror++;
+    }
+  }
+  // 一度も追い出さない、ヒットしないテストになっていないこと
+  nchecks++;
+  if (evictions == 0 || hits == 0) nerror++;
+
+  // clear() は地名語を取り除き、統計情報は保持する
+  cache.clear();
+  stats = cache.getStats();
+  nchecks++;
+  if (stats.entries != 0 || stats.bytes != 0 || stats.hits != hits || cache.get(name(0))) nerror++;
+
+  std::cout << nchecks << " 件中、誤り " << nerror << " 件" << std::endl;
+  return nerror > 0 ? 1 : 0;
+}
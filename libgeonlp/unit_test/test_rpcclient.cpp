@@ -17,12 +17,12 @@ int main(int argc, char* argv[]) {
       message = (char*)"{\"method\":\"getWeight\",\"params\":[[[37.393276,138.595812]]],\"id\":1}";
     }
 
-    boost::asio::io_service io_service;
-    geonlp::JsonRpcClient c(io_service, argv[1], argv[2], message, "80");
-    io_service.run();
-    std::cout << "Content: \n" << c.content_ << std::endl;
+    geonlp::JsonRpcClientPtr c = geonlp::JsonRpcClient::get(argv[1], "80");
+    picojson::ext e = c->call(argv[2], message);
+    std::cout << "JSON: '" << e.toJson() << "'" << std::endl;
 
-    picojson::ext e = c.getJsonResponse();
+    // 2 回目はプールした接続を再利用する
+    e = c->call(argv[2], message);
     std::cout << "JSON: '" << e.toJson() << "'" << std::endl;
   } catch (std::exception& e) {
     std::cout << "Exception: " << e.what() << "\n";
@@ -0,0 +1,78 @@
+/*
+ * SqliteStatementPool のユニットテスト
+ *
+ * ステートメントの再利用と、統計情報の prepare, 再利用, step の回数を確かめる
+ */
+
+#include <iostream>
+#include <string>
+#include <sqlite3.h>
+#include "SqliteStatementPool.h"
+
+static int nerror = 0;
+static int nchecks = 0;
+
+static void check(const std::string& name, unsigned long result, unsigned long expected) {
+  nchecks++;
+  if (result != expected) {
+    std::cout << name << "：" << result << ", 正解：" << expected << std::endl;
+    nerror++;
+  }
+}
+
+// id を指定して name を取得する
+static std::string find_name(geonlp::SqliteStatementPool& pool, int id) {
+  geonlp::PooledStatement stmt(pool, "SELECT name FROM t WHERE id = ?");
+  stmt.bind(1, id);
+  if (!stmt.step()) return std::string("");
+  return stmt.getText(0);
+}
+
+int main(int argc, char** argv) {
+  sqlite3* db;
+  if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+    std::cerr << "DB を作成できません" << std::endl;
+    return 1;
+  }
+  sqlite3_exec(db, "CREATE TABLE t(id INTEGER PRIMARY KEY, name VARCHAR);"
+	       "INSERT INTO t VALUES (1, 'a'); INSERT INTO t VALUES (2, 'b'); INSERT INTO t VALUES (3, 'c');",
+	       NULL, NULL, NULL);
+
+  {
+    geonlp::SqliteStatementPool pool(db);
+
+    // 同じ SQL を順に実行すると、二回目以降はステートメントを再利用する
+    nchecks++;
+    if (find_name(pool, 1) != "a" || find_name(pool, 2) != "b" || find_name(pool, 4) != "") nerror++;
+    geonlp::SqliteStatementStats stats = pool.getStats();
+    check("prepare 回数", stats.prepares, 1);
+    check("再利用回数", stats.reuses, 2);
+    check("step 回数", stats.steps, 3);
+
+    // 貸し出し中のステートメントは再利用せず、新しく prepare する
+    {
+      geonlp::PooledStatement outer(pool, "SELECT id, name FROM t ORDER BY id");
+      int rows = 0;
+      while (outer.step()) {
+	nchecks++;
+	if (find_name(pool, outer.getInt(0)) != outer.getText(1)) nerror++;
+	rows++;
+      }
+      check("行数", rows, 3);
+    }
+    stats = pool.getStats();
+    check("prepare 回数（入れ子）", stats.prepares, 2);
+    check("再利用回数（入れ子）", stats.reuses, 5);
+    check("step 回数（入れ子）", stats.steps, 10);
+    nchecks++;
+    if (stats.prepare_usec < 0.0 || stats.step_usec < 0.0) nerror++;
+
+    // 返却したステートメントは再び借りられる
+    { geonlp::PooledStatement stmt(pool, "SELECT id, name FROM t ORDER BY id"); }
+    check("prepare 回数（返却後）", pool.getStats().prepares, 2);
+  }
+  sqlite3_close(db);
+
+  std::cout << nchecks << " 件中、誤り " << nerror << " 件" << std::endl;
+  return nerror > 0 ? 1 : 0;
+}
@@ -3,8 +3,16 @@
  */
 
 #include <iostream>
+#include <cstdlib>
+#include <ctime>
 #include <boost/regex.hpp>
 #include "Util.h"
+#include "LatLonArray.h"
+
+// 経過時間（秒）
+static double elapsed(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
 
 int main(int argc, char** argv) {
   // 東京
@@ -21,6 +29,55 @@ int main(int argc, char** argv) {
   // 結果表示
   std::cout << "距離：" << dist << ", 国土地理院サイトとの誤差：" << delta_gsi << std::endl;
 
+  // 一点から多数の点への距離の計算時間を、一点ずつの場合と比較する
+  const int npoints = 100000, nrepeat = 50;
+  const double radius = 10.0;
+  geonlp::LatLonArray points;
+  srand(1);
+  for (int i = 0; i < npoints; i++) {
+    points.add(24.0 + 22.0 * rand() / RAND_MAX, 123.0 + 23.0 * rand() / RAND_MAX);
+  }
+  std::vector<double> dists(npoints);
+  double sum_scalar = 0.0, sum_batch = 0.0;
+  int near_scalar = 0, near_grid = 0;
+  clock_t start = clock();
+  for (int r = 0; r < nrepeat; r++) {
+    for (int i = 0; i < npoints; i++) {
+      double d = geonlp::Util::latlonDist(lat0, lon0, points.latitude(i), points.longitude(i));
+      sum_scalar += d;
+      if (d < radius) near_scalar++;
+    }
+  }
+  double t_scalar = elapsed(start);
+  start = clock();
+  for (int r = 0; r < nrepeat; r++) {
+    points.distances(lat0, lon0, 0, npoints, &dists[0]);
+    for (int i = 0; i < npoints; i++) sum_batch += dists[i];
+  }
+  double t_batch = elapsed(start);
+  // 格子で radius 以内になりうる点だけを取り出す
+  geonlp::LatLonGrid grid;
+  grid.build(points, radius);
+  std::vector<std::pair<size_t, size_t> > ranges;
+  start = clock();
+  for (int r = 0; r < nrepeat; r++) {
+    ranges.clear();
+    grid.ranges(lat0, lon0, radius, ranges);
+    for (size_t k = 0; k < ranges.size(); k++) {
+      grid.points().distances(lat0, lon0, ranges[k].first, ranges[k].second, &dists[0]);
+      for (size_t i = 0; i < ranges[k].second - ranges[k].first; i++) {
+	if (dists[i] < radius) near_grid++;
+      }
+    }
+  }
+  double t_grid = elapsed(start);
+  std::cout << npoints << " 点 x " << nrepeat << " 回の距離計算" << std::endl;
+  std::cout << "  latlonDist:             " << t_scalar << " 秒" << std::endl;
+  std::cout << "  LatLonArray::distances: " << t_batch << " 秒, 距離の合計の差："
+	    << (sum_batch - sum_scalar) / sum_scalar << "（相対）" << std::endl;
+  std::cout << "  LatLonGrid (" << radius << "km):       " << t_grid << " 秒, "
+	    << radius << "km 以内の点：" << near_grid << "（latlonDist では " << near_scalar << "）" << std::endl;
+
 
   // URL 分解のテスト
   std::string url = "http://www.info-proto.com/foo.cgi?key=20141009&t=abc";
@@ -0,0 +1,57 @@
+/*
+ * WeightGrid のユニットテスト
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "WeightGrid.h"
+
+int main(int argc, char** argv) {
+  std::string filename = "test_weightgrid.grid";
+  double cell = 0.01;
+
+  // 小数点以下 2 桁の緯度経度（セルの境界上の地点）に、地点ごとに異なる重みを与える
+  std::vector<double> lats, lons, weights;
+  for (int i = 0; i < 2200; i++) {
+    std::stringstream slat, slon;
+    slat << (24.0 + i * 0.01);
+    slon << (122.0 + (i * 7 % 2300) * 0.01);
+    lats.push_back(atof(slat.str().c_str()));
+    lons.push_back(atof(slon.str().c_str()));
+    weights.push_back(1.0 + i);
+  }
+
+  geonlp::WeightGridBuilder builder(cell, 0.5f);
+  for (size_t i = 0; i < lats.size(); i++) builder.add(lats[i], lons[i], weights[i]);
+  try {
+    builder.save(filename);
+  } catch (std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  geonlp::WeightGrid grid;
+  if (!grid.load(filename)) {
+    std::cerr << "グリッドファイルを読み込めません：" << filename << std::endl;
+    return 1;
+  }
+
+  // 全ての地点について、追加した重みが読み出せること
+  int nerror = 0;
+  for (size_t i = 0; i < lats.size(); i++) {
+    double w = grid.get(lats[i], lons[i]);
+    if (w != (float)weights[i]) {
+      if (nerror < 10) std::cout << "(" << lats[i] << ", " << lons[i] << ") の重み：" << w << ", 正解：" << weights[i] << std::endl;
+      nerror++;
+    }
+  }
+  // 範囲外は既定の重み
+  if (grid.get(0.0, 0.0) != 0.5) nerror++;
+
+  std::cout << lats.size() << " 地点中、誤り " << nerror << " 件" << std::endl;
+  remove(filename.c_str());
+  return nerror > 0 ? 1 : 0;
+}
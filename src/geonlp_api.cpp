@@ -2,10 +2,17 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
+#include <deque>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "GeonlpService.h"
 
 void usage(const char* cmd) {
-  std::cerr << "Usage: " << cmd << " [--rc=<rc filename>] [<jsonfile>]" << std::endl;
+  std::cerr << "Usage: " << cmd << " [--rc=<rc filename>] [--stats] [<jsonfile>]" << std::endl;
+  std::cerr << "or, " << cmd << " --lines [--threads=<num>] [--unordered] [--rc=<rc filename>] [--stats] [<jsonfile>]" << std::endl;
   std::cerr << "or, " << cmd << " --version" << std::endl;
   return;
 }
@@ -22,10 +29,134 @@ bool proc(geonlp::ServicePtr service, std::stringstream& ss_req) {
   return true;
 }
 
+/// @brief JSON Lines 形式のリクエストを複数のスレッドで処理する
+///
+/// 入力の 1 行を 1 リクエストとして読み、レスポンスを 1 行ずつ出力する。
+/// ordered の場合は入力の順に、そうでない場合は処理が終わった順に出力する。
+/// 処理中と出力待ちのリクエストは window 件までに制限する。
+class LineStream {
+private:
+  std::istream& _is;
+  std::ostream& _os;
+  bool _ordered;
+  size_t _window;
+
+  boost::mutex _mutex;
+  boost::condition_variable _readable;   // キューに行がある、または入力終了
+  boost::condition_variable _writable;   // window に空きができた
+  std::deque<std::pair<size_t, std::string> > _queue;
+  std::map<size_t, std::string> _pending; // 出力待ちのレスポンス（ordered の場合）
+  size_t _next_read;
+  size_t _next_write;
+  bool _eof;
+
+  // 1 行のリクエストを処理してレスポンスの行を返す
+  std::string process(geonlp::ServicePtr service, const std::string& line) {
+    picojson::ext req;
+    try {
+      req.initByJson(line);
+    } catch (picojson::PicojsonException& e) {
+      return std::string("{\"result\":null,\"error\":\"Request string is not a valid JSON representation.\",\"id\":null}");
+    }
+    // Service::proc は std::runtime_error 以外の例外を返すことがあるので、
+    // ワーカースレッドが終了しないようにここでエラーのレスポンスにする
+    try {
+      service->reset();
+      return service->proc(picojson::value(req)).serialize();
+    } catch (std::exception& e) {
+      return this->error(req, e.what());
+    } catch (...) {
+      return this->error(req, "Unexpected error occurred while processing the request.");
+    }
+  }
+
+  // リクエストの id に対するエラーのレスポンスを作る（バッチリクエストの場合 id は null）
+  std::string error(const picojson::value& req, const std::string& message) {
+    picojson::object response;
+    response["result"] = picojson::value();
+    response["error"] = picojson::value(message);
+    response["id"] = picojson::value();
+    if (req.is<picojson::object>()) {
+      const picojson::object& o = req.get<picojson::object>();
+      picojson::object::const_iterator it = o.find("id");
+      if (it != o.end()) response["id"] = (*it).second;
+    }
+    return picojson::value(response).serialize();
+  }
+
+  // レスポンスを出力する
+  void write(size_t seq, const std::string& response) {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    if (!this->_ordered) {
+      this->_os << response << std::endl;
+      this->_next_write++;
+    } else {
+      this->_pending.insert(std::make_pair(seq, response));
+      std::map<size_t, std::string>::iterator it;
+      while ((it = this->_pending.find(this->_next_write)) != this->_pending.end()) {
+	this->_os << (*it).second << std::endl;
+	this->_pending.erase(it);
+	this->_next_write++;
+      }
+    }
+    this->_writable.notify_one();
+  }
+
+  // ワーカースレッド
+  void work(geonlp::ServicePtr service) {
+    for (;;) {
+      std::pair<size_t, std::string> item;
+      {
+	boost::mutex::scoped_lock lock(this->_mutex);
+	while (this->_queue.empty() && !this->_eof) this->_readable.wait(lock);
+	if (this->_queue.empty()) return;
+	item = this->_queue.front();
+	this->_queue.pop_front();
+      }
+      this->write(item.first, this->process(service, item.second));
+    }
+  }
+
+public:
+  LineStream(std::istream& is, std::ostream& os, bool ordered, size_t window)
+    : _is(is), _os(os), _ordered(ordered), _window(window), _next_read(0), _next_write(0), _eof(false) {}
+
+  /// @brief 入力が終わるまで処理する
+  /// @arg @c service  各スレッドは service のセッションを利用する
+  /// @arg @c threads  ワーカースレッド数
+  /// @return 処理したリクエスト数
+  size_t run(geonlp::ServicePtr service, int threads) {
+    boost::thread_group workers;
+    for (int i = 0; i < threads; i++) {
+      workers.create_thread(boost::bind(&LineStream::work, this, service->createSession()));
+    }
+
+    std::string line;
+    while (std::getline(this->_is, line)) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos) continue; // 空行は読み飛ばす
+      boost::mutex::scoped_lock lock(this->_mutex);
+      while (this->_next_read - this->_next_write >= this->_window) this->_writable.wait(lock);
+      this->_queue.push_back(std::make_pair(this->_next_read++, line));
+      this->_readable.notify_one();
+    }
+    {
+      boost::mutex::scoped_lock lock(this->_mutex);
+      this->_eof = true;
+      this->_readable.notify_all();
+    }
+    workers.join_all();
+    return this->_next_read;
+  }
+};
+
 int main (int argc, char * const argv[]) {
   geonlp::ServicePtr service;
   std::string rcfilename = "";
   std::string infile = "";
+  bool lines = false;
+  bool ordered = true;
+  bool stats = false;
+  int threads = 1;
 
   for (int i = 1; i < argc; i++) {
     if (!strncmp("--version", argv[i], 9)) {
@@ -33,6 +164,14 @@ int main (int argc, char * const argv[]) {
       exit(0);
     } else if (!std::strncmp("--rc=", argv[i], 5)) {
       rcfilename = std::string(argv[i] + 5);
+    } else if (!std::strcmp("--lines", argv[i])) {
+      lines = true;
+    } else if (!std::strncmp("--threads=", argv[i], 10)) {
+      threads = std::atoi(argv[i] + 10);
+    } else if (!std::strcmp("--unordered", argv[i])) {
+      ordered = false;
+    } else if (!std::strcmp("--stats", argv[i])) {
+      stats = true;
     } else if (infile.length() == 0 && argv[i][0] != '-') {
       infile = std::string(argv[i]);
     } else {
@@ -64,6 +203,15 @@ int main (int argc, char * const argv[]) {
     }
     is = &ifs;
   }
+
+  if (lines) {
+    // JSON Lines モード
+    if (threads < 1) threads = 1;
+    LineStream stream(*is, std::cout, ordered, threads * 16);
+    stream.run(service, threads);
+    if (stats) std::cerr << service->getMA()->getStatistics().serialize() << std::endl;
+    return 0;
+  }
   
   ss_req.str("");
   while(!is->eof()) {
@@ -73,6 +221,7 @@ int main (int argc, char * const argv[]) {
     if (line.length() == 0) break;
   }
   proc(service, ss_req);
+  if (stats) std::cerr << service->getMA()->getStatistics().serialize() << std::endl;
 
   return 0;
 }
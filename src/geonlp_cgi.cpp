@@ -1,91 +1,555 @@
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <map>
+#include <vector>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 #include "GeonlpService.h"
 
+/// POST で受け付けるメッセージの最大長
+#define CGI_MAX_CONTENT_LENGTH (16 * 1024 * 1024)
+
+/// FastCGI の PARAMS の最大長
+#define FCGI_MAX_PARAMS_LENGTH (64 * 1024)
+
+/// FastCGI のレコード種別（FastCGI Specification 1.0）
+#define FCGI_VERSION_1           1
+#define FCGI_BEGIN_REQUEST       1
+#define FCGI_ABORT_REQUEST       2
+#define FCGI_END_REQUEST         3
+#define FCGI_PARAMS              4
+#define FCGI_STDIN               5
+#define FCGI_STDOUT              6
+#define FCGI_STDERR              7
+#define FCGI_DATA                8
+#define FCGI_GET_VALUES          9
+#define FCGI_GET_VALUES_RESULT  10
+#define FCGI_UNKNOWN_TYPE       11
+
+#define FCGI_KEEP_CONN           1
+#define FCGI_RESPONDER           1
+
+#define FCGI_REQUEST_COMPLETE    0
+#define FCGI_CANT_MPX_CONN       1
+#define FCGI_UNKNOWN_ROLE        3
+
+/// レコードのコンテンツの最大長
+#define FCGI_MAX_CONTENT_LENGTH 65535
+
 picojson::value default_id;
 
-void error_response(const std::string& error_message) {
-  std::cout << "Status: 400 Bad Request\n";
-  std::cout << "Content-Type: text/html\n";
-  std::cout << "Access-Control-Allow-Origin: *\n\n";
-  std::cout << "<HTML><HEAD><TITLE>400 Bad Request</TITLE></HEAD>\n";
-  std::cout << "<BODY><H1>Error</H1>\n";
-  std::cout << "<P>The request is not parsed as a JSON-RPC request</P>\n";
-  std::cout << "<P>Reason: " << error_message << "</P>\n";
-  std::cout << "</BODY></HTML>\n";
+/// FastCGI モードで終了シグナルを受けた場合に true
+static volatile bool stopping = false;
+
+void usage(const char* cmd) {
+  std::cerr << "Usage: " << cmd << " (as a CGI program)" << std::endl;
+  std::cerr << "or, " << cmd << " --fastcgi[=<[host]:port>|<socket path>] [--rc=<rc filename>] [--threads=<num>]" << std::endl;
+  std::cerr << "or, " << cmd << " --version" << std::endl;
+  return;
+}
+
+std::string error_response(const std::string& error_message) {
+  std::ostringstream oss;
+  oss << "Status: 400 Bad Request\n";
+  oss << "Content-Type: text/html\n";
+  oss << "Access-Control-Allow-Origin: *\n\n";
+  oss << "<HTML><HEAD><TITLE>400 Bad Request</TITLE></HEAD>\n";
+  oss << "<BODY><H1>Error</H1>\n";
+  oss << "<P>The request is not parsed as a JSON-RPC request</P>\n";
+  oss << "<P>Reason: " << error_message << "</P>\n";
+  oss << "</BODY></HTML>\n";
+  return oss.str();
+}
+
+std::string too_large_response(void) {
+  std::ostringstream oss;
+  oss << "Status: 413 Request Entity Too Large\n";
+  oss << "Content-Type: text/plain\n";
+  oss << "Access-Control-Allow-Origin: *\n\n";
+  oss << "The request must not exceed " << CGI_MAX_CONTENT_LENGTH << " bytes.\n";
+  return oss.str();
+}
+
+std::string json_error_response(const std::string& error_message, picojson::value& id) {
+  // メッセージに '"' や '\' が含まれても壊れないよう、文字列を連結せずに組み立てる
+  picojson::object response;
+  response.insert(std::make_pair("result", picojson::value()));
+  response.insert(std::make_pair("error", picojson::value(error_message)));
+  response.insert(std::make_pair("id", id));
+  std::ostringstream oss;
+  oss << "Content-type: application/json; charset=utf-8\n";
+  oss << "Access-control-allow-origin: *\n\n";
+  oss << picojson::value(response).serialize();
+  return oss.str();
 }
 
-void json_error_response(const std::string& error_message, picojson::value& id) {
-  picojson::ext response;
-  response.initByJson(std::string("{\"result\":null,\"error\":\"") + error_message + "\",\"id\":" + id.serialize() + "}");
-  std::cout << "Content-type: application/json; charset=utf-8\n";
-  std::cout << "Access-control-allow-origin: *\n\n";
-  std::cout << response.toJson();
+std::string preflight_response(void) {
+  std::ostringstream oss;
+  oss << "Access-Control-Allow-Origin: *\n";
+  oss << "Access-Control-Allow-Methods: POST, OPTIONS\n";
+  oss << "Access-Control-Allow-Headers: X-GeoNLP-Authorization, Content-type\n";
+  oss << "Access-Control-Max-Age: 3600\n";
+  oss << "Content-Length: 0\n";
+  oss << "Content-Type: text/plain\n\n";
+  return oss.str();
 }
 
 // Get POST message from stdin to string
-void get_post_message(std::string& message) {
+// Returns false if the message is too large
+bool get_post_message(std::string& message, unsigned long len) {
   message = "";
-  char* cp = getenv("CONTENT_LENGTH");
-  if (!cp) {
-    error_response(std::string("CONTENT_LENGTH is not defined."));
-    exit(0);
+  if (len > CGI_MAX_CONTENT_LENGTH) return false;
+  message.resize(len);
+  if (len > 0) {
+    std::cin.read(&message[0], len);
+    message.resize(std::cin.gcount());
   }
-  int len = atoi(getenv("CONTENT_LENGTH"));
-  char buf[len + 1];
-  std::cin.read(buf, len);
-  buf[len] = '\0';
-  message = buf;
+  return true;
 }
 
-bool proc (geonlp::ServicePtr service, const std::string& request_json, picojson::value& response) {
+std::string proc (geonlp::ServicePtr service, const std::string& request_json) {
   picojson::ext req;
+  picojson::value response;
 
-  if (request_json.length() == 0) return false;
+  if (request_json.length() == 0) return error_response(std::string("Request string is empty."));
   try {
     req.initByJson(request_json);
   } catch (picojson::PicojsonException e) {
-    error_response(std::string("Request string is not a valid JSON representation."));
-    exit(0);
+    return error_response(std::string("Request string is not a valid JSON representation."));
   }
   response = service->proc(picojson::value(req));
+  std::ostringstream oss;
+  oss << "Content-Type: application/json; charset=utf-8\n";
+  oss << "Access-Control-Allow-Origin: *\n\n";
+  oss << response.serialize();
+  return oss.str();
+}
+
+/// @brief FastCGI の一つの接続
+///
+/// 多重化は行わず、接続上のリクエストを一つずつ処理する。
+class FastCgiConnection {
+private:
+  int _fd;
+
+  bool read_full(char* buf, size_t len);
+  bool write_full(const char* buf, size_t len);
+  bool wait_readable(void);
+  bool read_record(int& type, int& request_id, std::string& content);
+  bool write_record(int type, int request_id, const char* data, size_t len);
+  bool write_stream(int type, int request_id, const std::string& data);
+  bool end_request(int request_id, int protocol_status);
+  bool get_values(const std::string& content, int threads);
+
+public:
+  FastCgiConnection(int fd): _fd(fd) {}
+  ~FastCgiConnection() { ::close(this->_fd); }
+
+  // 接続上のリクエストを処理する
+  void serve(geonlp::ServicePtr service, int threads);
+};
+
+/// 名前と値のペアの長さを読む
+static bool read_nv_length(const std::string& s, size_t& pos, size_t& len) {
+  if (pos >= s.length()) return false;
+  unsigned char b = s[pos];
+  if ((b & 0x80) == 0) {
+    len = b;
+    pos += 1;
+    return true;
+  }
+  if (pos + 4 > s.length()) return false;
+  len = ((size_t)(b & 0x7f) << 24) | ((size_t)(unsigned char)s[pos + 1] << 16) | ((size_t)(unsigned char)s[pos + 2] << 8) | (unsigned char)s[pos + 3];
+  pos += 4;
+  return true;
+}
+
+/// 名前と値のペアの列を解析する
+static void parse_nv_pairs(const std::string& s, std::map<std::string, std::string>& ret) {
+  size_t pos = 0, name_len, value_len;
+  while (read_nv_length(s, pos, name_len) && read_nv_length(s, pos, value_len)) {
+    if (pos + name_len + value_len > s.length()) break;
+    ret[s.substr(pos, name_len)] = s.substr(pos + name_len, value_len);
+    pos += name_len + value_len;
+  }
+}
+
+/// 名前と値のペアを追加する（値は 127 バイト以下）
+static void append_nv_pair(std::string& s, const std::string& name, const std::string& value) {
+  s += (char)name.length();
+  s += (char)value.length();
+  s += name;
+  s += value;
+}
+
+bool FastCgiConnection::read_full(char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::read(this->_fd, buf, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool FastCgiConnection::write_full(const char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::send(this->_fd, buf, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
+  }
   return true;
 }
 
+/// 次のレコードが届くまで待つ
+/// 待機中に終了シグナルを受けた場合は false
+bool FastCgiConnection::wait_readable(void) {
+  struct pollfd pfd;
+  pfd.fd = this->_fd;
+  pfd.events = POLLIN;
+  while (!stopping) {
+    int rc = ::poll(&pfd, 1, 1000);
+    if (rc > 0) return true;
+    if (rc < 0 && errno != EINTR) return false;
+  }
+  return false;
+}
+
+bool FastCgiConnection::read_record(int& type, int& request_id, std::string& content) {
+  unsigned char header[8];
+  if (!this->read_full((char*)header, sizeof(header))) return false;
+  if (header[0] != FCGI_VERSION_1) return false;
+  type = header[1];
+  request_id = (header[2] << 8) | header[3];
+  size_t content_length = (header[4] << 8) | header[5];
+  size_t padding_length = header[6];
+  content.resize(content_length + padding_length);
+  if (content.length() > 0 && !this->read_full(&content[0], content.length())) return false;
+  content.resize(content_length);
+  return true;
+}
+
+bool FastCgiConnection::write_record(int type, int request_id, const char* data, size_t len) {
+  unsigned char header[8];
+  size_t padding_length = (8 - len % 8) % 8;
+  static const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  header[0] = FCGI_VERSION_1;
+  header[1] = type;
+  header[2] = (request_id >> 8) & 0xff;
+  header[3] = request_id & 0xff;
+  header[4] = (len >> 8) & 0xff;
+  header[5] = len & 0xff;
+  header[6] = padding_length;
+  header[7] = 0;
+  return this->write_full((const char*)header, sizeof(header))
+    && (len == 0 || this->write_full(data, len))
+    && (padding_length == 0 || this->write_full(padding, padding_length));
+}
+
+/// ストリームを送信し、空のレコードで終端する
+bool FastCgiConnection::write_stream(int type, int request_id, const std::string& data) {
+  for (size_t pos = 0; pos < data.length(); pos += FCGI_MAX_CONTENT_LENGTH) {
+    size_t len = data.length() - pos;
+    if (len > FCGI_MAX_CONTENT_LENGTH) len = FCGI_MAX_CONTENT_LENGTH;
+    if (!this->write_record(type, request_id, data.data() + pos, len)) return false;
+  }
+  return this->write_record(type, request_id, NULL, 0);
+}
+
+bool FastCgiConnection::end_request(int request_id, int protocol_status) {
+  char body[8] = {0, 0, 0, 0, (char)protocol_status, 0, 0, 0}; // appStatus は常に 0
+  return this->write_record(FCGI_END_REQUEST, request_id, body, sizeof(body));
+}
+
+/// FCGI_GET_VALUES に応答する
+bool FastCgiConnection::get_values(const std::string& content, int threads) {
+  std::map<std::string, std::string> names;
+  parse_nv_pairs(content, names);
+  std::ostringstream oss;
+  oss << threads;
+  std::string result;
+  if (names.count("FCGI_MAX_CONNS") > 0) append_nv_pair(result, "FCGI_MAX_CONNS", oss.str());
+  if (names.count("FCGI_MAX_REQS") > 0) append_nv_pair(result, "FCGI_MAX_REQS", oss.str());
+  if (names.count("FCGI_MPXS_CONNS") > 0) append_nv_pair(result, "FCGI_MPXS_CONNS", "0");
+  return this->write_record(FCGI_GET_VALUES_RESULT, 0, result.data(), result.length());
+}
+
+/// @brief 接続上のリクエストを順に処理する
+///
+/// Web サーバが FCGI_KEEP_CONN を指定しない場合は一つのリクエストで終了する。
+/// @arg @c service  リクエストの処理に利用する Service
+/// @arg @c threads  同時に処理できるリクエスト数（FCGI_GET_VALUES への応答）
+void FastCgiConnection::serve(geonlp::ServicePtr service, int threads) {
+  int type, request_id, active_id = 0;
+  bool keep_conn = false, too_large = false;
+  std::string content, params, body;
+
+  while (active_id != 0 || this->wait_readable()) {
+    if (!this->read_record(type, request_id, content)) return;
+
+    if (request_id == 0) {
+      // 管理レコード
+      if (type == FCGI_GET_VALUES) {
+	if (!this->get_values(content, threads)) return;
+      } else {
+	char unknown[8] = {(char)type, 0, 0, 0, 0, 0, 0, 0};
+	if (!this->write_record(FCGI_UNKNOWN_TYPE, 0, unknown, sizeof(unknown))) return;
+      }
+      continue;
+    }
+
+    if (type == FCGI_BEGIN_REQUEST) {
+      if (content.length() < 8) return;
+      int role = ((unsigned char)content[0] << 8) | (unsigned char)content[1];
+      if (active_id != 0) {
+	if (!this->end_request(request_id, FCGI_CANT_MPX_CONN)) return;
+	continue;
+      }
+      keep_conn = (content[2] & FCGI_KEEP_CONN) != 0;
+      if (role != FCGI_RESPONDER) {
+	if (!this->end_request(request_id, FCGI_UNKNOWN_ROLE) || !keep_conn) return;
+	continue;
+      }
+      active_id = request_id;
+      params = body = "";
+      too_large = false;
+      continue;
+    }
+    if (request_id != active_id) continue; // 終了済みのリクエスト
+
+    if (type == FCGI_ABORT_REQUEST) {
+      active_id = 0;
+      if (!this->end_request(request_id, FCGI_REQUEST_COMPLETE) || !keep_conn) return;
+    } else if (type == FCGI_PARAMS) {
+      params += content;
+      if (params.length() > FCGI_MAX_PARAMS_LENGTH) return;
+    } else if (type == FCGI_STDIN && content.length() > 0) {
+      // 上限を超えた分は読み捨てる
+      if (body.length() + content.length() > CGI_MAX_CONTENT_LENGTH) too_large = true;
+      else body += content;
+    } else if (type == FCGI_STDIN) {
+      // 入力終了、リクエストを処理する
+      std::map<std::string, std::string> env;
+      parse_nv_pairs(params, env);
+      std::string method = env["REQUEST_METHOD"];
+      std::string response;
+      if (method == "POST") {
+	if (too_large || std::strtoul(env["CONTENT_LENGTH"].c_str(), NULL, 10) > CGI_MAX_CONTENT_LENGTH) {
+	  response = too_large_response();
+	} else {
+	  try {
+	    service->reset();
+	    response = proc(service, body);
+	  } catch (std::exception& e) {
+	    response = json_error_response(e.what(), default_id);
+	  }
+	}
+      } else if (method != "GET" && method != "HEAD") {
+	response = preflight_response();
+      }
+      active_id = 0;
+      if (!this->write_stream(FCGI_STDOUT, request_id, response)) return;
+      if (!this->end_request(request_id, FCGI_REQUEST_COMPLETE) || !keep_conn) return;
+    }
+  }
+}
+
+/// リッスンするソケットを作成する
+/// @arg @c address  "[host]:port" または UNIX ドメインソケットのパス
+/// @return ソケット、作成できなかった場合は -1
+static int listen_socket(const std::string& address) {
+  int fd = -1;
+  size_t colon = address.rfind(':');
+  if (address.find('/') != std::string::npos || colon == std::string::npos) {
+    struct sockaddr_un sun;
+    if (address.length() >= sizeof(sun.sun_path)) return -1;
+    std::memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    std::strcpy(sun.sun_path, address.c_str());
+    ::unlink(address.c_str());
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (::bind(fd, (struct sockaddr*)&sun, sizeof(sun)) < 0) {
+      ::close(fd);
+      return -1;
+    }
+  } else {
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    struct addrinfo hints, *res;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (::getaddrinfo(host.length() > 0 ? host.c_str() : NULL, port.c_str(), &hints, &res) != 0) return -1;
+    fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    int on = 1;
+    if (fd < 0
+	|| ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+	|| ::bind(fd, res->ai_addr, res->ai_addrlen) < 0) {
+      if (fd >= 0) ::close(fd);
+      ::freeaddrinfo(res);
+      return -1;
+    }
+    ::freeaddrinfo(res);
+  }
+  if (::listen(fd, SOMAXCONN) < 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/// 接続を受け付けて処理するワーカースレッド
+static void fastcgi_worker(int listen_fd, geonlp::ServicePtr service, int threads) {
+  while (!stopping) {
+    int fd = ::accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break; // リッスンソケットが閉じられた
+    }
+    FastCgiConnection connection(fd);
+    connection.serve(service, threads);
+  }
+}
+
+/// @brief FastCGI アプリケーションとして動作する
+///
+/// address が空の場合、Web サーバから標準入力として渡されたソケットで待ち受ける。
+/// Service は起動時に一度だけ作成し、スレッドごとのセッションで共有する。
+int fastcgi_main(const std::string& address, const std::string& rcfilename, int threads) {
+  int listen_fd = 0; // FCGI_LISTENSOCK_FILENO
+  if (address.length() > 0) {
+    listen_fd = listen_socket(address);
+    if (listen_fd < 0) {
+      std::cerr << "Cannot listen on '" << address << "': " << std::strerror(errno) << std::endl;
+      return 1;
+    }
+  }
+
+  geonlp::ServicePtr service;
+  try {
+    if (rcfilename == "") {
+      service = geonlp::createService();
+    } else {
+      service = geonlp::createService(rcfilename);
+    }
+  } catch (geonlp::ServiceCreateFailedException& e) {
+    std::cerr << e.what();
+    return 1;
+  }
+
+  // 終了シグナルはメインスレッドで受ける
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+  sigaddset(&sigset, SIGTERM);
+  sigaddset(&sigset, SIGUSR1); // mod_fcgid 等が停止時に送る
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  boost::thread_group workers;
+  for (int i = 0; i < threads; i++) {
+    workers.create_thread(boost::bind(&fastcgi_worker, listen_fd, service->createSession(), threads));
+  }
+
+  int sig;
+  sigwait(&sigset, &sig);
+
+  // 新しい接続の受け付けを止め、処理中のリクエストが終わるのを待つ
+  stopping = true;
+  ::shutdown(listen_fd, SHUT_RDWR);
+  workers.join_all();
+  ::close(listen_fd);
+  if (address.find('/') != std::string::npos) ::unlink(address.c_str());
+  return 0;
+}
+
+/// 標準入力が Web サーバから渡されたリッスンソケットかどうか判定する
+static bool is_fastcgi_socket(void) {
+  struct sockaddr_storage sa;
+  socklen_t len = sizeof(sa);
+  return ::getpeername(0, (struct sockaddr*)&sa, &len) < 0 && errno == ENOTCONN;
+}
+
 int main(int argc, char* argv[])
 {
   default_id = picojson::value(long(0));
-  
+
+  bool fastcgi = false;
+  std::string address = "";
+  std::string rcfilename = "";
+  int threads = boost::thread::hardware_concurrency();
+  for (int i = 1; i < argc; i++) {
+    if (!strncmp("--version", argv[i], 9)) {
+      std::cout << PACKAGE_VERSION << std::endl;
+      exit(0);
+    } else if (!strcmp("--fastcgi", argv[i])) {
+      fastcgi = true;
+    } else if (!strncmp("--fastcgi=", argv[i], 10)) {
+      fastcgi = true;
+      address = std::string(argv[i] + 10);
+    } else if (!strncmp("--rc=", argv[i], 5)) {
+      rcfilename = std::string(argv[i] + 5);
+    } else if (!strncmp("--threads=", argv[i], 10)) {
+      threads = atoi(argv[i] + 10);
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (threads < 1) threads = 1;
+
+  if (fastcgi || is_fastcgi_socket()) {
+    return fastcgi_main(address, rcfilename, threads);
+  }
+
   char* cp = getenv("REQUEST_METHOD");
   if (!cp) {
-    error_response(std::string("Unknown method '") + cp + "'.");
+    std::cout << error_response(std::string("REQUEST_METHOD is not defined."));
     exit(0);
   }
   if (!strcmp(cp, "POST")) {
     std::string request;
-    get_post_message(request);
-    
+    char* lp = getenv("CONTENT_LENGTH");
+    if (!lp) {
+      std::cout << error_response(std::string("CONTENT_LENGTH is not defined."));
+      exit(0);
+    }
+    if (!get_post_message(request, strtoul(lp, NULL, 10))) {
+      std::cout << too_large_response();
+      exit(0);
+    }
+
     try {
-      geonlp::ServicePtr service = geonlp::createService();
-      picojson::value response;
-      proc(service, request, response);
-      std::cout << "Content-Type: application/json; charset=utf-8\n";
-      std::cout << "Access-Control-Allow-Origin: *\n\n";
-      std::cout << response.serialize();
+      geonlp::ServicePtr service;
+      if (rcfilename == "") {
+	service = geonlp::createService();
+      } else {
+	service = geonlp::createService(rcfilename);
+      }
+      std::cout << proc(service, request);
     } catch (geonlp::ServiceCreateFailedException& e) {
-      json_error_response(e.what(), default_id);
+      std::cout << json_error_response(e.what(), default_id);
       exit(0);
     }
   } else if (strcmp(cp, "GET") && strcmp(cp, "HEAD")) {
     // Preflignted requests
-    std::cout << "Access-Control-Allow-Origin: *\n";
-    std::cout << "Access-Control-Allow-Methods: POST, OPTIONS\n";
-    std::cout << "Access-Control-Allow-Headers: X-GeoNLP-Authorization, Content-type\n";
-    std::cout << "Access-Control-Max-Age: 3600\n";
-    std::cout << "Content-Length: 0\n";
-    std::cout << "Content-Type: text/plain\n\n";
+    std::cout << preflight_response();
     exit(0);
   }
 
@@ -0,0 +1,508 @@
+///
+/// @file
+/// @brief JSON-RPC over HTTP サーバ
+/// @author 株式会社情報試作室
+///
+/// Copyright (c)2014, NII
+///
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <set>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/algorithm/string.hpp>
+#include "GeonlpService.h"
+
+using boost::asio::ip::tcp;
+
+/// リクエストヘッダの最大長
+#define SERVER_MAX_HEADER_LENGTH (64 * 1024)
+
+/// リクエストボディの最大長
+#define SERVER_MAX_CONTENT_LENGTH (16 * 1024 * 1024)
+
+/// accept に失敗した場合に再試行するまでの待ち時間（ミリ秒）
+#define SERVER_ACCEPT_RETRY_MSEC 100
+
+void usage(const char* cmd) {
+  std::cerr << "Usage: " << cmd << " [--rc=<rc filename>] [--address=<address>] [--port=<port>] [--threads=<num>] [--timeout=<sec>]" << std::endl;
+  std::cerr << "or, " << cmd << " --version" << std::endl;
+  return;
+}
+
+/// @brief 辞書を共有する Service のプール
+///
+/// 起動時に作成した Service の createSession で必要な数だけセッションを作り、
+/// 処理を終えたセッションは破棄せずに次のリクエストで再利用する。
+class ServicePool {
+private:
+  geonlp::ServicePtr _base;
+  std::vector<geonlp::ServicePtr> _idle;
+  boost::mutex _mutex;
+
+public:
+  ServicePool(geonlp::ServicePtr base): _base(base) {}
+
+  /// @brief セッションを借りる
+  /// オプションとコンテキストは初期状態に戻してから返す
+  geonlp::ServicePtr acquire(void) {
+    geonlp::ServicePtr service;
+    {
+      boost::mutex::scoped_lock lock(this->_mutex);
+      if (!this->_idle.empty()) {
+	service = this->_idle.back();
+	this->_idle.pop_back();
+      }
+    }
+    if (!service) return this->_base->createSession();
+    service->reset();
+    return service;
+  }
+
+  /// @brief セッションを返却する
+  void release(geonlp::ServicePtr service) {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    this->_idle.push_back(service);
+  }
+};
+
+class Server;
+
+/// @brief クライアントとの一つの接続
+///
+/// ハンドラは strand を通して実行するので、同じ接続のハンドラが
+/// 複数のスレッドで同時に実行されることはない。
+class Connection : public boost::enable_shared_from_this<Connection> {
+private:
+  Server& _server;
+  tcp::socket _socket;
+  boost::asio::io_service::strand _strand;
+  boost::asio::deadline_timer _timer;
+  boost::asio::streambuf _request;
+  std::string _response;
+  std::string _method;
+  size_t _content_length;
+  bool _keep_alive;
+  bool _busy;
+
+  void read_header(void);
+  void handle_read_header(const boost::system::error_code& err);
+  void handle_read_content(const boost::system::error_code& err);
+  void handle_write(const boost::system::error_code& err);
+  void handle_timeout(const boost::system::error_code& err);
+  void handle_shutdown(void);
+  bool parse_header(std::istream& is, int& status);
+  void process(const std::string& content);
+  void respond(int status, const std::string& content_type, const std::string& content);
+  void close(void);
+
+public:
+  Connection(boost::asio::io_service& io_service, Server& server);
+
+  tcp::socket& socket(void) { return this->_socket; }
+
+  // リクエストの受信を開始する
+  void start(void);
+
+  // 処理中のリクエストが終わったら接続を閉じる
+  void shutdown(void);
+};
+
+typedef boost::shared_ptr<Connection> ConnectionPtr;
+
+/// @brief JSON-RPC over HTTP サーバ
+///
+/// io_service を複数のスレッドで実行し、各スレッドがリクエストの
+/// 受信から Service::proc の実行、レスポンスの送信までを行う。
+class Server {
+private:
+  boost::asio::io_service _io_service;
+  boost::asio::signal_set _signals;
+  tcp::acceptor _acceptor;
+  boost::asio::deadline_timer _accept_timer;
+  ServicePool _pool;
+  ConnectionPtr _new_connection;
+  std::set<ConnectionPtr> _connections;
+  boost::mutex _mutex;
+  bool _stopping;
+  long _timeout;
+
+  void start_accept(void);
+  void handle_accept(const boost::system::error_code& err);
+  void handle_accept_retry(const boost::system::error_code& err);
+  void handle_stop(void);
+
+public:
+  Server(geonlp::ServicePtr service, const std::string& address, const std::string& port, long timeout);
+
+  // 指定したスレッド数で処理を行う、終了シグナルを受けるまで戻らない
+  void run(size_t threads);
+
+  ServicePool& pool(void) { return this->_pool; }
+  long timeout(void) const { return this->_timeout; }
+  bool stopping(void) { boost::mutex::scoped_lock lock(this->_mutex); return this->_stopping; }
+
+  // 接続を登録、削除する
+  void join(ConnectionPtr connection);
+  void leave(ConnectionPtr connection);
+};
+
+/// HTTP ステータスコードに対応する理由句
+static const char* status_reason(int status) {
+  switch (status) {
+  case 200: return "OK";
+  case 400: return "Bad Request";
+  case 405: return "Method Not Allowed";
+  case 413: return "Request Entity Too Large";
+  case 500: return "Internal Server Error";
+  default: return "Unknown";
+  }
+}
+
+/// JSON-RPC のエラーレスポンスを作成する（geonlp_cgi と同じ形式）
+static std::string json_error(const std::string& error_message) {
+  picojson::object response;
+  response.insert(std::make_pair("result", picojson::value()));
+  response.insert(std::make_pair("error", picojson::value(error_message)));
+  response.insert(std::make_pair("id", picojson::value(long(0))));
+  return picojson::value(response).serialize();
+}
+
+Connection::Connection(boost::asio::io_service& io_service, Server& server)
+  : _server(server), _socket(io_service), _strand(io_service), _timer(io_service),
+    _request(SERVER_MAX_HEADER_LENGTH + SERVER_MAX_CONTENT_LENGTH),
+    _content_length(0), _keep_alive(false), _busy(false) {}
+
+void Connection::start(void) {
+  this->_server.join(shared_from_this());
+  this->read_header();
+}
+
+/// 次のリクエストのヘッダを待つ
+/// 一定時間リクエストが来ない場合は接続を閉じる
+void Connection::read_header(void) {
+  this->_busy = false;
+  this->_timer.expires_from_now(boost::posix_time::seconds(this->_server.timeout()));
+  this->_timer.async_wait(this->_strand.wrap(boost::bind(&Connection::handle_timeout, shared_from_this(), boost::asio::placeholders::error)));
+  boost::asio::async_read_until(this->_socket, this->_request, "\r\n\r\n",
+				this->_strand.wrap(boost::bind(&Connection::handle_read_header, shared_from_this(), boost::asio::placeholders::error)));
+}
+
+void Connection::handle_read_header(const boost::system::error_code& err) {
+  if (err) {
+    // 切断、タイムアウト、ヘッダが長すぎる場合
+    this->close();
+    return;
+  }
+  int status = 200;
+  std::istream is(&this->_request);
+  if (!this->parse_header(is, status)) {
+    this->_busy = true;
+    this->_timer.cancel();
+    this->_keep_alive = false;
+    this->respond(status, "text/plain", std::string(status_reason(status)) + "\n");
+    return;
+  }
+
+  // ヘッダと同時に受信した分を除き、残りのボディを受信する
+  // ボディを送らずに止まったクライアントが接続を占有しないよう、受信し終えるまで時刻を再設定しておく
+  if (this->_request.size() < this->_content_length) {
+    this->_timer.expires_from_now(boost::posix_time::seconds(this->_server.timeout()));
+    this->_timer.async_wait(this->_strand.wrap(boost::bind(&Connection::handle_timeout, shared_from_this(), boost::asio::placeholders::error)));
+    boost::asio::async_read(this->_socket, this->_request,
+			    boost::asio::transfer_exactly(this->_content_length - this->_request.size()),
+			    this->_strand.wrap(boost::bind(&Connection::handle_read_content, shared_from_this(), boost::asio::placeholders::error)));
+  } else {
+    this->handle_read_content(boost::system::error_code());
+  }
+}
+
+void Connection::handle_read_content(const boost::system::error_code& err) {
+  if (err) {
+    // 切断、タイムアウトの場合
+    this->close();
+    return;
+  }
+  this->_busy = true;
+  this->_timer.cancel();
+
+  std::string content(boost::asio::buffers_begin(this->_request.data()),
+		      boost::asio::buffers_begin(this->_request.data()) + this->_content_length);
+  this->_request.consume(this->_content_length); // パイプライン化された後続のリクエストは残す
+
+  if (this->_method == "POST") {
+    this->process(content);
+  } else if (this->_method == "OPTIONS") {
+    // Preflighted requests
+    this->respond(200, "text/plain", "");
+  } else {
+    this->respond(405, "text/plain", std::string(status_reason(405)) + "\n");
+  }
+}
+
+/// リクエスト行とヘッダを解析する
+/// @return 解析できた場合は true、できない場合は status にエラーコードを入れて false
+bool Connection::parse_header(std::istream& is, int& status) {
+  std::string line, version;
+  std::getline(is, line);
+  boost::algorithm::trim_right(line);
+  std::istringstream request_line(line);
+  request_line >> this->_method;
+  request_line >> version; // path は参照しない
+  request_line >> version;
+  this->_content_length = 0;
+  this->_keep_alive = (version == "HTTP/1.1"); // HTTP/1.1 はデフォルトで keep-alive
+
+  while (std::getline(is, line)) {
+    boost::algorithm::trim_right(line);
+    if (line.length() == 0) break;
+    size_t pos = line.find(':');
+    if (pos == std::string::npos) continue;
+    std::string name = boost::algorithm::to_lower_copy(line.substr(0, pos));
+    std::string value = boost::algorithm::trim_copy(line.substr(pos + 1));
+    if (name == "content-length") {
+      this->_content_length = std::strtoul(value.c_str(), NULL, 10);
+    } else if (name == "connection") {
+      boost::algorithm::to_lower(value);
+      if (value == "close") this->_keep_alive = false;
+      else if (value == "keep-alive") this->_keep_alive = true;
+    }
+  }
+
+  if (this->_method.length() == 0 || version.substr(0, 5) != "HTTP/") {
+    status = 400;
+    return false;
+  }
+  if (this->_content_length > SERVER_MAX_CONTENT_LENGTH) {
+    status = 413;
+    return false;
+  }
+  return true;
+}
+
+/// JSON-RPC リクエストを処理する
+void Connection::process(const std::string& content) {
+  picojson::ext req;
+  try {
+    req.initByJson(content);
+  } catch (picojson::PicojsonException& e) {
+    this->respond(200, "application/json; charset=utf-8", json_error("Request string is not a valid JSON representation."));
+    return;
+  }
+
+  std::string response;
+  geonlp::ServicePtr service = this->_server.pool().acquire();
+  try {
+    response = service->proc(picojson::value(req)).serialize();
+  } catch (std::exception& e) {
+    this->_server.pool().release(service);
+    this->respond(500, "application/json; charset=utf-8", json_error(e.what()));
+    return;
+  }
+  this->_server.pool().release(service);
+  this->respond(200, "application/json; charset=utf-8", response);
+}
+
+/// レスポンスを送信する
+void Connection::respond(int status, const std::string& content_type, const std::string& content) {
+  if (this->_server.stopping()) this->_keep_alive = false;
+
+  std::ostringstream oss;
+  oss << "HTTP/1.1 " << status << " " << status_reason(status) << "\r\n";
+  oss << "Content-Type: " << content_type << "\r\n";
+  oss << "Content-Length: " << content.length() << "\r\n";
+  oss << "Access-Control-Allow-Origin: *\r\n";
+  if (this->_method == "OPTIONS") {
+    oss << "Access-Control-Allow-Methods: POST, OPTIONS\r\n";
+    oss << "Access-Control-Allow-Headers: X-GeoNLP-Authorization, Content-type\r\n";
+    oss << "Access-Control-Max-Age: 3600\r\n";
+  } else if (status == 405) {
+    oss << "Allow: POST, OPTIONS\r\n";
+  }
+  oss << "Connection: " << (this->_keep_alive ? "keep-alive" : "close") << "\r\n\r\n";
+  oss << content;
+  this->_response = oss.str();
+
+  boost::asio::async_write(this->_socket, boost::asio::buffer(this->_response),
+			   this->_strand.wrap(boost::bind(&Connection::handle_write, shared_from_this(), boost::asio::placeholders::error)));
+}
+
+void Connection::handle_write(const boost::system::error_code& err) {
+  if (!err && this->_keep_alive && !this->_server.stopping()) {
+    this->read_header();
+    return;
+  }
+  this->close();
+}
+
+void Connection::handle_timeout(const boost::system::error_code& err) {
+  if (err == boost::asio::error::operation_aborted) return; // 時刻が再設定された
+  if (this->_timer.expires_at() > boost::asio::deadline_timer::traits_type::now()) return;
+  if (!this->_busy) this->close();
+}
+
+void Connection::shutdown(void) {
+  this->_strand.post(boost::bind(&Connection::handle_shutdown, shared_from_this()));
+}
+
+void Connection::handle_shutdown(void) {
+  // 処理中の場合はレスポンス送信後に閉じる
+  this->_keep_alive = false;
+  if (!this->_busy) this->close();
+}
+
+/// 接続を閉じる
+void Connection::close(void) {
+  boost::system::error_code ignored;
+  this->_timer.cancel(ignored);
+  if (this->_socket.is_open()) {
+    this->_socket.shutdown(tcp::socket::shutdown_both, ignored);
+    this->_socket.close(ignored);
+  }
+  this->_server.leave(shared_from_this());
+}
+
+Server::Server(geonlp::ServicePtr service, const std::string& address, const std::string& port, long timeout)
+  : _signals(_io_service), _acceptor(_io_service), _accept_timer(_io_service), _pool(service), _stopping(false), _timeout(timeout) {
+  this->_signals.add(SIGINT);
+  this->_signals.add(SIGTERM);
+#if defined(SIGQUIT)
+  this->_signals.add(SIGQUIT);
+#endif /* SIGQUIT */
+  this->_signals.async_wait(boost::bind(&Server::handle_stop, this));
+
+  tcp::resolver resolver(this->_io_service);
+  tcp::resolver::query query(address, port);
+  tcp::endpoint endpoint = *resolver.resolve(query);
+  this->_acceptor.open(endpoint.protocol());
+  this->_acceptor.set_option(tcp::acceptor::reuse_address(true));
+  this->_acceptor.bind(endpoint);
+  this->_acceptor.listen();
+
+  this->start_accept();
+}
+
+void Server::run(size_t threads) {
+  std::vector<boost::shared_ptr<boost::thread> > workers;
+  for (size_t i = 0; i < threads; i++) {
+    boost::shared_ptr<boost::thread> thread(new boost::thread(boost::bind(&boost::asio::io_service::run, &this->_io_service)));
+    workers.push_back(thread);
+  }
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i]->join();
+  }
+}
+
+void Server::start_accept(void) {
+  this->_new_connection.reset(new Connection(this->_io_service, *this));
+  this->_acceptor.async_accept(this->_new_connection->socket(),
+			       boost::bind(&Server::handle_accept, this, boost::asio::placeholders::error));
+}
+
+void Server::handle_accept(const boost::system::error_code& err) {
+  if (!this->_acceptor.is_open()) return; // 終了処理中
+  if (err) {
+    // EMFILE, ENFILE などはすぐに再試行しても同じ結果になるので、少し待ってから再試行する
+    this->_accept_timer.expires_from_now(boost::posix_time::milliseconds(SERVER_ACCEPT_RETRY_MSEC));
+    this->_accept_timer.async_wait(boost::bind(&Server::handle_accept_retry, this, boost::asio::placeholders::error));
+    return;
+  }
+  this->_new_connection->start();
+  this->start_accept();
+}
+
+void Server::handle_accept_retry(const boost::system::error_code& err) {
+  if (err == boost::asio::error::operation_aborted) return; // 終了処理中
+  if (!this->_acceptor.is_open()) return;
+  this->start_accept();
+}
+
+/// 終了シグナルを受けた場合、新しい接続の受け付けを止め、
+/// 処理中のリクエストを送信し終えてから終了する
+void Server::handle_stop(void) {
+  std::set<ConnectionPtr> connections;
+  {
+    boost::mutex::scoped_lock lock(this->_mutex);
+    this->_stopping = true;
+    connections = this->_connections;
+  }
+  boost::system::error_code ignored;
+  this->_acceptor.close(ignored);
+  this->_accept_timer.cancel(ignored);
+  for (std::set<ConnectionPtr>::iterator it = connections.begin(); it != connections.end(); it++) {
+    (*it)->shutdown();
+  }
+}
+
+void Server::join(ConnectionPtr connection) {
+  boost::mutex::scoped_lock lock(this->_mutex);
+  this->_connections.insert(connection);
+}
+
+void Server::leave(ConnectionPtr connection) {
+  boost::mutex::scoped_lock lock(this->_mutex);
+  this->_connections.erase(connection);
+}
+
+int main (int argc, char * const argv[]) {
+  geonlp::ServicePtr service;
+  std::string rcfilename = "";
+  std::string address = "0.0.0.0";
+  std::string port = "8080";
+  long threads = boost::thread::hardware_concurrency();
+  long timeout = 30;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strncmp("--version", argv[i], 9)) {
+      std::cout << PACKAGE_VERSION << std::endl;
+      exit(0);
+    } else if (!std::strncmp("--rc=", argv[i], 5)) {
+      rcfilename = std::string(argv[i] + 5);
+    } else if (!std::strncmp("--address=", argv[i], 10)) {
+      address = std::string(argv[i] + 10);
+    } else if (!std::strncmp("--port=", argv[i], 7)) {
+      port = std::string(argv[i] + 7);
+    } else if (!std::strncmp("--threads=", argv[i], 10)) {
+      threads = std::atol(argv[i] + 10);
+    } else if (!std::strncmp("--timeout=", argv[i], 10)) {
+      timeout = std::atol(argv[i] + 10);
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (threads < 1) threads = 1;
+  if (timeout < 1) timeout = 1;
+
+  // 辞書の読み込みは起動時に一度だけ行う
+  try {
+    if (rcfilename == "") {
+      service = geonlp::createService();
+    } else {
+      service = geonlp::createService(rcfilename);
+    }
+  } catch (geonlp::ServiceCreateFailedException& e) {
+    std::cerr << e.what();
+    return 1;
+  }
+
+  try {
+    Server server(service, address, port, timeout);
+    std::cerr << "geonlp_server listening on " << address << ":" << port << " with " << threads << " threads." << std::endl;
+    server.run(threads);
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
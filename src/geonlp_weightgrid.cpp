@@ -0,0 +1,95 @@
+/**
+ * @file  geonlp_weightgrid.cpp
+ * @brief (緯度, 経度, 重み) の CSV から地名語候補の重みのグリッドファイルを生成する
+ * @author 株式会社情報試作室
+ * @copyright 2014, NII
+ **/
+
+#include "config.h"
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+#include "CSVReader.h"
+#include "WeightGrid.h"
+
+void usage(const char* cmd) {
+  std::cerr << "Usage: " << cmd << " [--cell=<degrees>] [--default=<weight>] [--normalize] <csv filename> <grid filename>" << std::endl;
+  std::cerr << "or, " << cmd << " --version" << std::endl;
+  std::cerr << "  Each line of the CSV file must be 'latitude,longitude,weight'." << std::endl;
+  std::cerr << "  --cell       size of a grid cell in degrees (default: 0.01)" << std::endl;
+  std::cerr << "  --default    weight outside the grid or of cells without data (default: 1.0)" << std::endl;
+  std::cerr << "  --normalize  divide all weights by the maximum weight" << std::endl;
+  return;
+}
+
+// 文字列全体を実数として読めた場合のみ true
+static bool to_double(const std::string& str, double& ret) {
+  char* end;
+  ret = strtod(str.c_str(), &end);
+  return str.length() > 0 && *end == '\0';
+}
+
+int main (int argc, char * const argv[]) {
+  double cell = 0.01;
+  double default_weight = 1.0;
+  bool normalize = false;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strncmp("--version", argv[i], 9)) {
+      std::cout << PACKAGE_VERSION << std::endl;
+      exit(0);
+    } else if (!strncmp("--cell=", argv[i], 7)) {
+      cell = atof(argv[i] + 7);
+    } else if (!strncmp("--default=", argv[i], 10)) {
+      default_weight = atof(argv[i] + 10);
+    } else if (!strcmp("--normalize", argv[i])) {
+      normalize = true;
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+      exit(-1);
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.size() != 2 || !(cell > 0.0)) {
+    usage(argv[0]);
+    exit(-1);
+  }
+
+  std::fstream fs_csv(files[0].c_str(), std::ios::in);
+  if (!fs_csv) {
+    std::cerr << "Cannot open '" << files[0] << "'." << std::endl;
+    exit(1);
+  }
+
+  // ヘッダ行など、数値として読めない行は読み飛ばす
+  geonlp::WeightGridBuilder builder(cell, (float)default_weight);
+  CSVReader csv(fs_csv);
+  std::vector<std::string> tokens;
+  unsigned long nlines = 0, nskipped = 0;
+  while (csv.Read(tokens) == 0) {
+    nlines++;
+    double lat, lon, weight;
+    if (tokens.size() < 3 || !to_double(tokens[0], lat) || !to_double(tokens[1], lon) || !to_double(tokens[2], weight)) {
+      nskipped++;
+      continue;
+    }
+    builder.add(lat, lon, weight);
+  }
+  csv.Close();
+  if (normalize) builder.normalize();
+
+  try {
+    builder.save(files[1]);
+  } catch (std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    exit(1);
+  }
+  std::cerr << nlines << " lines read, " << nskipped << " lines skipped, " << builder.size() << " cells written to " << files[1] << "." << std::endl;
+  return 0;
+}
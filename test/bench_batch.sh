@@ -0,0 +1,33 @@
+#!/bin/sh
+# JSON-RPC のバッチリクエストと個別リクエストのスループットを比較する
+#  usage: bench_batch.sh [<requests>] [<rc filename>]
+# どちらも geonlp_api --lines を一度だけ起動して処理するので、辞書の読み込み時間は等しい
+REQUESTS=${1:-1000}
+RC=${2:+--rc=$2}
+API=../src/geonlp_api
+SENTENCE="NIIは千代田区一ツ橋２－１－２にあります。神保町から徒歩3分。"
+SINGLE=`mktemp`
+BATCH=`mktemp`
+trap 'rm -f ${SINGLE} ${BATCH}' EXIT
+
+# 同じ文を REQUESTS 個の個別リクエスト（1 行に 1 つ）と、1 つのバッチリクエストにする
+i=0
+printf '[' > ${BATCH}
+while [ $i -lt ${REQUESTS} ]; do
+  REQ="{\"method\":\"geonlp.parse\",\"params\":[\"${SENTENCE}\",{\"geocoding\":false}],\"id\":$i}"
+  echo "${REQ}" >> ${SINGLE}
+  if [ $i -gt 0 ]; then printf ',' >> ${BATCH}; fi
+  printf '%s' "${REQ}" >> ${BATCH}
+  i=`expr $i + 1`
+done
+echo ']' >> ${BATCH}
+
+measure() {
+  START=`date +%s.%N`
+  ${API} ${RC} --lines < $2 > /dev/null
+  END=`date +%s.%N`
+  echo "$1 ${REQUESTS} ${START} ${END}" | awk '{ printf("%-8s %d requests in %.3f sec, %.1f requests/sec\n", $1, $2, $4 - $3, $2 / ($4 - $3)); }'
+}
+
+measure single ${SINGLE}
+measure batch ${BATCH}
@@ -0,0 +1,72 @@
+#!/bin/sh
+# 長い文書に対する geonlp.parseStructured の処理時間を文数を変えて計測する
+#  usage: bench_structured.sh [<max sentences>] [<rc filename>] [<candidate limit>]
+# 文数を 2 倍ずつ増やしながら、一つの文書（一つのリクエスト）として処理する
+# 処理時間が文数にほぼ比例していれば、文書の長さに対して線形に処理できている
+# candidate limit を指定すると、同じ文書を候補数の上限なし（candidate_limit = 0）と
+# 上限あり（candidate_limit = <candidate limit>）のプロファイルで処理して比較する
+# プロファイルを省略した場合は $GEONLP_DIR/geonlp.rc を元にする
+MAX=${1:-8000}
+RCFILE=${2:-${GEONLP_DIR:+${GEONLP_DIR}/geonlp.rc}}
+LIMIT=$3
+API=../src/geonlp_api
+# 同じ地名が繰り返し現れ、候補の多い語（中央、本町など）を含むニュース記事風の文
+SENTENCES='"神奈川県全域の大雨で、中央区の横山公園に避難した。","府中から調布を経由して新宿に向かった。",{"tag":"p"},"NIIは千代田区一ツ橋にあります。神保町から徒歩3分。","中央区本町の火災で、府中市と調布市から消防車が出動した。"'
+UNIT=4
+REQ=`mktemp`
+RC_OFF=`mktemp`
+RC_ON=`mktemp`
+OUT_OFF=`mktemp`
+OUT_ON=`mktemp`
+trap 'rm -f ${REQ} ${RC_OFF} ${RC_ON} ${OUT_OFF} ${OUT_ON}' EXIT
+
+if [ -n "${LIMIT}" ]; then
+  if [ ! -f "${RCFILE}" ]; then
+    echo "Cannot find the profile, specify <rc filename> or set GEONLP_DIR." >&2
+    exit 1
+  fi
+  # candidate_limit の指定だけを置き換えたプロファイルを作る
+  grep -v '^[ 	]*candidate_limit[ 	]*=' ${RCFILE} > ${RC_OFF}
+  cp ${RC_OFF} ${RC_ON}
+  echo "candidate_limit = 0" >> ${RC_OFF}
+  echo "candidate_limit = ${LIMIT}" >> ${RC_ON}
+fi
+
+# $1 文になるまで文の並びを繰り返したリクエストを作る
+make_request() {
+  printf '{"method":"geonlp.parseStructured","params":[[' > ${REQ}
+  i=0
+  while [ $i -lt $1 ]; do
+    if [ $i -gt 0 ]; then printf ',' >> ${REQ}; fi
+    printf '%s' "${SENTENCES}" >> ${REQ}
+    i=`expr $i + ${UNIT}`
+  done
+  echo '],{"geocoding":false}],"id":1}' >> ${REQ}
+}
+
+# $1: 表示名, $2: --rc オプション, $3: 結果の出力先
+measure() {
+  START=`date +%s.%N`
+  ${API} $2 --lines < ${REQ} > $3
+  END=`date +%s.%N`
+  grep -v '"error":null' $3 >&2
+  echo "$1 $i ${START} ${END}" | awk '{ printf("%-10s %6d sentences in %.3f sec, %.3f msec/sentence\n", $1, $2, $4 - $3, ($4 - $3) * 1000 / $2); }'
+}
+
+N=1000
+while [ $N -le ${MAX} ]; do
+  make_request $N
+  if [ -z "${LIMIT}" ]; then
+    measure all "${RCFILE:+--rc=${RCFILE}}" ${OUT_OFF}
+  else
+    measure limit=0 --rc=${RC_OFF} ${OUT_OFF}
+    measure limit=${LIMIT} --rc=${RC_ON} ${OUT_ON}
+    # 上限を設けると結果が変わることがあるので、一致するかどうかも示す
+    if cmp -s ${OUT_OFF} ${OUT_ON}; then
+      echo "           results are identical"
+    else
+      echo "           results differ"
+    fi
+  fi
+  N=`expr $N \* 2`
+done
@@ -0,0 +1,43 @@
+<?php
+/*
+ * 分布情報保持サーバ (dist-server) のスタブ
+ *  usage: DIST_STUB_LOG=<log filename> php -S 127.0.0.1:<port> dist_server_stub.php
+ *
+ * getWeight の JSON-RPC リクエスト（単一またはバッチ）に対して、
+ * すべての座標に重み 1.0 を返す。
+ * HTTP リクエスト（ラウンドトリップ）ごとに、含まれていた候補集合の数を
+ * 1 行ずつログファイルに追記する。
+ */
+$body = file_get_contents('php://input');
+$request = json_decode($body, true);
+
+function weight_response($req) {
+  $weights = array();
+  foreach ($req['params'][0] as $latlon) {
+    $weights[] = 1.0;
+  }
+  return array('result' => $weights, 'error' => null, 'id' => $req['id']);
+}
+
+if (!is_array($request)) {
+  $response = array('result' => null, 'error' => 'Invalid request format', 'id' => null);
+  $nsets = 0;
+} else if (array_key_exists('method', $request)) {
+  $response = weight_response($request);
+  $nsets = 1;
+} else {
+  // バッチリクエスト
+  $response = array();
+  foreach ($request as $req) {
+    $response[] = weight_response($req);
+  }
+  $nsets = count($request);
+}
+
+$log = getenv('DIST_STUB_LOG');
+if ($log) {
+  file_put_contents($log, $nsets . "\n", FILE_APPEND | LOCK_EX);
+}
+
+header('Content-Type: application/json');
+echo json_encode($response);
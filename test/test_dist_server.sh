@@ -0,0 +1,50 @@
+#!/bin/sh
+# dist-server オプション使用時の dist-server へのラウンドトリップ数と処理時間を計測する
+#  usage: test_dist_server.sh [<repeat>] [<port>] [<rc filename>]
+# ローカルに起動したスタブ (dist_server_stub.php) に対して、
+# 文書単位のバッチ問い合わせ (batch:true) と候補集合ごとの問い合わせ (batch:false) を比較する
+REPEAT=${1:-10}
+PORT=${2:-18081}
+RC=${3:+--rc=$3}
+API=../src/geonlp_api
+SENTENCES='"神奈川県全域の大雨で、中央区の横山公園に避難した。","府中から調布を経由して新宿に向かった。","NIIは千代田区一ツ橋にあります。神保町から徒歩3分。"'
+LOG=`mktemp`
+REQ=`mktemp`
+trap 'kill ${STUB} 2>/dev/null; wait ${STUB} 2>/dev/null; rm -f ${LOG} ${REQ}' EXIT
+
+if ! which php > /dev/null 2>&1; then
+  echo "php is required to run the dist-server stub." >&2
+  exit 1
+fi
+DIST_STUB_LOG=${LOG} php -S 127.0.0.1:${PORT} dist_server_stub.php > /dev/null 2>&1 &
+STUB=$!
+
+# スタブが起動するまで待つ
+i=0
+while ! curl -s -o /dev/null -X POST --data-binary '[]' http://127.0.0.1:${PORT}/; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "dist-server stub did not start." >&2
+    exit 1
+  fi
+  sleep 0.2
+done
+
+measure() {
+  : > ${REQ}
+  i=0
+  while [ $i -lt ${REPEAT} ]; do
+    echo "{\"method\":\"geonlp.parseStructured\",\"params\":[[${SENTENCES}],{\"geocoding\":false,\"dist-server\":{\"url\":\"http://127.0.0.1:${PORT}/\",\"batch\":$1}}],\"id\":$i}" >> ${REQ}
+    i=`expr $i + 1`
+  done
+  : > ${LOG}
+  START=`date +%s.%N`
+  ${API} ${RC} --lines < ${REQ} | grep -v '"error":null' >&2
+  END=`date +%s.%N`
+  TRIPS=`wc -l < ${LOG}`
+  SETS=`awk '{ n += $1 } END { print n + 0 }' ${LOG}`
+  echo "batch:$1 ${REPEAT} ${TRIPS} ${SETS} ${START} ${END}" | awk '{ printf("%-12s %d documents, %d round trips, %d candidate sets in %.3f sec\n", $1, $2, $3, $4, $6 - $5); }'
+}
+
+measure true
+measure false
@@ -0,0 +1,35 @@
+#!/bin/sh
+# geonlp_server のスループットを localhost で計測する
+#  usage: test_server.sh [<requests>] [<concurrency>] [<port>]
+REQUESTS=${1:-1000}
+CONCURRENCY=${2:-8}
+PORT=${3:-18080}
+URL="http://127.0.0.1:${PORT}/"
+JSON=geonlp_api_test.json
+
+../src/geonlp_server --address=127.0.0.1 --port=${PORT} --threads=${CONCURRENCY} &
+SERVER=$!
+trap 'kill -TERM ${SERVER} 2>/dev/null; wait ${SERVER}' EXIT
+
+# 辞書の読み込みが終わるまで待つ
+i=0
+while ! curl -s -o /dev/null -X POST --data-binary @${JSON} ${URL}; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "geonlp_server did not start." >&2
+    exit 1
+  fi
+  sleep 0.2
+done
+
+if which ab > /dev/null 2>&1; then
+  ab -k -q -n ${REQUESTS} -c ${CONCURRENCY} -p ${JSON} -T 'application/json' ${URL} | grep -E "Requests per second|Failed requests|Time per request"
+else
+  # ab が無い場合は curl を並列に実行する
+  PER_CLIENT=`expr ${REQUESTS} / ${CONCURRENCY}`
+  START=`date +%s.%N`
+  seq ${CONCURRENCY} | xargs -P ${CONCURRENCY} -I{} sh -c \
+    "for n in \`seq ${PER_CLIENT}\`; do [ \$n -gt 1 ] && echo 'next'; echo 'url = \"${URL}\"'; echo 'data-binary = \"@${JSON}\"'; echo 'output = \"/dev/null\"'; done | curl -s -K -"
+  END=`date +%s.%N`
+  echo "${PER_CLIENT} ${CONCURRENCY} ${START} ${END}" | awk '{ printf("Requests per second: %.1f [#/sec] (%d requests, concurrency %d)\n", $1 * $2 / ($4 - $3), $1 * $2, $2); }'
+fi